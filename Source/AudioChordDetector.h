@@ -0,0 +1,372 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_dsp/juce_dsp.h>
+#include "ChordEngineBank.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Chords from audio: an STFT folded into a 12-bin chroma, turned into a
+// handful of notes for ChordDetector.
+//
+// The input is mixed to mono into a ring sized for the largest window. Every
+// hop a Hann-windowed frame ending on the hop boundary is transformed. Where
+// bins are narrower than a semitone the magnitudes are folded into pitch
+// classes through precomputed runs of bins that share a semitone, so the
+// fold is a few contiguous sums rather than a lookup per bin. Below that a
+// partial spreads over neighbouring semitones, so the low end is read from
+// spectral peaks instead, each placed by parabolic interpolation. Peaks
+// below bassCutoffHz also make up a bass chroma, which picks the root.
+//
+// The FFT budget is one frame per block whatever the block or hop size: when
+// a long block spans several hops only the latest frame is analysed and the
+// others are counted as skipped. Everything that depends on the window size
+// (FFT engines, windows, bin runs) is built for all sizes in prepare(), so
+// the audio thread can switch window and hop without allocating.
+class AudioChordDetector
+{
+public:
+    static constexpr int minWindowOrder = 10;                   // 1024 samples
+    static constexpr int numWindowSizes = 4;                    // Up to 8192
+    static constexpr int maxWindowSize = 1 << (minWindowOrder + numWindowSizes - 1);
+    static constexpr int numHopSizes = 4;
+    static constexpr int maxNotes = 4;
+
+    static constexpr float minFrequencyHz = 55.0f;
+    static constexpr float maxFrequencyHz = 4200.0f;
+    static constexpr float bassCutoffHz = 260.0f;
+    static constexpr float silenceLevel = 3.0e-4f;             // About -70 dBFS
+
+    static int getWindowSize (int windowIndex)  { return 1 << (minWindowOrder + juce::jlimit (0, numWindowSizes - 1, windowIndex)); }
+    static int getHopSize (int hopIndex)        { return 128 << juce::jlimit (0, numHopSizes - 1, hopIndex); }
+
+    // Average time from a chord being played to it being reported: half a
+    // window to centre the frame on it, a hop to wait for the frame and a
+    // second hop for the change to be confirmed
+    static double getLatencySeconds (int windowIndex, int hopIndex, double sampleRate)
+    {
+        return (getWindowSize (windowIndex) / 2 + 2 * getHopSize (hopIndex)) / sampleRate;
+    }
+
+    //==========================================================================
+    // Allocates. Call from prepareToPlay.
+    void prepare (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        ring.assign ((size_t) maxWindowSize, 0.0f);
+        frame.assign ((size_t) maxWindowSize * 2, 0.0f);
+
+        for (int w = 0; w < numWindowSizes; ++w)
+        {
+            auto& analysis = analyses[(size_t) w];
+            const int size = getWindowSize (w);
+
+            analysis.fft = std::make_unique<juce::dsp::FFT> (minWindowOrder + w);
+            analysis.window.resize ((size_t) size);
+            juce::dsp::WindowingFunction<float>::fillWindowingTables (analysis.window.data(), (size_t) size,
+                                                                      juce::dsp::WindowingFunction<float>::hann, false);
+            buildRuns (analysis, size);
+        }
+
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        std::fill (ring.begin(), ring.end(), 0.0f);
+        writePosition = 0;
+        samplesSinceFrame = 0;
+        smoothed.fill (0.0f);
+        smoothedBass.fill (0.0f);
+        notes.clear();
+        candidate.clear();
+        pending.clear();
+    }
+
+    //==========================================================================
+    // Audio thread. Returns true when the detected notes changed; the change
+    // belongs at getChangeSample() in this block.
+    bool process (const juce::AudioBuffer<float>& buffer, int numChannels, int numSamples,
+                  int windowIndex, int hopIndex) noexcept
+    {
+        windowIndex = juce::jlimit (0, numWindowSizes - 1, windowIndex);
+        hopIndex = juce::jlimit (0, numHopSizes - 1, hopIndex);
+
+        if (windowIndex != currentWindow || hopIndex != currentHop)
+        {
+            // The smoothing and frame timing depend on both
+            currentWindow = windowIndex;
+            currentHop = hopIndex;
+            samplesSinceFrame = 0;
+            smoothed.fill (0.0f);
+            smoothedBass.fill (0.0f);
+            pending.clear();
+        }
+
+        numChannels = juce::jmin (numChannels, buffer.getNumChannels());
+
+        if (numChannels <= 0 || ring.empty())
+            return false;
+
+        writeToRing (buffer, numChannels, numSamples);
+
+        const int hop = getHopSize (hopIndex);
+        samplesSinceFrame += numSamples;
+
+        if (samplesSinceFrame < hop)
+            return false;
+
+        // One frame per block: the latest hop boundary
+        const int framesDue = samplesSinceFrame / hop;
+        samplesSinceFrame %= hop;
+
+        if (framesDue > 1)
+            skippedFrames.fetch_add (framesDue - 1, std::memory_order_relaxed);
+
+        changeSample = juce::jmax (0, numSamples - 1 - samplesSinceFrame);
+        analyse (analyses[(size_t) windowIndex], getWindowSize (windowIndex), hop);
+
+        return confirm();
+    }
+
+    const NoteMask& getNotes() const noexcept   { return notes; }
+    int getChangeSample() const noexcept        { return changeSample; }
+    int getSkippedFrames() const noexcept       { return skippedFrames.load (std::memory_order_relaxed); }
+
+private:
+    //==========================================================================
+    struct Run
+    {
+        int start, length, pitchClass;
+    };
+
+    struct Analysis
+    {
+        std::unique_ptr<juce::dsp::FFT> fft;
+        std::vector<float> window;
+        std::vector<Run> runs;          // Bins folded directly
+        int firstPeakBin { 1 };         // Bins read as peaks
+        int firstRunBin { 1 };
+        double binHz { 1.0 };
+    };
+
+    static int getPitchClass (double hz) noexcept
+    {
+        const int semitone = juce::roundToInt (69.0 + 12.0 * std::log2 (hz / 440.0));
+        return ((semitone % 12) + 12) % 12;
+    }
+
+    // Groups consecutive bins with the same nearest semitone, from where the
+    // bin spacing drops below a semitone (and above the bass range)
+    void buildRuns (Analysis& analysis, int size)
+    {
+        analysis.binHz = sampleRate / size;
+        analysis.firstPeakBin = juce::jmax (1, (int) std::ceil (minFrequencyHz / analysis.binHz));
+        analysis.firstRunBin = (int) std::ceil (juce::jmax ((double) bassCutoffHz, analysis.binHz * 16.8) / analysis.binHz);
+        analysis.runs.clear();
+
+        const int lastBin = juce::jmin (size / 2, (int) (maxFrequencyHz / analysis.binHz));
+
+        for (int bin = analysis.firstRunBin; bin <= lastBin; ++bin)
+        {
+            const int pitchClass = getPitchClass (bin * analysis.binHz);
+            auto& runs = analysis.runs;
+
+            if (! runs.empty() && runs.back().pitchClass == pitchClass)
+                ++runs.back().length;
+            else
+                runs.push_back ({ bin, 1, pitchClass });
+        }
+    }
+
+    void writeToRing (const juce::AudioBuffer<float>& buffer, int numChannels, int numSamples) noexcept
+    {
+        const float gain = 1.0f / (float) numChannels;
+        int position = 0;
+
+        while (position < numSamples)
+        {
+            const int n = juce::jmin (numSamples - position, maxWindowSize - writePosition);
+            auto* dest = ring.data() + writePosition;
+
+            juce::FloatVectorOperations::copyWithMultiply (dest, buffer.getReadPointer (0, position), gain, n);
+
+            for (int c = 1; c < numChannels; ++c)
+                juce::FloatVectorOperations::addWithMultiply (dest, buffer.getReadPointer (c, position), gain, n);
+
+            position += n;
+            writePosition = (writePosition + n) & (maxWindowSize - 1);
+        }
+    }
+
+    //==========================================================================
+    void analyse (Analysis& analysis, int size, int hop) noexcept
+    {
+        // The frame ends on the hop boundary, samplesSinceFrame ago
+        const int end = (writePosition - samplesSinceFrame) & (maxWindowSize - 1);
+        const int start = (end - size) & (maxWindowSize - 1);
+        const int first = juce::jmin (size, maxWindowSize - start);
+
+        std::copy (ring.data() + start, ring.data() + start + first, frame.data());
+        std::copy (ring.data(), ring.data() + (size - first), frame.data() + first);
+        juce::FloatVectorOperations::multiply (frame.data(), analysis.window.data(), size);
+
+        analysis.fft->performFrequencyOnlyForwardTransform (frame.data(), true);
+
+        std::array<float, 12> chroma {}, bass {};
+        fold (analysis.runs, chroma);
+        foldPeaks (analysis, chroma, bass);
+
+        // About 150 ms of smoothing whatever the hop
+        const auto decay = (float) std::exp (-hop / (0.15 * sampleRate));
+        float total = 0.0f;
+
+        for (size_t pc = 0; pc < 12; ++pc)
+        {
+            smoothed[pc] = smoothed[pc] * decay + chroma[pc] * (1.0f - decay);
+            smoothedBass[pc] = smoothedBass[pc] * decay + bass[pc] * (1.0f - decay);
+            total += chroma[pc];
+        }
+
+        candidate.clear();
+
+        // Silence releases the chord at once rather than once the smoothing
+        // has decayed. A Hann-windowed sine of amplitude a peaks at a * size / 4.
+        if (total < silenceLevel * (float) size * 0.25f)
+        {
+            smoothed.fill (0.0f);
+            smoothedBass.fill (0.0f);
+            return;
+        }
+
+        pickNotes();
+    }
+
+    // Sum of each run into its pitch class. Four partial sums per run keep
+    // the adds independent so the loop vectorises.
+    void fold (const std::vector<Run>& runs, std::array<float, 12>& chroma) const noexcept
+    {
+        const auto* magnitudes = frame.data();
+
+        for (const auto& run : runs)
+        {
+            const auto* m = magnitudes + run.start;
+            float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+            int i = 0;
+
+            for (; i + 4 <= run.length; i += 4)
+            {
+                s0 += m[i];
+                s1 += m[i + 1];
+                s2 += m[i + 2];
+                s3 += m[i + 3];
+            }
+
+            for (; i < run.length; ++i)
+                s0 += m[i];
+
+            chroma[(size_t) run.pitchClass] += (s0 + s1) + (s2 + s3);
+        }
+    }
+
+    // Each local maximum below the folded range, at its interpolated
+    // frequency. There are only a few dozen bins down there.
+    void foldPeaks (const Analysis& analysis, std::array<float, 12>& chroma, std::array<float, 12>& bass) const noexcept
+    {
+        const auto* m = frame.data();
+
+        for (int k = analysis.firstPeakBin; k < analysis.firstRunBin; ++k)
+        {
+            const float a = m[k - 1], b = m[k], c = m[k + 1];
+
+            if (b <= a || b < c)
+                continue;
+
+            const float curvature = a - 2.0f * b + c;
+            const float offset = curvature < 0.0f ? 0.5f * (a - c) / curvature : 0.0f;
+            const double hz = (k + offset) * analysis.binHz;
+
+            if (hz < minFrequencyHz)
+                continue;
+
+            const auto pc = (size_t) getPitchClass (hz);
+            chroma[pc] += b;
+
+            if (hz < bassCutoffHz)
+                bass[pc] += b;
+        }
+    }
+
+    // The strongest pitch classes (at most maxNotes), with the root from the
+    // bass chroma when there is one. A pitch class joins at 40% of the peak
+    // and, once detected, stays down to 25%, so a note near the line doesn't
+    // flicker in and out of the chord.
+    void pickNotes() noexcept
+    {
+        const auto peak = *std::max_element (smoothed.begin(), smoothed.end());
+        std::array<int, 12> order {};
+
+        for (int i = 0; i < 12; ++i)
+            order[(size_t) i] = i;
+
+        std::sort (order.begin(), order.end(), [this] (int a, int b) { return smoothed[(size_t) a] > smoothed[(size_t) b]; });
+
+        const auto bassPeak = std::max_element (smoothedBass.begin(), smoothedBass.end());
+        const int root = *bassPeak > 0.0f ? (int) (bassPeak - smoothedBass.begin()) : order[0];
+
+        candidate.insert (48 + root);
+        int count = 1;
+
+        for (int pc : order)
+        {
+            const bool wasDetected = notes.contains (48 + pc) || notes.contains (60 + pc);
+
+            if (count >= maxNotes)
+                break;
+
+            if (pc != root && smoothed[(size_t) pc] >= (wasDetected ? 0.25f : 0.4f) * peak)
+            {
+                candidate.insert (60 + pc);     // Above the root, so ChordDetector keeps it
+                ++count;
+            }
+        }
+    }
+
+    // A new set of notes has to be seen on two frames in a row
+    bool confirm() noexcept
+    {
+        if (candidate == notes)
+        {
+            pending = candidate;
+            return false;
+        }
+
+        const bool confirmed = candidate == pending;
+        pending = candidate;
+
+        if (! confirmed)
+            return false;
+
+        notes = candidate;
+        return true;
+    }
+
+    //==========================================================================
+    double sampleRate { 44100.0 };
+    std::array<Analysis, numWindowSizes> analyses;
+    std::vector<float> ring, frame;
+    int writePosition { 0 };
+    int samplesSinceFrame { 0 };
+    int currentWindow { -1 }, currentHop { -1 };
+    int changeSample { 0 };
+
+    std::array<float, 12> smoothed {}, smoothedBass {};
+    NoteMask candidate, pending, notes;
+
+    std::atomic<int> skippedFrames { 0 };
+};
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "ChordEngineBank.h"
+#include "KeyEstimator.h"
+#include "MidiFileStream.h"
+#include <array>
+#include <functional>
+
+//==============================================================================
+// A stretch of time over which the held notes spell one chord
+struct ChordSegment
+{
+    double startSeconds { 0.0 };
+    double endSeconds { 0.0 };
+    int track { -1 };               // Source track, -1 when tracks are merged
+    int rootPitchClass { -1 };      // 0 = C
+    juce::String root;              // Spelled root name
+    juce::String quality;           // Chord type (e.g. "m7")
+    juce::uint16 pitchClassMask { 0 };  // Bit n set = pitch class n is sounding
+
+    double getDuration() const { return endSeconds - startSeconds; }
+};
+
+//==============================================================================
+// Sweep-line chord segmenter.
+//
+// Note events must arrive in time order. The held-note state is only
+// re-evaluated once time moves past a group of simultaneous events, so a
+// chord struck as a block produces one segment rather than one per note.
+class ChordSegmenter
+{
+public:
+    using SegmentCallback = std::function<void (const ChordSegment&)>;
+
+    ChordSegmenter (int trackIndex, int minimumNotes, SegmentCallback callback)
+        : track (trackIndex), minNotes (juce::jmax (2, minimumNotes)), onSegment (std::move (callback))
+    {
+        // Key estimate on a millisecond clock
+        keyEstimator.prepare (1000.0);
+    }
+
+    //==========================================================================
+    void noteOn (int note, float velocity, double timeSeconds)
+    {
+        advanceTo (timeSeconds);
+
+        auto& count = noteCounts[(size_t) note];
+
+        if (count == 0)
+            held.insert (note);
+
+        if (count < 255)
+            ++count;
+
+        keyEstimator.noteOn (note, velocity);
+        dirty = true;
+    }
+
+    void noteOff (int note, double timeSeconds)
+    {
+        advanceTo (timeSeconds);
+
+        if (noteCounts[(size_t) note] > 0 && --noteCounts[(size_t) note] == 0)
+            held.erase (note);
+
+        dirty = true;
+    }
+
+    // Closes the open segment at the end of the stream
+    void finish (double endSeconds)
+    {
+        advanceTo (endSeconds);
+        evaluate (endSeconds);
+        closeSegment (endSeconds);
+    }
+
+private:
+    //==========================================================================
+    void advanceTo (double timeSeconds)
+    {
+        if (timeSeconds > lastEventTime)
+        {
+            if (dirty)
+                evaluate (lastEventTime);
+
+            const auto nowMs = (juce::int64) (timeSeconds * 1000.0);
+            if (nowMs > keyClockMs)
+            {
+                keyEstimator.advance ((int) juce::jmin<juce::int64> (nowMs - keyClockMs, 1 << 30));
+                keyClockMs = nowMs;
+            }
+
+            lastEventTime = timeSeconds;
+        }
+    }
+
+    void evaluate (double timeSeconds)
+    {
+        dirty = false;
+
+        if ((int) held.size() < minNotes)
+        {
+            closeSegment (timeSeconds);
+            return;
+        }
+
+        const auto chord = ChordDetector::detect (held, keyEstimator.getEstimate());
+
+        juce::uint16 mask = 0;
+        for (int note : held)
+            mask |= (juce::uint16) (1 << (note % 12));
+
+        const int rootPc = chord.rootNote % 12;
+
+        if (isOpen && rootPc == open.rootPitchClass && open.quality == chord.quality)
+        {
+            open.pitchClassMask |= mask;
+            return;
+        }
+
+        closeSegment (timeSeconds);
+
+        open.startSeconds = timeSeconds;
+        open.track = track;
+        open.rootPitchClass = rootPc;
+        open.root = ChordDetector::getNoteName (chord.rootNote, keyEstimator.getEstimate().prefersFlats());
+        open.quality = chord.quality;
+        open.pitchClassMask = mask;
+        isOpen = true;
+    }
+
+    void closeSegment (double timeSeconds)
+    {
+        if (! isOpen)
+            return;
+
+        open.endSeconds = timeSeconds;
+        isOpen = false;
+
+        if (open.getDuration() > 0.0 && onSegment != nullptr)
+            onSegment (open);
+    }
+
+    //==========================================================================
+    const int track;
+    const int minNotes;
+    SegmentCallback onSegment;
+
+    std::array<juce::uint8, 128> noteCounts {};     // Same pitch may be held on several channels
+    NoteMask held;
+    KeyEstimator keyEstimator;
+
+    double lastEventTime { 0.0 };
+    juce::int64 keyClockMs { 0 };
+    bool dirty { false };
+
+    ChordSegment open;
+    bool isOpen { false };
+};
+
+//==============================================================================
+// Runs the segmenter over a MIDI file held in memory. With a track index the
+// notes of that track are analysed on their own (tempo still comes from every
+// track that carries it); with -1 all tracks are merged.
+struct ChordFileAnalysis
+{
+    struct Options
+    {
+        int minimumNotes { 3 };
+        bool includeDrums { false };    // Channel 10
+    };
+
+    struct Stats
+    {
+        juce::int64 numNotes { 0 };
+        int numSegments { 0 };
+    };
+
+    static bool analyse (const void* data, size_t size, int track, const Options& options,
+                         const ChordSegmenter::SegmentCallback& onSegment, Stats& stats)
+    {
+        MidiFileStreamReader reader;
+
+        if (! reader.open (data, size))
+            return false;
+
+        if (track >= 0)
+        {
+            if (track >= reader.getNumTracks())
+                return false;
+
+            // Format 1 files keep the tempo map in track 0
+            if (track == 0 || reader.getFormat() != 1)
+                reader.selectTracks ({ track });
+            else
+                reader.selectTracks ({ 0, track });
+        }
+
+        ChordSegmenter segmenter (track, options.minimumNotes, [&] (const ChordSegment& segment)
+        {
+            ++stats.numSegments;
+            onSegment (segment);
+        });
+
+        MidiStreamEvent event;
+        double endTime = 0.0;
+
+        while (reader.next (event))
+        {
+            endTime = event.timeSeconds;
+
+            if (track >= 0 && event.track != track)
+                continue;
+
+            if (! options.includeDrums && event.getChannel() == 10)
+                continue;
+
+            if (event.isNoteOn())
+            {
+                segmenter.noteOn (event.data1, event.data2 / 127.0f, event.timeSeconds);
+                ++stats.numNotes;
+            }
+            else if (event.isNoteOff())
+            {
+                segmenter.noteOff (event.data1, event.timeSeconds);
+            }
+        }
+
+        segmenter.finish (endTime);
+        return true;
+    }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "ChordDetector.h"
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+//==============================================================================
+// A chord as it travels on the bus: plain data, so it can be copied through
+// atomics
+struct BusChord
+{
+    static constexpr int maxIntervals = 8;
+
+    juce::int64 timestamp { -1 };       // Host sample position of the change, -1 = unknown
+    juce::int8 rootNote { -1 };
+    juce::uint8 numIntervals { 0 };
+    juce::int8 intervals[maxIntervals] {};
+    char name[24] {};
+    char quality[13] {};
+    bool isValid { false };
+
+    static BusChord fromDetectedChord (const DetectedChord& chord, juce::int64 timestamp)
+    {
+        BusChord result;
+        result.timestamp = timestamp;
+        result.isValid = chord.isValid;
+        result.rootNote = (juce::int8) juce::jlimit (-1, 127, chord.rootNote);
+        result.numIntervals = (juce::uint8) juce::jmin ((int) chord.intervals.size(), maxIntervals);
+
+        for (int i = 0; i < result.numIntervals; ++i)
+            result.intervals[i] = (juce::int8) chord.intervals[(size_t) i];
+
+        copyText (result.name, sizeof (result.name), chord.chordName);
+        copyText (result.quality, sizeof (result.quality), chord.quality);
+        return result;
+    }
+
+    void toDetectedChord (DetectedChord& chord) const noexcept
+    {
+        chord.isValid = isValid;
+        chord.rootNote = rootNote;
+        chord.intervals.assign (intervals, intervals + numIntervals);
+        copyText (chord.chordName, sizeof (chord.chordName), name);
+        copyText (chord.quality, sizeof (chord.quality), quality);
+    }
+
+    // Same chord, whenever it happened
+    bool isSameChordAs (const BusChord& other) const
+    {
+        return isValid == other.isValid && rootNote == other.rootNote
+            && numIntervals == other.numIntervals
+            && std::memcmp (intervals, other.intervals, sizeof (intervals)) == 0
+            && std::memcmp (name, other.name, sizeof (name)) == 0;
+    }
+
+private:
+    // Null-terminated, truncated to fit, and zero-padded so chords compare by bytes
+    static void copyText (char* dest, size_t destSize, const char* source) noexcept
+    {
+        std::memset (dest, 0, destSize);
+        juce::CharPointer_UTF8 (dest).writeWithDestByteLimit (juce::CharPointer_UTF8 (source), destSize);
+    }
+};
+
+//==============================================================================
+// In-process broadcast of detected chords between plugin instances.
+//
+// Every instance in the process shares one bus (SharedResourcePointer). A
+// leader owns a channel and publishes its chord there; any number of
+// followers read it. Each channel is a sequence lock: the writer bumps the
+// sequence to odd, stores the chord as relaxed atomic words and bumps it to
+// even again, so publishing never waits. Readers copy the words and keep the
+// copy only if the sequence was even and unchanged; a read that keeps
+// colliding with the writer gives up after a few tries and picks the chord
+// up on the next block, so reading never waits either.
+class ChordBus
+{
+public:
+    static constexpr int numChannels = 16;
+
+    //==========================================================================
+    // Leader side (audio thread). A channel has one owner at a time; claim()
+    // fails while another instance leads it.
+    bool claim (int channel, const void* owner) noexcept
+    {
+        auto& slotOwner = slots[(size_t) channel].owner;
+        const void* expected = nullptr;
+        return slotOwner.compare_exchange_strong (expected, owner) || expected == owner;
+    }
+
+    void release (int channel, const void* owner) noexcept
+    {
+        const void* expected = owner;
+        slots[(size_t) channel].owner.compare_exchange_strong (expected, nullptr);
+    }
+
+    // Only the owner may publish
+    void publish (int channel, const BusChord& chord) noexcept
+    {
+        auto& slot = slots[(size_t) channel];
+        std::array<juce::uint64, numWords> words {};
+        std::memcpy (words.data(), &chord, sizeof (BusChord));
+
+        const auto sequence = slot.sequence.load (std::memory_order_relaxed);
+        slot.sequence.store (sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+
+        for (size_t i = 0; i < numWords; ++i)
+            slot.words[i].store (words[i], std::memory_order_relaxed);
+
+        slot.sequence.store (sequence + 2, std::memory_order_release);
+    }
+
+    //==========================================================================
+    // Follower side (audio thread). Returns true and fills dest when the
+    // channel holds a chord newer than lastSequence.
+    bool read (int channel, BusChord& dest, juce::uint32& lastSequence) const noexcept
+    {
+        const auto& slot = slots[(size_t) channel];
+
+        for (int attempt = 0; attempt < 4; ++attempt)
+        {
+            const auto before = slot.sequence.load (std::memory_order_acquire);
+
+            if ((before & 1) != 0)
+                continue;
+
+            if (before == lastSequence)
+                return false;
+
+            std::array<juce::uint64, numWords> words;
+
+            for (size_t i = 0; i < numWords; ++i)
+                words[i] = slot.words[i].load (std::memory_order_relaxed);
+
+            std::atomic_thread_fence (std::memory_order_acquire);
+
+            if (slot.sequence.load (std::memory_order_relaxed) == before)
+            {
+                std::memcpy (&dest, words.data(), sizeof (BusChord));
+                lastSequence = before;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    //==========================================================================
+    static constexpr size_t numWords = (sizeof (BusChord) + 7) / 8;
+
+    static_assert (std::is_trivially_copyable<BusChord>::value, "BusChord is copied as raw words");
+
+    // One cache line or two per channel, so leaders don't contend
+    struct alignas (64) Slot
+    {
+        std::atomic<const void*> owner { nullptr };
+        std::atomic<juce::uint32> sequence { 0 };
+        std::array<std::atomic<juce::uint64>, numWords> words {};
+    };
+
+    std::array<Slot, numChannels> slots;
+};
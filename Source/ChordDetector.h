@@ -1,17 +1,65 @@
 #pragma once
 
 #include <juce_core/juce_core.h>
+#include "KeyEstimator.h"
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
 #include <set>
 #include <vector>
 #include <algorithm>
 
 //==============================================================================
-// Result of chord detection
+// Distinct intervals above a chord's root, in fixed storage so chords can be
+// detected and copied on the audio thread without allocating
+class ChordIntervals
+{
+public:
+    static constexpr int maxIntervals = 12;
+
+    ChordIntervals() = default;
+    ChordIntervals (std::initializer_list<int> list)    { assign (list.begin(), list.end()); }
+
+    template <typename Iterator>
+    void assign (Iterator first, Iterator last)
+    {
+        numIntervals = 0;
+
+        for (; first != last; ++first)
+            add (*first);
+    }
+
+    void add (int interval) noexcept
+    {
+        if (numIntervals < maxIntervals)
+            values[(size_t) numIntervals++] = interval;
+    }
+
+    bool contains (int interval) const noexcept     { return std::find (begin(), end(), interval) != end(); }
+
+    size_t size() const noexcept                    { return (size_t) numIntervals; }
+    bool empty() const noexcept                     { return numIntervals == 0; }
+    int operator[] (size_t index) const noexcept    { return values[index]; }
+
+    int* begin() noexcept                           { return values.data(); }
+    int* end() noexcept                             { return values.data() + numIntervals; }
+    const int* begin() const noexcept               { return values.data(); }
+    const int* end() const noexcept                 { return values.data() + numIntervals; }
+
+private:
+    std::array<int, maxIntervals> values {};
+    int numIntervals { 0 };
+};
+
+//==============================================================================
+// Result of chord detection. Plain data, so it never allocates.
 struct DetectedChord
 {
     int rootNote { -1 };                    // MIDI note number of root (-1 if no chord)
-    juce::String chordName { "---" };       // Display name (e.g., "C Major", "Am7")
-    std::vector<int> intervals;             // Intervals from root (always includes 0 for root)
+    char chordName[16] { "---" };           // Display name (e.g., "C Maj", "A m7")
+    char quality[8] {};                     // Chord type without root (e.g., "m7"), empty for single notes
+    ChordIntervals intervals;               // Intervals from root (always includes 0 for root)
     bool isValid { false };                 // True if a valid chord was detected
 };
 
@@ -21,10 +69,15 @@ class ChordDetector
 {
 public:
     //==========================================================================
-    // Analyze held notes and detect chord
-    static DetectedChord detect (const std::set<int>& heldNotes)
+    // Analyze held notes and detect chord. When a key estimate is available it
+    // is used to choose between chords that share the same pitch classes
+    // (e.g. Am7 / C6) and to spell the root with sharps or flats.
+    // NoteSet is any ascending container of note numbers (std::set<int>, NoteMask).
+    template <typename NoteSet>
+    static DetectedChord detect (const NoteSet& heldNotes, const KeyEstimate& key = {})
     {
         DetectedChord result;
+        const bool useFlats = key.prefersFlats();
         
         if (heldNotes.size() < 2)
         {
@@ -32,7 +85,8 @@ public:
             if (heldNotes.size() == 1)
             {
                 result.rootNote = *heldNotes.begin();
-                result.chordName = getNoteNameWithOctave (result.rootNote);
+                std::snprintf (result.chordName, sizeof (result.chordName), "%s%d",
+                               getNoteText (result.rootNote, useFlats), result.rootNote / 12 - 1);
                 result.intervals = { 0 };
                 result.isValid = true;
             }
@@ -41,24 +95,38 @@ public:
         
         // Get root (lowest note) and calculate intervals
         int root = *heldNotes.begin();
-        std::vector<int> rawIntervals;
+        ChordIntervals rawIntervals = getIntervalsFrom (heldNotes, root);
         
-        for (int note : heldNotes)
+        // Match against known chord patterns
+        const char* chordType = identifyChordType (rawIntervals);
+        
+        // Sixth and minor seventh chords are inversions of each other - let
+        // the key decide which root is more plausible
+        if (key.isValid() && key.confidence >= minimumKeyConfidence)
         {
-            int interval = (note - root) % 12;  // Normalize to single octave
-            if (std::find (rawIntervals.begin(), rawIntervals.end(), interval) == rawIntervals.end())
+            const int alternativeOffset = getAlternativeRootOffset (chordType);
+            
+            if (alternativeOffset != 0)
             {
-                rawIntervals.push_back (interval);
+                const int alternativePc = (root + alternativeOffset) % 12;
+                
+                if (key.getScaleDegreeWeight (alternativePc) > key.getScaleDegreeWeight (root % 12))
+                {
+                    const int alternativeRoot = findLowestWithPitchClass (heldNotes, alternativePc);
+                    
+                    if (alternativeRoot >= 0)
+                    {
+                        root = alternativeRoot;
+                        rawIntervals = getIntervalsFrom (heldNotes, root);
+                        chordType = identifyChordType (rawIntervals);
+                    }
+                }
             }
         }
         
-        std::sort (rawIntervals.begin(), rawIntervals.end());
-        
-        // Match against known chord patterns
-        juce::String chordType = identifyChordType (rawIntervals);
-        
         result.rootNote = root;
-        result.chordName = getNoteName (root) + " " + chordType;
+        std::snprintf (result.chordName, sizeof (result.chordName), "%s %s", getNoteText (root, useFlats), chordType);
+        std::snprintf (result.quality, sizeof (result.quality), "%s", chordType);
         result.intervals = rawIntervals;
         result.isValid = true;
         
@@ -67,7 +135,7 @@ public:
     
     //==========================================================================
     // Get the full intervals for playback (including octave variations)
-    static std::vector<int> getPlaybackIntervals (const DetectedChord& chord)
+    static ChordIntervals getPlaybackIntervals (const DetectedChord& chord)
     {
         if (!chord.isValid)
             return { 0, 4, 7 };  // Default to major if invalid
@@ -75,9 +143,68 @@ public:
         return chord.intervals;
     }
 
+    //==========================================================================
+    // Pitch-class name of a MIDI note, spelled with sharps or flats
+    static juce::String getNoteName (int midiNote, bool useFlats = false)
+    {
+        return getNoteText (midiNote, useFlats);
+    }
+    
+    static const char* getNoteText (int midiNote, bool useFlats = false) noexcept
+    {
+        static const char* sharpNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+        static const char* flatNames[]  = { "C", "Db", "D", "Eb", "E", "F", "Gb", "G", "Ab", "A", "Bb", "B" };
+        return useFlats ? flatNames[midiNote % 12] : sharpNames[midiNote % 12];
+    }
+    
 private:
     //==========================================================================
-    static juce::String identifyChordType (const std::vector<int>& intervals)
+    // Below this correlation the key estimate is too vague to re-root chords
+    static constexpr float minimumKeyConfidence = 0.5f;
+    
+    //==========================================================================
+    template <typename NoteSet>
+    static ChordIntervals getIntervalsFrom (const NoteSet& heldNotes, int root)
+    {
+        ChordIntervals intervals;
+        
+        for (int note : heldNotes)
+        {
+            int interval = ((note - root) % 12 + 12) % 12;  // Normalize to single octave
+            if (! intervals.contains (interval))
+            {
+                intervals.add (interval);
+            }
+        }
+        
+        std::sort (intervals.begin(), intervals.end());
+        return intervals;
+    }
+    
+    //==========================================================================
+    // Semitones from the detected root to the root of the enharmonic
+    // alternative with the same pitch classes (0 if there is none)
+    static int getAlternativeRootOffset (const char* chordType)
+    {
+        if (std::strcmp (chordType, "6") == 0)     return 9;   // C6    -> Am7
+        if (std::strcmp (chordType, "m6") == 0)    return 9;   // Cm6   -> Am7b5
+        if (std::strcmp (chordType, "m7") == 0)    return 3;   // Am7   -> C6
+        if (std::strcmp (chordType, "m7b5") == 0)  return 3;   // Am7b5 -> Cm6
+        return 0;
+    }
+    
+    template <typename NoteSet>
+    static int findLowestWithPitchClass (const NoteSet& heldNotes, int pitchClass)
+    {
+        for (int note : heldNotes)
+            if (note % 12 == pitchClass)
+                return note;
+        
+        return -1;
+    }
+    
+    //==========================================================================
+    static const char* identifyChordType (const ChordIntervals& intervals)
     {
         // Check for various chord types based on interval patterns
         // intervals are normalized to 0-11 range
@@ -137,22 +264,9 @@ private:
     }
     
     //==========================================================================
-    static bool hasInterval (const std::vector<int>& intervals, int target)
-    {
-        return std::find (intervals.begin(), intervals.end(), target) != intervals.end();
-    }
-    
-    //==========================================================================
-    static juce::String getNoteName (int midiNote)
-    {
-        static const char* noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
-        return noteNames[midiNote % 12];
-    }
-    
-    //==========================================================================
-    static juce::String getNoteNameWithOctave (int midiNote)
+    static bool hasInterval (const ChordIntervals& intervals, int target)
     {
-        return getNoteName (midiNote) + juce::String (midiNote / 12 - 1);
+        return intervals.contains (target);
     }
 };
 
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "ChordDetector.h"
+#include <array>
+
+//==============================================================================
+// Fixed-size set of MIDI note numbers (0-127) stored as a bitmask.
+// Iterates in ascending order like std::set<int>, so ChordDetector can use it
+// directly, but never allocates.
+struct NoteMask
+{
+    juce::uint64 bits[2] {};
+
+    void insert (int note)          { if (isInRange (note)) bits[note >> 6] |=  (juce::uint64 (1) << (note & 63)); }
+    void erase (int note)           { if (isInRange (note)) bits[note >> 6] &= ~(juce::uint64 (1) << (note & 63)); }
+    bool contains (int note) const  { return isInRange (note) && (bits[note >> 6] >> (note & 63)) & 1; }
+    bool empty() const              { return (bits[0] | bits[1]) == 0; }
+    void clear()                    { bits[0] = bits[1] = 0; }
+
+    NoteMask& operator|= (const NoteMask& other)    { bits[0] |= other.bits[0]; bits[1] |= other.bits[1]; return *this; }
+    NoteMask& operator-= (const NoteMask& other)    { bits[0] &= ~other.bits[0]; bits[1] &= ~other.bits[1]; return *this; }
+    bool operator== (const NoteMask& other) const   { return bits[0] == other.bits[0] && bits[1] == other.bits[1]; }
+    bool operator!= (const NoteMask& other) const   { return ! operator== (other); }
+
+    size_t size() const
+    {
+        return (size_t) (juce::countNumberOfBits (bits[0]) + juce::countNumberOfBits (bits[1]));
+    }
+
+    //==========================================================================
+    class Iterator
+    {
+    public:
+        Iterator (const NoteMask& m, int startNote) : mask (m), note (m.findNext (startNote)) {}
+
+        int operator*() const                           { return note; }
+        Iterator& operator++()                          { note = mask.findNext (note + 1); return *this; }
+        bool operator!= (const Iterator& other) const   { return note != other.note; }
+        bool operator== (const Iterator& other) const   { return note == other.note; }
+
+    private:
+        const NoteMask& mask;
+        int note;
+    };
+
+    Iterator begin() const  { return { *this, 0 }; }
+    Iterator end() const    { return { *this, 128 }; }
+
+private:
+    static bool isInRange (int note) { return note >= 0 && note < 128; }
+
+    // Lowest set note >= from, or 128 if none
+    int findNext (int from) const
+    {
+        for (int word = from >> 6; word < 2; ++word)
+        {
+            auto w = bits[word];
+
+            if (word == (from >> 6))
+                w &= ~juce::uint64 (0) << (from & 63);
+
+            if (w != 0)
+                return word * 64 + juce::countNumberOfBits ((w & (~w + 1)) - 1);
+        }
+        return 128;
+    }
+};
+
+//==============================================================================
+// Chord-following state for up to 16 independent engines (one per input
+// channel, or one per keyboard zone). Each field is an array across engines
+// rather than an array of engine objects, so the per-block loops that touch a
+// single field walk contiguous memory.
+struct ChordEngineBank
+{
+    static constexpr int maxEngines = 16;
+
+    std::array<NoteMask, maxEngines> heldNotes;             // Input notes per engine
+    std::array<DetectedChord, maxEngines> chords;           // Detected chord per engine
+    std::array<int, maxEngines> activePatternIndex {};      // Pattern each engine is playing
+    std::array<double, maxEngines> accumulatedBeats {};     // Internal-timing cursor per engine
+    std::array<NoteMask, maxEngines> activeOutputNotes;     // Notes each engine has sounding
+    std::array<NoteMask, maxEngines> strumLookahead;        // Note-ons still inside the capture window
+    std::array<int, maxEngines> chordKeys {};               // Last chord's walking-bass key, -1 = none yet
+    juce::uint32 chordChangedMask { 0 };                    // Engines needing re-detection
+
+    void reset()
+    {
+        for (int e = 0; e < maxEngines; ++e)
+        {
+            heldNotes[(size_t) e].clear();
+            chords[(size_t) e] = DetectedChord();
+            activePatternIndex[(size_t) e] = 0;
+            accumulatedBeats[(size_t) e] = 0.0;
+            activeOutputNotes[(size_t) e].clear();
+            strumLookahead[(size_t) e].clear();
+            chordKeys[(size_t) e] = -1;
+        }
+        chordChangedMask = 0;
+    }
+};
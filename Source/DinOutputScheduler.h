@@ -0,0 +1,283 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+#include <vector>
+
+//==============================================================================
+// Output stage that models a 31.25 kbaud DIN MIDI link.
+//
+// A pattern hit puts a bass note and several chord tones on the same sample;
+// on a DIN cable those bytes go out one after another at 320 us each. This
+// stage orders each group (note-offs first, then note-ons from the lowest
+// note up so the bass lands first), counts bytes with running status, and
+// moves every event to the sample where the wire is actually free, carrying
+// anything that spills past the block into the next one. Chord tones that
+// would land later than the jitter budget are dropped (together with their
+// note-offs); note-offs and the first note-on of each group never are.
+//
+// The carry-over holds maxEventsPerBlock events plus room for a note-off on
+// every key of every channel. Once the backlog is that deep, new note-ons
+// and controllers are shed, and a note-off that still finds no room sheds
+// the oldest waiting event that isn't one, so a note-off is only lost if
+// the whole carry-over is note-offs. Shed events are counted.
+//
+// The output is built in a buffer sized in prepare() for a full block plus
+// a full carry-over, then copied back into the block's buffer, so neither
+// grows on the audio thread unless more than that passes straight through.
+class DinOutputScheduler
+{
+public:
+    //==========================================================================
+    static constexpr double baudRate = 31250.0;
+    static constexpr double bitsPerByte = 10.0;     // Start + 8 data + stop
+    static constexpr int maxEventsPerBlock = 1024;
+    static constexpr int maxCarriedNoteOffs = 16 * 128;
+    static constexpr int maxCarriedEvents = maxEventsPerBlock + maxCarriedNoteOffs;
+
+    // MidiBuffer stores each event as a sample position, a size and the bytes
+    static constexpr int bytesPerEvent = (int) (sizeof (juce::int32) + sizeof (juce::uint16)) + 3;
+    static constexpr int sysexHeadroomBytes = 4096;
+    static constexpr int maxOutputBytes = (maxEventsPerBlock + maxCarriedEvents) * bytesPerEvent + sysexHeadroomBytes;
+
+    void prepare (double sampleRate)
+    {
+        samplesPerByte = sampleRate * bitsPerByte / baudRate;
+        events.reserve (maxEventsPerBlock);
+        carried.reserve (maxCarriedEvents);
+        scheduled.ensureSize (maxOutputBytes);
+        reset();
+    }
+
+    void reset()
+    {
+        events.clear();
+        carried.clear();
+        linkBusyUntil = 0.0;
+        runningStatus = 0;
+        soundingNotes.fill (0);
+        droppedNoteOns.fill (0);
+    }
+
+    //==========================================================================
+    // Audio thread: events carried over, still waiting for the wire
+    int getNumQueued() const noexcept  { return (int) carried.size(); }
+
+    // Audio thread: reschedules the block's output in place
+    void process (juce::MidiBuffer& midiMessages, int numSamples, double jitterBudgetMs, double sampleRate)
+    {
+        const double budgetSamples = jitterBudgetMs * 0.001 * sampleRate;
+        double worstLatency = 0.0;
+
+        events.clear();
+        scheduled.clear();
+
+        // Events that didn't fit on the wire in the previous block were already
+        // scheduled - they go out first, in their original order
+        int numCarried = 0;
+        for (auto& e : carried)
+        {
+            if (e.sample < numSamples)
+                scheduled.addEvent (e.bytes, e.size, e.sample);
+            else
+                carried[(size_t) numCarried++] = { e.sample - numSamples, e.order, { e.bytes[0], e.bytes[1], e.bytes[2] }, e.size };
+        }
+        carried.resize ((size_t) numCarried);
+
+        for (const auto metadata : midiMessages)
+        {
+            if (metadata.numBytes > 3 || events.size() >= (size_t) maxEventsPerBlock)
+            {
+                // Sysex and overflow pass straight through but still occupy the wire
+                scheduled.addEvent (metadata.data, metadata.numBytes, metadata.samplePosition);
+                linkBusyUntil = juce::jmax (linkBusyUntil, (double) metadata.samplePosition)
+                                  + metadata.numBytes * samplesPerByte;
+                runningStatus = 0;
+                continue;
+            }
+
+            Event e;
+            e.sample = metadata.samplePosition;
+            e.size = metadata.numBytes;
+            std::copy (metadata.data, metadata.data + metadata.numBytes, e.bytes);
+            convertNoteOff (e);
+            e.order = getOrder (e);
+            events.push_back (e);
+        }
+
+        // Sample, then note-offs before note-ons, then lowest note first
+        std::sort (events.begin(), events.end(), [] (const Event& a, const Event& b)
+        {
+            return a.sample != b.sample ? a.sample < b.sample : a.order < b.order;
+        });
+
+        int groupSample = -1;
+        bool groupHasNoteOn = false;
+
+        for (auto& e : events)
+        {
+            if (e.sample != groupSample)
+            {
+                groupSample = e.sample;
+                groupHasNoteOn = false;
+            }
+
+            const int type = e.bytes[0] & 0xf0;
+            const bool isNoteOn = type == 0x90 && e.size == 3 && e.bytes[2] > 0;
+            const bool isNoteOff = type == 0x90 && e.size == 3 && e.bytes[2] == 0;
+            const size_t key = isNoteOn || isNoteOff ? getKeyIndex (e) : 0;
+
+            // A dropped note-on's note-off has nothing to release. Notes on one
+            // key can overlap, so while another note on the key is sounding the
+            // note-off may be that one's and still goes out
+            if (isNoteOff && droppedNoteOns[key] > 0 && soundingNotes[key] == 0)
+            {
+                --droppedNoteOns[key];
+                continue;
+            }
+
+            const double wireStart = juce::jmax ((double) e.sample, linkBusyUntil);
+            const double latency = wireStart - e.sample;
+
+            if (isNoteOn && groupHasNoteOn && latency > budgetSamples)
+            {
+                ++droppedNoteOns[key];
+                droppedEvents.fetch_add (1, std::memory_order_relaxed);
+                continue;
+            }
+
+            const int outSample = (int) wireStart;
+            const bool carry = outSample >= numSamples;
+
+            if (carry && carried.size() >= (size_t) maxEventsPerBlock && ! (isNoteOff && makeRoomForNoteOff()))
+            {
+                // The backlog is full: shed before the event takes wire time
+                if (isNoteOn)
+                    ++droppedNoteOns[key];
+
+                shedEvents.fetch_add (1, std::memory_order_relaxed);
+                continue;
+            }
+
+            if (isNoteOn)
+                ++soundingNotes[key];
+            else if (isNoteOff && soundingNotes[key] > 0)
+                --soundingNotes[key];
+
+            groupHasNoteOn = groupHasNoteOn || isNoteOn;
+            worstLatency = juce::jmax (worstLatency, latency);
+
+            // Running status: repeated channel status bytes are not resent
+            const bool isChannelMessage = e.bytes[0] >= 0x80 && e.bytes[0] < 0xf0;
+            const int wireBytes = e.size - (isChannelMessage && e.bytes[0] == runningStatus ? 1 : 0);
+
+            if (isChannelMessage)
+                runningStatus = e.bytes[0];
+            else if (e.bytes[0] < 0xf8)
+                runningStatus = 0;      // System common cancels running status; realtime doesn't
+
+            linkBusyUntil = wireStart + wireBytes * samplesPerByte;
+
+            if (carry)
+                carried.push_back ({ outSample - numSamples, e.order, { e.bytes[0], e.bytes[1], e.bytes[2] }, e.size });
+            else
+                scheduled.addEvent (e.bytes, e.size, outSample);
+        }
+
+        linkBusyUntil = juce::jmax (0.0, linkBusyUntil - numSamples);
+
+        // Copied rather than swapped, so the buffer sized in prepare() stays here
+        midiMessages.clear();
+        midiMessages.ensureSize (maxOutputBytes);
+        midiMessages.addEvents (scheduled, 0, -1, 0);
+
+        worstLatencyMs.store ((float) (worstLatency / sampleRate * 1000.0), std::memory_order_relaxed);
+    }
+
+    //==========================================================================
+    // Any thread
+    float getWorstLatencyMs() const    { return worstLatencyMs.load (std::memory_order_relaxed); }
+    int getDroppedEventCount() const   { return droppedEvents.load (std::memory_order_relaxed); }
+    int getShedEventCount() const      { return shedEvents.load (std::memory_order_relaxed); }
+
+private:
+    //==========================================================================
+    struct Event
+    {
+        int sample;
+        int order;
+        juce::uint8 bytes[3];
+        int size;
+    };
+
+    // Note-offs are sent as note-on with velocity 0 so a chord's releases and
+    // attacks can share one running status byte
+    static void convertNoteOff (Event& e)
+    {
+        if ((e.bytes[0] & 0xf0) == 0x80 && e.size == 3)
+        {
+            e.bytes[0] = (juce::uint8) (0x90 | (e.bytes[0] & 0x0f));
+            e.bytes[2] = 0;
+        }
+    }
+
+    static bool isNoteOffEvent (const Event& e)
+    {
+        return (e.bytes[0] & 0xf0) == 0x90 && e.size == 3 && e.bytes[2] == 0;
+    }
+
+    static size_t getKeyIndex (const Event& e)
+    {
+        return (size_t) ((e.bytes[0] & 0x0f) * 128 + (e.bytes[1] & 0x7f));
+    }
+
+    // A note-off past the carry-over's event budget goes in the note-off
+    // room, or else takes the place of the oldest event that isn't a note-off
+    bool makeRoomForNoteOff()
+    {
+        if (carried.size() < (size_t) maxCarriedEvents)
+            return true;
+
+        const auto victim = std::find_if (carried.begin(), carried.end(), [] (const Event& c) { return ! isNoteOffEvent (c); });
+
+        if (victim == carried.end())
+            return false;
+
+        // A note-on that never goes out no longer sounds; its note-off is swallowed
+        if ((victim->bytes[0] & 0xf0) == 0x90 && victim->size == 3)
+        {
+            const auto key = getKeyIndex (*victim);
+            soundingNotes[key] = (juce::uint16) juce::jmax (0, soundingNotes[key] - 1);
+            ++droppedNoteOns[key];
+        }
+
+        carried.erase (victim);
+        shedEvents.fetch_add (1, std::memory_order_relaxed);
+        return true;
+    }
+
+    static int getOrder (const Event& e)
+    {
+        const int type = e.bytes[0] & 0xf0;
+
+        if (type == 0x90 && e.size == 3)
+            return e.bytes[2] == 0 ? e.bytes[1] : 512 + e.bytes[1];   // Note-offs, then note-ons low to high
+
+        return 256;     // Controllers etc. between the two
+    }
+
+    //==========================================================================
+    std::vector<Event> events;
+    std::vector<Event> carried;
+    juce::MidiBuffer scheduled;
+
+    double samplesPerByte { 44100.0 * bitsPerByte / baudRate };
+    double linkBusyUntil { 0.0 };       // Samples from the block start until the wire is free
+    juce::uint8 runningStatus { 0 };
+    std::array<juce::uint16, 16 * 128> soundingNotes {};     // Per channel and key: note-ons sent
+    std::array<juce::uint16, 16 * 128> droppedNoteOns {};    // ... and dropped, their note-offs pending
+
+    std::atomic<float> worstLatencyMs { 0.0f };
+    std::atomic<int> droppedEvents { 0 };
+    std::atomic<int> shedEvents { 0 };
+};
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "ChordDetector.h"
+#include "ChordEngineBank.h"
+#include "MidiFileStream.h"
+#include "RhythmPattern.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+//==============================================================================
+// How a loop was played against the grid it was quantised to: per step of
+// one cycle, the mean distance of its hits from the grid and their mean
+// velocity. Putting the offsets back on the quantised pattern restores the
+// original feel.
+struct GrooveTemplate
+{
+    int stepsPerBeat { 4 };
+    double lengthInBeats { 4.0 };
+    std::vector<float> offsets;     // Per step, in steps (-0.5 to 0.5); 0 where nothing plays
+    std::vector<float> velocities;  // Per step (0-1); 0 where nothing plays
+    float swing { 50.0f };          // Where the second step of each pair lands, in percent of the pair (50 = straight)
+};
+
+//==============================================================================
+// A MIDI loop turned into a pattern
+struct ExtractedLoop
+{
+    RhythmPattern pattern;          // Quantised to the groove's grid
+    GrooveTemplate groove;
+    juce::String chordName;         // The chord that roles were read against
+    int numNotes { 0 };
+    int numHits { 0 };
+};
+
+//==============================================================================
+// Reads a comping loop from a MIDI file and rebuilds it as a RhythmPattern.
+//
+//   - A note whose onset is within clusterBeats of the previous one joins its
+//     hit, so strums, flams and loose hands make one hit. The hit sits on
+//     its earliest onset.
+//   - Hits are quantised to stepsPerBeat, or with 0 to the coarsest grid
+//     that gives every hit its own step within a third of a step, so swung
+//     eighths stay eighths. What quantising moved them by is kept in the
+//     groove template rather than in the pattern.
+//   - The loop is taken to be one chord. Its root is the one whose chord
+//     template best explains how long each pitch class sounds, so inversions
+//     and a rootless voicing over its bass note (F A C E over a D is named
+//     Dm7, ChordDetector having no 9ths) get the root a player would name.
+//     A rootless voicing with no root anywhere in the loop is read as the
+//     chord its notes spell (Fmaj7).
+//     Each note's interval above the root gives its role: root, 3rd (with
+//     sus2 and sus4 tones), 5th or 7th (with 6ths), as PatternNote counts
+//     them. The lowest note of a hit below bassBelow plays the bass instead.
+//   - Velocity and duration are kept. Notes of a hit that end up with the
+//     same role, such as octave doublings, become one note.
+//
+// Bars are taken as 4 beats, as the file reader doesn't pass time
+// signatures on; the cycle is the fewest whole bars that hold every hit.
+struct GrooveExtraction
+{
+    struct Options
+    {
+        int stepsPerBeat { 0 };         // 0 = pick from the playing
+        double clusterBeats { 0.06 };   // Onsets this close form one hit
+        int bassBelow { 52 };           // E3
+        bool includeDrums { false };    // Channel 10
+    };
+
+    // Returns an error message, or an empty string on success
+    static juce::String extract (const void* data, size_t size, const Options& options, ExtractedLoop& loop)
+    {
+        MidiFileStreamReader reader;
+
+        if (! reader.open (data, size))
+            return "Not a Standard MIDI File";
+
+        const int ticksPerQuarter = reader.getTicksPerQuarter();
+
+        if (ticksPerQuarter <= 0)
+            return "SMPTE timing has no beats to quantise to";
+
+        const auto notes = readNotes (reader, ticksPerQuarter, options);
+
+        if (notes.empty())
+            return "No notes";
+
+        // Notes are in onset order, so each hit is a run of them
+        std::vector<size_t> hitStarts;
+
+        for (size_t i = 0; i < notes.size(); ++i)
+            if (i == 0 || notes[i].start - notes[i - 1].start > options.clusterBeats)
+                hitStarts.push_back (i);
+
+        hitStarts.push_back (notes.size());
+
+        const int stepsPerBeat = options.stepsPerBeat > 0 ? juce::jlimit (1, 16, options.stepsPerBeat)
+                                                          : chooseGrid (notes, hitStarts);
+        const int numSteps = getNumSteps (notes, stepsPerBeat);
+
+        if (numSteps > maxSteps)
+            return "Loop is longer than " + juce::String (maxSteps / stepsPerBeat) + " beats";
+
+        const auto chord = detectChord (notes);
+
+        auto& pattern = loop.pattern;
+        pattern.lengthInBeats = (double) numSteps / stepsPerBeat;
+        pattern.notes.clear();
+        pattern.tags = { "Imported" };
+
+        auto& groove = loop.groove;
+        groove.stepsPerBeat = stepsPerBeat;
+        groove.lengthInBeats = pattern.lengthInBeats;
+        groove.offsets.assign ((size_t) numSteps, 0.0f);
+        groove.velocities.assign ((size_t) numSteps, 0.0f);
+
+        loop.chordName = chord.chordName;
+        loop.numNotes = (int) notes.size();
+        loop.numHits = 0;
+
+        std::vector<int> hitsAtStep ((size_t) numSteps, 0);
+
+        for (size_t h = 0; h + 1 < hitStarts.size(); ++h)
+        {
+            const auto first = hitStarts[h], end = hitStarts[h + 1];
+            const double position = notes[first].start * stepsPerBeat;
+            const int gridStep = juce::roundToInt (position);
+            const int step = ((gridStep % numSteps) + numSteps) % numSteps;
+
+            addHit (notes, first, end, step, chord.rootNote, options, pattern, (double) stepsPerBeat);
+
+            float hitVelocity = 0.0f;
+
+            for (size_t i = first; i < end; ++i)
+                hitVelocity = juce::jmax (hitVelocity, notes[i].velocity);
+
+            // Running means, for loops that hit the same step more than once
+            const auto n = (float) ++hitsAtStep[(size_t) step];
+            groove.offsets[(size_t) step] += ((float) (position - gridStep) - groove.offsets[(size_t) step]) / n;
+            groove.velocities[(size_t) step] += (hitVelocity - groove.velocities[(size_t) step]) / n;
+
+            ++loop.numHits;
+        }
+
+        // Swing from the second step of each pair
+        float offBeatOffset = 0.0f;
+        int numOffBeats = 0;
+
+        for (int step = 1; step < numSteps; step += 2)
+        {
+            if (hitsAtStep[(size_t) step] > 0)
+            {
+                offBeatOffset += groove.offsets[(size_t) step];
+                ++numOffBeats;
+            }
+        }
+
+        groove.swing = 50.0f * (1.0f + (numOffBeats > 0 ? offBeatOffset / (float) numOffBeats : 0.0f));
+
+        std::sort (pattern.notes.begin(), pattern.notes.end(), [] (const PatternNote& a, const PatternNote& b)
+        {
+            return a.beatPosition != b.beatPosition ? a.beatPosition < b.beatPosition : a.chordIndex < b.chordIndex;
+        });
+
+        return {};
+    }
+
+    // The most steps a pattern script cycle holds
+    // (PatternScript::maxStepsPerCycle). PatternScript::fromPattern writes a
+    // loop out on its own grid, so any loop within this fits in one script.
+    static constexpr int maxSteps = 64;
+
+    // How far off the grid a hit may be when the grid is picked for it
+    static constexpr double maxGridOffset = 0.35;
+
+private:
+    struct Note
+    {
+        double start, end;      // Beats
+        int pitch;
+        float velocity;
+    };
+
+    static std::vector<Note> readNotes (MidiFileStreamReader& reader, int ticksPerQuarter, const Options& options)
+    {
+        std::vector<Note> notes;
+        std::array<int, 16 * 128> sounding;     // Index of the open note per channel and pitch
+        sounding.fill (-1);
+
+        MidiStreamEvent event;
+        double lastBeat = 0.0;
+
+        while (reader.next (event))
+        {
+            if (event.status == 0xff || (! options.includeDrums && event.getChannel() == 10))
+                continue;
+
+            const double beat = (double) event.tick / ticksPerQuarter;
+            auto& open = sounding[(size_t) ((event.status & 0x0f) * 128 + (event.data1 & 0x7f))];
+            lastBeat = juce::jmax (lastBeat, beat);
+
+            if (event.isNoteOn() || event.isNoteOff())
+            {
+                // A repeated note-on ends the note it repeats
+                if (open >= 0)
+                {
+                    notes[(size_t) open].end = beat;
+                    open = -1;
+                }
+
+                if (event.isNoteOn())
+                {
+                    open = (int) notes.size();
+                    notes.push_back ({ beat, -1.0, event.data1 & 0x7f, event.data2 / 127.0f });
+                }
+            }
+        }
+
+        for (auto& note : notes)
+            if (note.end < note.start)
+                note.end = lastBeat;
+
+        std::stable_sort (notes.begin(), notes.end(), [] (const Note& a, const Note& b) { return a.start < b.start; });
+        return notes;
+    }
+
+    // Whole 4-beat bars that hold every onset
+    static int getNumSteps (const std::vector<Note>& notes, int stepsPerBeat)
+    {
+        const int stepsPerBar = 4 * stepsPerBeat;
+        const int lastStep = juce::roundToInt (notes.back().start * stepsPerBeat);
+        return juce::jmax (1, (lastStep + stepsPerBar) / stepsPerBar) * stepsPerBar;
+    }
+
+    static int chooseGrid (const std::vector<Note>& notes, const std::vector<size_t>& hitStarts)
+    {
+        for (int stepsPerBeat : { 2, 3, 4, 6, 8, 12, 16 })
+        {
+            const int numSteps = getNumSteps (notes, stepsPerBeat);
+
+            if (numSteps > maxSteps)
+                break;
+
+            std::vector<bool> taken ((size_t) numSteps, false);
+            bool fits = true;
+
+            for (size_t h = 0; fits && h + 1 < hitStarts.size(); ++h)
+            {
+                const double position = notes[hitStarts[h]].start * stepsPerBeat;
+                const int gridStep = juce::roundToInt (position);
+                const auto step = (size_t) (((gridStep % numSteps) + numSteps) % numSteps);
+
+                fits = std::abs (position - gridStep) <= maxGridOffset && ! taken[step];
+                taken[step] = true;
+            }
+
+            if (fits)
+                return stepsPerBeat;
+        }
+
+        return 4;
+    }
+
+    //==========================================================================
+    // Chord shapes the root is chosen against, as interval bit masks
+    static constexpr int chordTemplates[] =
+    {
+        0x091,  // Major            0 4 7
+        0x089,  // Minor            0 3 7
+        0x049,  // Diminished       0 3 6
+        0x111,  // Augmented        0 4 8
+        0x0a1,  // Sus4             0 5 7
+        0x085,  // Sus2             0 2 7
+        0x491,  // 7                0 4 7 10
+        0x891,  // Maj7             0 4 7 11
+        0x489,  // m7               0 3 7 10
+        0x449,  // m7b5             0 3 6 10
+        0x889,  // mMaj7            0 3 7 11
+        0x291,  // 6                0 4 7 9
+        0x289,  // m6               0 3 7 9
+        0x495,  // 9                0 2 4 7 10
+        0x895,  // Maj9             0 2 4 7 11
+        0x48d   // m9               0 2 3 7 10
+    };
+
+    // Scores a root and template against the share of the loop each pitch
+    // class sounds for: the weight it explains, less the weight it leaves
+    // out and the tones it needs that never sound (a missing 5th costs
+    // little, a missing root the most), with a small cost per tone so the
+    // simpler chord wins a tie, and a bonus for the bass note
+    static double scoreChord (const std::array<double, 12>& weights, int rootPc, int chordTemplate, int bassPc)
+    {
+        double explained = 0.0, missing = 0.0, tones = 0.0;
+
+        for (int interval = 0; interval < 12; ++interval)
+        {
+            if ((chordTemplate & (1 << interval)) == 0)
+                continue;
+
+            const double weight = weights[(size_t) ((rootPc + interval) % 12)];
+            explained += weight;
+            tones += 1.0;
+
+            if (weight < minToneWeight)
+                missing += interval == 0 ? 0.25 : (interval == 7 ? 0.05 : 0.15);
+        }
+
+        return explained - (1.0 - explained) - missing - 0.01 * tones + (rootPc == bassPc ? 0.1 : 0.0);
+    }
+
+    // Share of the loop below which a pitch class counts as not played
+    static constexpr double minToneWeight = 0.02;
+
+    // The best scoring root over all 12, voiced with the pitch classes that
+    // sound for at least a sixth as long as the most sounded one
+    static DetectedChord detectChord (const std::vector<Note>& notes)
+    {
+        std::array<double, 12> sounded {};
+        int lowest = 127;
+
+        for (const auto& note : notes)
+        {
+            sounded[(size_t) (note.pitch % 12)] += juce::jmax (0.01, note.end - note.start);
+            lowest = juce::jmin (lowest, note.pitch);
+        }
+
+        double total = 0.0;
+
+        for (auto s : sounded)
+            total += s;
+
+        std::array<double, 12> weights {};
+
+        for (size_t pc = 0; pc < 12; ++pc)
+            weights[pc] = sounded[pc] / total;
+
+        int rootPc = lowest % 12;
+        double bestScore = -1.0e9;
+
+        for (int candidate = 0; candidate < 12; ++candidate)
+        {
+            for (int chordTemplate : chordTemplates)
+            {
+                const double score = scoreChord (weights, candidate, chordTemplate, lowest % 12);
+
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    rootPc = candidate;
+                }
+            }
+        }
+
+        const double most = *std::max_element (sounded.begin(), sounded.end());
+
+        NoteMask voicing;
+        voicing.insert (48 + rootPc);
+
+        for (int pc = 0; pc < 12; ++pc)
+            if (pc != rootPc && sounded[(size_t) pc] >= most / 6.0)
+                voicing.insert (48 + rootPc + ((pc - rootPc + 12) % 12));
+
+        // Comping often leaves the 5th out; the chord is named as if it were there
+        const bool hasThird = voicing.contains (48 + rootPc + 3) || voicing.contains (48 + rootPc + 4);
+        const bool hasFifth = voicing.contains (48 + rootPc + 6) || voicing.contains (48 + rootPc + 7) || voicing.contains (48 + rootPc + 8);
+
+        if (hasThird && ! hasFifth)
+            voicing.insert (48 + rootPc + 7);
+
+        // The root is the voicing's lowest note, which ChordDetector names it by
+        return ChordDetector::detect (voicing);
+    }
+
+    // Chord index for a note: 0 = root, 1 = 3rd, 2 = 5th, 3 = 7th
+    static int getRole (int pitch, int root)
+    {
+        static constexpr int roles[12] = { 0, 0, 1, 1, 1, 1, 2, 2, 2, 3, 3, 3 };
+        return roles[((pitch - root) % 12 + 12) % 12];
+    }
+
+    static void addHit (const std::vector<Note>& notes, size_t first, size_t end, int step, int root,
+                        const Options& options, RhythmPattern& pattern, double stepsPerBeat)
+    {
+        int lowest = 128;
+
+        for (size_t i = first; i < end; ++i)
+            lowest = juce::jmin (lowest, notes[i].pitch);
+
+        const double beat = step / stepsPerBeat;
+        const double durationGrid = 4.0 * stepsPerBeat;     // Durations to a quarter step
+
+        for (size_t i = first; i < end; ++i)
+        {
+            const auto& note = notes[i];
+            const int role = note.pitch == lowest && lowest < options.bassBelow ? -1 : getRole (note.pitch, root);
+            const double duration = juce::jmax (1.0, std::round ((note.end - note.start) * durationGrid)) / durationGrid;
+            const float velocity = (float) juce::roundToInt (note.velocity * 100.0f) / 100.0f;
+
+            auto existing = std::find_if (pattern.notes.begin(), pattern.notes.end(), [&] (const PatternNote& n)
+            {
+                return n.beatPosition == beat && n.chordIndex == role;
+            });
+
+            if (existing != pattern.notes.end())
+            {
+                existing->velocity = juce::jmax (existing->velocity, velocity);
+                existing->duration = juce::jmax (existing->duration, duration);
+            }
+            else
+            {
+                pattern.notes.push_back ({ beat, role, velocity, duration });
+            }
+        }
+    }
+};
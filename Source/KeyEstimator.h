@@ -0,0 +1,247 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <array>
+#include <cmath>
+
+//==============================================================================
+// Result of key estimation
+struct KeyEstimate
+{
+    int tonic { -1 };           // Pitch class of the tonic (0 = C), -1 if unknown
+    bool isMinor { false };
+    float confidence { 0.0f };  // Correlation with the winning key profile (-1..1)
+
+    bool isValid() const { return tonic >= 0; }
+
+    // Flat keys (and their relative minors) spell accidentals with flats
+    bool prefersFlats() const
+    {
+        if (! isValid())
+            return false;
+
+        const int majorTonic = isMinor ? (tonic + 3) % 12 : tonic;
+        return majorTonic == 1 || majorTonic == 3 || majorTonic == 5
+            || majorTonic == 8 || majorTonic == 10;
+    }
+
+    // Weight of a pitch class within this key (tonic = 1, least stable ~0.35)
+    float getScaleDegreeWeight (int pitchClass) const;
+
+    juce::String getName() const
+    {
+        if (! isValid())
+            return "---";
+
+        static const char* sharpNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+        static const char* flatNames[]  = { "C", "Db", "D", "Eb", "E", "F", "Gb", "G", "Ab", "A", "Bb", "B" };
+
+        return juce::String (prefersFlats() ? flatNames[tonic] : sharpNames[tonic])
+                 + (isMinor ? " minor" : " major");
+    }
+};
+
+//==============================================================================
+// Rolling key estimator.
+//
+// Keeps a time-decayed pitch-class histogram and periodically correlates it
+// against the 24 Krumhansl-Kessler key profiles. Decay is applied lazily by
+// growing the weight of new notes instead of shrinking every bin, so adding a
+// note is O(1) and advancing time is O(1) per block. The correlation runs at
+// most once per block and always costs the same 12x24 multiply-adds, laid out
+// so the inner loop over keys vectorises.
+class KeyEstimator
+{
+public:
+    //==========================================================================
+    static constexpr int numKeys = 24;  // 0-11 major, 12-23 minor
+
+    void prepare (double sampleRate, double halfLifeSeconds = 8.0, double updateIntervalSeconds = 0.25)
+    {
+        growthPerSample = std::exp (std::log (2.0) / (halfLifeSeconds * sampleRate));
+        updateIntervalSamples = juce::jmax (1, (int) (updateIntervalSeconds * sampleRate));
+        getProfiles();  // Build the profile table here rather than on the audio thread
+        reset();
+    }
+
+    void reset()
+    {
+        histogram.fill (0.0f);
+        noteWeight = 1.0;
+        samplesUntilUpdate = updateIntervalSamples;
+        estimate.store (packEstimate ({}));
+    }
+
+    //==========================================================================
+    // Audio thread: O(1)
+    void noteOn (int noteNumber, float velocity)
+    {
+        histogram[(size_t) (noteNumber % 12)] += (float) (velocity * noteWeight);
+    }
+
+    // Audio thread: advances time and refreshes the estimate when due
+    void advance (int numSamples)
+    {
+        noteWeight *= std::pow (growthPerSample, (double) numSamples);
+
+        // Renormalise before the float bins lose precision (bounded: 12 bins)
+        if (noteWeight > 1.0e6)
+        {
+            const auto scale = (float) (1.0 / noteWeight);
+            for (auto& bin : histogram)
+                bin *= scale;
+            noteWeight = 1.0;
+        }
+
+        samplesUntilUpdate -= numSamples;
+
+        if (samplesUntilUpdate <= 0)
+        {
+            samplesUntilUpdate += updateIntervalSamples;
+            if (samplesUntilUpdate <= 0)
+                samplesUntilUpdate = updateIntervalSamples;
+
+            estimate.store (packEstimate (correlate()));
+        }
+    }
+
+    // Any thread
+    KeyEstimate getEstimate() const { return unpackEstimate (estimate.load()); }
+
+    //==========================================================================
+    // Krumhansl-Kessler probe-tone profiles, indexed from the tonic
+    static const std::array<float, 12>& getMajorProfile()
+    {
+        static const std::array<float, 12> profile { 6.35f, 2.23f, 3.48f, 2.33f, 4.38f, 4.09f,
+                                                     2.52f, 5.19f, 2.39f, 3.66f, 2.29f, 2.88f };
+        return profile;
+    }
+
+    static const std::array<float, 12>& getMinorProfile()
+    {
+        static const std::array<float, 12> profile { 6.33f, 2.68f, 3.52f, 5.38f, 2.60f, 3.53f,
+                                                     2.54f, 4.75f, 3.98f, 2.69f, 3.34f, 3.17f };
+        return profile;
+    }
+
+private:
+    //==========================================================================
+    // Mean-centred, unit-length profiles, transposed to [pitchClass][key]
+    struct ProfileMatrix
+    {
+        alignas (32) float weights[12][numKeys];
+
+        ProfileMatrix()
+        {
+            for (int key = 0; key < numKeys; ++key)
+            {
+                const auto& profile = key < 12 ? getMajorProfile() : getMinorProfile();
+                const int tonic = key % 12;
+
+                float mean = 0.0f;
+                for (auto v : profile)
+                    mean += v;
+                mean /= 12.0f;
+
+                float norm = 0.0f;
+                for (auto v : profile)
+                    norm += (v - mean) * (v - mean);
+                norm = std::sqrt (norm);
+
+                for (int pc = 0; pc < 12; ++pc)
+                    weights[pc][key] = (profile[(size_t) ((pc - tonic + 12) % 12)] - mean) / norm;
+            }
+        }
+    };
+
+    static const ProfileMatrix& getProfiles()
+    {
+        static const ProfileMatrix profiles;
+        return profiles;
+    }
+
+    KeyEstimate correlate() const
+    {
+        float mean = 0.0f;
+        for (auto bin : histogram)
+            mean += bin;
+        mean /= 12.0f;
+
+        float centred[12];
+        float norm = 0.0f;
+
+        for (int pc = 0; pc < 12; ++pc)
+        {
+            centred[pc] = histogram[(size_t) pc] - mean;
+            norm += centred[pc] * centred[pc];
+        }
+
+        if (norm <= 1.0e-12f)
+            return {};
+
+        const auto& profiles = getProfiles();
+        alignas (32) float scores[numKeys] = {};
+
+        for (int pc = 0; pc < 12; ++pc)
+        {
+            const float h = centred[pc];
+            const float* row = profiles.weights[pc];
+
+            for (int key = 0; key < numKeys; ++key)
+                scores[key] += h * row[key];
+        }
+
+        int best = 0;
+        for (int key = 1; key < numKeys; ++key)
+            if (scores[key] > scores[best])
+                best = key;
+
+        KeyEstimate result;
+        result.tonic = best % 12;
+        result.isMinor = best >= 12;
+        result.confidence = scores[best] / std::sqrt (norm);
+        return result;
+    }
+
+    //==========================================================================
+    // Packed into one word so the UI and detector can read it lock-free
+    static juce::uint32 packEstimate (const KeyEstimate& k)
+    {
+        if (! k.isValid())
+            return 0;
+
+        const auto conf = (juce::uint32) juce::jlimit (0, 0xffff, (int) ((k.confidence + 1.0f) * 32767.5f));
+        return 0x80000000u | ((juce::uint32) k.tonic << 17) | ((k.isMinor ? 1u : 0u) << 16) | conf;
+    }
+
+    static KeyEstimate unpackEstimate (juce::uint32 packed)
+    {
+        KeyEstimate k;
+
+        if ((packed & 0x80000000u) != 0)
+        {
+            k.tonic = (int) ((packed >> 17) & 0x0f);
+            k.isMinor = ((packed >> 16) & 1u) != 0;
+            k.confidence = (float) (packed & 0xffffu) / 32767.5f - 1.0f;
+        }
+        return k;
+    }
+
+    //==========================================================================
+    std::array<float, 12> histogram {};
+    double noteWeight { 1.0 };
+    double growthPerSample { 1.0 };
+    int updateIntervalSamples { 11025 };
+    int samplesUntilUpdate { 11025 };
+    std::atomic<juce::uint32> estimate { 0 };
+};
+
+//==============================================================================
+inline float KeyEstimate::getScaleDegreeWeight (int pitchClass) const
+{
+    if (! isValid())
+        return 0.0f;
+
+    const auto& profile = isMinor ? KeyEstimator::getMinorProfile() : KeyEstimator::getMajorProfile();
+    return profile[(size_t) ((pitchClass - tonic + 12) % 12)] / profile[0];
+}
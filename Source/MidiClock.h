@@ -0,0 +1,307 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <atomic>
+#include <cmath>
+
+//==============================================================================
+// 24-PPQN MIDI clock output.
+//
+// Given the beat position and tempo of each block, writes a clock message at
+// the sample where each tick falls, start or song-position + continue when
+// the transport starts, and stop when it stops. A jump in position (host
+// loop or seek) is sent as stop, song position and continue.
+class MidiClockGenerator
+{
+public:
+    static constexpr int ticksPerBeat = 24;
+
+    void reset()
+    {
+        isRunning = false;
+        expectedBeat = 0.0;
+        resumeBeat = 0.0;
+    }
+
+    void process (juce::MidiBuffer& midiMessages, int numSamples, bool running,
+                  double startBeat, double bpm, double sampleRate)
+    {
+        if (! running)
+        {
+            if (isRunning)
+                midiMessages.addEvent (juce::MidiMessage::midiStop(), 0);
+
+            isRunning = false;
+            return;
+        }
+
+        const double samplesPerBeat = sampleRate * 60.0 / bpm;
+        const double endBeat = startBeat + numSamples / samplesPerBeat;
+
+        if (isRunning && std::abs (startBeat - expectedBeat) > 0.5 / ticksPerBeat)
+        {
+            midiMessages.addEvent (juce::MidiMessage::midiStop(), 0);
+            isRunning = false;
+        }
+
+        if (! isRunning)
+        {
+            // A latency-shifted timeline can start before beat 0; wait for it
+            if (endBeat <= 0.0)
+                return;
+
+            const double from = juce::jmax (0.0, startBeat);
+            const int startSample = juce::jlimit (0, numSamples - 1, (int) std::ceil ((from - startBeat) * samplesPerBeat));
+
+            if (from < 0.5 / ticksPerBeat)
+            {
+                midiMessages.addEvent (juce::MidiMessage::midiStart(), startSample);
+                resumeBeat = 0.0;
+            }
+            else
+            {
+                // Song position counts 16th notes; resume on the next one
+                const int sixteenths = (int) std::ceil (from * 4.0 - 1.0e-9);
+                midiMessages.addEvent (juce::MidiMessage::songPositionPointer (sixteenths), startSample);
+                midiMessages.addEvent (juce::MidiMessage::midiContinue(), startSample);
+                resumeBeat = sixteenths / 4.0;
+            }
+
+            isRunning = true;
+        }
+
+        // Ticks with startBeat <= beat < endBeat belong to this block
+        const auto firstTick = (juce::int64) std::ceil (juce::jmax (startBeat, resumeBeat) * ticksPerBeat);
+
+        for (auto tick = firstTick; (double) tick < endBeat * ticksPerBeat; ++tick)
+        {
+            const double offset = ((double) tick / ticksPerBeat - startBeat) * samplesPerBeat;
+            midiMessages.addEvent (juce::MidiMessage::midiClock(), juce::jlimit (0, numSamples - 1, (int) offset));
+        }
+
+        expectedBeat = endBeat;
+    }
+
+private:
+    bool isRunning { false };
+    double expectedBeat { 0.0 };
+    double resumeBeat { 0.0 };
+};
+
+//==============================================================================
+// Follows incoming MIDI clock with a second-order phase-locked loop.
+//
+// Tick arrival times from USB interfaces jitter by a millisecond or more,
+// which is a sizeable fraction of a tick at normal tempos. Each tick is
+// compared with the loop's prediction; a small share of the error corrects
+// the phase and a smaller one the period, so the beat position and tempo
+// handed to the pattern engine move smoothly. The RMS of the raw error is
+// kept as the measured jitter.
+//
+// A tick that goes missing (USB packet loss, a flooded input) leaves a gap of
+// a whole number of periods. That is counted as the ticks it stands for and
+// the loop carries on; only a gap that isn't a whole number of periods, or
+// the same kind of gap several times running, is taken as a tempo change.
+class MidiClockFollower
+{
+public:
+    static constexpr int ticksPerBeat = MidiClockGenerator::ticksPerBeat;
+
+    void prepare (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        reset();
+    }
+
+    void reset()
+    {
+        blockStartSample = 0;
+        lastTickTime = -1.0;
+        filteredTickTime = 0.0;
+        tickPeriod = 0.0;
+        skipRun = 0;
+        skippedTicks = 0;
+        tickCount = 0;
+        nextTickCount = 0;
+        songPosition = 0;
+        running = false;
+        armed = false;
+        jitterVariance = 0.0;
+        lockedFlag.store (false, std::memory_order_relaxed);
+        jitterMs.store (0.0f, std::memory_order_relaxed);
+    }
+
+    //==========================================================================
+    // Audio thread: estimates the position at the start of this block, then
+    // feeds this block's clock messages into the loop for the next one
+    void process (const juce::MidiBuffer& input, int numSamples)
+    {
+        blockStartBeat = estimateBeatAt ((double) blockStartSample);
+
+        for (const auto metadata : input)
+        {
+            if (metadata.numBytes < 1)
+                continue;
+
+            const double time = (double) (blockStartSample + metadata.samplePosition);
+
+            switch (metadata.data[0])
+            {
+                case 0xf8:  handleTick (time); break;
+                case 0xfa:  arm (0); break;                                 // Start
+                case 0xfb:  arm (songPosition * ticksPerBeat / 4); break;   // Continue
+                case 0xfc:  running = armed = false; break;                 // Stop
+
+                case 0xf2:  // Song position, in 16th notes
+                    if (metadata.numBytes >= 3)
+                        songPosition = (metadata.data[1] & 0x7f) | ((metadata.data[2] & 0x7f) << 7);
+                    break;
+
+                default:    break;
+            }
+        }
+
+        blockStartSample += numSamples;
+        lockedFlag.store (running && tickPeriod > 0.0, std::memory_order_relaxed);
+    }
+
+    bool isRunning() const              { return running && tickPeriod > 0.0; }
+    double getBeatAtBlockStart() const  { return blockStartBeat; }
+
+    double getBpm() const
+    {
+        return tickPeriod > 0.0 ? sampleRate * 60.0 / (tickPeriod * ticksPerBeat) : 0.0;
+    }
+
+    //==========================================================================
+    // Any thread
+    bool isLocked() const           { return lockedFlag.load (std::memory_order_relaxed); }
+    float getJitterMs() const       { return jitterMs.load (std::memory_order_relaxed); }
+    float getTempo() const          { return tempo.load (std::memory_order_relaxed); }
+
+private:
+    //==========================================================================
+    static constexpr double phaseGain = 0.1;
+    static constexpr double periodGain = phaseGain * phaseGain / 4.0;   // Critically damped
+    static constexpr int maxMissingTicks = 3;       // In one gap
+    static constexpr int maxSkipRun = 3;            // Gaps in a row before it's a tempo change
+
+    void arm (juce::int64 firstTick)
+    {
+        // The first clock after start/continue is the tick at the resume position
+        armed = true;
+        running = false;
+        nextTickCount = firstTick;
+    }
+
+    void handleTick (double time)
+    {
+        const int ticks = updateLoop (time);
+
+        if (armed)
+        {
+            armed = false;
+            running = true;
+            filteredTickTime = time;    // Phase restarts on the first tick
+            tickCount = nextTickCount;
+        }
+        else if (running)
+        {
+            tickCount += ticks;
+        }
+    }
+
+    // Ticks the count moves by: 1, more if ticks went missing before this
+    // one, or less when a run of gaps turns out to have been a tempo change
+    int updateLoop (double time)
+    {
+        int ticks = 1;
+
+        if (lastTickTime < 0.0)
+        {
+            lastTickTime = time;
+            filteredTickTime = time;
+            return ticks;
+        }
+
+        const double interval = time - lastTickTime;
+        lastTickTime = time;
+
+        if (tickPeriod <= 0.0)
+        {
+            tickPeriod = interval;
+            filteredTickTime = time;
+        }
+        else
+        {
+            const int elapsed = juce::jlimit (1, maxMissingTicks + 1,
+                                              (int) std::round ((time - filteredTickTime) / tickPeriod));
+            const double error = time - (filteredTickTime + elapsed * tickPeriod);
+
+            // Missing ticks are only assumed when the gap is close to whole
+            // periods; a slower tempo gives the same gap every time
+            const double tolerance = tickPeriod * (elapsed > 1 ? 0.25 : 0.5);
+            const bool tempoChanged = elapsed > 1 && skipRun >= maxSkipRun - 1;
+
+            if (std::abs (error) > tolerance || tempoChanged)
+            {
+                // Too far off to be jitter (tempo jump, dropout): relock. Ticks
+                // counted as missing in a run that was really a slower tempo
+                // are taken back
+                if (tempoChanged)
+                    ticks -= skippedTicks;
+
+                tickPeriod = interval;
+                filteredTickTime = time;
+                skipRun = 0;
+                skippedTicks = 0;
+            }
+            else
+            {
+                ticks = elapsed;
+                skipRun = elapsed > 1 ? skipRun + 1 : 0;
+                skippedTicks = elapsed > 1 ? skippedTicks + elapsed - 1 : 0;
+
+                filteredTickTime += elapsed * tickPeriod + phaseGain * error;
+                tickPeriod += periodGain * error / elapsed;
+
+                jitterVariance += 0.05 * (error * error - jitterVariance);
+                jitterMs.store ((float) (std::sqrt (jitterVariance) / sampleRate * 1000.0), std::memory_order_relaxed);
+            }
+        }
+
+        tempo.store ((float) getBpm(), std::memory_order_relaxed);
+        return ticks;
+    }
+
+    double estimateBeatAt (double time) const
+    {
+        if (! isRunning())
+            return blockStartBeat;
+
+        // Don't run more than a tick ahead if the clock stops arriving
+        const double ticksSince = juce::jlimit (0.0, 1.0, (time - filteredTickTime) / tickPeriod);
+        return ((double) tickCount + ticksSince) / ticksPerBeat;
+    }
+
+    //==========================================================================
+    double sampleRate { 44100.0 };
+    juce::int64 blockStartSample { 0 };
+    double blockStartBeat { 0.0 };
+
+    double lastTickTime { -1.0 };       // Raw arrival of the previous tick
+    double filteredTickTime { 0.0 };    // Loop's estimate of the latest tick
+    double tickPeriod { 0.0 };          // Samples per tick, 0 = not locked yet
+    int skipRun { 0 };                  // Gaps with missing ticks in a row
+    int skippedTicks { 0 };             // ... and the ticks counted for them
+    juce::int64 tickCount { 0 };
+    juce::int64 nextTickCount { 0 };
+    int songPosition { 0 };
+    bool running { false };
+    bool armed { false };
+    double jitterVariance { 0.0 };
+
+    std::atomic<bool> lockedFlag { false };
+    std::atomic<float> jitterMs { 0.0f };
+    std::atomic<float> tempo { 0.0f };
+};
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <vector>
+
+//==============================================================================
+// A single event pulled from a Standard MIDI File
+struct MidiStreamEvent
+{
+    juce::int64 tick { 0 };         // Absolute tick position
+    double timeSeconds { 0.0 };     // Absolute time, following the file's tempo map
+    int track { 0 };
+    juce::uint8 status { 0 };       // Channel status byte, or 0xff for meta events
+    juce::uint8 data1 { 0 };        // Note / controller number, or meta type
+    juce::uint8 data2 { 0 };        // Velocity / controller value
+
+    bool isNoteOn() const   { return (status & 0xf0) == 0x90 && data2 > 0; }
+    bool isNoteOff() const  { return (status & 0xf0) == 0x80 || ((status & 0xf0) == 0x90 && data2 == 0); }
+    int getChannel() const  { return (status & 0x0f) + 1; }
+};
+
+//==============================================================================
+// Streaming Standard MIDI File reader.
+//
+// Works directly on the file bytes (typically a MemoryMappedFile) and decodes
+// each track lazily through a cursor, merging the tracks in tick order. Only
+// one cursor per track is kept in memory, so memory use depends on the number
+// of tracks rather than the number of events. Tempo changes from any track
+// are applied as they are reached, so event times follow the tempo map.
+class MidiFileStreamReader
+{
+public:
+    //==========================================================================
+    // Parses the header and locates the track chunks. Returns false if the
+    // data is not a Standard MIDI File.
+    bool open (const void* fileData, size_t fileSize)
+    {
+        data = static_cast<const juce::uint8*> (fileData);
+        size = fileSize;
+        cursors.clear();
+        trackOffsets.clear();
+
+        if (data == nullptr || size < 14 || std::memcmp (data, "MThd", 4) != 0)
+            return false;
+
+        const auto headerLength = readBE32 (data + 4);
+        if (headerLength < 6 || 8 + (size_t) headerLength > size)
+            return false;
+
+        format = readBE16 (data + 8);
+        const int declaredTracks = readBE16 (data + 10);
+        const auto division = readBE16 (data + 12);
+
+        if ((division & 0x8000) != 0)
+        {
+            // SMPTE: -frames per second in the high byte, ticks per frame in the low byte
+            const int framesPerSecond = -(juce::int8) (division >> 8);
+            const int ticksPerFrame = division & 0xff;
+            secondsPerTickSmpte = 1.0 / juce::jmax (1, framesPerSecond * ticksPerFrame);
+            ticksPerQuarter = 0;
+        }
+        else
+        {
+            ticksPerQuarter = juce::jmax (1, (int) division);
+            secondsPerTickSmpte = 0.0;
+        }
+
+        // Locate the MTrk chunks, skipping any unknown chunk types
+        size_t pos = 8 + headerLength;
+
+        while (pos + 8 <= size && (int) trackOffsets.size() < declaredTracks)
+        {
+            const auto chunkLength = (size_t) readBE32 (data + pos + 4);
+            const auto chunkEnd = juce::jmin (size, pos + 8 + chunkLength);
+
+            if (std::memcmp (data + pos, "MTrk", 4) == 0)
+                trackOffsets.push_back ({ pos + 8, chunkEnd });
+
+            pos = pos + 8 + chunkLength;
+        }
+
+        selectTracks ({});
+        return true;
+    }
+
+    int getNumTracks() const        { return (int) trackOffsets.size(); }
+    int getFormat() const           { return format; }
+    int getTicksPerQuarter() const  { return ticksPerQuarter; }
+
+    //==========================================================================
+    // Restricts streaming to the given tracks (empty = all tracks) and rewinds
+    void selectTracks (const std::vector<int>& tracks)
+    {
+        cursors.clear();
+
+        for (int t = 0; t < getNumTracks(); ++t)
+        {
+            if (tracks.empty() || std::find (tracks.begin(), tracks.end(), t) != tracks.end())
+            {
+                TrackCursor c;
+                c.track = t;
+                c.pos = trackOffsets[(size_t) t].start;
+                c.end = trackOffsets[(size_t) t].end;
+                readDelta (c);
+                cursors.push_back (c);
+            }
+        }
+
+        tempoTick = 0;
+        tempoSeconds = 0.0;
+        microsPerQuarter = 500000.0;
+    }
+
+    //==========================================================================
+    // Returns the next event across the selected tracks in tick order
+    bool next (MidiStreamEvent& event)
+    {
+        for (;;)
+        {
+            TrackCursor* earliest = nullptr;
+
+            for (auto& c : cursors)
+                if (! c.finished && (earliest == nullptr || c.nextTick < earliest->nextTick))
+                    earliest = &c;
+
+            if (earliest == nullptr)
+                return false;
+
+            if (readEvent (*earliest, event))
+                return true;
+        }
+    }
+
+private:
+    //==========================================================================
+    struct TrackRange { size_t start, end; };
+
+    struct TrackCursor
+    {
+        int track { 0 };
+        size_t pos { 0 }, end { 0 };
+        juce::int64 nextTick { 0 };
+        juce::uint8 runningStatus { 0 };
+        bool finished { false };
+    };
+
+    //==========================================================================
+    // Decodes one event from the cursor. Returns false for events that are
+    // consumed internally (tempo, sysex, other meta).
+    bool readEvent (TrackCursor& c, MidiStreamEvent& event)
+    {
+        if (c.pos >= c.end)
+        {
+            c.finished = true;
+            return false;
+        }
+
+        const auto tick = c.nextTick;
+        auto status = data[c.pos];
+
+        if (status < 0x80)
+        {
+            // Running status - reuse the previous channel status byte
+            if (c.runningStatus == 0)
+            {
+                c.finished = true;
+                return false;
+            }
+            status = c.runningStatus;
+        }
+        else
+        {
+            ++c.pos;
+        }
+
+        bool isReportable = false;
+
+        if (status == 0xff)
+        {
+            if (c.pos >= c.end) { c.finished = true; return false; }
+
+            const auto type = data[c.pos++];
+            const auto length = (size_t) readVarLen (c);
+
+            if (type == 0x51 && length >= 3 && c.pos + 3 <= c.end)
+            {
+                updateTempoMap (tick, (data[c.pos] << 16) | (data[c.pos + 1] << 8) | data[c.pos + 2]);
+            }
+            else if (type == 0x2f)
+            {
+                c.finished = true;
+                return false;
+            }
+
+            c.pos += length;
+        }
+        else if (status == 0xf0 || status == 0xf7)
+        {
+            c.pos += (size_t) readVarLen (c);
+        }
+        else if (status >= 0xf0)
+        {
+            // System common/realtime bytes have no place in a file - stop this track
+            c.finished = true;
+            return false;
+        }
+        else
+        {
+            c.runningStatus = status;
+            const int numDataBytes = ((status & 0xf0) == 0xc0 || (status & 0xf0) == 0xd0) ? 1 : 2;
+
+            if (c.pos + (size_t) numDataBytes > c.end)
+            {
+                c.finished = true;
+                return false;
+            }
+
+            event.tick = tick;
+            event.timeSeconds = tickToSeconds (tick);
+            event.track = c.track;
+            event.status = status;
+            event.data1 = data[c.pos] & 0x7f;
+            event.data2 = numDataBytes > 1 ? (data[c.pos + 1] & 0x7f) : 0;
+            c.pos += (size_t) numDataBytes;
+            isReportable = true;
+        }
+
+        readDelta (c);
+        return isReportable;
+    }
+
+    void readDelta (TrackCursor& c)
+    {
+        if (c.pos >= c.end)
+        {
+            c.finished = true;
+            return;
+        }
+        c.nextTick += readVarLen (c);
+    }
+
+    juce::uint32 readVarLen (TrackCursor& c) const
+    {
+        juce::uint32 value = 0;
+
+        for (int i = 0; i < 4 && c.pos < c.end; ++i)
+        {
+            const auto byte = data[c.pos++];
+            value = (value << 7) | (byte & 0x7f);
+
+            if ((byte & 0x80) == 0)
+                break;
+        }
+        return value;
+    }
+
+    //==========================================================================
+    void updateTempoMap (juce::int64 tick, int newMicrosPerQuarter)
+    {
+        tempoSeconds = tickToSeconds (tick);
+        tempoTick = tick;
+
+        if (newMicrosPerQuarter > 0)
+            microsPerQuarter = newMicrosPerQuarter;
+    }
+
+    double tickToSeconds (juce::int64 tick) const
+    {
+        if (ticksPerQuarter == 0)
+            return (double) tick * secondsPerTickSmpte;
+
+        return tempoSeconds + (double) (tick - tempoTick) * microsPerQuarter * 1.0e-6 / ticksPerQuarter;
+    }
+
+    static juce::uint32 readBE32 (const juce::uint8* p) { return ((juce::uint32) p[0] << 24) | ((juce::uint32) p[1] << 16) | ((juce::uint32) p[2] << 8) | p[3]; }
+    static juce::uint16 readBE16 (const juce::uint8* p) { return (juce::uint16) ((p[0] << 8) | p[1]); }
+
+    //==========================================================================
+    const juce::uint8* data { nullptr };
+    size_t size { 0 };
+    int format { 0 };
+    int ticksPerQuarter { 480 };
+    double secondsPerTickSmpte { 0.0 };
+
+    std::vector<TrackRange> trackOffsets;
+    std::vector<TrackCursor> cursors;
+
+    juce::int64 tempoTick { 0 };
+    double tempoSeconds { 0.0 };
+    double microsPerQuarter { 500000.0 };
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "ChordEngineBank.h"
+#include <array>
+
+//==============================================================================
+// The part of an input message the chord follower acts on
+struct InputEvent
+{
+    enum Type : juce::uint8
+    {
+        ignored,
+        noteOn,
+        noteOff,
+        sustain,            // CC64
+        sostenuto,          // CC66
+        allNotesOff,        // CC120, CC123 and the mode messages CC124-127
+        resetControllers    // CC121: pedals up
+    };
+
+    Type type { ignored };
+    juce::uint8 channel { 0 };  // 0-15
+    juce::uint8 data1 { 0 };    // Note or controller number
+    juce::uint8 data2 { 0 };    // Velocity or controller value
+};
+
+//==============================================================================
+// Decodes input straight from the MidiBuffer bytes, without building a
+// MidiMessage per event.
+//
+// A message is classified by two table lookups: the status nibble, then the
+// controller number for control changes. Everything the follower ignores -
+// pressure, pitch bend, other controllers, system messages - drops out on
+// the first lookup or the length check, which keeps dense MPE and aftertouch
+// streams cheap. Channels outside the mask are skipped before decoding.
+class MidiInputDecoder
+{
+public:
+    static constexpr juce::uint16 allChannels = 0xffff;
+
+    void setChannelMask (juce::uint16 newMask) noexcept    { channelMask = newMask; }
+    juce::uint16 getChannelMask() const noexcept            { return channelMask; }
+
+    // Calls handler (const InputEvent&, int samplePosition) for each event
+    // that isn't ignored, in buffer order
+    template <typename Handler>
+    void decode (const juce::MidiBuffer& buffer, Handler&& handler) const
+    {
+        for (const auto metadata : buffer)
+        {
+            const auto type = classify (metadata.data, metadata.numBytes);
+
+            if (type == InputEvent::ignored)
+                continue;
+
+            const auto* data = metadata.data;
+            handler (InputEvent { type, (juce::uint8) (data[0] & 0x0f), (juce::uint8) (data[1] & 0x7f), (juce::uint8) (data[2] & 0x7f) },
+                     metadata.samplePosition);
+        }
+    }
+
+    // What the follower makes of one raw message; ignored for anything it
+    // doesn't use or that is on a channel outside the mask
+    InputEvent::Type classify (const juce::uint8* data, int numBytes) const noexcept
+    {
+        // Every message the follower uses is three bytes long
+        if (numBytes != 3)
+            return InputEvent::ignored;
+
+        const int status = data[0];
+
+        if (((channelMask >> (status & 0x0f)) & 1) == 0)
+            return InputEvent::ignored;
+
+        auto type = statusTypes[(size_t) (status >> 4)];
+
+        if (type == controlChange)
+            type = controllerTypes[(size_t) (data[1] & 0x7f)];
+
+        // Note-on with velocity 0 is a note-off
+        if (type == InputEvent::noteOn && data[2] == 0)
+            type = InputEvent::noteOff;
+
+        return type;
+    }
+
+private:
+    // Placeholder in the status table, resolved by the controller table
+    static constexpr auto controlChange = (InputEvent::Type) 0xff;
+
+    static constexpr std::array<InputEvent::Type, 16> statusTypes {{
+        InputEvent::ignored, InputEvent::ignored, InputEvent::ignored, InputEvent::ignored,
+        InputEvent::ignored, InputEvent::ignored, InputEvent::ignored, InputEvent::ignored,
+        InputEvent::noteOff, InputEvent::noteOn,  InputEvent::ignored, controlChange,
+        InputEvent::ignored, InputEvent::ignored, InputEvent::ignored, InputEvent::ignored
+    }};
+
+    static constexpr std::array<InputEvent::Type, 128> controllerTypes = []
+    {
+        std::array<InputEvent::Type, 128> types {};
+        types[64] = InputEvent::sustain;
+        types[66] = InputEvent::sostenuto;
+        types[120] = InputEvent::allNotesOff;
+        types[121] = InputEvent::resetControllers;
+
+        for (int cc = 123; cc < 128; ++cc)
+            types[(size_t) cc] = InputEvent::allNotesOff;
+
+        return types;
+    }();
+
+    juce::uint16 channelMask { allChannels };
+};
+
+//==============================================================================
+// Which input notes are sounding on each channel, following the pedals.
+//
+// A note sounds while its key is down, after release while the sustain
+// pedal is down, and - if its key was down when the sostenuto pedal went
+// down - until that pedal comes up. Releases return the notes that actually
+// stopped, so a note-off under the pedal leaves the chord alone and a pedal
+// release can end several notes at once.
+class InputNoteTracker
+{
+public:
+    void reset()
+    {
+        for (auto& channel : channels)
+            channel = {};
+    }
+
+    bool isSounding (int channel, int note) const
+    {
+        const auto& c = channels[(size_t) channel];
+        return c.keysDown.contains (note) || c.sustained.contains (note) || c.latched.contains (note);
+    }
+
+    // Channels (bit n = channel n) on which the note sounds
+    juce::uint16 getChannelsSounding (int note) const
+    {
+        juce::uint16 mask = 0;
+
+        for (int c = 0; c < 16; ++c)
+            if (isSounding (c, note))
+                mask |= (juce::uint16) (1 << c);
+
+        return mask;
+    }
+
+    void noteOn (int channel, int note)
+    {
+        channels[(size_t) channel].keysDown.insert (note);
+    }
+
+    // True if the note stopped sounding
+    bool noteOff (int channel, int note)
+    {
+        auto& c = channels[(size_t) channel];
+        c.keysDown.erase (note);
+
+        if (c.sustainDown)
+            c.sustained.insert (note);
+
+        return ! isSounding (channel, note);
+    }
+
+    // Each of these returns the notes that stopped sounding
+    NoteMask setSustain (int channel, bool isDown)
+    {
+        auto& c = channels[(size_t) channel];
+        c.sustainDown = isDown;
+
+        if (isDown)
+            return {};
+
+        auto released = c.sustained;
+        c.sustained.clear();
+        released -= c.keysDown;
+        released -= c.latched;
+        return released;
+    }
+
+    NoteMask setSostenuto (int channel, bool isDown)
+    {
+        auto& c = channels[(size_t) channel];
+
+        if (isDown == c.sostenutoDown)
+            return {};
+
+        c.sostenutoDown = isDown;
+
+        if (isDown)
+        {
+            // Only the keys down right now are caught
+            c.latched = c.keysDown;
+            return {};
+        }
+
+        auto released = c.latched;
+        c.latched.clear();
+        released -= c.keysDown;
+        released -= c.sustained;
+        return released;
+    }
+
+    NoteMask allNotesOff (int channel)
+    {
+        auto& c = channels[(size_t) channel];
+        auto released = c.keysDown;
+        released |= c.sustained;
+        released |= c.latched;
+        c.keysDown.clear();
+        c.sustained.clear();
+        c.latched.clear();
+        return released;
+    }
+
+    NoteMask resetControllers (int channel)
+    {
+        auto released = setSustain (channel, false);
+        released |= setSostenuto (channel, false);
+        return released;
+    }
+
+private:
+    struct ChannelState
+    {
+        NoteMask keysDown, sustained, latched;
+        bool sustainDown { false }, sostenutoDown { false };
+    };
+
+    std::array<ChannelState, 16> channels;
+};
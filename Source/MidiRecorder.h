@@ -0,0 +1,411 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <utility>
+#include <vector>
+
+//==============================================================================
+// Records the generated output to a Standard MIDI File.
+//
+// The audio thread only copies each block's channel messages, stamped with
+// their sample position since the take started, into a preallocated
+// single-producer ring; tempo and sample-rate changes go in as timing
+// events. If the ring is full the event is counted as dropped. A background
+// thread drains the ring every 50 ms, converts sample positions to ticks
+// through the recorded tempo map and streams the track to disk, so a take
+// can run for hours without the audio thread touching the file system, a
+// lock or the heap.
+class MidiRecorder final : private juce::Thread
+{
+public:
+    static constexpr int ringSize = 1 << 16;
+    static constexpr int ticksPerQuarterNote = 960;
+
+    MidiRecorder() : juce::Thread ("MIDI recorder"), events ((size_t) ringSize) {}
+
+    ~MidiRecorder() override
+    {
+        stop();
+        stopThread (4000);      // run() closes the file on the way out
+    }
+
+    //==========================================================================
+    // Message thread. Starting a new take finishes the current one first.
+    void start (const juce::File& file)
+    {
+        const auto newGeneration = ++lastGeneration;
+
+        {
+            const juce::ScopedLock sl (commandLock);
+            stopPending = true;
+            pendingFile = file;
+            pendingGeneration = newGeneration;
+        }
+
+        writeFailed = false;
+        eventsWritten = 0;
+        droppedEvents = 0;
+        recordedSeconds = 0.0;
+        generation.store (newGeneration, std::memory_order_release);
+
+        if (! isThreadRunning())
+            startThread (juce::Thread::Priority::low);
+
+        notify();
+    }
+
+    void stop()
+    {
+        generation.store (0, std::memory_order_release);
+
+        {
+            const juce::ScopedLock sl (commandLock);
+            stopPending = true;
+            pendingFile = juce::File();
+        }
+
+        notify();
+    }
+
+    bool isRecording() const            { return generation.load() != 0; }
+    bool hasWriteFailed() const         { return writeFailed.load(); }
+    juce::int64 getEventsWritten() const { return eventsWritten.load(); }
+    int getDroppedEvents() const        { return droppedEvents.load(); }
+    double getRecordedSeconds() const   { return recordedSeconds.load(); }
+
+    juce::File getCurrentFile() const
+    {
+        const juce::ScopedLock sl (commandLock);
+        return currentFile;
+    }
+
+    static juce::File getDefaultTakeFile()
+    {
+        return juce::File::getSpecialLocation (juce::File::userDocumentsDirectory)
+                 .getChildFile ("Chord Pattern Player Recordings")
+                 .getChildFile ("take-" + juce::Time::getCurrentTime().formatted ("%Y%m%d-%H%M%S") + ".mid");
+    }
+
+    //==========================================================================
+    // Audio thread: call with the block's final output
+    void process (const juce::MidiBuffer& midiMessages, int numSamples, double bpm, double sampleRate) noexcept
+    {
+        const auto currentGeneration = generation.load (std::memory_order_acquire);
+
+        if (currentGeneration == 0)
+            return;
+
+        if (currentGeneration != audioGeneration)
+        {
+            // New take: its timeline starts here
+            audioGeneration = currentGeneration;
+            takeSample = 0;
+            lastBpm = 0.0;
+            lastSampleRate = 0.0;
+        }
+
+        if (bpm != lastBpm || sampleRate != lastSampleRate)
+        {
+            push ({ takeSample, (float) bpm, (float) sampleRate, audioGeneration, {}, 0 });
+            lastBpm = bpm;
+            lastSampleRate = sampleRate;
+        }
+
+        for (const auto metadata : midiMessages)
+        {
+            // Channel messages only; clock and other system messages stay out
+            if (metadata.numBytes < 1 || metadata.numBytes > 3 || metadata.data[0] < 0x80 || metadata.data[0] >= 0xf0)
+                continue;
+
+            Event event { takeSample + metadata.samplePosition, 0.0f, 0.0f, audioGeneration, {}, (juce::uint8) metadata.numBytes };
+            std::copy (metadata.data, metadata.data + metadata.numBytes, event.bytes);
+            push (event);
+        }
+
+        takeSample += numSamples;
+        recordedSeconds.store ((double) takeSample / sampleRate, std::memory_order_relaxed);
+    }
+
+private:
+    //==========================================================================
+    struct Event
+    {
+        juce::int64 sample;
+        float bpm;                  // Timing events only
+        float sampleRate;
+        juce::uint32 generation;    // Take the event belongs to
+        juce::uint8 bytes[3];
+        juce::uint8 numBytes;       // 0 = timing event
+    };
+
+    void push (const Event& event) noexcept
+    {
+        const auto scope = fifo.write (1);
+
+        if (scope.blockSize1 + scope.blockSize2 == 0)
+        {
+            droppedEvents.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+
+        scope.forEach ([&] (int index) { events[(size_t) index] = event; });
+    }
+
+    //==========================================================================
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait (50);
+            service();
+        }
+
+        drain();
+        finishFile();
+    }
+
+    void service()
+    {
+        bool shouldStop;
+        juce::File fileToOpen;
+        juce::uint32 newGeneration;
+
+        {
+            const juce::ScopedLock sl (commandLock);
+            shouldStop = std::exchange (stopPending, false);
+            fileToOpen = std::exchange (pendingFile, juce::File());
+            newGeneration = pendingGeneration;
+        }
+
+        if (shouldStop)
+        {
+            drain();
+            finishFile();
+        }
+
+        if (fileToOpen != juce::File())
+            openFile (fileToOpen, newGeneration);
+
+        drain();
+    }
+
+    // Writes the current take's events. Events from an older take are
+    // dropped; a newer take's events wait in the ring until its file opens.
+    void drain()
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (fifo.getNumReady(), start1, size1, start2, size2);
+
+        int consumed = 0;
+
+        for (int i = 0; i < size1 + size2; ++i)
+        {
+            const auto& event = events[(size_t) (i < size1 ? start1 + i : start2 + i - size1)];
+
+            if (event.generation > fileGeneration)
+                break;
+
+            if (event.generation == fileGeneration && output != nullptr)
+                writeEvent (event);
+
+            ++consumed;
+        }
+
+        fifo.finishedRead (consumed);
+
+        if (output != nullptr)
+            output->flush();
+    }
+
+    //==========================================================================
+    void openFile (const juce::File& file, juce::uint32 takeGeneration)
+    {
+        file.getParentDirectory().createDirectory();
+        file.deleteFile();
+
+        auto stream = std::make_unique<juce::FileOutputStream> (file);
+
+        if (! stream->openedOk())
+        {
+            writeFailed = true;
+            fileGeneration = takeGeneration;     // Its events are discarded
+            return;
+        }
+
+        output = std::move (stream);
+        fileGeneration = takeGeneration;
+
+        {
+            const juce::ScopedLock sl (commandLock);
+            currentFile = file;
+        }
+
+        // Format 0, one track
+        output->write ("MThd", 4);
+        output->writeIntBigEndian (6);
+        output->writeShortBigEndian (0);
+        output->writeShortBigEndian (1);
+        output->writeShortBigEndian ((short) ticksPerQuarterNote);
+
+        output->write ("MTrk", 4);
+        trackLengthPosition = output->getPosition();
+        output->writeIntBigEndian (0);          // Patched when the take ends
+        trackStart = output->getPosition();
+
+        const juce::String trackName ("Chord Pattern Player");
+        writeDelta (0);
+        writeBytes ({ 0xff, 0x03 });
+        writeVariableLength ((juce::uint32) trackName.getNumBytesAsUTF8());
+        output->write (trackName.toRawUTF8(), trackName.getNumBytesAsUTF8());
+
+        lastTick = 0;
+        timingSample = 0;
+        timingTick = 0.0;
+        samplesPerTick = 0.0;
+        lastTempoBpm = 0.0f;
+
+        for (auto& notes : soundingNotes)
+            notes.reset();
+    }
+
+    void finishFile()
+    {
+        if (output == nullptr)
+            return;
+
+        // Close notes whose note-off was never recorded (dropped, or still
+        // pending when the take stopped)
+        for (int channel = 0; channel < 16; ++channel)
+        {
+            for (int note = 0; note < 128; ++note)
+            {
+                if (soundingNotes[(size_t) channel][(size_t) note])
+                {
+                    writeDelta (lastTick);
+                    writeBytes ({ (juce::uint8) (0x80 | channel), (juce::uint8) note, 0 });
+                }
+            }
+        }
+
+        writeDelta (lastTick);
+        writeBytes ({ 0xff, 0x2f, 0x00 });
+
+        const auto end = output->getPosition();
+        output->setPosition (trackLengthPosition);
+        output->writeIntBigEndian ((int) (end - trackStart));
+        output->flush();
+        output.reset();
+        fileGeneration = 0;
+    }
+
+    //==========================================================================
+    void writeEvent (const Event& event)
+    {
+        const auto tick = tickForSample (event.sample);
+
+        if (event.numBytes == 0)
+        {
+            // Timing change: later positions convert at the new rate
+            timingTick = (double) tick;
+            timingSample = event.sample;
+            samplesPerTick = event.sampleRate * 60.0 / (event.bpm * ticksPerQuarterNote);
+
+            if (event.bpm != lastTempoBpm)
+            {
+                const auto microsPerQuarter = (juce::uint32) juce::roundToInt (60.0e6 / event.bpm);
+                writeDelta (tick);
+                writeBytes ({ 0xff, 0x51, 0x03,
+                              (juce::uint8) (microsPerQuarter >> 16), (juce::uint8) (microsPerQuarter >> 8),
+                              (juce::uint8) microsPerQuarter });
+                lastTempoBpm = event.bpm;
+            }
+            return;
+        }
+
+        const int status = event.bytes[0] & 0xf0;
+        const int channel = event.bytes[0] & 0x0f;
+
+        if (status == 0x90 && event.numBytes == 3 && event.bytes[2] > 0)
+            soundingNotes[(size_t) channel].set (event.bytes[1] & 0x7f);
+        else if ((status == 0x80 || status == 0x90) && event.numBytes >= 2)
+            soundingNotes[(size_t) channel].reset (event.bytes[1] & 0x7f);
+
+        writeDelta (tick);
+        output->write (event.bytes, event.numBytes);
+        eventsWritten.fetch_add (1, std::memory_order_relaxed);
+    }
+
+    juce::int64 tickForSample (juce::int64 sample) const
+    {
+        if (samplesPerTick <= 0.0)
+            return lastTick;
+
+        // Events are written in time order; never step backwards
+        const auto tick = (juce::int64) std::llround (timingTick + (double) (sample - timingSample) / samplesPerTick);
+        return juce::jmax (lastTick, tick);
+    }
+
+    void writeDelta (juce::int64 tick)
+    {
+        writeVariableLength ((juce::uint32) juce::jmax<juce::int64> (0, tick - lastTick));
+        lastTick = juce::jmax (lastTick, tick);
+    }
+
+    void writeVariableLength (juce::uint32 value)
+    {
+        juce::uint8 buffer[5];
+        int length = 0;
+        buffer[length++] = (juce::uint8) (value & 0x7f);
+
+        while ((value >>= 7) != 0)
+            buffer[length++] = (juce::uint8) ((value & 0x7f) | 0x80);
+
+        while (length > 0)
+            output->writeByte ((char) buffer[--length]);
+    }
+
+    void writeBytes (std::initializer_list<juce::uint8> bytes)
+    {
+        for (auto b : bytes)
+            output->writeByte ((char) b);
+    }
+
+    //==========================================================================
+    // Audio thread -> writer
+    juce::AbstractFifo fifo { ringSize };
+    std::vector<Event> events;
+
+    // Audio thread only
+    juce::uint32 audioGeneration { 0 };
+    juce::int64 takeSample { 0 };
+    double lastBpm { 0.0 }, lastSampleRate { 0.0 };
+
+    // Message thread -> writer
+    juce::CriticalSection commandLock;
+    bool stopPending { false };
+    juce::File pendingFile, currentFile;
+    juce::uint32 pendingGeneration { 0 };
+    juce::uint32 lastGeneration { 0 };      // Message thread only
+    std::atomic<juce::uint32> generation { 0 };
+
+    // Writer thread only
+    std::unique_ptr<juce::FileOutputStream> output;
+    juce::uint32 fileGeneration { 0 };
+    juce::int64 trackLengthPosition { 0 }, trackStart { 0 };
+    juce::int64 lastTick { 0 };
+    juce::int64 timingSample { 0 };
+    double timingTick { 0.0 }, samplesPerTick { 0.0 };
+    float lastTempoBpm { 0.0f };
+    std::array<std::bitset<128>, 16> soundingNotes;
+
+    // Stats, any thread
+    std::atomic<bool> writeFailed { false };
+    std::atomic<juce::int64> eventsWritten { 0 };
+    std::atomic<int> droppedEvents { 0 };
+    std::atomic<double> recordedSeconds { 0.0 };
+
+    JUCE_DECLARE_NON_COPYABLE (MidiRecorder)
+};
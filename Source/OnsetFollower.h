@@ -0,0 +1,540 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_dsp/juce_dsp.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Onsets in the audio input, from spectral flux.
+//
+// Every hop a Hann-windowed frame of the latest windowSize samples is
+// transformed, and its flux is the summed rise in magnitude of every bin
+// over the previous frame. The threshold adapts to the playing:
+// thresholdRatio times the mean of the last historySize flux values plus
+// thresholdDeviations times their mean absolute deviation, with a floor for
+// silence, so steady noise and a ringing tail don't count as hits. An onset
+// is the frame where the flux first rises above it, at least
+// minInterOnsetSeconds after the last one.
+//
+// Where the hit began is then found in the time domain, as the first of the
+// frame's newest samples to reach half their peak level. Each onset carries
+// both the sample it was found at, the earliest anything can react to it,
+// and the samples since the hit began, which is the onset-to-MIDI latency
+// of a note sent in reaction.
+//
+// Work is fixed per block: at most maxFramesPerBlock frames are analysed.
+// A block with more hops than that analyses every second (third, ...) one
+// and counts the others as skipped.
+class OnsetDetector
+{
+public:
+    static constexpr int fftOrder = 9;
+    static constexpr int windowSize = 1 << fftOrder;        // 512 samples
+    static constexpr int hopSize = 128;
+    static constexpr int numBins = windowSize / 2 + 1;
+    static constexpr int historySize = 64;                  // About 170 ms at 48 kHz
+    static constexpr int maxFramesPerBlock = 32;
+    static constexpr int maxOnsetsPerBlock = 8;
+
+    static constexpr float thresholdRatio = 1.5f;
+    static constexpr float thresholdDeviations = 2.0f;
+    static constexpr float minFlux = 1.0e-3f * windowSize * 0.25f;    // A -60 dBFS hit
+    static constexpr double minInterOnsetSeconds = 0.05;
+
+    struct Onset
+    {
+        int sample;             // In this block, where it was found
+        int latencySamples;     // From the start of the hit to sample
+        float strength;         // Flux over threshold
+    };
+
+    //==========================================================================
+    // Allocates. Call from prepareToPlay.
+    void prepare (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        fft = std::make_unique<juce::dsp::FFT> (fftOrder);
+        window.resize ((size_t) windowSize);
+        juce::dsp::WindowingFunction<float>::fillWindowingTables (window.data(), (size_t) windowSize,
+                                                                  juce::dsp::WindowingFunction<float>::hann, false);
+        ring.assign ((size_t) ringSize, 0.0f);
+        frame.assign ((size_t) windowSize * 2, 0.0f);
+        previous.assign ((size_t) numBins, 0.0f);
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        std::fill (ring.begin(), ring.end(), 0.0f);
+        std::fill (previous.begin(), previous.end(), 0.0f);
+        history.fill (0.0f);
+        historyPosition = 0;
+        writePosition = 0;
+        samplesSinceFrame = 0;
+        samplesSinceOnset = 0;
+        wasAbove = false;
+        numOnsets = 0;
+    }
+
+    //==========================================================================
+    // Audio thread. Finds this block's onsets, in order.
+    void process (const juce::AudioBuffer<float>& buffer, int numChannels, int numSamples) noexcept
+    {
+        numOnsets = 0;
+        numChannels = juce::jmin (numChannels, buffer.getNumChannels());
+
+        if (numChannels <= 0 || ring.empty())
+            return;
+
+        const int framesDue = (samplesSinceFrame + numSamples) / hopSize;
+        const int stride = (framesDue + maxFramesPerBlock - 1) / maxFramesPerBlock;
+        int frameIndex = 0;
+        int position = 0;
+
+        while (position < numSamples)
+        {
+            const int n = juce::jmin (numSamples - position, hopSize - samplesSinceFrame);
+            writeToRing (buffer, numChannels, position, n);
+            position += n;
+            samplesSinceFrame += n;
+            samplesSinceOnset += n;
+
+            if (samplesSinceFrame < hopSize)
+                break;
+
+            samplesSinceFrame = 0;
+
+            if (frameIndex++ % stride == 0)
+                analyse (position - 1);
+            else
+                skippedFrames.fetch_add (1, std::memory_order_relaxed);
+        }
+    }
+
+    const Onset* getOnsets() const noexcept     { return onsets.data(); }
+    int getNumOnsets() const noexcept           { return numOnsets; }
+
+    //==========================================================================
+    // Any thread
+    int getSkippedFrames() const noexcept       { return skippedFrames.load (std::memory_order_relaxed); }
+
+private:
+    static constexpr int ringSize = windowSize * 2;
+
+    void writeToRing (const juce::AudioBuffer<float>& buffer, int numChannels, int start, int numSamples) noexcept
+    {
+        const float gain = 1.0f / (float) numChannels;
+
+        while (numSamples > 0)
+        {
+            const int n = juce::jmin (numSamples, ringSize - writePosition);
+            auto* dest = ring.data() + writePosition;
+
+            juce::FloatVectorOperations::copyWithMultiply (dest, buffer.getReadPointer (0, start), gain, n);
+
+            for (int c = 1; c < numChannels; ++c)
+                juce::FloatVectorOperations::addWithMultiply (dest, buffer.getReadPointer (c, start), gain, n);
+
+            start += n;
+            numSamples -= n;
+            writePosition = (writePosition + n) & (ringSize - 1);
+        }
+    }
+
+    //==========================================================================
+    // The frame ends on the newest sample in the ring, which is blockSample
+    void analyse (int blockSample) noexcept
+    {
+        const int start = (writePosition - windowSize) & (ringSize - 1);
+        const int first = juce::jmin (windowSize, ringSize - start);
+
+        std::copy (ring.data() + start, ring.data() + start + first, frame.data());
+        std::copy (ring.data(), ring.data() + (windowSize - first), frame.data() + first);
+        juce::FloatVectorOperations::multiply (frame.data(), window.data(), windowSize);
+
+        fft->performFrequencyOnlyForwardTransform (frame.data(), true);
+
+        const float flux = getFlux();
+
+        // Threshold from the frames before this one
+        float mean = 0.0f, deviation = 0.0f;
+
+        for (auto f : history)
+            mean += f;
+
+        mean /= (float) historySize;
+
+        for (auto f : history)
+            deviation += std::abs (f - mean);
+
+        deviation /= (float) historySize;
+
+        const float threshold = juce::jmax (minFlux, thresholdRatio * mean + thresholdDeviations * deviation);
+        const bool above = flux > threshold;
+
+        history[(size_t) historyPosition] = flux;
+        historyPosition = (historyPosition + 1) % historySize;
+
+        if (above && ! wasAbove && samplesSinceOnset >= minInterOnsetSeconds * sampleRate
+             && numOnsets < maxOnsetsPerBlock)
+        {
+            onsets[(size_t) numOnsets++] = { blockSample, findHitStart(), flux - threshold };
+            samplesSinceOnset = 0;
+        }
+
+        wasAbove = above;
+    }
+
+    // Summed rise of each bin since the previous frame. Four partial sums
+    // keep the adds independent and the max is branch-free, so the loop
+    // vectorises.
+    float getFlux() noexcept
+    {
+        const auto* current = frame.data();
+        auto* last = previous.data();
+        float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+        int i = 0;
+
+        for (; i + 4 <= numBins; i += 4)
+        {
+            s0 += juce::jmax (0.0f, current[i] - last[i]);
+            s1 += juce::jmax (0.0f, current[i + 1] - last[i + 1]);
+            s2 += juce::jmax (0.0f, current[i + 2] - last[i + 2]);
+            s3 += juce::jmax (0.0f, current[i + 3] - last[i + 3]);
+        }
+
+        for (; i < numBins; ++i)
+            s0 += juce::jmax (0.0f, current[i] - last[i]);
+
+        std::copy (current, current + numBins, last);
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    // Samples from the first of the newest half window to reach half its
+    // peak level, up to the newest sample
+    int findHitStart() const noexcept
+    {
+        constexpr int span = windowSize / 2;
+        const int start = (writePosition - span) & (ringSize - 1);
+        const int first = juce::jmin (span, ringSize - start);
+
+        const auto a = juce::FloatVectorOperations::findMinAndMax (ring.data() + start, first);
+        const auto b = first < span ? juce::FloatVectorOperations::findMinAndMax (ring.data(), span - first) : a;
+        const float peak = juce::jmax (-a.getStart(), a.getEnd(), -b.getStart(), b.getEnd());
+
+        for (int i = 0; i < span; ++i)
+            if (std::abs (ring[(size_t) ((start + i) & (ringSize - 1))]) >= 0.5f * peak)
+                return span - 1 - i;
+
+        return 0;
+    }
+
+    //==========================================================================
+    double sampleRate { 44100.0 };
+    std::unique_ptr<juce::dsp::FFT> fft;
+    std::vector<float> window, ring, frame, previous;
+    int writePosition { 0 };
+    int samplesSinceFrame { 0 };
+    juce::int64 samplesSinceOnset { 0 };
+
+    std::array<float, historySize> history {};
+    int historyPosition { 0 };
+    bool wasAbove { false };
+
+    std::array<Onset, maxOnsetsPerBlock> onsets {};
+    int numOnsets { 0 };
+
+    std::atomic<int> skippedFrames { 0 };
+};
+
+//==============================================================================
+// A pattern timeline that follows a live player's onsets, in place of the
+// host transport or a clock.
+//
+// Tempo comes from the intervals between the last maxOnsets onsets. Every
+// pair less than maxIntervalSeconds apart votes for a tempo, folded by
+// octaves into the one around the Tempo parameter (0.71 to 1.41 times it),
+// neighbouring onsets with more weight than ones further apart. The
+// strongest vote moves the tempo a quarter of the way when it is close, and
+// replaces it when it is seen twice in a row.
+//
+// Phase: a hit within maxPhaseError beats of an eighth note is taken to be
+// on it, and the timeline is put where that eighth is now, allowing for the
+// detection latency. Running behind, the timeline jumps forward and the
+// notes on that eighth play at once; running ahead, they have already
+// played, so it waits for the player rather than going back and playing
+// them twice.
+//
+// The first hit after a silence starts the pattern from the top, and the
+// timeline stops after stopAfterBeats beats without one, so the pattern
+// plays while the player does.
+//
+// Each block the timeline is a few spans of samples, each starting at its
+// own beat, for the pattern to render.
+class OnsetFollower
+{
+public:
+    static constexpr int maxOnsets = 16;
+    static constexpr double maxIntervalSeconds = 2.0;
+    static constexpr double phaseGrid = 0.5;            // Beats
+    static constexpr double maxPhaseError = 0.2;        // Beats
+    static constexpr double stopAfterBeats = 8.0;
+    static constexpr int maxSpans = 2 * OnsetDetector::maxOnsetsPerBlock + 1;
+
+    struct Span
+    {
+        int start, end;         // Samples in the block
+        double beat;            // At start
+    };
+
+    void prepare (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        blockStartSample = 0;
+        running = false;
+        beat = 0.0;
+        holdSamples = 0;
+        bpm = 0.0;
+        pendingBpm = 0.0;
+        numOnsets = 0;
+        nextOnset = 0;
+        numSpans = 0;
+        meanLatency = 0.0;
+        worstLatency = 0.0;
+        latencyMs.store (0.0f, std::memory_order_relaxed);
+        worstLatencyMs.store (0.0f, std::memory_order_relaxed);
+        tempo.store (0.0f, std::memory_order_relaxed);
+    }
+
+    //==========================================================================
+    // Audio thread: lays out this block's timeline around its onsets.
+    // nominalBpm is the Tempo parameter.
+    void process (const OnsetDetector::Onset* onsets, int count, int numSamples, double nominalBpm) noexcept
+    {
+        numSpans = 0;
+
+        if (bpm <= 0.0)
+        {
+            bpm = nominalBpm;
+            tempo.store ((float) bpm, std::memory_order_relaxed);
+        }
+
+        if (running && (double) (blockStartSample - lastOnsetTime) > stopAfterBeats * getSamplesPerBeat())
+        {
+            running = false;
+            holdSamples = 0;
+        }
+
+        int position = 0;
+
+        for (int i = 0; i < count; ++i)
+        {
+            const auto& onset = onsets[i];
+            advance (position, onset.sample);
+            position = onset.sample;
+            handleOnset (onset, nominalBpm, position, numSamples);
+        }
+
+        advance (position, numSamples);
+        blockStartSample += numSamples;
+    }
+
+    bool isRunning() const noexcept             { return running; }
+    double getBpm() const noexcept              { return bpm; }
+    const Span* getSpans() const noexcept       { return spans.data(); }
+    int getNumSpans() const noexcept            { return numSpans; }
+
+    //==========================================================================
+    // Any thread
+    float getTempo() const noexcept             { return tempo.load (std::memory_order_relaxed); }
+    float getLatencyMs() const noexcept         { return latencyMs.load (std::memory_order_relaxed); }
+    float getWorstLatencyMs() const noexcept    { return worstLatencyMs.load (std::memory_order_relaxed); }
+
+private:
+    static constexpr int binsPerOctave = 48;
+
+    double getSamplesPerBeat() const noexcept   { return sampleRate * 60.0 / bpm; }
+
+    void addSpan (int start, int end, double spanBeat) noexcept
+    {
+        if (start < end && numSpans < maxSpans)
+            spans[(size_t) numSpans++] = { start, end, spanBeat };
+    }
+
+    // Runs the timeline over [start, end), after any hold
+    void advance (int start, int end) noexcept
+    {
+        if (! running || start >= end)
+            return;
+
+        const int held = juce::jmin (holdSamples, end - start);
+        holdSamples -= held;
+        start += held;
+
+        addSpan (start, end, beat);
+        beat += (end - start) / getSamplesPerBeat();
+    }
+
+    void handleOnset (const OnsetDetector::Onset& onset, double nominalBpm, int& position, int numSamples) noexcept
+    {
+        const double onsetTime = (double) (blockStartSample + onset.sample - onset.latencySamples);
+        estimateTempo (onsetTime, nominalBpm);
+        lastOnsetTime = (juce::int64) onsetTime;
+
+        const double samplesPerBeat = getSamplesPerBeat();
+        const double latencyBeats = onset.latencySamples / samplesPerBeat;
+        double hitBeat = 0.0;
+        double target = latencyBeats;
+
+        if (running)
+        {
+            // Where the timeline would be now without the hold, and so at the hit
+            const double current = beat - holdSamples / samplesPerBeat;
+            const double nearest = std::round ((current - latencyBeats) / phaseGrid) * phaseGrid;
+            const double error = nearest - (current - latencyBeats);
+
+            if (std::abs (error) > maxPhaseError)
+                return;
+
+            hitBeat = nearest;
+            target = current + error;
+        }
+        else
+        {
+            running = true;
+            beat = 0.0;
+            holdSamples = 0;
+        }
+
+        measureLatency (onset.latencySamples);
+
+        if (target < beat)
+        {
+            holdSamples = juce::roundToInt ((beat - target) * samplesPerBeat);
+            return;
+        }
+
+        // Catch up: the notes on the hit's eighth play on the sample the hit
+        // was found, and the timeline carries on from where the player is
+        holdSamples = 0;
+
+        if (hitBeat >= beat && position < numSamples)
+        {
+            addSpan (position, position + 1, hitBeat);
+            ++position;
+            target += 1.0 / samplesPerBeat;
+        }
+
+        beat = target;
+    }
+
+    //==========================================================================
+    void estimateTempo (double onsetTime, double nominalBpm) noexcept
+    {
+        onsetTimes[(size_t) nextOnset] = onsetTime;
+        nextOnset = (nextOnset + 1) % maxOnsets;
+        numOnsets = juce::jmin (numOnsets + 1, maxOnsets);
+
+        if (numOnsets < 4)
+            return;
+
+        // Votes on a log scale over the octave around the nominal tempo
+        const double low = nominalBpm / juce::MathConstants<double>::sqrt2;
+        std::array<float, binsPerOctave> votes {};
+
+        for (int i = 0; i < numOnsets; ++i)
+        {
+            const double from = onsetTimes[(size_t) ((nextOnset - numOnsets + i + maxOnsets) % maxOnsets)];
+
+            for (int j = i + 1; j < numOnsets; ++j)
+            {
+                const double to = onsetTimes[(size_t) ((nextOnset - numOnsets + j + maxOnsets) % maxOnsets)];
+                const double interval = (to - from) / sampleRate;
+
+                if (interval > maxIntervalSeconds)
+                    break;
+
+                if (interval < OnsetDetector::minInterOnsetSeconds)
+                    continue;
+
+                const double octaves = std::log2 (60.0 / interval / low);
+                const double position = (octaves - std::floor (octaves)) * binsPerOctave;
+                const int bin = (int) position;
+                const auto fraction = (float) (position - bin);
+                const float weight = 1.0f / (float) (j - i);
+
+                votes[(size_t) (bin % binsPerOctave)] += weight * (1.0f - fraction);
+                votes[(size_t) ((bin + 1) % binsPerOctave)] += weight * fraction;
+            }
+        }
+
+        const auto peak = std::max_element (votes.begin(), votes.end());
+
+        if (*peak < 1.0f)
+            return;
+
+        // Centre of the peak from its neighbours, around the octave
+        const int bin = (int) (peak - votes.begin());
+        const float below = votes[(size_t) ((bin + binsPerOctave - 1) % binsPerOctave)];
+        const float above = votes[(size_t) ((bin + 1) % binsPerOctave)];
+        const double centre = bin + (above - below) / (below + *peak + above);
+        const double candidate = low * std::exp2 (centre / binsPerOctave);
+
+        if (std::abs (candidate / bpm - 1.0) < 0.08)
+        {
+            bpm += 0.25 * (candidate - bpm);
+            pendingBpm = 0.0;
+        }
+        else if (pendingBpm > 0.0 && std::abs (candidate / pendingBpm - 1.0) < 0.04)
+        {
+            bpm = candidate;
+            pendingBpm = 0.0;
+        }
+        else
+        {
+            pendingBpm = candidate;
+        }
+
+        tempo.store ((float) bpm, std::memory_order_relaxed);
+    }
+
+    void measureLatency (int latencySamples) noexcept
+    {
+        const double ms = latencySamples * 1000.0 / sampleRate;
+        meanLatency = meanLatency > 0.0 ? meanLatency + 0.2 * (ms - meanLatency) : ms;
+        worstLatency = juce::jmax (worstLatency, ms);
+        latencyMs.store ((float) meanLatency, std::memory_order_relaxed);
+        worstLatencyMs.store ((float) worstLatency, std::memory_order_relaxed);
+    }
+
+    //==========================================================================
+    double sampleRate { 44100.0 };
+    juce::int64 blockStartSample { 0 };
+
+    bool running { false };
+    double beat { 0.0 };                // At the current sample
+    int holdSamples { 0 };              // Still to wait before the timeline moves on
+    double bpm { 0.0 };
+    double pendingBpm { 0.0 };          // A tempo change seen once
+
+    std::array<double, maxOnsets> onsetTimes {};
+    int numOnsets { 0 }, nextOnset { 0 };
+    juce::int64 lastOnsetTime { 0 };
+
+    std::array<Span, maxSpans> spans {};
+    int numSpans { 0 };
+
+    double meanLatency { 0.0 }, worstLatency { 0.0 };
+    std::atomic<float> latencyMs { 0.0f }, worstLatencyMs { 0.0f };
+    std::atomic<float> tempo { 0.0f };
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "MidiInputDecoder.h"
+#include <array>
+#include <atomic>
+
+//==============================================================================
+// Per-block event budgets, so a MIDI flood from a broken controller or a
+// runaway sequencer costs a bounded amount of work per block instead of
+// taking the audio graph down.
+//
+// Input passes through filterInput once per block, before anything else
+// sees it. A token bucket refilled at inputEventsPerSample and holding at
+// most maxInputEvents sets the block's budget, which bounds both a single
+// block and the events that pile up in the strum capture delay line.
+// Within the budget, events are kept by priority in a single pass:
+//
+//   - releases that end something (a note-off for a key that is down, a
+//     pedal coming up, all-notes-off on a channel in use) are always kept,
+//     so a flood never leaves a note hanging
+//   - clock, start, stop, continue and song position are always kept too:
+//     a lost clock tick is a lasting phase slip for the clock follower, and
+//     they come at most a few hundred a second
+//   - new note-ons take the budget
+//   - duplicates (a note-on for a key already down, a pedal going down,
+//     a release with nothing to end) only use its top half, so they are
+//     the first to go
+//
+// Messages the chord follower ignores, such as pitch bend, pressure and
+// other controllers, are dropped here without being counted.
+//
+// Output note-ons are limited per block, by the room left in the note-off
+// schedule so every note that starts has its note-off waiting, and by the
+// backlog of a slow output (the DIN stage) so the note-offs queued there
+// always have room. Note-offs are never limited here, and the DIN stage
+// sheds note-ons and controllers before it would shed one. Everything shed
+// is counted per stage for the editor.
+//
+// Key and pedal tracking follows the player's hands, so it is only reset
+// when the audio stream restarts, not when the engines are.
+class OverloadGuard
+{
+public:
+    static constexpr int maxInputEvents = 256;             // Burst, per block
+    static constexpr double inputEventsPerSample = 0.125;  // Sustained rate, 6000 a second at 48 kHz
+    static constexpr int maxOutputNotes = 512;              // Note-ons per block
+    static constexpr int maxScheduledNoteOffs = 2048;       // Note-offs waiting across blocks
+    static constexpr int maxOutputBacklog = 1024;           // Events a slow output has queued
+
+    enum Stage { inputStage = 0, outputStage, scheduleStage, numStages };
+
+    //==========================================================================
+    // Audio thread
+
+    void reset() noexcept
+    {
+        for (auto& channel : channels)
+            channel = {};
+
+        inputTokens = maxInputEvents;
+    }
+
+    // Replaces output with the events of input worth processing this block
+    void filterInput (const juce::MidiBuffer& input, juce::MidiBuffer& output, int numSamples,
+                      const MidiInputDecoder& decoder)
+    {
+        output.clear();
+        outputNotes = 0;
+        inputTokens = juce::jmin ((double) maxInputEvents, inputTokens + numSamples * inputEventsPerSample);
+
+        int shed = 0;
+
+        for (const auto metadata : input)
+        {
+            const auto type = decoder.classify (metadata.data, metadata.numBytes);
+            const auto priority = prioritise (type, metadata.data, metadata.numBytes);
+
+            if (priority == drop)
+                continue;
+
+            if (priority != release)
+            {
+                const double reserve = priority == duplicate ? maxInputEvents * 0.5 : 0.0;
+
+                if (inputTokens < 1.0 + reserve)
+                {
+                    ++shed;
+                    continue;
+                }
+
+                inputTokens -= 1.0;
+            }
+
+            if (type != InputEvent::ignored)
+                track (type, metadata.data);
+
+            output.addEvent (metadata.data, metadata.numBytes, metadata.samplePosition);
+        }
+
+        if (shed > 0)
+            shedEvents[(size_t) inputStage].fetch_add (shed, std::memory_order_relaxed);
+    }
+
+    // True if one more output note may start this block; if not, the note
+    // is counted as shed and must not be sent
+    bool tryStartNote (size_t numScheduledNoteOffs) noexcept
+    {
+        if (outputNotes >= maxOutputNotes || outputBacklog >= maxOutputBacklog)
+        {
+            shedEvents[(size_t) outputStage].fetch_add (1, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (numScheduledNoteOffs >= (size_t) maxScheduledNoteOffs)
+        {
+            shedEvents[(size_t) scheduleStage].fetch_add (1, std::memory_order_relaxed);
+            return false;
+        }
+
+        ++outputNotes;
+        return true;
+    }
+
+    // Events still queued from earlier blocks for a slow output, or 0
+    void setOutputBacklog (int numQueued) noexcept
+    {
+        outputBacklog = numQueued;
+    }
+
+    //==========================================================================
+    // Any thread (for UI display, lock-free)
+
+    int getShedEvents (Stage stage) const noexcept
+    {
+        return shedEvents[(size_t) stage].load (std::memory_order_relaxed);
+    }
+
+    int getTotalShedEvents() const noexcept
+    {
+        int total = 0;
+
+        for (const auto& count : shedEvents)
+            total += count.load (std::memory_order_relaxed);
+
+        return total;
+    }
+
+private:
+    enum Priority { drop, release, normal, duplicate };
+
+    // The input as the guard has let it through, so it can tell a release
+    // that ends something from one that doesn't
+    struct ChannelState
+    {
+        NoteMask keysDown;
+        bool sustainDown { false }, sostenutoDown { false };
+
+        bool isIdle() const noexcept    { return keysDown.empty() && ! sustainDown && ! sostenutoDown; }
+    };
+
+    Priority prioritise (InputEvent::Type type, const juce::uint8* data, int numBytes) const noexcept
+    {
+        const auto& channel = channels[(size_t) (data[0] & 0x0f)];
+
+        switch (type)
+        {
+            case InputEvent::noteOn:            return channel.keysDown.contains (data[1] & 0x7f) ? duplicate : normal;
+            case InputEvent::noteOff:           return channel.keysDown.contains (data[1] & 0x7f) ? release : duplicate;
+            case InputEvent::sustain:           return data[2] < 64 && channel.sustainDown ? release : duplicate;
+            case InputEvent::sostenuto:         return data[2] < 64 && channel.sostenutoDown ? release : duplicate;
+            case InputEvent::allNotesOff:       return channel.isIdle() ? duplicate : release;
+            case InputEvent::resetControllers:  return channel.sustainDown || channel.sostenutoDown ? release : duplicate;
+            case InputEvent::ignored:           break;
+        }
+
+        // Clock, start, stop, continue and song position drive the clock follower
+        if ((numBytes == 1 && data[0] >= 0xf8 && data[0] <= 0xfc) || (numBytes == 3 && data[0] == 0xf2))
+            return release;
+
+        return drop;
+    }
+
+    // Mirrors InputNoteTracker, keys and pedals only
+    void track (InputEvent::Type type, const juce::uint8* data) noexcept
+    {
+        auto& channel = channels[(size_t) (data[0] & 0x0f)];
+        const int note = data[1] & 0x7f;
+
+        switch (type)
+        {
+            case InputEvent::noteOn:            channel.keysDown.insert (note); break;
+            case InputEvent::noteOff:           channel.keysDown.erase (note); break;
+            case InputEvent::sustain:           channel.sustainDown = data[2] >= 64; break;
+            case InputEvent::sostenuto:         channel.sostenutoDown = data[2] >= 64; break;
+            case InputEvent::allNotesOff:       channel.keysDown.clear(); break;
+            case InputEvent::resetControllers:  channel.sustainDown = channel.sostenutoDown = false; break;
+            case InputEvent::ignored:           break;
+        }
+    }
+
+    std::array<ChannelState, 16> channels;
+    double inputTokens { maxInputEvents };
+    int outputNotes { 0 };
+    int outputBacklog { 0 };
+
+    std::array<std::atomic<int>, numStages> shedEvents {};
+};
@@ -0,0 +1,234 @@
+#include "PatternBrowser.h"
+
+//==============================================================================
+PatternBrowser::PatternBrowser (PatternSearchIndex& i, PatternLookup l, int current,
+                                std::function<void (int)> onChosen)
+    : index (i),
+      lookup (std::move (l)),
+      onPatternChosen (std::move (onChosen)),
+      currentPattern (current)
+{
+    searchBox.setTextToShowWhenEmpty ("Search patterns", juce::Colour (0xff8888aa));
+    searchBox.setColour (juce::TextEditor::backgroundColourId, juce::Colour (0xff2a2a4a));
+    searchBox.setColour (juce::TextEditor::textColourId, juce::Colours::white);
+    searchBox.setColour (juce::TextEditor::outlineColourId, juce::Colour (0xff4a4a6a));
+    searchBox.setColour (juce::TextEditor::focusedOutlineColourId, juce::Colour (0xff4ecdc4));
+    searchBox.onTextChange = [this] { updateResults(); };
+    searchBox.onReturnKey = [this] { choose (juce::jmax (0, list.getSelectedRow())); };
+    addAndMakeVisible (searchBox);
+
+    for (const auto& tag : index.getTagNames())
+    {
+        auto* button = tagButtons.add (new juce::TextButton (tag));
+        button->setClickingTogglesState (true);
+        button->setColour (juce::TextButton::buttonColourId, juce::Colour (0xff3a3a5a));
+        button->setColour (juce::TextButton::buttonOnColourId, juce::Colour (0xff4ecdc4));
+        button->setColour (juce::TextButton::textColourOnId, juce::Colour (0xff1a1a2e));
+        button->setColour (juce::TextButton::textColourOffId, juce::Colours::white);
+        button->onClick = [this] { updateResults(); };
+        addAndMakeVisible (button);
+    }
+
+    list.setModel (this);
+    list.setRowHeight (rowHeight);
+    list.setColour (juce::ListBox::backgroundColourId, juce::Colour (0xff1a1a2e));
+    addAndMakeVisible (list);
+
+    countLabel.setFont (juce::FontOptions (12.0f));
+    countLabel.setColour (juce::Label::textColourId, juce::Colour (0xffaaaacc));
+    addAndMakeVisible (countLabel);
+
+    updateResults();
+
+    // Start on the current pattern
+    if (const auto found = std::find (results->begin(), results->end(), currentPattern); found != results->end())
+    {
+        const int row = (int) std::distance (results->begin(), found);
+        list.selectRow (row);
+        list.scrollToEnsureRowIsOnscreen (row);
+    }
+}
+
+//==============================================================================
+void PatternBrowser::paint (juce::Graphics& g)
+{
+    g.fillAll (juce::Colour (0xff16213e));
+}
+
+void PatternBrowser::parentHierarchyChanged()
+{
+    // Ready for typing as soon as the call-out opens
+    juce::Component::SafePointer<juce::TextEditor> box (&searchBox);
+    juce::MessageManager::callAsync ([box]
+    {
+        if (box != nullptr && box->isShowing())
+            box->grabKeyboardFocus();
+    });
+}
+
+void PatternBrowser::resized()
+{
+    auto bounds = getLocalBounds().reduced (8);
+    searchBox.setBounds (bounds.removeFromTop (26));
+    bounds.removeFromTop (6);
+
+    // Tag buttons flow onto as many lines as they need
+    auto line = bounds.removeFromTop (22);
+
+    for (auto* button : tagButtons)
+    {
+        const int width = juce::GlyphArrangement::getStringWidthInt (juce::Font (juce::FontOptions (13.0f)), button->getButtonText()) + 16;
+
+        if (width > line.getWidth() && line.getX() > bounds.getX())
+        {
+            bounds.removeFromTop (4);
+            line = bounds.removeFromTop (22);
+        }
+
+        button->setBounds (line.removeFromLeft (width));
+        line.removeFromLeft (4);
+    }
+
+    bounds.removeFromTop (6);
+    countLabel.setBounds (bounds.removeFromBottom (18));
+    list.setBounds (bounds);
+}
+
+//==============================================================================
+int PatternBrowser::getNumRows()
+{
+    return results != nullptr ? (int) results->size() : 0;
+}
+
+void PatternBrowser::paintListBoxItem (int row, juce::Graphics& g, int width, int height, bool rowIsSelected)
+{
+    if (! juce::isPositiveAndBelow (row, getNumRows()))
+        return;
+
+    const int pattern = (*results)[(size_t) row];
+
+    if (rowIsSelected)
+        g.fillAll (juce::Colour (0x404ecdc4));
+
+    auto bounds = juce::Rectangle<int> (0, 0, width, height).reduced (6, 0);
+    g.drawImageAt (getThumbnail (pattern), bounds.getX(), (height - thumbnailHeight) / 2);
+    bounds.removeFromLeft (thumbnailWidth + 8);
+
+    const auto tagText = getTagText (pattern);
+    const juce::Font tagFont (juce::FontOptions (11.0f));
+    g.setFont (tagFont);
+    g.setColour (juce::Colour (0xff8888aa));
+    g.drawText (tagText, bounds, juce::Justification::centredRight, true);
+    bounds.removeFromRight (juce::GlyphArrangement::getStringWidthInt (tagFont, tagText) + 6);
+
+    g.setFont (juce::FontOptions (14.0f));
+    g.setColour (pattern == currentPattern ? juce::Colour (0xff4ecdc4) : juce::Colours::white);
+    g.drawText (index.getName (pattern), bounds, juce::Justification::centredLeft, true);
+}
+
+void PatternBrowser::listBoxItemClicked (int row, const juce::MouseEvent&)
+{
+    choose (row);
+}
+
+void PatternBrowser::returnKeyPressed (int lastRowSelected)
+{
+    choose (lastRowSelected);
+}
+
+//==============================================================================
+void PatternBrowser::updateResults()
+{
+    juce::uint64 requiredTags = 0;
+
+    for (int i = 0; i < tagButtons.size(); ++i)
+        if (tagButtons[i]->getToggleState())
+            requiredTags |= (juce::uint64) 1 << i;
+
+    results = &index.search (searchBox.getText(), requiredTags);
+
+    list.updateContent();
+    list.selectRow (0);
+    list.repaint();
+
+    countLabel.setText (juce::String ((int) results->size()) + " of " + juce::String (index.getNumPatterns())
+                          + " patterns", juce::dontSendNotification);
+}
+
+void PatternBrowser::choose (int row)
+{
+    if (! juce::isPositiveAndBelow (row, getNumRows()))
+        return;
+
+    onPatternChosen ((*results)[(size_t) row]);
+
+    if (auto* callOut = findParentComponentOfClass<juce::CallOutBox>())
+        callOut->dismiss();
+}
+
+juce::String PatternBrowser::getTagText (int pattern) const
+{
+    juce::StringArray tags;
+    const auto mask = index.getTagMask (pattern);
+
+    for (int i = 0; i < index.getTagNames().size(); ++i)
+        if ((mask & ((juce::uint64) 1 << i)) != 0)
+            tags.add (index.getTagNames()[i]);
+
+    return tags.joinIntoString (", ");
+}
+
+//==============================================================================
+const juce::Image& PatternBrowser::getThumbnail (int pattern)
+{
+    if (const auto found = thumbnailLookup.find (pattern); found != thumbnailLookup.end())
+    {
+        thumbnails.splice (thumbnails.begin(), thumbnails, found->second);
+        return found->second->second;
+    }
+
+    if (thumbnails.size() >= maxThumbnails)
+    {
+        thumbnailLookup.erase (thumbnails.back().first);
+        thumbnails.pop_back();
+    }
+
+    thumbnails.emplace_front (pattern, renderThumbnail (lookup (pattern), thumbnailWidth, thumbnailHeight));
+    thumbnailLookup[pattern] = thumbnails.begin();
+    return thumbnails.front().second;
+}
+
+// One lane per chord tone with the bass at the bottom; brighter is louder
+juce::Image PatternBrowser::renderThumbnail (const RhythmPattern& pattern, int width, int height)
+{
+    juce::Image image (juce::Image::ARGB, width, height, true);
+    juce::Graphics g (image);
+
+    g.setColour (juce::Colour (0xff2a2a4a));
+    g.fillRoundedRectangle (image.getBounds().toFloat(), 3.0f);
+
+    if (pattern.lengthInBeats <= 0.0)
+        return image;
+
+    const float beatWidth = (float) (width / pattern.lengthInBeats);
+    g.setColour (juce::Colour (0xff3a3a5a));
+
+    for (int beat = 1; beat < pattern.lengthInBeats; ++beat)
+        g.drawVerticalLine (juce::roundToInt (beat * beatWidth), 1.0f, (float) height - 1.0f);
+
+    constexpr int numLanes = 5;
+    const float laneHeight = (float) (height - 2) / numLanes;
+
+    for (const auto& note : pattern.notes)
+    {
+        const int lane = juce::jlimit (0, numLanes - 1, note.chordIndex + 1);
+        const float x = (float) note.beatPosition * beatWidth;
+        const float w = juce::jmax (1.5f, (float) note.duration * beatWidth);
+        const float y = (float) height - 1.0f - (float) (lane + 1) * laneHeight;
+
+        g.setColour (juce::Colour (0xff4ecdc4).withAlpha (0.3f + 0.7f * note.velocity * note.probability));
+        g.fillRect (x, y + 0.5f, w, laneHeight - 1.0f);
+    }
+
+    return image;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <juce_gui_basics/juce_gui_basics.h>
+#include "PatternSearchIndex.h"
+#include "RhythmPattern.h"
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+//==============================================================================
+// Pattern picker with type-ahead search, tag filters and mini-grid
+// thumbnails, shown in a call-out from the editor.
+//
+// The list only paints the rows in view, so its cost doesn't depend on the
+// size of the library. A row's thumbnail is drawn the first time the row is
+// painted and kept in a small LRU cache; searching goes through the
+// processor's prebuilt PatternSearchIndex.
+class PatternBrowser final : public juce::Component,
+                             private juce::ListBoxModel
+{
+public:
+    // Returns a copy of pattern i, for drawing its thumbnail
+    using PatternLookup = std::function<RhythmPattern (int)>;
+
+    PatternBrowser (PatternSearchIndex& index, PatternLookup lookup, int currentPattern,
+                    std::function<void (int)> onPatternChosen);
+
+    void paint (juce::Graphics&) override;
+    void resized() override;
+    void parentHierarchyChanged() override;
+
+private:
+    //==========================================================================
+    int getNumRows() override;
+    void paintListBoxItem (int row, juce::Graphics&, int width, int height, bool rowIsSelected) override;
+    void listBoxItemClicked (int row, const juce::MouseEvent&) override;
+    void returnKeyPressed (int lastRowSelected) override;
+
+    void updateResults();
+    void choose (int row);
+    juce::String getTagText (int pattern) const;
+
+    const juce::Image& getThumbnail (int pattern);
+    static juce::Image renderThumbnail (const RhythmPattern& pattern, int width, int height);
+
+    //==========================================================================
+    static constexpr int rowHeight = 28;
+    static constexpr int thumbnailWidth = 64, thumbnailHeight = 20;
+    static constexpr size_t maxThumbnails = 256;
+
+    PatternSearchIndex& index;
+    PatternLookup lookup;
+    std::function<void (int)> onPatternChosen;
+    const int currentPattern;
+    const std::vector<int>* results { nullptr };
+
+    juce::TextEditor searchBox;
+    juce::OwnedArray<juce::TextButton> tagButtons;
+    juce::ListBox list;
+    juce::Label countLabel;
+
+    // Most recently used first
+    std::list<std::pair<int, juce::Image>> thumbnails;
+    std::unordered_map<int, std::list<std::pair<int, juce::Image>>::iterator> thumbnailLookup;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PatternBrowser)
+};
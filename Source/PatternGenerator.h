@@ -0,0 +1,273 @@
+#pragma once
+
+#include <juce_events/juce_events.h>
+#include "RhythmPattern.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Knob settings for a generated pattern
+struct PatternGeneratorSettings
+{
+    int steps { 16 };                   // 16th-note steps per cycle
+    int hits { 5 };
+    int rotation { 0 };
+    float probability { 1.0f };         // Chance of each hit after the first
+    float ghostProbability { 0.0f };    // Chance of a soft ghost stab on each rest
+    float accent { 0.5f };              // Velocity contrast between on-beat and off-beat steps
+
+    // Identifies the pattern these settings compile to
+    juce::uint64 getHash() const
+    {
+        juce::uint64 hash = 1469598103934665603ull;
+
+        for (auto value : { steps, hits, rotation,
+                            juce::roundToInt (probability * 1000.0f),
+                            juce::roundToInt (ghostProbability * 1000.0f),
+                            juce::roundToInt (accent * 1000.0f) })
+            hash = (hash ^ (juce::uint64) (juce::uint32) value) * 1099511628211ull;
+
+        return hash;
+    }
+};
+
+//==============================================================================
+// Euclidean rhythms with per-step probability and accent maps, compiled into
+// the RhythmPattern form the engines play.
+namespace PatternGenerator
+{
+    // One entry per step: whether it is a hit, its chance of sounding and its
+    // velocity
+    struct StepMaps
+    {
+        std::vector<bool> hits;
+        std::vector<float> probability;
+        std::vector<float> velocity;
+    };
+
+    // k hits spread as evenly as possible over n steps (the same sets as
+    // Bjorklund's algorithm), starting on step 0 and rotated right
+    inline std::vector<bool> euclidean (int hits, int steps, int rotation)
+    {
+        std::vector<bool> result ((size_t) juce::jmax (1, steps), false);
+        const int n = (int) result.size();
+        hits = juce::jlimit (0, n, hits);
+        rotation = ((rotation % n) + n) % n;
+
+        for (int i = 0; i < n; ++i)
+            result[(size_t) ((i + rotation) % n)] = (i * hits) % n < hits;
+
+        return result;
+    }
+
+    inline StepMaps createStepMaps (const PatternGeneratorSettings& settings)
+    {
+        StepMaps maps;
+        maps.hits = euclidean (settings.hits, settings.steps, settings.rotation);
+
+        const int n = (int) maps.hits.size();
+        maps.probability.resize ((size_t) n);
+        maps.velocity.resize ((size_t) n);
+
+        bool anchored = false;
+
+        for (int i = 0; i < n; ++i)
+        {
+            const bool isHit = maps.hits[(size_t) i];
+            const bool onBeat = i % 4 == 0;
+
+            // The first hit always plays so the cycle stays recognisable
+            if (isHit)
+                maps.probability[(size_t) i] = anchored ? settings.probability : 1.0f;
+            else
+                maps.probability[(size_t) i] = settings.ghostProbability;
+
+            anchored = anchored || isHit;
+
+            if (isHit)
+                maps.velocity[(size_t) i] = onBeat ? juce::jmin (1.0f, 0.75f + 0.25f * settings.accent)
+                                                   : 0.75f - 0.35f * settings.accent;
+            else
+                maps.velocity[(size_t) i] = 0.3f;
+        }
+
+        return maps;
+    }
+
+    // Hits are full stabs, with the bass added on accented (on-beat) hits;
+    // ghost notes are short stabs of the upper chord tones. Notes on one step
+    // are emitted together and share a probability, so they sound or rest as
+    // one.
+    inline RhythmPattern compile (const PatternGeneratorSettings& settings)
+    {
+        constexpr double stepLength = 0.25;
+        const auto maps = createStepMaps (settings);
+        const int n = (int) maps.hits.size();
+        const int numHits = (int) std::count (maps.hits.begin(), maps.hits.end(), true);
+
+        RhythmPattern pattern;
+        pattern.name = "Euclidean " + juce::String (numHits) + "/" + juce::String (n);
+        pattern.lengthInBeats = n * stepLength;
+        pattern.tags = { "Generated" };
+        pattern.notes.reserve ((size_t) n * 4);
+
+        for (int i = 0; i < n; ++i)
+        {
+            const double beat = i * stepLength;
+            const float probability = maps.probability[(size_t) i];
+            const float velocity = maps.velocity[(size_t) i];
+
+            if (probability <= 0.0f)
+                continue;
+
+            if (maps.hits[(size_t) i])
+            {
+                if (i % 4 == 0)
+                    pattern.notes.push_back ({ beat, -1, velocity, stepLength * 1.8, probability });
+
+                for (int chordIndex = 0; chordIndex < 3; ++chordIndex)
+                    pattern.notes.push_back ({ beat, chordIndex, velocity, stepLength * 0.8, probability });
+            }
+            else
+            {
+                for (int chordIndex = 1; chordIndex < 3; ++chordIndex)
+                    pattern.notes.push_back ({ beat, chordIndex, velocity, stepLength * 0.5, probability });
+            }
+        }
+
+        return pattern;
+    }
+}
+
+//==============================================================================
+// Keeps the generated pattern in step with its settings without the audio
+// thread ever compiling one.
+//
+// A timer on the message thread hashes the current settings; on a change the
+// pattern comes from a small cache keyed by that hash, or is compiled, and is
+// published through an atomic pointer. The audio thread only loads that
+// pointer. It also announces the pointer it is using (a hazard pointer), so
+// cache eviction never frees a pattern in the middle of a block.
+class GeneratedPatternSource final : private juce::Timer
+{
+public:
+    static constexpr int maxCachedPatterns = 32;
+
+    // getSettings is called on the message thread
+    explicit GeneratedPatternSource (std::function<PatternGeneratorSettings()> settingsProvider)
+        : getSettings (std::move (settingsProvider))
+    {
+        update();
+        startTimerHz (20);
+    }
+
+    ~GeneratedPatternSource() override
+    {
+        stopTimer();
+    }
+
+    //==========================================================================
+    // Audio thread: the pattern to play for this block. Stays valid until the
+    // next call.
+    const RhythmPattern& acquire() noexcept
+    {
+        auto* pattern = published.load();
+
+        for (;;)
+        {
+            inUse.store (pattern);
+            auto* latest = published.load();
+
+            if (latest == pattern)
+                return *pattern;
+
+            pattern = latest;
+        }
+    }
+
+    // Message thread: publish the current settings now rather than on the
+    // next timer tick (a session replay has no message loop)
+    void refresh()
+    {
+        update();
+    }
+
+private:
+    //==========================================================================
+    struct Entry
+    {
+        juce::uint64 hash;
+        std::unique_ptr<RhythmPattern> pattern;
+        juce::uint32 lastUsed;
+    };
+
+    void timerCallback() override   { update(); }
+
+    void update()
+    {
+        const auto settings = getSettings();
+        const auto hash = settings.getHash();
+
+        if (hash == publishedHash && published.load() != nullptr)
+            return;
+
+        auto* pattern = findOrCompile (settings, hash);
+        published.store (pattern);
+        publishedHash = hash;
+
+        evictIfFull();
+    }
+
+    const RhythmPattern* findOrCompile (const PatternGeneratorSettings& settings, juce::uint64 hash)
+    {
+        ++useCounter;
+
+        for (auto& entry : cache)
+        {
+            if (entry.hash == hash)
+            {
+                entry.lastUsed = useCounter;
+                return entry.pattern.get();
+            }
+        }
+
+        cache.push_back ({ hash, std::make_unique<RhythmPattern> (PatternGenerator::compile (settings)), useCounter });
+        return cache.back().pattern.get();
+    }
+
+    // Drops the least recently used patterns the audio thread can't be reading
+    void evictIfFull()
+    {
+        while ((int) cache.size() > maxCachedPatterns)
+        {
+            const auto* current = published.load();
+            const auto* reading = inUse.load();
+            auto victim = cache.end();
+
+            for (auto it = cache.begin(); it != cache.end(); ++it)
+                if (it->pattern.get() != current && it->pattern.get() != reading
+                     && (victim == cache.end() || it->lastUsed < victim->lastUsed))
+                    victim = it;
+
+            if (victim == cache.end())
+                return;
+
+            cache.erase (victim);
+        }
+    }
+
+    //==========================================================================
+    std::function<PatternGeneratorSettings()> getSettings;
+
+    std::vector<Entry> cache;                               // Message thread only
+    juce::uint32 useCounter { 0 };
+    juce::uint64 publishedHash { 0 };
+
+    std::atomic<const RhythmPattern*> published { nullptr };
+    std::atomic<const RhythmPattern*> inUse { nullptr };
+
+    JUCE_DECLARE_NON_COPYABLE (GeneratedPatternSource)
+};
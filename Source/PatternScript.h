@@ -0,0 +1,856 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "RhythmPattern.h"
+#include "ChordDetector.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+//==============================================================================
+// A small pattern language for conditional rhythms, compiled on the message
+// thread into bytecode the audio thread runs without allocating.
+//
+//   # Bossa with a fill every fourth bar and a seventh on dominant chords
+//   length 4
+//   steps 16
+//   if step % 4 == 0: play bass vel 0.9 len 2
+//   if step == 3 or step == 6 or step == 10 or step == 13: play all vel 0.6 + random * 0.2
+//   if dominant and step == 8: play 3 vel 0.7
+//   if bar % 4 == 3 and step >= 12: play 0,1,2 vel 0.4 + step / 40 len 0.5
+//
+// The program runs once per grid step. play takes chord tones (0 = root,
+// 1 = the next tone up, ...), bass (the root an octave down) or all, then an
+// optional velocity (0-1, default 0.8; 0 or less is a rest) and length in
+// steps (default 0.8). Tones the current chord doesn't have are skipped.
+//
+// Names: step, steps, beat (within the cycle), bar, cycle, tones (number of
+// chord tones), root (pitch class), major, minor, dominant, seventh (1 or 0)
+// and random (a new 0-1 value on each read).
+// Operators: + - * / % == != < <= > >= and or not ( ), with / and % by zero
+// giving 0.
+namespace PatternScript
+{
+    enum Variable : juce::uint8
+    {
+        stepVar, stepsVar, beatVar, barVar, cycleVar,
+        tonesVar, rootVar, majorVar, minorVar, dominantVar, seventhVar,
+        randomVar,
+        numVariables
+    };
+
+    enum class Op : juce::uint8
+    {
+        push,           // value
+        load,           // variable
+        add, subtract, multiply, divide, modulo, negate,
+        equal, notEqual, less, lessEqual, greater, greaterEqual,
+        logicalAnd, logicalOr, logicalNot,
+        jumpIfFalse,    // target; pops the condition
+        play            // target = tone mask; pops length, then velocity
+    };
+
+    // Tone mask bits for play: 0-7 chord tones, then the bass
+    constexpr juce::uint16 bassTone = 1 << 8;
+    constexpr juce::uint16 allTones = 0xff;
+
+    struct Instruction
+    {
+        Op op;
+        juce::uint8 variable;
+        juce::uint16 target;
+        float value;
+    };
+
+    static_assert (sizeof (Instruction) == 8, "Instructions are packed two to a cache word");
+
+    constexpr int maxStackDepth = 16;
+    constexpr int maxInstructions = 1024;
+    constexpr int maxSourceLength = 8192;
+    constexpr int maxStepsPerCycle = 64;
+
+    // Instructions one script may run per engine per block. A block that runs
+    // out stops playing steps for that engine and counts as an overrun.
+    constexpr int instructionBudget = 8192;
+
+    constexpr float defaultVelocity = 0.8f;
+    constexpr float defaultLength = 0.8f;
+
+    //==========================================================================
+    struct Program
+    {
+        std::vector<Instruction> code;
+        int stepsPerCycle { 16 };
+
+        // Name and length for the engines' bar and wrap logic. The notes are
+        // one cycle over a dominant seventh, for the browser thumbnail.
+        RhythmPattern pattern;
+
+        double getStepLength() const    { return pattern.lengthInBeats / stepsPerCycle; }
+    };
+
+    struct CompileResult
+    {
+        std::unique_ptr<Program> program;   // Null on error
+        juce::String error;                 // "Line n: ..." on error
+    };
+
+    //==========================================================================
+    // What a program can read for one step
+    struct Context
+    {
+        std::array<float, numVariables> values {};
+        juce::Random* random { nullptr };
+
+        void setChord (const DetectedChord& chord)
+        {
+            bool hasInterval[12] {};
+
+            for (auto interval : chord.intervals)
+                hasInterval[((interval % 12) + 12) % 12] = true;
+
+            values[tonesVar] = (float) chord.intervals.size();
+            values[rootVar] = chord.rootNote >= 0 ? (float) (chord.rootNote % 12) : 0.0f;
+            values[majorVar] = hasInterval[4] ? 1.0f : 0.0f;
+            values[minorVar] = hasInterval[3] && ! hasInterval[4] ? 1.0f : 0.0f;
+            values[dominantVar] = hasInterval[4] && hasInterval[10] ? 1.0f : 0.0f;
+            values[seventhVar] = hasInterval[10] || hasInterval[11] ? 1.0f : 0.0f;
+        }
+
+        // Grid position of absolute step k, with bars of barLength beats
+        void setStep (const Program& program, juce::int64 k, double barLength)
+        {
+            const auto n = (juce::int64) program.stepsPerCycle;
+            const auto step = ((k % n) + n) % n;
+            const auto cycle = (k - step) / n;
+            const double stepLength = program.getStepLength();
+
+            values[stepVar] = (float) step;
+            values[stepsVar] = (float) n;
+            values[beatVar] = (float) (step * stepLength);
+            values[cycleVar] = (float) cycle;
+            values[barVar] = (float) std::floor ((double) k * stepLength / barLength + 1.0e-9);
+        }
+    };
+
+    struct PlayEvent
+    {
+        juce::uint16 tones;
+        float velocity;
+        float lengthInSteps;
+    };
+
+    //==========================================================================
+    // Runs the program for one step, calling emit (const PlayEvent&) for each
+    // play it reaches. Every instruction costs one unit of budget; returns
+    // false if the budget ran out before the end. Jumps only go forward, so a
+    // run never takes more than code.size() instructions.
+    template <typename Emit>
+    bool run (const Program& program, Context& context, int& budget, Emit&& emit) noexcept
+    {
+        float stack[maxStackDepth];
+        int sp = 0;
+        const auto* code = program.code.data();
+        const auto size = program.code.size();
+
+        for (size_t pc = 0; pc < size;)
+        {
+            if (--budget < 0)
+                return false;
+
+            const auto& instruction = code[pc++];
+
+            switch (instruction.op)
+            {
+                case Op::push:  stack[sp++] = instruction.value; break;
+
+                case Op::load:
+                    stack[sp++] = instruction.variable == randomVar ? context.random->nextFloat()
+                                                                    : context.values[instruction.variable];
+                    break;
+
+                case Op::negate:        stack[sp - 1] = -stack[sp - 1]; break;
+                case Op::logicalNot:    stack[sp - 1] = stack[sp - 1] != 0.0f ? 0.0f : 1.0f; break;
+
+                case Op::jumpIfFalse:
+                    if (stack[--sp] == 0.0f)
+                        pc = instruction.target;
+                    break;
+
+                case Op::play:
+                {
+                    const float length = stack[--sp];
+                    const float velocity = stack[--sp];
+                    emit (PlayEvent { instruction.target, velocity, length });
+                    break;
+                }
+
+                default:
+                {
+                    const float b = stack[--sp];
+                    float& a = stack[sp - 1];
+
+                    switch (instruction.op)
+                    {
+                        case Op::add:           a = a + b; break;
+                        case Op::subtract:      a = a - b; break;
+                        case Op::multiply:      a = a * b; break;
+                        case Op::divide:        a = b != 0.0f ? a / b : 0.0f; break;
+                        case Op::modulo:        a = b != 0.0f ? a - b * std::floor (a / b) : 0.0f; break;
+                        case Op::equal:         a = a == b ? 1.0f : 0.0f; break;
+                        case Op::notEqual:      a = a != b ? 1.0f : 0.0f; break;
+                        case Op::less:          a = a < b ? 1.0f : 0.0f; break;
+                        case Op::lessEqual:     a = a <= b ? 1.0f : 0.0f; break;
+                        case Op::greater:       a = a > b ? 1.0f : 0.0f; break;
+                        case Op::greaterEqual:  a = a >= b ? 1.0f : 0.0f; break;
+                        case Op::logicalAnd:    a = a != 0.0f && b != 0.0f ? 1.0f : 0.0f; break;
+                        case Op::logicalOr:     a = a != 0.0f || b != 0.0f ? 1.0f : 0.0f; break;
+                        default:                break;
+                    }
+                    break;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    //==========================================================================
+    // Line-at-a-time recursive descent compiler
+    class Compiler
+    {
+    public:
+        CompileResult compile (const juce::String& source)
+        {
+            CompileResult result;
+
+            if (source.length() > maxSourceLength)
+            {
+                result.error = "Script is longer than " + juce::String (maxSourceLength) + " characters";
+                return result;
+            }
+
+            program = std::make_unique<Program>();
+            program->pattern.name = "Script";
+            program->pattern.lengthInBeats = 4.0;
+            program->pattern.tags = { "Script" };
+
+            juce::StringArray lines;
+            lines.addLines (source);
+
+            for (lineNumber = 1; lineNumber <= lines.size(); ++lineNumber)
+            {
+                if (! tokenise (lines[lineNumber - 1].toStdString()) || ! compileLine())
+                {
+                    result.error = "Line " + juce::String (lineNumber) + ": " + error;
+                    return result;
+                }
+            }
+
+            renderPreview (*program);
+            result.program = std::move (program);
+            return result;
+        }
+
+    private:
+        //======================================================================
+        struct Token
+        {
+            enum Type { end, number, name, symbol } type { end };
+            std::string text;
+            float value { 0.0f };
+        };
+
+        bool tokenise (const std::string& line)
+        {
+            tokens.clear();
+            position = 0;
+
+            for (size_t i = 0; i < line.size();)
+            {
+                const char c = line[i];
+
+                if (c == '#')
+                    break;
+
+                if (std::isspace ((unsigned char) c))
+                {
+                    ++i;
+                    continue;
+                }
+
+                Token token;
+
+                if (std::isdigit ((unsigned char) c) || (c == '.' && i + 1 < line.size() && std::isdigit ((unsigned char) line[i + 1])))
+                {
+                    const auto start = i;
+
+                    while (i < line.size() && (std::isdigit ((unsigned char) line[i]) || line[i] == '.'))
+                        ++i;
+
+                    token.type = Token::number;
+                    token.text = line.substr (start, i - start);
+
+                    if (std::count (token.text.begin(), token.text.end(), '.') > 1)
+                        return fail ("bad number '" + juce::String (token.text) + "'");
+
+                    token.value = (float) std::strtod (token.text.c_str(), nullptr);
+                }
+                else if (std::isalpha ((unsigned char) c) || c == '_')
+                {
+                    const auto start = i;
+
+                    while (i < line.size() && (std::isalnum ((unsigned char) line[i]) || line[i] == '_'))
+                        ++i;
+
+                    token.type = Token::name;
+                    token.text = line.substr (start, i - start);
+                }
+                else
+                {
+                    static const char* const twoCharSymbols[] = { "==", "!=", "<=", ">=" };
+                    token.type = Token::symbol;
+                    token.text = std::string (1, c);
+
+                    for (auto* symbol : twoCharSymbols)
+                        if (line.compare (i, 2, symbol) == 0)
+                            token.text = symbol;
+
+                    if (token.text.size() == 1 && std::string ("+-*/%<>(),:").find (c) == std::string::npos)
+                        return fail ("unexpected '" + token.text + "'");
+
+                    i += token.text.size();
+                }
+
+                tokens.push_back (std::move (token));
+            }
+
+            tokens.push_back ({});
+            return true;
+        }
+
+        const Token& peek() const   { return tokens[position]; }
+        const Token& next()         { return tokens[position < tokens.size() - 1 ? position++ : position]; }
+
+        bool accept (const char* text)
+        {
+            if (peek().type != Token::end && peek().type != Token::number && peek().text == text)
+            {
+                ++position;
+                return true;
+            }
+            return false;
+        }
+
+        bool expect (const char* text)
+        {
+            return accept (text) || fail (juce::String ("expected '") + text + "'" + describeNext());
+        }
+
+        juce::String describeNext() const
+        {
+            return peek().type == Token::end ? " at end of line" : " before '" + juce::String (peek().text) + "'";
+        }
+
+        bool fail (const juce::String& message)
+        {
+            error = message;
+            return false;
+        }
+
+        //======================================================================
+        bool compileLine()
+        {
+            if (peek().type == Token::end)
+                return true;
+
+            if (accept ("length"))
+            {
+                float beats = 0.0f;
+
+                if (! readNumber (beats) || beats < 0.25f || beats > 64.0f)
+                    return fail ("length takes a number of beats from 0.25 to 64");
+
+                program->pattern.lengthInBeats = beats;
+                return expectEnd();
+            }
+
+            if (accept ("steps"))
+            {
+                float steps = 0.0f;
+
+                if (! readNumber (steps) || steps < 1.0f || steps > (float) maxStepsPerCycle || steps != std::floor (steps))
+                    return fail ("steps takes a whole number from 1 to " + juce::String (maxStepsPerCycle));
+
+                program->stepsPerCycle = (int) steps;
+                return expectEnd();
+            }
+
+            int jump = -1;
+
+            if (accept ("if"))
+            {
+                if (! compileExpression() || ! expect (":"))
+                    return false;
+
+                jump = (int) program->code.size();
+                emit ({ Op::jumpIfFalse, 0, 0, 0.0f });
+            }
+
+            if (! accept ("play"))
+                return fail ("expected 'play', 'if', 'length' or 'steps'" + describeNext());
+
+            juce::uint16 tones = 0;
+
+            if (! compileTones (tones))
+                return false;
+
+            if (accept ("vel"))
+            {
+                if (! compileExpression())
+                    return false;
+            }
+            else
+            {
+                emit ({ Op::push, 0, 0, defaultVelocity });
+            }
+
+            if (accept ("len"))
+            {
+                if (! compileExpression())
+                    return false;
+            }
+            else
+            {
+                emit ({ Op::push, 0, 0, defaultLength });
+            }
+
+            emit ({ Op::play, 0, tones, 0.0f });
+
+            if (jump >= 0)
+                program->code[(size_t) jump].target = (juce::uint16) program->code.size();
+
+            if ((int) program->code.size() > maxInstructions)
+                return fail ("script is too long");
+
+            return error.isEmpty() && expectEnd();
+        }
+
+        bool expectEnd()
+        {
+            return peek().type == Token::end || fail ("unexpected '" + juce::String (peek().text) + "'");
+        }
+
+        bool readNumber (float& value)
+        {
+            if (peek().type != Token::number)
+                return false;
+
+            value = next().value;
+            return true;
+        }
+
+        bool compileTones (juce::uint16& tones)
+        {
+            do
+            {
+                if (accept ("bass"))
+                    tones |= bassTone;
+                else if (accept ("all"))
+                    tones |= allTones;
+                else if (peek().type == Token::number && peek().value == std::floor (peek().value) && peek().value < 8.0f)
+                    tones |= (juce::uint16) (1 << (int) next().value);
+                else
+                    return fail ("expected a chord tone (0-7), 'bass' or 'all'" + describeNext());
+            }
+            while (accept (","));
+
+            return true;
+        }
+
+        //======================================================================
+        bool compileExpression()
+        {
+            if (! compileAnd())
+                return false;
+
+            while (accept ("or"))
+            {
+                if (! compileAnd())
+                    return false;
+
+                emit ({ Op::logicalOr, 0, 0, 0.0f });
+            }
+            return true;
+        }
+
+        // Bounds the parser's recursion on input like "((((" or "- - - -"
+        bool compileNested (bool (Compiler::*compileInner)())
+        {
+            if (++nesting > maxNesting)
+                return fail ("expression is too deeply nested");
+
+            const bool ok = (this->*compileInner)();
+            --nesting;
+            return ok;
+        }
+
+        bool compileAnd()
+        {
+            if (! compileNot())
+                return false;
+
+            while (accept ("and"))
+            {
+                if (! compileNot())
+                    return false;
+
+                emit ({ Op::logicalAnd, 0, 0, 0.0f });
+            }
+            return true;
+        }
+
+        bool compileNot()
+        {
+            if (accept ("not"))
+            {
+                if (! compileNested (&Compiler::compileNot))
+                    return false;
+
+                emit ({ Op::logicalNot, 0, 0, 0.0f });
+                return true;
+            }
+
+            return compileComparison();
+        }
+
+        bool compileComparison()
+        {
+            if (! compileSum())
+                return false;
+
+            static const std::pair<const char*, Op> comparisons[] = {
+                { "==", Op::equal }, { "!=", Op::notEqual }, { "<=", Op::lessEqual },
+                { ">=", Op::greaterEqual }, { "<", Op::less }, { ">", Op::greater }
+            };
+
+            for (const auto& [text, op] : comparisons)
+            {
+                if (accept (text))
+                {
+                    if (! compileSum())
+                        return false;
+
+                    emit ({ op, 0, 0, 0.0f });
+                    return true;
+                }
+            }
+            return true;
+        }
+
+        bool compileSum()
+        {
+            if (! compileProduct())
+                return false;
+
+            for (;;)
+            {
+                const auto op = accept ("+") ? Op::add : accept ("-") ? Op::subtract : Op::push;
+
+                if (op == Op::push)
+                    return true;
+
+                if (! compileProduct())
+                    return false;
+
+                emit ({ op, 0, 0, 0.0f });
+            }
+        }
+
+        bool compileProduct()
+        {
+            if (! compileUnary())
+                return false;
+
+            for (;;)
+            {
+                const auto op = accept ("*") ? Op::multiply : accept ("/") ? Op::divide
+                                                              : accept ("%") ? Op::modulo : Op::push;
+
+                if (op == Op::push)
+                    return true;
+
+                if (! compileUnary())
+                    return false;
+
+                emit ({ op, 0, 0, 0.0f });
+            }
+        }
+
+        bool compileUnary()
+        {
+            if (accept ("-"))
+            {
+                if (! compileNested (&Compiler::compileUnary))
+                    return false;
+
+                emit ({ Op::negate, 0, 0, 0.0f });
+                return true;
+            }
+
+            return compilePrimary();
+        }
+
+        bool compilePrimary()
+        {
+            if (peek().type == Token::number)
+            {
+                emit ({ Op::push, 0, 0, next().value });
+                return true;
+            }
+
+            if (accept ("("))
+                return compileNested (&Compiler::compileExpression) && expect (")");
+
+            if (peek().type == Token::name)
+            {
+                static const char* const names[numVariables] = {
+                    "step", "steps", "beat", "bar", "cycle",
+                    "tones", "root", "major", "minor", "dominant", "seventh",
+                    "random"
+                };
+
+                for (int v = 0; v < numVariables; ++v)
+                {
+                    if (peek().text == names[v])
+                    {
+                        next();
+                        emit ({ Op::load, (juce::uint8) v, 0, 0.0f });
+                        return true;
+                    }
+                }
+
+                return fail ("unknown name '" + juce::String (peek().text) + "'");
+            }
+
+            return fail ("expected a value" + describeNext());
+        }
+
+        //======================================================================
+        // Tracks the stack depth each instruction leaves behind
+        void emit (const Instruction& instruction)
+        {
+            switch (instruction.op)
+            {
+                case Op::push:
+                case Op::load:          ++depth; break;
+                case Op::negate:
+                case Op::logicalNot:    break;
+                case Op::play:          depth -= 2; break;
+                default:                --depth; break;
+            }
+
+            if (depth > maxStackDepth)
+                fail ("expression is too deeply nested");
+
+            program->code.push_back (instruction);
+        }
+
+        // One cycle over C7 at bar 0, with a fixed seed so it draws the same
+        // way each time
+        static void renderPreview (Program& program)
+        {
+            DetectedChord chord;
+            chord.rootNote = 60;
+            chord.intervals = { 0, 4, 7, 10 };
+            chord.isValid = true;
+
+            juce::Random random (1);
+            Context context;
+            context.setChord (chord);
+            context.random = &random;
+
+            const double stepLength = program.getStepLength();
+
+            for (int k = 0; k < program.stepsPerCycle; ++k)
+            {
+                int budget = instructionBudget;
+                context.setStep (program, k, program.pattern.lengthInBeats);
+
+                run (program, context, budget, [&] (const PlayEvent& event)
+                {
+                    if (event.velocity <= 0.0f)
+                        return;
+
+                    for (int tone = -1; tone < (int) chord.intervals.size(); ++tone)
+                        if ((event.tones & (tone < 0 ? bassTone : (1 << tone))) != 0)
+                            program.pattern.notes.push_back ({ k * stepLength, tone, juce::jmin (1.0f, event.velocity),
+                                                               juce::jmax (0.01f, event.lengthInSteps) * stepLength });
+                });
+            }
+        }
+
+        //======================================================================
+        std::unique_ptr<Program> program;
+        std::vector<Token> tokens;
+        size_t position { 0 };
+        int lineNumber { 0 };
+        int depth { 0 };
+        int nesting { 0 };
+        juce::String error;
+
+        static constexpr int maxNesting = 64;
+    };
+
+    inline CompileResult compile (const juce::String& source)
+    {
+        return Compiler().compile (source);
+    }
+
+    // Straight eighths over the chord with the bass on the beat
+    inline const char* getDefaultSource()
+    {
+        return "# Pattern script - see the Script pattern in the browser\n"
+               "length 4\n"
+               "steps 8\n"
+               "if step % 2 == 0: play bass vel 0.9 len 1.8\n"
+               "play all vel 0.75 - 0.2 * (step % 2)\n"
+               "if bar % 4 == 3 and step == 7: play 0,1,2 vel 0.5 len 0.5\n";
+    }
+
+    // A script that plays a fixed pattern: one line per (step, velocity,
+    // length) group, on the pattern's own grid if one is given (an imported
+    // loop's) and otherwise the coarsest grid that holds every note. Empty
+    // if the notes don't fall on a grid the language can express.
+    inline juce::String fromPattern (const RhythmPattern& pattern, int preferredStepsPerBeat = 0)
+    {
+        for (int stepsPerBeat : { preferredStepsPerBeat, 2, 3, 4, 6, 8, 12, 16 })
+        {
+            const int numSteps = juce::roundToInt (pattern.lengthInBeats * stepsPerBeat);
+
+            if (stepsPerBeat <= 0 || numSteps > maxStepsPerCycle)
+                continue;
+
+            const double stepLength = 1.0 / stepsPerBeat;
+            bool onGrid = true;
+            std::map<std::tuple<int, float, double>, juce::StringArray> groups;
+
+            for (const auto& note : pattern.notes)
+            {
+                const double step = note.beatPosition / stepLength;
+                onGrid = onGrid && std::abs (step - std::round (step)) < 1.0e-6 && note.probability >= 1.0f;
+                groups[{ (int) std::round (step), note.velocity, note.duration / stepLength }]
+                    .add (note.chordIndex < 0 ? juce::String ("bass") : juce::String (note.chordIndex));
+            }
+
+            if (! onGrid)
+                continue;
+
+            juce::String script;
+            script << "length " << pattern.lengthInBeats << "\nsteps " << numSteps << "\n";
+
+            for (const auto& [key, tones] : groups)
+                script << "if step == " << std::get<0> (key) << ": play " << tones.joinIntoString (",")
+                       << " vel " << juce::String (std::get<1> (key), 2)
+                       << " len " << juce::String (std::get<2> (key), 3) << "\n";
+
+            return script;
+        }
+
+        return {};
+    }
+}
+
+//==============================================================================
+// Holds the script the engines play. Compiling happens on the calling
+// (non-audio) thread; a script that compiles is published through an atomic
+// pointer, and the audio thread announces the program it is using (a hazard
+// pointer) so a replaced program is only freed once no block can be reading
+// it. A script that fails to compile leaves the current one playing.
+class PatternScriptSource
+{
+public:
+    PatternScriptSource()
+    {
+        setSource (PatternScript::getDefaultSource());
+    }
+
+    //==========================================================================
+    // Any thread but the audio thread. Returns the compile error, or an empty
+    // string once the new script is playing.
+    juce::String setSource (const juce::String& newSource)
+    {
+        auto result = PatternScript::compile (newSource);
+
+        // Too long to keep in the session state
+        if (newSource.length() > PatternScript::maxSourceLength)
+            return result.error;
+
+        const juce::ScopedLock sl (lock);
+        source = newSource;
+        error = result.error;
+
+        if (result.program != nullptr)
+        {
+            programs.push_back (std::move (result.program));
+            published.store (programs.back().get());
+            releaseUnused();
+        }
+
+        return error;
+    }
+
+    juce::String getSource() const      { const juce::ScopedLock sl (lock); return source; }
+    juce::String getError() const       { const juce::ScopedLock sl (lock); return error; }
+
+    // A copy of the playing script's pattern, for display
+    RhythmPattern getPattern() const    { const juce::ScopedLock sl (lock); return published.load()->pattern; }
+
+    //==========================================================================
+    // Audio thread: the program to run for this block. Stays valid until the
+    // next call.
+    const PatternScript::Program& acquire() noexcept
+    {
+        auto* program = published.load();
+
+        for (;;)
+        {
+            inUse.store (program);
+            auto* latest = published.load();
+
+            if (latest == program)
+                return *program;
+
+            program = latest;
+        }
+    }
+
+private:
+    // Frees replaced programs the audio thread can't be reading
+    void releaseUnused()
+    {
+        const auto* current = published.load();
+        const auto* reading = inUse.load();
+
+        programs.erase (std::remove_if (programs.begin(), programs.end(), [&] (const auto& p)
+                                        { return p.get() != current && p.get() != reading; }),
+                        programs.end());
+    }
+
+    juce::CriticalSection lock;
+    juce::String source, error;
+    std::vector<std::unique_ptr<PatternScript::Program>> programs;
+
+    std::atomic<const PatternScript::Program*> published { nullptr };
+    std::atomic<const PatternScript::Program*> inUse { nullptr };
+
+    JUCE_DECLARE_NON_COPYABLE (PatternScriptSource)
+};
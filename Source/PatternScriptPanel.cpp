@@ -0,0 +1,102 @@
+#include "PatternScriptPanel.h"
+
+//==============================================================================
+PatternScriptPanel::PatternScriptPanel (PatternScriptSource& s)
+    : script (s)
+{
+    sourceEditor.setMultiLine (true, false);
+    sourceEditor.setReturnKeyStartsNewLine (true);
+    sourceEditor.setTabKeyUsedAsCharacter (true);
+    sourceEditor.setScrollbarsShown (true);
+    sourceEditor.setFont (juce::FontOptions (juce::Font::getDefaultMonospacedFontName(), 13.0f, juce::Font::plain));
+    sourceEditor.setColour (juce::TextEditor::backgroundColourId, juce::Colour (0xff2a2a4a));
+    sourceEditor.setColour (juce::TextEditor::textColourId, juce::Colours::white);
+    sourceEditor.setColour (juce::TextEditor::outlineColourId, juce::Colour (0xff4a4a6a));
+    sourceEditor.setColour (juce::TextEditor::focusedOutlineColourId, juce::Colour (0xff4ecdc4));
+    sourceEditor.setText (script.getSource(), false);
+    addAndMakeVisible (sourceEditor);
+
+    for (auto* button : { &applyButton, &revertButton })
+    {
+        button->setColour (juce::TextButton::buttonColourId, juce::Colour (0xff3a3a5a));
+        button->setColour (juce::TextButton::textColourOffId, juce::Colours::white);
+        addAndMakeVisible (button);
+    }
+
+    applyButton.setTooltip ("Compile and play the script (Ctrl/Cmd + Return)");
+    applyButton.onClick = [this] { apply(); };
+
+    revertButton.setTooltip ("Replace the text with the default script");
+    revertButton.onClick = [this] { sourceEditor.setText (PatternScript::getDefaultSource(), false); };
+
+    resultLabel.setFont (juce::FontOptions (12.0f));
+    resultLabel.setJustificationType (juce::Justification::centredLeft);
+    addAndMakeVisible (resultLabel);
+
+    showResult (script.getError());
+}
+
+//==============================================================================
+void PatternScriptPanel::paint (juce::Graphics& g)
+{
+    g.fillAll (juce::Colour (0xff16213e));
+}
+
+void PatternScriptPanel::resized()
+{
+    auto bounds = getLocalBounds().reduced (8);
+    auto bottom = bounds.removeFromBottom (26);
+
+    applyButton.setBounds (bottom.removeFromRight (70));
+    bottom.removeFromRight (6);
+    revertButton.setBounds (bottom.removeFromRight (70));
+    bottom.removeFromRight (6);
+    resultLabel.setBounds (bottom);
+
+    bounds.removeFromBottom (6);
+    sourceEditor.setBounds (bounds);
+}
+
+void PatternScriptPanel::parentHierarchyChanged()
+{
+    // Ready for typing as soon as the call-out opens
+    juce::Component::SafePointer<juce::TextEditor> editor (&sourceEditor);
+    juce::MessageManager::callAsync ([editor]
+    {
+        if (editor != nullptr && editor->isShowing())
+            editor->grabKeyboardFocus();
+    });
+}
+
+bool PatternScriptPanel::keyPressed (const juce::KeyPress& key)
+{
+    if (key == juce::KeyPress (juce::KeyPress::returnKey, juce::ModifierKeys::commandModifier, 0))
+    {
+        apply();
+        return true;
+    }
+
+    return false;
+}
+
+//==============================================================================
+void PatternScriptPanel::apply()
+{
+    showResult (script.setSource (sourceEditor.getText()));
+}
+
+void PatternScriptPanel::showResult (const juce::String& error)
+{
+    if (error.isEmpty())
+    {
+        resultLabel.setColour (juce::Label::textColourId, juce::Colour (0xff4ecdc4));
+        resultLabel.setText ("Compiled - playing", juce::dontSendNotification);
+    }
+    else
+    {
+        resultLabel.setColour (juce::Label::textColourId, juce::Colour (0xffff6b6b));
+        resultLabel.setText (error, juce::dontSendNotification);
+    }
+
+    resultLabel.setTooltip (error);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <juce_gui_basics/juce_gui_basics.h>
+#include "PatternScript.h"
+
+//==============================================================================
+// Script editor shown in a call-out from the editor. Apply (or Cmd/Ctrl +
+// Return) compiles the text; the result line shows the first error, and the
+// script playing only changes once the text compiles.
+class PatternScriptPanel final : public juce::Component
+{
+public:
+    explicit PatternScriptPanel (PatternScriptSource& script);
+
+    void paint (juce::Graphics&) override;
+    void resized() override;
+    void parentHierarchyChanged() override;
+    bool keyPressed (const juce::KeyPress&) override;
+
+private:
+    void apply();
+    void showResult (const juce::String& error);
+
+    PatternScriptSource& script;
+
+    juce::TextEditor sourceEditor;
+    juce::TextButton applyButton { "Apply" };
+    juce::TextButton revertButton { "Default" };
+    juce::Label resultLabel;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PatternScriptPanel)
+};
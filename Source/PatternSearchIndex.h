@@ -0,0 +1,175 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//==============================================================================
+// Type-ahead search over pattern names, with tag filtering.
+//
+// Names are indexed by trigram (three consecutive lower-case bytes). A query
+// of three or more characters only visits the patterns holding all of its
+// trigrams - the posting lists are intersected shortest first - and then
+// checks the substring. Shorter queries scan every name. While the user keeps
+// typing, a query that extends the previous one just filters the previous
+// results. Tags are bits in a per-pattern mask (up to 64 distinct tags); a
+// filter keeps the patterns that have every selected tag.
+class PatternSearchIndex
+{
+public:
+    static constexpr int maxTags = 64;
+
+    void clear()
+    {
+        names.clear();
+        lowerNames.clear();
+        tagMasks.clear();
+        tagNames.clear();
+        postings.clear();
+        resultsValid = false;
+    }
+
+    // Patterns are numbered in the order they are added
+    void add (const juce::String& name, const juce::StringArray& tags)
+    {
+        const int index = (int) lowerNames.size();
+        names.add (name);
+        lowerNames.push_back (name.toLowerCase().toStdString());
+
+        juce::uint64 mask = 0;
+
+        for (const auto& tag : tags)
+        {
+            int bit = tagNames.indexOf (tag);
+
+            if (bit < 0 && tagNames.size() < maxTags)
+            {
+                bit = tagNames.size();
+                tagNames.add (tag);
+            }
+
+            if (bit >= 0)
+                mask |= (juce::uint64) 1 << bit;
+        }
+
+        tagMasks.push_back (mask);
+
+        const auto& lower = lowerNames.back();
+
+        for (size_t i = 0; i + 3 <= lower.size(); ++i)
+        {
+            // Indexes are added in order, so each list stays sorted; a name
+            // repeating a trigram is listed once
+            auto& list = postings[trigram (lower.data() + i)];
+
+            if (list.empty() || list.back() != index)
+                list.push_back (index);
+        }
+
+        resultsValid = false;
+    }
+
+    int getNumPatterns() const                      { return (int) lowerNames.size(); }
+    const juce::String& getName (int pattern) const { return names.getReference (pattern); }
+    const juce::StringArray& getTagNames() const    { return tagNames; }
+    juce::uint64 getTagMask (int pattern) const     { return tagMasks[(size_t) pattern]; }
+
+    //==========================================================================
+    // Indexes of the matching patterns, in library order. The reference stays
+    // valid until the next search or add().
+    const std::vector<int>& search (const juce::String& query, juce::uint64 requiredTags)
+    {
+        const auto text = query.trim().toLowerCase().toStdString();
+
+        if (resultsValid && requiredTags == lastTags && text == lastQuery)
+            return results;
+
+        const bool refinesLast = resultsValid && requiredTags == lastTags
+                                   && text.compare (0, lastQuery.size(), lastQuery) == 0;
+
+        const auto matches = [&] (int index)
+        {
+            return (tagMasks[(size_t) index] & requiredTags) == requiredTags
+                && lowerNames[(size_t) index].find (text) != std::string::npos;
+        };
+
+        if (refinesLast)
+        {
+            results.erase (std::remove_if (results.begin(), results.end(), [&] (int i) { return ! matches (i); }),
+                           results.end());
+        }
+        else if (text.size() >= 3)
+        {
+            intersectPostings (text);
+            results.erase (std::remove_if (results.begin(), results.end(), [&] (int i) { return ! matches (i); }),
+                           results.end());
+        }
+        else
+        {
+            results.clear();
+
+            for (int i = 0; i < getNumPatterns(); ++i)
+                if (matches (i))
+                    results.push_back (i);
+        }
+
+        lastQuery = text;
+        lastTags = requiredTags;
+        resultsValid = true;
+        return results;
+    }
+
+private:
+    //==========================================================================
+    static juce::uint32 trigram (const char* text)
+    {
+        return ((juce::uint32) (juce::uint8) text[0] << 16)
+             | ((juce::uint32) (juce::uint8) text[1] << 8)
+             |  (juce::uint32) (juce::uint8) text[2];
+    }
+
+    // Candidates holding every trigram of the query
+    void intersectPostings (const std::string& text)
+    {
+        std::vector<const std::vector<int>*> lists;
+
+        for (size_t i = 0; i + 3 <= text.size(); ++i)
+        {
+            const auto found = postings.find (trigram (text.data() + i));
+
+            if (found == postings.end())
+            {
+                results.clear();
+                return;
+            }
+
+            lists.push_back (&found->second);
+        }
+
+        std::sort (lists.begin(), lists.end(), [] (auto* a, auto* b) { return a->size() < b->size(); });
+
+        results = *lists.front();
+
+        for (size_t l = 1; l < lists.size() && ! results.empty(); ++l)
+        {
+            const auto& list = *lists[l];
+            results.erase (std::remove_if (results.begin(), results.end(),
+                                           [&] (int i) { return ! std::binary_search (list.begin(), list.end(), i); }),
+                           results.end());
+        }
+    }
+
+    juce::StringArray names;
+    std::vector<std::string> lowerNames;
+    std::vector<juce::uint64> tagMasks;
+    juce::StringArray tagNames;
+    std::unordered_map<juce::uint32, std::vector<int>> postings;
+
+    // Last search, refined while the query grows
+    std::vector<int> results;
+    std::string lastQuery;
+    juce::uint64 lastTags { 0 };
+    bool resultsValid { false };
+};
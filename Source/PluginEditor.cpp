@@ -1,5 +1,7 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "PatternBrowser.h"
+#include "PatternScriptPanel.h"
 
 //==============================================================================
 AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor& p)
@@ -11,13 +13,19 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     setupLabel (patternLabel);
     addAndMakeVisible (patternLabel);
     
-    patternSelector.addItemList (processorRef.getPatternNames(), 1);
-    patternSelector.setSelectedId (processorRef.currentPatternIndex.load() + 1, juce::dontSendNotification);
-    patternSelector.onChange = [this] {
-        processorRef.currentPatternIndex.store (patternSelector.getSelectedId() - 1);
-    };
-    setupComboBox (patternSelector);
-    addAndMakeVisible (patternSelector);
+    // A button rather than a combo box, so opening the editor doesn't build a
+    // menu of the whole library
+    patternButton.setColour (juce::TextButton::buttonColourId, juce::Colour (0xff2a2a4a));
+    patternButton.setColour (juce::TextButton::textColourOffId, juce::Colours::white);
+    patternButton.setTooltip ("Browse patterns");
+    patternButton.onClick = [this] { showPatternBrowser(); };
+    addAndMakeVisible (patternButton);
+    
+    patternAttachment = std::make_unique<juce::ParameterAttachment> (*processorRef.patternParam, [this] (float value)
+    {
+        patternButton.setButtonText (processorRef.patternParam->choices[juce::roundToInt (value)]);
+    });
+    patternAttachment->sendInitialUpdate();
     
     // Detected chord display
     setupLabel (detectedChordLabel);
@@ -30,37 +38,303 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     detectedChordValue.setJustificationType (juce::Justification::centred);
     addAndMakeVisible (detectedChordValue);
     
+    // Estimated key display (top right, next to the title)
+    detectedKeyValue.setFont (juce::FontOptions (13.0f));
+    detectedKeyValue.setColour (juce::Label::textColourId, juce::Colour (0xffaaaacc));
+    detectedKeyValue.setJustificationType (juce::Justification::centredRight);
+    addAndMakeVisible (detectedKeyValue);
+    
     // Tempo slider setup
     setupLabel (tempoLabel);
     addAndMakeVisible (tempoLabel);
     
-    tempoSlider.setRange (40.0, 240.0, 1.0);
-    tempoSlider.setValue (processorRef.internalTempo.load(), juce::dontSendNotification);
-    tempoSlider.setTextBoxStyle (juce::Slider::TextBoxRight, false, 50, 25);
-    tempoSlider.setColour (juce::Slider::thumbColourId, juce::Colour (0xffff6b6b));
-    tempoSlider.setColour (juce::Slider::trackColourId, juce::Colour (0xff4a4a6a));
-    tempoSlider.setColour (juce::Slider::backgroundColourId, juce::Colour (0xff2a2a4a));
-    tempoSlider.setColour (juce::Slider::textBoxTextColourId, juce::Colours::white);
-    tempoSlider.setColour (juce::Slider::textBoxOutlineColourId, juce::Colours::transparentBlack);
-    tempoSlider.onValueChange = [this] {
-        processorRef.internalTempo.store (static_cast<float> (tempoSlider.getValue()));
-    };
+    setupSlider (tempoSlider);
+    tempoAttachment = std::make_unique<juce::SliderParameterAttachment> (*processorRef.tempoParam, tempoSlider);
     addAndMakeVisible (tempoSlider);
     
     // Enable button setup
-    enableButton.setClickingTogglesState (true);
-    enableButton.setToggleState (processorRef.patternEnabled.load(), juce::dontSendNotification);
-    enableButton.setColour (juce::TextButton::buttonColourId, juce::Colour (0xff3a3a5a));
-    enableButton.setColour (juce::TextButton::buttonOnColourId, juce::Colour (0xff4ecdc4));
-    enableButton.setColour (juce::TextButton::textColourOnId, juce::Colour (0xff1a1a2e));
-    enableButton.setColour (juce::TextButton::textColourOffId, juce::Colours::white);
-    enableButton.onClick = [this] {
-        bool isOn = enableButton.getToggleState();
-        processorRef.patternEnabled.store (isOn);
-        enableButton.setButtonText (isOn ? "ON" : "OFF");
+    setupToggleButton (enableButton);
+    enableButton.onStateChange = [this] {
+        enableButton.setButtonText (enableButton.getToggleState() ? "ON" : "OFF");
     };
+    enabledAttachment = std::make_unique<juce::ButtonParameterAttachment> (*processorRef.enabledParam, enableButton);
     addAndMakeVisible (enableButton);
     
+    // Bar-quantised pattern switching
+    setupToggleButton (quantiseButton);
+    quantiseButton.setTooltip ("Delay pattern changes until the next bar line");
+    quantiseAttachment = std::make_unique<juce::ButtonParameterAttachment> (*processorRef.quantiseSwitchParam, quantiseButton);
+    addAndMakeVisible (quantiseButton);
+    
+    // Input routing setup
+    setupLabel (inputModeLabel);
+    addAndMakeVisible (inputModeLabel);
+    
+    inputModeSelector.addItemList (processorRef.inputModeParam->choices, 1);
+    inputModeAttachment = std::make_unique<juce::ComboBoxParameterAttachment> (*processorRef.inputModeParam, inputModeSelector);
+    setupComboBox (inputModeSelector);
+    addAndMakeVisible (inputModeSelector);
+    
+    inputChannelSelector.addItemList (processorRef.inputChannelParam->choices, 1);
+    inputChannelSelector.setTooltip ("Input channel to follow");
+    inputChannelAttachment = std::make_unique<juce::ComboBoxParameterAttachment> (*processorRef.inputChannelParam, inputChannelSelector);
+    setupComboBox (inputChannelSelector);
+    addAndMakeVisible (inputChannelSelector);
+    
+    setupLabel (splitPointLabel);
+    addAndMakeVisible (splitPointLabel);
+    
+    setupSlider (splitPointSlider);
+    splitPointSlider.textFromValueFunction = [] (double value) {
+        return juce::MidiMessage::getMidiNoteName ((int) value, true, true, 4);
+    };
+    splitPointAttachment = std::make_unique<juce::SliderParameterAttachment> (*processorRef.splitPointParam, splitPointSlider);
+    addAndMakeVisible (splitPointSlider);
+    
+    // DIN output stage setup
+    setupToggleButton (dinButton);
+    dinButton.setTooltip ("Schedule output for a 31.25 kbaud DIN MIDI cable");
+    dinAttachment = std::make_unique<juce::ButtonParameterAttachment> (*processorRef.dinOutputParam, dinButton);
+    addAndMakeVisible (dinButton);
+    
+    dinStatusValue.setFont (juce::FontOptions (13.0f));
+    dinStatusValue.setColour (juce::Label::textColourId, juce::Colour (0xffaaaacc));
+    dinStatusValue.setJustificationType (juce::Justification::centredLeft);
+    addAndMakeVisible (dinStatusValue);
+    
+    // Preview synth setup
+    setupLabel (previewLabel);
+    addAndMakeVisible (previewLabel);
+    
+    setupToggleButton (previewButton);
+    previewButton.setTooltip ("Play the generated notes on the built-in synth");
+    previewAttachment = std::make_unique<juce::ButtonParameterAttachment> (*processorRef.previewEnabledParam, previewButton);
+    addAndMakeVisible (previewButton);
+    
+    previewSoundSelector.addItemList (processorRef.previewSoundParam->choices, 1);
+    previewSoundAttachment = std::make_unique<juce::ComboBoxParameterAttachment> (*processorRef.previewSoundParam, previewSoundSelector);
+    setupComboBox (previewSoundSelector);
+    addAndMakeVisible (previewSoundSelector);
+    
+    setupLabel (previewLevelLabel);
+    addAndMakeVisible (previewLevelLabel);
+    
+    setupSlider (previewLevelSlider);
+    previewLevelAttachment = std::make_unique<juce::SliderParameterAttachment> (*processorRef.previewLevelParam, previewLevelSlider);
+    addAndMakeVisible (previewLevelSlider);
+    
+    // Strum capture setup
+    setupLabel (strumCaptureLabel);
+    addAndMakeVisible (strumCaptureLabel);
+    
+    setupSlider (strumCaptureSlider);
+    strumCaptureSlider.setTooltip ("Wait this long for a rolled chord to settle (adds latency, 0 = live)");
+    strumCaptureAttachment = std::make_unique<juce::SliderParameterAttachment> (*processorRef.strumCaptureParam, strumCaptureSlider);
+    
+    // Set after the attachment, which installs the parameter's own text conversion
+    strumCaptureSlider.textFromValueFunction = [] (double value) {
+        return value <= 0.0 ? juce::String ("Live") : juce::String (juce::roundToInt (value)) + " ms";
+    };
+    strumCaptureSlider.updateText();
+    addAndMakeVisible (strumCaptureSlider);
+    
+    // Bass line setup
+    setupLabel (bassModeLabel);
+    addAndMakeVisible (bassModeLabel);
+    
+    bassModeSelector.addItemList (processorRef.bassModeParam->choices, 1);
+    bassModeSelector.setTooltip ("Bass notes: the chord root, or a walking line that leads into the next chord");
+    bassModeAttachment = std::make_unique<juce::ComboBoxParameterAttachment> (*processorRef.bassModeParam, bassModeSelector);
+    setupComboBox (bassModeSelector);
+    addAndMakeVisible (bassModeSelector);
+    
+    // MIDI clock setup
+    setupLabel (clockModeLabel);
+    addAndMakeVisible (clockModeLabel);
+    
+    clockModeSelector.addItemList (processorRef.clockModeParam->choices, 1);
+    clockModeAttachment = std::make_unique<juce::ComboBoxParameterAttachment> (*processorRef.clockModeParam, clockModeSelector);
+    setupComboBox (clockModeSelector);
+    addAndMakeVisible (clockModeSelector);
+    
+    clockStatusValue.setFont (juce::FontOptions (13.0f));
+    clockStatusValue.setColour (juce::Label::textColourId, juce::Colour (0xffaaaacc));
+    clockStatusValue.setJustificationType (juce::Justification::centredLeft);
+    addAndMakeVisible (clockStatusValue);
+    
+    // Chord bus setup
+    setupLabel (chordBusLabel);
+    addAndMakeVisible (chordBusLabel);
+    
+    chordBusModeSelector.addItemList (processorRef.chordBusModeParam->choices, 1);
+    chordBusModeAttachment = std::make_unique<juce::ComboBoxParameterAttachment> (*processorRef.chordBusModeParam, chordBusModeSelector);
+    setupComboBox (chordBusModeSelector);
+    addAndMakeVisible (chordBusModeSelector);
+    
+    setupStepper (chordBusChannelSlider);
+    chordBusChannelSlider.setTooltip ("Bus channel (split and per-channel modes use one channel per zone from here)");
+    chordBusChannelAttachment = std::make_unique<juce::SliderParameterAttachment> (*processorRef.chordBusChannelParam, chordBusChannelSlider);
+    addAndMakeVisible (chordBusChannelSlider);
+    
+    // Euclidean generator setup
+    setupLabel (generatorLabel);
+    addAndMakeVisible (generatorLabel);
+    
+    setupStepper (genHitsSlider);
+    setupStepper (genStepsSlider);
+    setupStepper (genRotationSlider);
+    setupSlider (genProbabilitySlider);
+    setupSlider (genGhostSlider);
+    setupSlider (genAccentSlider);
+    
+    genHitsSlider.setTooltip ("Hits spread evenly over the steps");
+    genStepsSlider.setTooltip ("Steps in the cycle, one 16th note each");
+    genRotationSlider.setTooltip ("Shift the hits this many steps later");
+    genProbabilitySlider.setTooltip ("Chance of each hit after the first");
+    genGhostSlider.setTooltip ("Chance of a soft ghost stab on each rest");
+    genAccentSlider.setTooltip ("Velocity contrast between on-beat and off-beat hits");
+    
+    const std::array<std::pair<juce::RangedAudioParameter*, juce::Slider*>, 6> generatorControls {{
+        { processorRef.genHitsParam,        &genHitsSlider },
+        { processorRef.genStepsParam,       &genStepsSlider },
+        { processorRef.genRotationParam,    &genRotationSlider },
+        { processorRef.genProbabilityParam, &genProbabilitySlider },
+        { processorRef.genGhostParam,       &genGhostSlider },
+        { processorRef.genAccentParam,      &genAccentSlider }
+    }};
+    
+    for (size_t i = 0; i < generatorControls.size(); ++i)
+    {
+        generatorAttachments[i] = std::make_unique<juce::SliderParameterAttachment> (*generatorControls[i].first,
+                                                                                      *generatorControls[i].second);
+        addAndMakeVisible (generatorControls[i].second);
+    }
+    
+    for (auto* label : { &genStepsLabel, &genRotationLabel, &genProbabilityLabel, &genGhostLabel, &genAccentLabel })
+    {
+        setupLabel (*label);
+        addAndMakeVisible (label);
+    }
+    
+    // Take recorder setup. Recording isn't a parameter: it writes a file,
+    // so it shouldn't be automated or restored with the session.
+    setupLabel (recordLabel);
+    addAndMakeVisible (recordLabel);
+    
+    setupToggleButton (recordButton);
+    recordButton.setColour (juce::TextButton::buttonOnColourId, juce::Colour (0xffff6b6b));
+    recordButton.setTooltip ("Record the generated MIDI to a file in Documents/Chord Pattern Player Recordings");
+    recordButton.setToggleState (processorRef.getRecorder().isRecording(), juce::dontSendNotification);
+    recordButton.onClick = [this]
+    {
+        auto& recorder = processorRef.getRecorder();
+        
+        if (recordButton.getToggleState())
+            recorder.start (MidiRecorder::getDefaultTakeFile());
+        else
+            recorder.stop();
+    };
+    addAndMakeVisible (recordButton);
+    
+    recordStatusValue.setFont (juce::FontOptions (13.0f));
+    recordStatusValue.setColour (juce::Label::textColourId, juce::Colour (0xffaaaacc));
+    recordStatusValue.setJustificationType (juce::Justification::centredLeft);
+    addAndMakeVisible (recordStatusValue);
+    
+    // Chord source and audio analysis setup
+    setupLabel (chordSourceLabel);
+    addAndMakeVisible (chordSourceLabel);
+    
+    chordSourceSelector.addItemList (processorRef.chordSourceParam->choices, 1);
+    chordSourceSelector.setTooltip ("Detect chords from MIDI notes, or from audio on the Chord Input bus");
+    chordSourceAttachment = std::make_unique<juce::ComboBoxParameterAttachment> (*processorRef.chordSourceParam, chordSourceSelector);
+    setupComboBox (chordSourceSelector);
+    addAndMakeVisible (chordSourceSelector);
+    
+    setupLabel (audioWindowLabel);
+    addAndMakeVisible (audioWindowLabel);
+    
+    audioWindowSelector.addItemList (processorRef.audioWindowParam->choices, 1);
+    audioWindowSelector.setTooltip ("Analysis window in samples: larger finds bass notes better, smaller reacts faster");
+    audioWindowAttachment = std::make_unique<juce::ComboBoxParameterAttachment> (*processorRef.audioWindowParam, audioWindowSelector);
+    setupComboBox (audioWindowSelector);
+    addAndMakeVisible (audioWindowSelector);
+    
+    setupLabel (audioHopLabel);
+    addAndMakeVisible (audioHopLabel);
+    
+    audioHopSelector.addItemList (processorRef.audioHopParam->choices, 1);
+    audioHopSelector.setTooltip ("Samples between analyses: shorter reacts faster and costs more CPU");
+    audioHopAttachment = std::make_unique<juce::ComboBoxParameterAttachment> (*processorRef.audioHopParam, audioHopSelector);
+    setupComboBox (audioHopSelector);
+    addAndMakeVisible (audioHopSelector);
+    
+    audioStatusValue.setFont (juce::FontOptions (13.0f));
+    audioStatusValue.setColour (juce::Label::textColourId, juce::Colour (0xffaaaacc));
+    audioStatusValue.setJustificationType (juce::Justification::centredLeft);
+    addAndMakeVisible (audioStatusValue);
+    
+    // Shed event counts, only shown once a flood has hit
+    overloadStatusValue.setFont (juce::FontOptions (13.0f));
+    overloadStatusValue.setColour (juce::Label::textColourId, juce::Colour (0xffff6b6b));
+    overloadStatusValue.setJustificationType (juce::Justification::centredRight);
+    overloadStatusValue.setTooltip ("MIDI flood protection. In: duplicate and excess input events dropped. "
+                                    "Out: notes not started, including while the DIN output is backed up. "
+                                    "Note-offs are never dropped.");
+    addAndMakeVisible (overloadStatusValue);
+    
+    // Rhythm sync setup
+    setupLabel (rhythmSyncLabel);
+    addAndMakeVisible (rhythmSyncLabel);
+    
+    rhythmSyncSelector.addItemList (processorRef.rhythmSyncParam->choices, 1);
+    rhythmSyncSelector.setTooltip ("Tempo: follow the host, the MIDI clock or the Tempo knob. "
+                                   "Audio Onsets: follow a live player's hits on the audio input, "
+                                   "with the Tempo knob as a starting point");
+    rhythmSyncAttachment = std::make_unique<juce::ComboBoxParameterAttachment> (*processorRef.rhythmSyncParam, rhythmSyncSelector);
+    setupComboBox (rhythmSyncSelector);
+    addAndMakeVisible (rhythmSyncSelector);
+    
+    onsetStatusValue.setFont (juce::FontOptions (13.0f));
+    onsetStatusValue.setColour (juce::Label::textColourId, juce::Colour (0xffaaaacc));
+    onsetStatusValue.setJustificationType (juce::Justification::centredLeft);
+    onsetStatusValue.setTooltip ("Latency: from the start of a hit to the MIDI it re-phases, averaged, with the worst so far");
+    addAndMakeVisible (onsetStatusValue);
+    
+    // Session capture setup
+    setupToggleButton (captureButton);
+    captureButton.setColour (juce::TextButton::buttonOnColourId, juce::Colour (0xffff6b6b));
+    captureButton.setToggleState (processorRef.getSessionCapture().isCapturing(), juce::dontSendNotification);
+    captureButton.onClick = [this]
+    {
+        if (captureButton.getToggleState())
+            processorRef.startSessionCapture (SessionCapture::getDefaultLogFile());
+        else
+            processorRef.getSessionCapture().stop();
+    };
+    addAndMakeVisible (captureButton);
+    
+    // Pattern script setup
+    setupLabel (scriptLabel);
+    addAndMakeVisible (scriptLabel);
+    
+    scriptButton.setColour (juce::TextButton::buttonColourId, juce::Colour (0xff3a3a5a));
+    scriptButton.setColour (juce::TextButton::textColourOffId, juce::Colours::white);
+    scriptButton.setTooltip ("Edit the script played by the Script pattern");
+    scriptButton.onClick = [this] { showScriptEditor(); };
+    addAndMakeVisible (scriptButton);
+    
+    scriptStatusValue.setFont (juce::FontOptions (13.0f));
+    scriptStatusValue.setJustificationType (juce::Justification::centredLeft);
+    addAndMakeVisible (scriptStatusValue);
+    
+   #if CHORDER_ENABLE_TRACING
+    traceDumpButton.setColour (juce::TextButton::buttonColourId, juce::Colour (0xff3a3a5a));
+    traceDumpButton.setTooltip ("Save the recent trace as Chrome trace JSON in Documents");
+    traceDumpButton.onClick = [] { TraceRecorder::getInstance().requestDump (TraceRecorder::getDefaultDumpFile()); };
+    addAndMakeVisible (traceDumpButton);
+   #endif
+    
     // MIDI keyboard setup
     midiKeyboard.setKeyWidth (35.0f);
     midiKeyboard.setAvailableRange (36, 96);
@@ -71,7 +345,7 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     midiKeyboard.setColour (juce::MidiKeyboardComponent::keyDownOverlayColourId, juce::Colour (0xccff6b6b));
     addAndMakeVisible (midiKeyboard);
 
-    setSize (850, 280);
+    setSize (850, 560);
     startTimerHz (30);
 }
 
@@ -80,6 +354,26 @@ AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor()
     stopTimer();
 }
 
+void AudioPluginAudioProcessorEditor::showPatternBrowser()
+{
+    auto browser = std::make_unique<PatternBrowser> (processorRef.getPatternSearchIndex(),
+                                                     [this] (int index) { return processorRef.getPatternForDisplay (index); },
+                                                     processorRef.patternParam->getIndex(),
+                                                     [this] (int index) { patternAttachment->setValueAsCompleteGesture ((float) index); });
+    browser->setSize (360, 300);
+    
+    // Owned by the editor, so it can't outlive the callbacks above
+    juce::CallOutBox::launchAsynchronously (std::move (browser), patternButton.getBounds(), this);
+}
+
+void AudioPluginAudioProcessorEditor::showScriptEditor()
+{
+    auto panel = std::make_unique<PatternScriptPanel> (processorRef.getPatternScript());
+    panel->setSize (480, 320);
+    
+    juce::CallOutBox::launchAsynchronously (std::move (panel), scriptButton.getBounds(), this);
+}
+
 void AudioPluginAudioProcessorEditor::setupComboBox (juce::ComboBox& box)
 {
     box.setColour (juce::ComboBox::backgroundColourId, juce::Colour (0xff2a2a4a));
@@ -88,6 +382,33 @@ void AudioPluginAudioProcessorEditor::setupComboBox (juce::ComboBox& box)
     box.setColour (juce::ComboBox::arrowColourId, juce::Colour (0xff4ecdc4));
 }
 
+void AudioPluginAudioProcessorEditor::setupToggleButton (juce::TextButton& button)
+{
+    button.setClickingTogglesState (true);
+    button.setColour (juce::TextButton::buttonColourId, juce::Colour (0xff3a3a5a));
+    button.setColour (juce::TextButton::buttonOnColourId, juce::Colour (0xff4ecdc4));
+    button.setColour (juce::TextButton::textColourOnId, juce::Colour (0xff1a1a2e));
+    button.setColour (juce::TextButton::textColourOffId, juce::Colours::white);
+}
+
+void AudioPluginAudioProcessorEditor::setupSlider (juce::Slider& slider)
+{
+    slider.setTextBoxStyle (juce::Slider::TextBoxRight, false, 50, 25);
+    slider.setColour (juce::Slider::thumbColourId, juce::Colour (0xffff6b6b));
+    slider.setColour (juce::Slider::trackColourId, juce::Colour (0xff4a4a6a));
+    slider.setColour (juce::Slider::backgroundColourId, juce::Colour (0xff2a2a4a));
+    slider.setColour (juce::Slider::textBoxTextColourId, juce::Colours::white);
+    slider.setColour (juce::Slider::textBoxOutlineColourId, juce::Colours::transparentBlack);
+}
+
+void AudioPluginAudioProcessorEditor::setupStepper (juce::Slider& slider)
+{
+    setupSlider (slider);
+    slider.setSliderStyle (juce::Slider::IncDecButtons);
+    slider.setTextBoxStyle (juce::Slider::TextBoxLeft, false, 30, 25);
+    slider.setColour (juce::TextButton::buttonColourId, juce::Colour (0xff3a3a5a));
+}
+
 void AudioPluginAudioProcessorEditor::setupLabel (juce::Label& label)
 {
     label.setFont (juce::FontOptions (14.0f).withStyle ("Bold"));
@@ -115,7 +436,7 @@ void AudioPluginAudioProcessorEditor::paint (juce::Graphics& g)
     g.drawLine (20.0f, 50.0f, static_cast<float> (getWidth() - 20), 50.0f, 1.0f);
     
     // Control panel background
-    auto controlBounds = getLocalBounds().reduced (15).removeFromTop (100);
+    auto controlBounds = getLocalBounds().reduced (15).removeFromTop (305);
     controlBounds.removeFromTop (40);
     g.setColour (juce::Colour (0x20ffffff));
     g.fillRoundedRectangle (controlBounds.toFloat(), 8.0f);
@@ -124,6 +445,7 @@ void AudioPluginAudioProcessorEditor::paint (juce::Graphics& g)
 void AudioPluginAudioProcessorEditor::resized()
 {
     auto bounds = getLocalBounds().reduced (20);
+    detectedKeyValue.setBounds (juce::Rectangle<int> (bounds.getX(), 10, bounds.getWidth(), 25).removeFromRight (140));
     bounds.removeFromTop (55); // Space for title + separator
     
     // Control row
@@ -133,7 +455,7 @@ void AudioPluginAudioProcessorEditor::resized()
     // Pattern selector
     patternLabel.setBounds (controlRow.removeFromLeft (60));
     controlRow.removeFromLeft (5);
-    patternSelector.setBounds (controlRow.removeFromLeft (130));
+    patternButton.setBounds (controlRow.removeFromLeft (130));
     
     controlRow.removeFromLeft (20);
     
@@ -154,6 +476,158 @@ void AudioPluginAudioProcessorEditor::resized()
     // Enable button
     enableButton.setBounds (controlRow.removeFromLeft (60));
     
+    controlRow.removeFromLeft (10);
+    
+    // Bar-quantise button
+    quantiseButton.setBounds (controlRow.removeFromLeft (60));
+    
+    // Second control row - input routing
+    auto routingRow = bounds.removeFromTop (40);
+    routingRow.reduce (10, 6);
+    
+    inputModeLabel.setBounds (routingRow.removeFromLeft (60));
+    routingRow.removeFromLeft (5);
+    inputModeSelector.setBounds (routingRow.removeFromLeft (130));
+    routingRow.removeFromLeft (5);
+    inputChannelSelector.setBounds (routingRow.removeFromLeft (70));
+    
+    routingRow.removeFromLeft (20);
+    
+    splitPointLabel.setBounds (routingRow.removeFromLeft (55));
+    routingRow.removeFromLeft (5);
+    splitPointSlider.setBounds (routingRow.removeFromLeft (130));
+    
+    routingRow.removeFromLeft (20);
+    
+    // DIN output button and stats
+    dinButton.setBounds (routingRow.removeFromLeft (60));
+    routingRow.removeFromLeft (10);
+    dinStatusValue.setBounds (routingRow.removeFromLeft (195));
+    
+    // Third control row - preview synth
+    auto previewRow = bounds.removeFromTop (40);
+    previewRow.reduce (10, 6);
+    
+    previewLabel.setBounds (previewRow.removeFromLeft (60));
+    previewRow.removeFromLeft (5);
+    previewButton.setBounds (previewRow.removeFromLeft (60));
+    previewRow.removeFromLeft (10);
+    previewSoundSelector.setBounds (previewRow.removeFromLeft (60));
+    
+    previewRow.removeFromLeft (20);
+    
+    previewLevelLabel.setBounds (previewRow.removeFromLeft (55));
+    previewRow.removeFromLeft (5);
+    previewLevelSlider.setBounds (previewRow.removeFromLeft (140));
+    
+    previewRow.removeFromLeft (20);
+    
+    // Strum capture slider
+    strumCaptureLabel.setBounds (previewRow.removeFromLeft (55));
+    previewRow.removeFromLeft (5);
+    strumCaptureSlider.setBounds (previewRow.removeFromLeft (140));
+    
+    previewRow.removeFromLeft (20);
+    
+    // Bass line mode
+    bassModeLabel.setBounds (previewRow.removeFromLeft (45));
+    previewRow.removeFromLeft (5);
+    bassModeSelector.setBounds (previewRow.removeFromLeft (85));
+    
+    // Fourth control row - MIDI clock
+    auto clockRow = bounds.removeFromTop (40);
+    clockRow.reduce (10, 6);
+    
+    clockModeLabel.setBounds (clockRow.removeFromLeft (60));
+    clockRow.removeFromLeft (5);
+    clockModeSelector.setBounds (clockRow.removeFromLeft (130));
+    clockRow.removeFromLeft (20);
+    clockStatusValue.setBounds (clockRow.removeFromLeft (260));
+    clockRow.removeFromLeft (10);
+    
+    // Chord bus role and channel
+    chordBusLabel.setBounds (clockRow.removeFromLeft (40));
+    clockRow.removeFromLeft (5);
+    chordBusModeSelector.setBounds (clockRow.removeFromLeft (90));
+    clockRow.removeFromLeft (5);
+    chordBusChannelSlider.setBounds (clockRow.removeFromLeft (70));
+    
+   #if CHORDER_ENABLE_TRACING
+    traceDumpButton.setBounds (clockRow.removeFromRight (60));
+   #endif
+    
+    clockRow.removeFromRight (5);
+    captureButton.setBounds (clockRow.removeFromRight (70));
+    
+    // Fifth control row - Euclidean generator
+    auto generatorRow = bounds.removeFromTop (40);
+    generatorRow.reduce (10, 6);
+    
+    generatorLabel.setBounds (generatorRow.removeFromLeft (60));
+    generatorRow.removeFromLeft (5);
+    genHitsSlider.setBounds (generatorRow.removeFromLeft (70));
+    genStepsLabel.setBounds (generatorRow.removeFromLeft (25));
+    genStepsSlider.setBounds (generatorRow.removeFromLeft (70));
+    genRotationLabel.setBounds (generatorRow.removeFromLeft (40));
+    genRotationSlider.setBounds (generatorRow.removeFromLeft (70));
+    
+    generatorRow.removeFromLeft (15);
+    
+    genProbabilityLabel.setBounds (generatorRow.removeFromLeft (45));
+    genProbabilitySlider.setBounds (generatorRow.removeFromLeft (95));
+    genGhostLabel.setBounds (generatorRow.removeFromLeft (50));
+    genGhostSlider.setBounds (generatorRow.removeFromLeft (95));
+    genAccentLabel.setBounds (generatorRow.removeFromLeft (55));
+    genAccentSlider.setBounds (generatorRow.removeFromLeft (95));
+    
+    // Sixth control row - take recorder
+    auto recordRow = bounds.removeFromTop (40);
+    recordRow.reduce (10, 6);
+    
+    recordLabel.setBounds (recordRow.removeFromLeft (60));
+    recordRow.removeFromLeft (5);
+    recordButton.setBounds (recordRow.removeFromLeft (60));
+    recordRow.removeFromLeft (10);
+    recordStatusValue.setBounds (recordRow.removeFromLeft (290));
+    
+    scriptLabel.setBounds (recordRow.removeFromLeft (55));
+    recordRow.removeFromLeft (5);
+    scriptButton.setBounds (recordRow.removeFromLeft (60));
+    recordRow.removeFromLeft (10);
+    scriptStatusValue.setBounds (recordRow);
+    
+    // Seventh control row - chord source and audio analysis
+    auto audioRow = bounds.removeFromTop (40);
+    audioRow.reduce (10, 6);
+    
+    chordSourceLabel.setBounds (audioRow.removeFromLeft (60));
+    audioRow.removeFromLeft (5);
+    chordSourceSelector.setBounds (audioRow.removeFromLeft (90));
+    audioRow.removeFromLeft (20);
+    
+    audioWindowLabel.setBounds (audioRow.removeFromLeft (60));
+    audioRow.removeFromLeft (5);
+    audioWindowSelector.setBounds (audioRow.removeFromLeft (80));
+    audioRow.removeFromLeft (15);
+    
+    audioHopLabel.setBounds (audioRow.removeFromLeft (40));
+    audioRow.removeFromLeft (5);
+    audioHopSelector.setBounds (audioRow.removeFromLeft (80));
+    audioRow.removeFromLeft (20);
+    
+    overloadStatusValue.setBounds (audioRow.removeFromRight (170));
+    audioStatusValue.setBounds (audioRow);
+    
+    // Eighth control row - rhythm sync
+    auto rhythmRow = bounds.removeFromTop (40);
+    rhythmRow.reduce (10, 6);
+    
+    rhythmSyncLabel.setBounds (rhythmRow.removeFromLeft (60));
+    rhythmRow.removeFromLeft (5);
+    rhythmSyncSelector.setBounds (rhythmRow.removeFromLeft (130));
+    rhythmRow.removeFromLeft (20);
+    onsetStatusValue.setBounds (rhythmRow);
+    
     bounds.removeFromTop (15);
     
     // MIDI keyboard
@@ -162,14 +636,160 @@ void AudioPluginAudioProcessorEditor::resized()
 
 void AudioPluginAudioProcessorEditor::timerCallback()
 {
+    processorRef.updateKeyboardState();
     midiKeyboard.repaint();
     
-    // Sync UI with processor state
-    if (patternSelector.getSelectedId() - 1 != processorRef.currentPatternIndex.load())
-        patternSelector.setSelectedId (processorRef.currentPatternIndex.load() + 1, juce::dontSendNotification);
+    // Split point only matters in split mode
+    splitPointSlider.setEnabled (processorRef.inputModeParam->getIndex() == AudioPluginAudioProcessor::splitMode);
+    
+    // Generator controls only matter while something plays the generated pattern
+    const int generatedIndex = processorRef.getGeneratedPatternIndex();
+    bool generatorInUse = processorRef.patternParam->getIndex() == generatedIndex;
+    for (auto* param : processorRef.enginePatternParams)
+        generatorInUse = generatorInUse || param->getIndex() == generatedIndex + 1;
+    
+    for (auto* slider : { &genHitsSlider, &genStepsSlider, &genRotationSlider,
+                          &genProbabilitySlider, &genGhostSlider, &genAccentSlider })
+        slider->setEnabled (generatorInUse);
     
     // Update detected chord display
     juce::String chordName = processorRef.getDetectedChordName();
     if (detectedChordValue.getText() != chordName)
         detectedChordValue.setText (chordName, juce::dontSendNotification);
+    
+    // Update estimated key display
+    juce::String keyName = "Key: " + processorRef.getDetectedKey().getName();
+    if (detectedKeyValue.getText() != keyName)
+        detectedKeyValue.setText (keyName, juce::dontSendNotification);
+    
+    // Update DIN queueing stats
+    juce::String dinStatus;
+    if (processorRef.dinOutputParam->get())
+        dinStatus = "Max lag " + juce::String (processorRef.getDinWorstLatencyMs(), 1) + " ms, "
+                  + juce::String (processorRef.getDinDroppedNotes() + processorRef.getDinShedEvents()) + " dropped";
+    if (dinStatusValue.getText() != dinStatus)
+        dinStatusValue.setText (dinStatus, juce::dontSendNotification);
+    
+    // Update external clock lock and jitter
+    juce::String clockStatus;
+    if (processorRef.clockModeParam->getIndex() == AudioPluginAudioProcessor::clockFollow)
+    {
+        clockStatus = processorRef.isClockLocked()
+                        ? "Locked " + juce::String (processorRef.getClockTempo(), 1) + " BPM, jitter "
+                            + juce::String (processorRef.getClockJitterMs(), 2) + " ms"
+                        : juce::String ("Waiting for clock");
+    }
+    if (clockStatusValue.getText() != clockStatus)
+        clockStatusValue.setText (clockStatus, juce::dontSendNotification);
+    
+    // Update take recorder progress
+    auto& recorder = processorRef.getRecorder();
+    juce::String recordStatus;
+    
+    if (recorder.hasWriteFailed())
+    {
+        recordStatus = "Can't write the take file";
+    }
+    else if (recorder.getCurrentFile() != juce::File())
+    {
+        const int seconds = (int) recorder.getRecordedSeconds();
+        recordStatus = recorder.getCurrentFile().getFileName() + "  "
+                     + juce::String::formatted ("%d:%02d", seconds / 60, seconds % 60) + ", "
+                     + juce::String (recorder.getEventsWritten()) + " events";
+        
+        if (recorder.getDroppedEvents() > 0)
+            recordStatus += ", " + juce::String (recorder.getDroppedEvents()) + " dropped";
+    }
+    if (recordStatusValue.getText() != recordStatus)
+        recordStatusValue.setText (recordStatus, juce::dontSendNotification);
+    
+    recordButton.setToggleState (recorder.isRecording(), juce::dontSendNotification);
+    
+    // Update audio chord detection latency and skipped frames
+    juce::String audioStatus;
+    
+    if (processorRef.chordSourceParam->getIndex() == AudioPluginAudioProcessor::audioSource)
+    {
+        audioStatus = "Latency " + juce::String (processorRef.getAudioChordLatencyMs(), 0) + " ms";
+        
+        if (processorRef.getTotalNumInputChannels() == 0)
+            audioStatus = "Enable the Chord Input bus in the host";
+        else if (processorRef.getAudioSkippedFrames() > 0)
+            audioStatus += ", " + juce::String (processorRef.getAudioSkippedFrames()) + " frames skipped";
+    }
+    
+    if (audioStatusValue.getText() != audioStatus)
+        audioStatusValue.setText (audioStatus, juce::dontSendNotification);
+    
+    // Update events shed under MIDI floods
+    juce::String overloadStatus;
+    
+    if (processorRef.getTotalShedEvents() > 0)
+    {
+        overloadStatus = "Shed " + juce::String (processorRef.getShedEvents (OverloadGuard::inputStage)) + " in, "
+                       + juce::String (processorRef.getShedEvents (OverloadGuard::outputStage)
+                                       + processorRef.getShedEvents (OverloadGuard::scheduleStage)) + " out";
+    }
+    
+    if (overloadStatusValue.getText() != overloadStatus)
+        overloadStatusValue.setText (overloadStatus, juce::dontSendNotification);
+    
+    // Update onset following tempo and latency
+    juce::String onsetStatus;
+    
+    if (processorRef.rhythmSyncParam->getIndex() == AudioPluginAudioProcessor::onsetSync)
+    {
+        onsetStatus = juce::String (processorRef.getOnsetTempo(), 1) + " BPM, latency "
+                    + juce::String (processorRef.getOnsetLatencyMs(), 1) + " ms (worst "
+                    + juce::String (processorRef.getOnsetWorstLatencyMs(), 1) + " ms)";
+        
+        if (processorRef.getTotalNumInputChannels() == 0)
+            onsetStatus = "Enable the Chord Input bus in the host";
+        else if (processorRef.getOnsetSkippedFrames() > 0)
+            onsetStatus += ", " + juce::String (processorRef.getOnsetSkippedFrames()) + " frames skipped";
+    }
+    
+    if (onsetStatusValue.getText() != onsetStatus)
+        onsetStatusValue.setText (onsetStatus, juce::dontSendNotification);
+    
+    // Update session capture progress
+    auto& capture = processorRef.getSessionCapture();
+    juce::String captureStatus ("Capture every block for offline replay (Documents/Chord Pattern Player Sessions)");
+    
+    if (capture.hasWriteFailed())
+        captureStatus = "Can't write the session log";
+    else if (capture.getCurrentFile() != juce::File())
+        captureStatus = capture.getCurrentFile().getFileName() + ": " + juce::String (capture.getBlocksWritten())
+                      + " blocks, " + juce::String (capture.getDroppedBlocks()) + " dropped";
+    
+    if (captureButton.getTooltip() != captureStatus)
+        captureButton.setTooltip (captureStatus);
+    
+    captureButton.setToggleState (capture.isCapturing(), juce::dontSendNotification);
+    
+    // Update pattern script compile errors and budget overruns
+    const auto scriptError = processorRef.getPatternScript().getError();
+    juce::String scriptStatus = scriptError;
+    
+    if (scriptError.isEmpty())
+    {
+        const int overruns = processorRef.getScriptOverruns();
+        scriptStatus = overruns > 0 ? "Over budget in " + juce::String (overruns) + " blocks" : juce::String ("OK");
+    }
+    if (scriptStatusValue.getText() != scriptStatus)
+    {
+        scriptStatusValue.setText (scriptStatus, juce::dontSendNotification);
+        scriptStatusValue.setColour (juce::Label::textColourId, scriptStatus == "OK" ? juce::Colour (0xffaaaacc)
+                                                                                     : juce::Colour (0xffff6b6b));
+    }
+    
+    // Flag a bus channel that another instance already leads
+    const bool busTaken = processorRef.isChordBusChannelTaken();
+    const juce::String busTooltip = busTaken ? "Another instance already leads this bus channel"
+                                             : "Lead: share this instance's chords. Follow: play the leader's chords instead of the input.";
+    if (chordBusModeSelector.getTooltip() != busTooltip)
+    {
+        chordBusModeSelector.setTooltip (busTooltip);
+        chordBusModeSelector.setColour (juce::ComboBox::arrowColourId, busTaken ? juce::Colour (0xffff6b6b) : juce::Colour (0xff4ecdc4));
+    }
 }
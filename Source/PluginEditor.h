@@ -19,13 +19,14 @@ public:
 private:
     AudioPluginAudioProcessor& processorRef;
     
-    // Pattern selector
-    juce::ComboBox patternSelector;
+    // Pattern selector: shows the current pattern and opens the browser
+    juce::TextButton patternButton;
     juce::Label patternLabel { {}, "Rhythm:" };
     
     // Detected chord display
     juce::Label detectedChordLabel { {}, "Chord:" };
     juce::Label detectedChordValue { {}, "---" };
+    juce::Label detectedKeyValue { {}, "Key: ---" };
     
     // Tempo control
     juce::Slider tempoSlider;
@@ -34,12 +35,123 @@ private:
     // Enable/Disable button
     juce::TextButton enableButton { "ON" };
     
+    // Switch patterns on the next bar line
+    juce::TextButton quantiseButton { "BAR" };
+    
+    // Multi-zone routing
+    juce::ComboBox inputModeSelector;
+    juce::ComboBox inputChannelSelector;
+    juce::Label inputModeLabel { {}, "Input:" };
+    juce::Slider splitPointSlider;
+    juce::Label splitPointLabel { {}, "Split:" };
+    
+    // DIN output stage and its queueing stats
+    juce::TextButton dinButton { "DIN" };
+    juce::Label dinStatusValue;
+    
+    // Built-in preview synth
+    juce::Label previewLabel { {}, "Preview:" };
+    juce::TextButton previewButton { "SYNTH" };
+    juce::ComboBox previewSoundSelector;
+    juce::Slider previewLevelSlider;
+    juce::Label previewLevelLabel { {}, "Level:" };
+    
+    // Strum capture window
+    juce::Slider strumCaptureSlider;
+    juce::Label strumCaptureLabel { {}, "Strum:" };
+    
+    // Bass layer: root or walking line
+    juce::Label bassModeLabel { {}, "Bass:" };
+    juce::ComboBox bassModeSelector;
+    
+    // MIDI clock sync and lock status
+    juce::ComboBox clockModeSelector;
+    juce::Label clockModeLabel { {}, "Clock:" };
+    juce::Label clockStatusValue;
+    
+    // Cross-instance chord bus
+    juce::Label chordBusLabel { {}, "Bus:" };
+    juce::ComboBox chordBusModeSelector;
+    juce::Slider chordBusChannelSlider;
+    
+    // Euclidean pattern generator
+    juce::Label generatorLabel { {}, "Euclid:" };
+    juce::Slider genHitsSlider, genStepsSlider, genRotationSlider;
+    juce::Label genStepsLabel { {}, "of" };
+    juce::Label genRotationLabel { {}, "Rot:" };
+    juce::Slider genProbabilitySlider, genGhostSlider, genAccentSlider;
+    juce::Label genProbabilityLabel { {}, "Prob:" };
+    juce::Label genGhostLabel { {}, "Ghost:" };
+    juce::Label genAccentLabel { {}, "Accent:" };
+    
+    // Take recorder
+    juce::Label recordLabel { {}, "Record:" };
+    juce::TextButton recordButton { "REC" };
+    juce::Label recordStatusValue;
+    
+    // Chord source and audio analysis settings
+    juce::Label chordSourceLabel { {}, "Chords:" };
+    juce::ComboBox chordSourceSelector;
+    juce::Label audioWindowLabel { {}, "Window:" };
+    juce::ComboBox audioWindowSelector;
+    juce::Label audioHopLabel { {}, "Hop:" };
+    juce::ComboBox audioHopSelector;
+    juce::Label audioStatusValue;
+    juce::Label overloadStatusValue;
+    
+    // Rhythm sync: tempo or a live player's onsets
+    juce::Label rhythmSyncLabel { {}, "Rhythm:" };
+    juce::ComboBox rhythmSyncSelector;
+    juce::Label onsetStatusValue;
+    
+    // Session capture for offline replay; its status is in the tooltip
+    juce::TextButton captureButton { "CAPTURE" };
+    
+    // Pattern script: opens the script editor, shows compile errors
+    juce::Label scriptLabel { {}, "Script:" };
+    juce::TextButton scriptButton { "EDIT" };
+    juce::Label scriptStatusValue;
+    
+   #if CHORDER_ENABLE_TRACING
+    // Writes the recorded trace to a JSON file
+    juce::TextButton traceDumpButton { "TRACE" };
+   #endif
+    
+    // Parameter attachments (declared after the controls they bind)
+    std::unique_ptr<juce::ParameterAttachment> patternAttachment;
+    std::unique_ptr<juce::SliderParameterAttachment> tempoAttachment;
+    std::unique_ptr<juce::ButtonParameterAttachment> enabledAttachment;
+    std::unique_ptr<juce::ButtonParameterAttachment> quantiseAttachment;
+    std::unique_ptr<juce::ComboBoxParameterAttachment> inputModeAttachment;
+    std::unique_ptr<juce::ComboBoxParameterAttachment> inputChannelAttachment;
+    std::unique_ptr<juce::SliderParameterAttachment> splitPointAttachment;
+    std::unique_ptr<juce::ButtonParameterAttachment> dinAttachment;
+    std::unique_ptr<juce::ButtonParameterAttachment> previewAttachment;
+    std::unique_ptr<juce::ComboBoxParameterAttachment> previewSoundAttachment;
+    std::unique_ptr<juce::ComboBoxParameterAttachment> bassModeAttachment;
+    std::unique_ptr<juce::ComboBoxParameterAttachment> chordSourceAttachment;
+    std::unique_ptr<juce::ComboBoxParameterAttachment> audioWindowAttachment;
+    std::unique_ptr<juce::ComboBoxParameterAttachment> audioHopAttachment;
+    std::unique_ptr<juce::ComboBoxParameterAttachment> rhythmSyncAttachment;
+    std::unique_ptr<juce::SliderParameterAttachment> previewLevelAttachment;
+    std::unique_ptr<juce::SliderParameterAttachment> strumCaptureAttachment;
+    std::unique_ptr<juce::ComboBoxParameterAttachment> clockModeAttachment;
+    std::unique_ptr<juce::ComboBoxParameterAttachment> chordBusModeAttachment;
+    std::unique_ptr<juce::SliderParameterAttachment> chordBusChannelAttachment;
+    std::array<std::unique_ptr<juce::SliderParameterAttachment>, 6> generatorAttachments;
+    
     // MIDI keyboard to visualize output notes
     juce::MidiKeyboardComponent midiKeyboard;
     
+    void showPatternBrowser();
+    void showScriptEditor();
+    
     // Style helpers
     void setupComboBox (juce::ComboBox& box);
+    void setupToggleButton (juce::TextButton& button);
+    void setupSlider (juce::Slider& slider);
     void setupLabel (juce::Label& label);
+    void setupStepper (juce::Slider& slider);
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessorEditor)
 };
@@ -7,6 +7,8 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                      #if ! JucePlugin_IsMidiEffect
                       #if ! JucePlugin_IsSynth
                        .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
+                      #else
+                       .withInput  ("Chord Input", juce::AudioChannelSet::stereo(), false)
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
@@ -14,10 +16,107 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
 {
     // Initialize all rhythm patterns
     patterns = RhythmPatternFactory::createAllPatterns();
+    
+   #if CHORDER_ENABLE_TRACING
+    // Allocate the trace buffers here rather than on the first audio callback
+    TraceRecorder::getInstance();
+   #endif
+    
+    // Host-automatable parameters
+    addParameter (patternParam = new juce::AudioParameterChoice ({ "pattern", 1 }, "Pattern",
+                                                                 getPatternNames(), 0));
+    addParameter (tempoParam = new juce::AudioParameterFloat ({ "tempo", 1 }, "Tempo",
+                                                              juce::NormalisableRange<float> (40.0f, 240.0f, 1.0f),
+                                                              120.0f));
+    addParameter (enabledParam = new juce::AudioParameterBool ({ "enabled", 1 }, "Pattern Enabled", true));
+    addParameter (quantiseSwitchParam = new juce::AudioParameterBool ({ "quantiseSwitch", 1 },
+                                                                      "Switch On Next Bar", false));
+    addParameter (inputModeParam = new juce::AudioParameterChoice ({ "inputMode", 1 }, "Input Mode",
+                                                                   { "Omni", "Split", "Per Channel" }, omniMode));
+    addParameter (splitPointParam = new juce::AudioParameterInt ({ "splitPoint", 1 }, "Split Point", 0, 127, 60));
+    
+    juce::StringArray enginePatternChoices { "Main" };
+    enginePatternChoices.addArray (getPatternNames());
+    
+    for (int e = 0; e < ChordEngineBank::maxEngines; ++e)
+    {
+        const juce::String id = "enginePattern" + juce::String (e + 1);
+        const juce::String name = "Ch " + juce::String (e + 1) + " Pattern";
+        addParameter (enginePatternParams[(size_t) e] = new juce::AudioParameterChoice ({ id, 1 }, name,
+                                                                                         enginePatternChoices, 0));
+    }
+    
+    addParameter (dinOutputParam = new juce::AudioParameterBool ({ "dinOutput", 1 }, "DIN Output", false));
+    addParameter (dinJitterBudgetParam = new juce::AudioParameterFloat ({ "dinJitterBudget", 1 }, "DIN Jitter Budget",
+                                                                        juce::NormalisableRange<float> (0.0f, 10.0f, 0.1f),
+                                                                        3.0f, "ms"));
+    
+    addParameter (previewEnabledParam = new juce::AudioParameterBool ({ "previewEnabled", 1 }, "Preview Synth", false));
+    addParameter (previewSoundParam = new juce::AudioParameterChoice ({ "previewSound", 1 }, "Preview Sound",
+                                                                      { "Sine", "FM" }, PreviewSynth::sineSound));
+    addParameter (previewLevelParam = new juce::AudioParameterFloat ({ "previewLevel", 1 }, "Preview Level",
+                                                                     juce::NormalisableRange<float> (0.0f, 1.0f, 0.01f),
+                                                                     0.5f));
+    
+    addParameter (strumCaptureParam = new juce::AudioParameterFloat ({ "strumCapture", 1 }, "Strum Capture",
+                                                                     juce::NormalisableRange<float> (0.0f, 100.0f, 1.0f),
+                                                                     0.0f, "ms"));
+    
+    addParameter (clockModeParam = new juce::AudioParameterChoice ({ "clockMode", 1 }, "MIDI Clock",
+                                                                   { "Off", "Send", "Follow" }, clockOff));
+    
+    addParameter (genStepsParam = new juce::AudioParameterInt ({ "genSteps", 1 }, "Euclid Steps", 2, 32, 16));
+    addParameter (genHitsParam = new juce::AudioParameterInt ({ "genHits", 1 }, "Euclid Hits", 1, 32, 5));
+    addParameter (genRotationParam = new juce::AudioParameterInt ({ "genRotation", 1 }, "Euclid Rotation", 0, 31, 0));
+    addParameter (genProbabilityParam = new juce::AudioParameterFloat ({ "genProbability", 1 }, "Euclid Probability",
+                                                                       juce::NormalisableRange<float> (0.0f, 1.0f, 0.01f),
+                                                                       1.0f));
+    addParameter (genGhostParam = new juce::AudioParameterFloat ({ "genGhost", 1 }, "Euclid Ghost Notes",
+                                                                 juce::NormalisableRange<float> (0.0f, 1.0f, 0.01f),
+                                                                 0.0f));
+    addParameter (genAccentParam = new juce::AudioParameterFloat ({ "genAccent", 1 }, "Euclid Accent",
+                                                                  juce::NormalisableRange<float> (0.0f, 1.0f, 0.01f),
+                                                                  0.5f));
+    
+    addParameter (chordBusModeParam = new juce::AudioParameterChoice ({ "chordBusMode", 1 }, "Chord Bus",
+                                                                      { "Off", "Lead", "Follow" }, busOff));
+    addParameter (chordBusChannelParam = new juce::AudioParameterInt ({ "chordBusChannel", 1 }, "Chord Bus Channel",
+                                                                      1, ChordBus::numChannels, 1));
+    
+    juce::StringArray inputChannelChoices { "All" };
+    for (int channel = 1; channel <= 16; ++channel)
+        inputChannelChoices.add (juce::String (channel));
+    
+    addParameter (inputChannelParam = new juce::AudioParameterChoice ({ "inputChannel", 1 }, "Input Channel",
+                                                                      inputChannelChoices, 0));
+    
+    addParameter (bassModeParam = new juce::AudioParameterChoice ({ "bassMode", 1 }, "Bass Line",
+                                                                  { "Root", "Walking" }, rootBass));
+    
+    addParameter (chordSourceParam = new juce::AudioParameterChoice ({ "chordSource", 1 }, "Chord Source",
+                                                                     { "MIDI", "Audio" }, midiSource));
+    addParameter (audioWindowParam = new juce::AudioParameterChoice ({ "audioWindow", 1 }, "Audio Window",
+                                                                     { "1024", "2048", "4096", "8192" }, 2));
+    addParameter (audioHopParam = new juce::AudioParameterChoice ({ "audioHop", 1 }, "Audio Hop",
+                                                                  { "128", "256", "512", "1024" }, 2));
+    addParameter (rhythmSyncParam = new juce::AudioParameterChoice ({ "rhythmSync", 1 }, "Rhythm Sync",
+                                                                    { "Tempo", "Audio Onsets" }, tempoSync));
+    
+    // Needs the generator parameters above
+    generatedPatterns = std::make_unique<GeneratedPatternSource> ([this] { return getGeneratorSettings(); });
+    generatedPattern = &generatedPatterns->acquire();
+    scriptProgram = &patternScripts.acquire();
+    
+    sessionCapture.setNumParameters (getParameters().size());
+    startTimerHz (10);
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor()
 {
+    stopTimer();
+    
+    // Followers would otherwise hold on to this leader's last chord
+    leaveChordBus();
 }
 
 //==============================================================================
@@ -88,29 +187,365 @@ void AudioPluginAudioProcessor::changeProgramName (int index, const juce::String
 void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     currentSampleRate = sampleRate;
-    accumulatedBeats = 0.0;
+    keyEstimator.prepare (sampleRate);
+    dinScheduler.prepare (sampleRate);
+    previewSynth.prepare (sampleRate);
+    captureDelayLine.ensureSize (32768);  // Room for a full capture window of budgeted input
+    captureScratch.ensureSize (32768);
+    inputMidi.ensureSize (32768);     // Room for a block's budgeted input
+    pendingNoteOffs.reserve ((size_t) OverloadGuard::maxScheduledNoteOffs);
+    captureSamples = getCaptureSamples();
+    latencyToReport.store (captureSamples, std::memory_order_relaxed);
+    setLatencySamples (captureSamples);
+    clockGenerator.reset();
+    clockFollower.prepare (sampleRate);
+    audioChordDetector.prepare (sampleRate);
+    onsetDetector.prepare (sampleRate);
+    onsetFollower.prepare (sampleRate);
+    clockBeat = 0.0;
     lastPatternBeat = 0.0;
-    pendingNoteOffs.clear();
-    activeOutputNotes.clear();
-    heldNotes.clear();
-    currentChord = DetectedChord();
-    setDetectedChordName ("---");
+    lastInputMode = inputModeParam->getIndex();
+    lastInputChannel = inputChannelParam->getIndex();
+    lastChordSource = chordSourceParam->getIndex();
+    lastRhythmSync = rhythmSyncParam->getIndex();
+    resetEngines();
+    overloadGuard.reset();
     juce::ignoreUnused (samplesPerBlock);
 }
 
 void AudioPluginAudioProcessor::releaseResources()
+{
+    resetEngines();
+    overloadGuard.reset();
+}
+
+void AudioPluginAudioProcessor::resetEngines()
 {
     pendingNoteOffs.clear();
-    activeOutputNotes.clear();
-    heldNotes.clear();
-    currentChord = DetectedChord();
+    captureDelayLine.clear();
+    
+    engines.reset();
+    
+    inputNotes.reset();
+    busSequenceSeen.fill (0);   // A follower picks up the current chord again
+    
+    // The overload guard keeps its key and pedal tracking: this block's input
+    // has already been filtered against it, and the releases of keys held
+    // through a routing change must still count as releases
+    
+    for (int e = 0; e < ChordEngineBank::maxEngines; ++e)
+        engines.activePatternIndex[(size_t) e] = getRequestedPattern (e);
+    
     setDetectedChordName ("---");
 }
 
-void AudioPluginAudioProcessor::updateDetectedChord()
+void AudioPluginAudioProcessor::timerCallback()
+{
+    const int latency = latencyToReport.load (std::memory_order_relaxed);
+    
+    if (latency != getLatencySamples())
+        setLatencySamples (latency);
+}
+
+int AudioPluginAudioProcessor::getCaptureSamples() const
+{
+    return juce::roundToInt (strumCaptureParam->get() * 0.001 * currentSampleRate);
+}
+
+void AudioPluginAudioProcessor::delayInputForCapture (int numSamples, int inputMode)
+{
+    // New input joins the delay line; whatever falls due in this block is
+    // handed back for processing and the rest moves one block closer
+    captureDelayLine.addEvents (inputMidi, 0, -1, captureSamples);
+    inputMidi.clear();
+    inputMidi.addEvents (captureDelayLine, 0, numSamples, 0);
+    
+    captureScratch.clear();
+    captureScratch.addEvents (captureDelayLine, numSamples, -1, -numSamples);
+    captureDelayLine.swapWith (captureScratch);
+    
+    // Note-ons still in the line are the rest of a strum the engines are about
+    // to receive. An engine's lookahead stops at its first pending note-off.
+    std::array<NoteMask, ChordEngineBank::maxEngines> lookahead;
+    juce::uint32 closedMask = 0;
+    
+    inputDecoder.decode (captureDelayLine, [&] (const InputEvent& event, int)
+    {
+        if (event.type != InputEvent::noteOn && event.type != InputEvent::noteOff)
+            return;
+        
+        const int engine = getEngineForNote (inputMode, event.channel + 1, event.data1);
+        
+        if (event.type == InputEvent::noteOff)
+            closedMask |= 1u << engine;
+        else if ((closedMask & (1u << engine)) == 0)
+            lookahead[(size_t) engine].insert (event.data1);
+    });
+    
+    for (int e = 0; e < ChordEngineBank::maxEngines; ++e)
+    {
+        if (lookahead[(size_t) e] != engines.strumLookahead[(size_t) e])
+        {
+            engines.strumLookahead[(size_t) e] = lookahead[(size_t) e];
+            engines.chordChangedMask |= 1u << e;
+        }
+    }
+}
+
+void AudioPluginAudioProcessor::releaseInputNote (int inputMode, int channel, int note, juce::MidiBuffer& midiMessages,
+                                                  int samplePosition, std::array<int, ChordEngineBank::maxEngines>& changeSamples)
 {
-    currentChord = ChordDetector::detect (heldNotes);
-    setDetectedChordName (currentChord.chordName);
+    const int engine = getEngineForNote (inputMode, channel + 1, note);
+    auto& held = engines.heldNotes[(size_t) engine];
+    
+    // A release for a note the engine isn't holding changes nothing, so a
+    // stream of stray note-offs stays cheap
+    if (! held.contains (note))
+        return;
+    
+    // The same note may still sound on another channel feeding this engine
+    const auto stillSounding = inputNotes.getChannelsSounding (note);
+    
+    for (int c = 0; c < 16; ++c)
+        if ((stillSounding & (1 << c)) != 0 && getEngineForNote (inputMode, c + 1, note) == engine)
+            return;
+    
+    held.erase (note);
+    
+    if (held.empty())
+    {
+        // All notes released - stop this engine's pattern and turn off its notes
+        engines.chords[(size_t) engine] = DetectedChord();
+        setDetectedChordName ("---");
+        stopAllActiveNotes (midiMessages, engine, samplePosition);
+    }
+    
+    engines.chordChangedMask |= 1u << engine;
+    changeSamples[(size_t) engine] = samplePosition;
+}
+
+void AudioPluginAudioProcessor::applyAudioChord (juce::MidiBuffer& midiMessages,
+                                                 std::array<int, ChordEngineBank::maxEngines>& changeSamples)
+{
+    // Audio drives engine 0, as omni input would
+    const auto& detected = audioChordDetector.getNotes();
+    const int samplePosition = audioChordDetector.getChangeSample();
+    auto& held = engines.heldNotes[0];
+    
+    for (int note : detected)
+        if (! held.contains (note))
+            keyEstimator.noteOn (note, 0.7f);
+    
+    held = detected;
+    
+    if (held.empty())
+    {
+        engines.chords[0] = DetectedChord();
+        setDetectedChordName ("---");
+        stopAllActiveNotes (midiMessages, 0, samplePosition);
+    }
+    
+    engines.chordChangedMask |= 1u;
+    changeSamples[0] = samplePosition;
+}
+
+void AudioPluginAudioProcessor::updateDetectedChord (int engine)
+{
+    CHORDER_TRACE_SCOPE ("detectChord");
+    
+    // Include the rest of a strum that is still inside the capture window
+    auto notes = engines.heldNotes[(size_t) engine];
+    notes |= engines.strumLookahead[(size_t) engine];
+    
+    engines.chords[(size_t) engine] = ChordDetector::detect (notes, keyEstimator.getEstimate());
+    setDetectedChordName (engines.chords[(size_t) engine].chordName);
+    updateChordKey (engine);
+}
+
+void AudioPluginAudioProcessor::updateChordKey (int engine)
+{
+    const auto& chord = engines.chords[(size_t) engine];
+    auto& chordKey = engines.chordKeys[(size_t) engine];
+    
+    // Released chords keep their key, so a change made with the hands lifted
+    // still counts as a change
+    if (! chord.isValid)
+        return;
+    
+    const int key = WalkingBass::getChordKey (WalkingBass::getQualityIndex (chord.quality), chord.rootNote);
+    
+    if (key != chordKey)
+    {
+        bassLines.chordChanged (chordKey, key);
+        chordKey = key;
+    }
+}
+
+void AudioPluginAudioProcessor::leaveChordBus()
+{
+    // A leader clears its channels for its followers before giving them up
+    for (int channel = 0; channel < ChordBus::numChannels; ++channel)
+    {
+        if ((ownedBusChannels & (1u << channel)) != 0)
+        {
+            chordBus->publish (channel, BusChord());
+            chordBus->release (channel, this);
+        }
+    }
+    
+    ownedBusChannels = 0;
+    lastPublishedChords.fill (BusChord());
+    busSequenceSeen.fill (0);
+    chordBusChannelTaken = false;
+}
+
+void AudioPluginAudioProcessor::publishToChordBus (int numEngines, juce::int64 hostSample,
+                                                   const std::array<int, ChordEngineBank::maxEngines>& changeSamples)
+{
+    const int firstChannel = chordBusChannelParam->get() - 1;
+    bool taken = false;
+    
+    for (int e = 0; e < numEngines && firstChannel + e < ChordBus::numChannels; ++e)
+    {
+        const int channel = firstChannel + e;
+        
+        if (! chordBus->claim (channel, this))
+        {
+            taken = true;
+            continue;
+        }
+        
+        ownedBusChannels |= 1u << channel;
+        
+        const auto timestamp = hostSample >= 0 ? hostSample + changeSamples[(size_t) e] : -1;
+        const auto chord = BusChord::fromDetectedChord (engines.chords[(size_t) e], timestamp);
+        
+        if (! chord.isSameChordAs (lastPublishedChords[(size_t) e]))
+        {
+            chordBus->publish (channel, chord);
+            lastPublishedChords[(size_t) e] = chord;
+        }
+    }
+    
+    chordBusChannelTaken.store (taken, std::memory_order_relaxed);
+}
+
+void AudioPluginAudioProcessor::followChordBus (juce::MidiBuffer& midiMessages, int numEngines,
+                                                juce::int64 hostSample, int numSamples)
+{
+    const int firstChannel = chordBusChannelParam->get() - 1;
+    
+    for (int e = 0; e < numEngines && firstChannel + e < ChordBus::numChannels; ++e)
+    {
+        BusChord busChord;
+        
+        if (! chordBus->read (firstChannel + e, busChord, busSequenceSeen[(size_t) e]))
+            continue;
+        
+        auto& chord = engines.chords[(size_t) e];
+        
+        if (busChord.isValid)
+        {
+            busChord.toDetectedChord (chord);
+            setDetectedChordName (chord.chordName);
+            updateChordKey (e);
+        }
+        else if (chord.isValid)
+        {
+            // The leader let go: stop where it did, if that falls in this block
+            int position = 0;
+            
+            if (busChord.timestamp >= 0 && hostSample >= 0)
+                position = (int) juce::jlimit<juce::int64> (0, numSamples - 1, busChord.timestamp - hostSample);
+            
+            chord = DetectedChord();
+            setDetectedChordName ("---");
+            stopAllActiveNotes (midiMessages, e, position);
+        }
+    }
+}
+
+//==============================================================================
+int AudioPluginAudioProcessor::getNumEngines (int inputMode)
+{
+    switch (inputMode)
+    {
+        case splitMode:      return 2;
+        case perChannelMode: return ChordEngineBank::maxEngines;
+        default:             return 1;
+    }
+}
+
+int AudioPluginAudioProcessor::getEngineForNote (int inputMode, int channel, int noteNumber) const
+{
+    switch (inputMode)
+    {
+        case splitMode:      return noteNumber < splitPointParam->get() ? 0 : 1;
+        case perChannelMode: return juce::jlimit (0, ChordEngineBank::maxEngines - 1, channel - 1);
+        default:             return 0;
+    }
+}
+
+int AudioPluginAudioProcessor::getOutputChannel (int inputMode, int engine)
+{
+    // Omni keeps everything on channel 1; zones and channels get their own
+    return inputMode == omniMode ? 1 : engine + 1;
+}
+
+int AudioPluginAudioProcessor::getRequestedPattern (int engine) const
+{
+    const int numPatterns = getNumPatterns();
+    const int overrideIndex = enginePatternParams[(size_t) engine]->getIndex();
+    
+    if (overrideIndex > 0)
+        return juce::jlimit (0, numPatterns - 1, overrideIndex - 1);
+    
+    return juce::jlimit (0, numPatterns - 1, patternParam->getIndex());
+}
+
+const RhythmPattern& AudioPluginAudioProcessor::getPattern (int index) const
+{
+    if (index == getScriptPatternIndex())
+        return scriptProgram->pattern;
+    
+    return index == getGeneratedPatternIndex() ? *generatedPattern : patterns[(size_t) index];
+}
+
+PatternSearchIndex& AudioPluginAudioProcessor::getPatternSearchIndex()
+{
+    if (patternSearchIndex.getNumPatterns() == 0)
+    {
+        for (const auto& pattern : patterns)
+            patternSearchIndex.add (pattern.name, pattern.tags);
+        
+        patternSearchIndex.add ("Euclidean", { "Generated" });
+        patternSearchIndex.add ("Script", { "Script" });
+    }
+    
+    return patternSearchIndex;
+}
+
+RhythmPattern AudioPluginAudioProcessor::getPatternForDisplay (int index) const
+{
+    if (index == getGeneratedPatternIndex())
+        return PatternGenerator::compile (getGeneratorSettings());
+    
+    if (index == getScriptPatternIndex())
+        return patternScripts.getPattern();
+    
+    return patterns[(size_t) juce::jlimit (0, (int) patterns.size() - 1, index)];
+}
+
+PatternGeneratorSettings AudioPluginAudioProcessor::getGeneratorSettings() const
+{
+    PatternGeneratorSettings settings;
+    settings.steps = genStepsParam->get();
+    settings.hits = genHitsParam->get();
+    settings.rotation = genRotationParam->get();
+    settings.probability = genProbabilityParam->get();
+    settings.ghostProbability = genGhostParam->get();
+    settings.accent = genAccentParam->get();
+    return settings;
 }
 
 bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
@@ -126,6 +561,12 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
    #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
+   #else
+    // The chord input is optional: off, mono or stereo
+    const auto input = layouts.getMainInputChannelSet();
+    
+    if (! input.isDisabled() && input != juce::AudioChannelSet::mono() && input != juce::AudioChannelSet::stereo())
+        return false;
    #endif
 
     return true;
@@ -135,6 +576,8 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
                                               juce::MidiBuffer& midiMessages)
 {
+    CHORDER_TRACE_SCOPE ("processBlock");
+    CHORDER_REALTIME_SCOPE();
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -144,161 +587,532 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
 
     const int numSamples = buffer.getNumSamples();
     
+    // Knob changes swap in a pattern compiled on the message thread
+    const auto* previousGenerated = std::exchange (generatedPattern, &generatedPatterns->acquire());
+    scriptProgram = &patternScripts.acquire();
+    
+    juce::Optional<juce::AudioPlayHead::PositionInfo> position;
+    
+    if (auto* playHead = getPlayHead())
+        position = playHead->getPosition();
+    
+    // Session capture sees the block exactly as the host handed it over
+    if (sessionCapture.isCapturing())
+    {
+        CHORDER_TRACE_SCOPE ("sessionCapture");
+        bassLines.getTargets (capturedBassTargets);
+        
+        // The audio input is part of the performance while it picks the
+        // chords or its onsets drive the rhythm
+        const bool audioDrivesOutput = chordSourceParam->getIndex() == audioSource
+                                        || rhythmSyncParam->getIndex() == onsetSync;
+        
+        sessionCapture.beginBlock (midiMessages, audioDrivesOutput ? &buffer : nullptr, totalNumInputChannels,
+                                   numSamples, position, getParameters(), patternRandom.getSeed(),
+                                   generatedPattern != previousGenerated, capturedBassTargets,
+                                   currentSampleRate, getBlockSize());
+    }
+    
+    const int inputChannel = inputChannelParam->getIndex();
+    inputDecoder.setChannelMask (inputChannel == 0 ? MidiInputDecoder::allChannels
+                                                   : (juce::uint16) (1 << (inputChannel - 1)));
+    
+    // Move the input aside, within the block's event budget, before anything
+    // is written to the output. Both buffers keep their storage, so this
+    // doesn't allocate.
+    {
+        CHORDER_TRACE_SCOPE ("overloadGuard");
+        overloadGuard.filterInput (midiMessages, inputMidi, numSamples, inputDecoder);
+        midiMessages.clear();
+        
+        // New notes wait while the DIN wire is backed up, so its note-offs
+        // always have room
+        static_assert (OverloadGuard::maxOutputBacklog <= DinOutputScheduler::maxEventsPerBlock);
+        overloadGuard.setOutputBacklog (dinOutputParam->get() ? dinScheduler.getNumQueued() : 0);
+    }
+    
     // Get tempo and transport info from host
-    double bpm = internalTempo.load();
+    double bpm = tempoParam->get();
     bool useHostTiming = false;
     double ppqPosition = 0.0;
+    double beatsPerBar = 0.0;   // 0 = unknown, use the pattern length
+    bool hostHasTransport = false;
+    juce::int64 hostSample = -1;    // Shared timeline for chord bus timestamps
     
-    if (auto* playHead = getPlayHead())
+    if (const auto& posInfo = position)
     {
-        if (auto posInfo = playHead->getPosition())
+        hostHasTransport = posInfo->getPpqPosition().hasValue();
+        
+        if (auto timeInSamples = posInfo->getTimeInSamples())
+            hostSample = *timeInSamples;
+        
+        if (auto bpmOpt = posInfo->getBpm())
+        {
+            bpm = *bpmOpt;
+        }
+        
+        if (auto timeSig = posInfo->getTimeSignature())
+        {
+            if (timeSig->numerator > 0 && timeSig->denominator > 0)
+                beatsPerBar = timeSig->numerator * 4.0 / timeSig->denominator;
+        }
+        
+        // Only use host PPQ if transport is playing
+        if (posInfo->getIsPlaying())
         {
-            if (auto bpmOpt = posInfo->getBpm())
+            if (auto ppqOpt = posInfo->getPpqPosition())
             {
-                bpm = *bpmOpt;
+                ppqPosition = *ppqOpt;
+                useHostTiming = true;
             }
+        }
+    }
+    
+    // MIDI clock. A running external clock replaces the host transport; when
+    // sending without a host transport the pattern runs on the clock's own
+    // timeline so the receiving gear stays in phase with it.
+    const int clockMode = clockModeParam->getIndex();
+    
+    if (clockMode == clockFollow)
+    {
+        if (lastClockMode != clockFollow)
+            clockFollower.reset();
+        
+        clockFollower.process (inputMidi, numSamples);
+        
+        if (clockFollower.isRunning())
+        {
+            bpm = clockFollower.getBpm();
+            ppqPosition = clockFollower.getBeatAtBlockStart();
+            useHostTiming = true;
+        }
+    }
+    else if (clockMode == clockSend && ! hostHasTransport)
+    {
+        if (lastClockMode != clockSend)
+            clockBeat = 0.0;
+        
+        ppqPosition = clockBeat;
+        useHostTiming = true;
+        clockBeat += numSamples * bpm / (60.0 * currentSampleRate);
+    }
+    
+    lastClockMode = clockMode;
+    
+    // Audio onsets: a live player's hits drive the pattern timeline in place
+    // of the transport and the clock, at the tempo they play
+    const int rhythmSync = rhythmSyncParam->getIndex();
+    
+    if (rhythmSync != lastRhythmSync)
+    {
+        onsetDetector.reset();
+        onsetFollower.reset();
+        lastRhythmSync = rhythmSync;
+    }
+    
+    if (rhythmSync == onsetSync)
+    {
+        CHORDER_TRACE_SCOPE ("onsets");
+        onsetDetector.process (buffer, totalNumInputChannels, numSamples);
+        onsetFollower.process (onsetDetector.getOnsets(), onsetDetector.getNumOnsets(), numSamples, tempoParam->get());
+        bpm = onsetFollower.getBpm();
+    }
+    
+    // Changing the routing, the channel filter or the chord source re-assigns
+    // every note, so start from silence
+    const int inputMode = inputModeParam->getIndex();
+    const int chordSource = chordSourceParam->getIndex();
+    
+    if (inputMode != lastInputMode || inputChannel != lastInputChannel || chordSource != lastChordSource)
+    {
+        for (int e = 0; e < ChordEngineBank::maxEngines; ++e)
+            stopAllActiveNotes (midiMessages, e, 0);
+        
+        resetEngines();
+        audioChordDetector.reset();
+        leaveChordBus();    // A leader may now use fewer channels
+        lastInputMode = inputMode;
+        lastInputChannel = inputChannel;
+        lastChordSource = chordSource;
+    }
+    
+    // A new capture window changes the latency and the timeline, so that
+    // also starts from silence
+    const int newCaptureSamples = getCaptureSamples();
+    
+    if (newCaptureSamples != captureSamples)
+    {
+        for (int e = 0; e < ChordEngineBank::maxEngines; ++e)
+            stopAllActiveNotes (midiMessages, e, 0);
+        
+        resetEngines();
+        captureSamples = newCaptureSamples;
+        latencyToReport.store (captureSamples, std::memory_order_relaxed);
+    }
+    
+    // The output runs captureSamples behind the input and the host
+    // compensates for that, so render the pattern that much earlier in the song
+    if (useHostTiming && captureSamples > 0)
+        ppqPosition -= captureSamples * bpm / (60.0 * currentSampleRate);
+    
+    // Switching bus role or channel starts from silence too
+    const int busMode = chordBusModeParam->getIndex();
+    const int busChannel = chordBusChannelParam->get();
+    
+    if (busMode != lastBusMode || busChannel != lastBusChannel)
+    {
+        if (lastBusMode != busOff)
+        {
+            for (int e = 0; e < ChordEngineBank::maxEngines; ++e)
+                stopAllActiveNotes (midiMessages, e, 0);
             
-            // Only use host PPQ if transport is playing
-            if (posInfo->getIsPlaying())
+            resetEngines();
+        }
+        
+        leaveChordBus();
+        lastBusMode = busMode;
+        lastBusChannel = busChannel;
+    }
+    
+    const int numEngines = getNumEngines (inputMode);
+    
+    // Process input MIDI - track held notes per engine for chord detection
+    if (captureSamples > 0)
+        delayInputForCapture (numSamples, inputMode);
+    
+    if (busMode == busFollow)
+    {
+        // The leader's chords replace our own input
+        followChordBus (midiMessages, numEngines, hostSample, numSamples);
+    }
+    else
+    {
+        std::array<int, ChordEngineBank::maxEngines> changeSamples {};
+        
+        if (chordSource == audioSource)
+        {
+            CHORDER_TRACE_SCOPE ("audioChords");
+            
+            if (audioChordDetector.process (buffer, totalNumInputChannels, numSamples,
+                                            audioWindowParam->getIndex(), audioHopParam->getIndex()))
+                applyAudioChord (midiMessages, changeSamples);
+        }
+        else
+        {
+            // Releases held by a pedal don't change the chord until the pedal lifts
+            inputDecoder.decode (inputMidi, [&] (const InputEvent& event, int samplePosition)
             {
-                if (auto ppqOpt = posInfo->getPpqPosition())
+                const int channel = event.channel;
+                NoteMask released;
+                
+                switch (event.type)
                 {
-                    ppqPosition = *ppqOpt;
-                    useHostTiming = true;
+                    case InputEvent::noteOn:
+                    {
+                        const int engine = getEngineForNote (inputMode, channel + 1, event.data1);
+                        inputNotes.noteOn (channel, event.data1);
+                        engines.heldNotes[(size_t) engine].insert (event.data1);
+                        engines.chordChangedMask |= 1u << engine;
+                        changeSamples[(size_t) engine] = samplePosition;
+                        keyEstimator.noteOn (event.data1, event.data2 / 127.0f);
+                        return;
+                    }
+                
+                    case InputEvent::noteOff:
+                        if (inputNotes.noteOff (channel, event.data1))
+                            releaseInputNote (inputMode, channel, event.data1, midiMessages, samplePosition, changeSamples);
+                        return;
+                
+                    case InputEvent::sustain:           released = inputNotes.setSustain (channel, event.data2 >= 64); break;
+                    case InputEvent::sostenuto:         released = inputNotes.setSostenuto (channel, event.data2 >= 64); break;
+                    case InputEvent::allNotesOff:       released = inputNotes.allNotesOff (channel); break;
+                    case InputEvent::resetControllers:  released = inputNotes.resetControllers (channel); break;
+                    case InputEvent::ignored:           return;
                 }
-            }
+                
+                for (int note : released)
+                    releaseInputNote (inputMode, channel, note, midiMessages, samplePosition, changeSamples);
+            });
+        }
+        
+        keyEstimator.advance (numSamples);
+        
+        // Update chord detection for engines whose notes changed
+        for (int e = 0; e < numEngines; ++e)
+        {
+            if ((engines.chordChangedMask & (1u << e)) != 0 && ! engines.heldNotes[(size_t) e].empty())
+                updateDetectedChord (e);
         }
+        engines.chordChangedMask = 0;
+        
+        if (busMode == busLead)
+            publishToChordBus (numEngines, hostSample, changeSamples);
     }
     
-    // Process input MIDI - track held notes for chord detection
-    juce::MidiBuffer inputMidi;
-    inputMidi.swapWith (midiMessages);
+   #if JucePlugin_IsSynth
+    // The instrument's audio input only feeds chord detection; it isn't
+    // passed through
+    for (int i = 0; i < totalNumInputChannels; ++i)
+        buffer.clear (i, 0, numSamples);
+   #endif
     
-    bool chordChanged = false;
+    // Process rhythm pattern for each engine that is enabled and has a valid chord
+    const bool enabled = enabledParam->get();
     
-    for (const auto metadata : inputMidi)
+    for (int e = 0; e < numEngines; ++e)
     {
-        auto message = metadata.getMessage();
-        
-        if (message.isNoteOn())
+        if (enabled && engines.chords[(size_t) e].isValid)
         {
-            heldNotes.insert (message.getNoteNumber());
-            chordChanged = true;
+            processRhythmPattern (e, midiMessages, numSamples, bpm, useHostTiming, ppqPosition, beatsPerBar);
         }
-        else if (message.isNoteOff())
+        else
         {
-            heldNotes.erase (message.getNoteNumber());
-            
-            if (heldNotes.empty())
+            // Nothing is sounding, so a pattern change can take effect right away
+            engines.activePatternIndex[(size_t) e] = getRequestedPattern (e);
+        }
+    }
+    
+    // Process pending note-offs, compacting the rest in one pass
+    {
+        CHORDER_TRACE_SCOPE ("pendingNoteOffs");
+        size_t numWaiting = 0;
+        
+        for (auto& pending : pendingNoteOffs)
+        {
+            if (pending.samplePosition < numSamples)
             {
-                // All notes released - stop pattern and turn off active notes
-                currentChord = DetectedChord();
-                setDetectedChordName ("---");
-                stopAllActiveNotes (midiMessages, metadata.samplePosition);
+                auto noteOff = juce::MidiMessage::noteOff (pending.channel, pending.noteNumber);
+                midiMessages.addEvent (noteOff, pending.samplePosition);
+                engines.activeOutputNotes[(size_t) pending.engine].erase (pending.noteNumber);
+            }
+            else
+            {
+                pending.samplePosition -= numSamples;
+                pendingNoteOffs[numWaiting++] = pending;
             }
-            
-            chordChanged = true;
         }
+        
+        pendingNoteOffs.resize (numWaiting);
     }
     
-    // Update chord detection when notes change
-    if (chordChanged && !heldNotes.empty())
+    // Hand the block's output to the take recorder before clock messages go in
     {
-        updateDetectedChord();
+        CHORDER_TRACE_SCOPE ("recorder");
+        recorder.process (midiMessages, numSamples, bpm, currentSampleRate);
     }
     
-    // Process rhythm pattern if enabled and we have a valid chord
-    if (patternEnabled.load() && currentChord.isValid)
+    // Clock out runs on the same (latency-shifted) timeline as the pattern.
+    // Outside send mode this only sends a stop if the clock was running.
+    clockGenerator.process (midiMessages, numSamples, clockMode == clockSend && useHostTiming,
+                            ppqPosition, bpm, currentSampleRate);
+    
+    // Audition the generated notes before any output rescheduling
+    const bool previewEnabled = previewEnabledParam->get();
+    
+    if (previewEnabled && ! previewWasEnabled)
+        previewSynth.reset();
+    
+    if (previewEnabled)
     {
-        processRhythmPattern (midiMessages, numSamples, bpm, useHostTiming, ppqPosition);
+        CHORDER_TRACE_SCOPE ("previewSynth");
+        previewSynth.render (buffer, midiMessages, previewSoundParam->getIndex(), previewLevelParam->get());
     }
     
-    // Process pending note-offs
-    for (auto it = pendingNoteOffs.begin(); it != pendingNoteOffs.end(); )
+    previewWasEnabled = previewEnabled;
+    
+    // Serialise the block as a DIN link would. The model restarts from an idle
+    // wire whenever the stage is switched on.
+    const bool dinEnabled = dinOutputParam->get();
+    
+    if (dinEnabled && ! dinWasEnabled)
+        dinScheduler.reset();
+    
+    if (dinEnabled)
     {
-        if (it->samplePosition < numSamples)
-        {
-            auto noteOff = juce::MidiMessage::noteOff (it->channel, it->noteNumber);
-            midiMessages.addEvent (noteOff, it->samplePosition);
-            activeOutputNotes.erase (it->noteNumber);
-            it = pendingNoteOffs.erase (it);
-        }
-        else
+        CHORDER_TRACE_SCOPE ("dinScheduler");
+        dinScheduler.process (midiMessages, numSamples, dinJitterBudgetParam->get(), currentSampleRate);
+    }
+    
+    dinWasEnabled = dinEnabled;
+    
+    sessionCapture.endBlock (midiMessages);
+    
+    // Queue the output notes for the on-screen keyboard
+    for (const auto metadata : midiMessages)
+    {
+        const auto type = metadata.data[0] & 0xf0;
+        
+        if (metadata.numBytes != 3 || (type != 0x80 && type != 0x90 && ! (type == 0xb0 && (metadata.data[1] == 120 || metadata.data[1] == 123))))
+            continue;
+        
+        const auto scope = keyboardFifo.write (1);
+        
+        if (scope.blockSize1 == 0)
         {
-            it->samplePosition -= numSamples;
-            ++it;
+            keyboardEventsLost.store (true, std::memory_order_relaxed);
+            break;
         }
+        
+        std::copy (metadata.data, metadata.data + 3, keyboardEvents[(size_t) scope.startIndex1].begin());
     }
+}
+
+void AudioPluginAudioProcessor::updateKeyboardState()
+{
+    const auto scope = keyboardFifo.read (keyboardFifo.getNumReady());
+    
+    scope.forEach ([this] (int index)
+    {
+        const auto& bytes = keyboardEvents[(size_t) index];
+        keyboardState.processNextMidiEvent (juce::MidiMessage (bytes[0], bytes[1], bytes[2]));
+    });
     
-    // Update keyboard state for UI visualization
-    keyboardState.processNextMidiBuffer (midiMessages, 0, numSamples, false);
+    if (keyboardEventsLost.exchange (false, std::memory_order_relaxed))
+        keyboardState.allNotesOff (0);
 }
 
-void AudioPluginAudioProcessor::processRhythmPattern (juce::MidiBuffer& midiMessages, 
+void AudioPluginAudioProcessor::processRhythmPattern (int engine,
+                                                       juce::MidiBuffer& midiMessages, 
                                                        int numSamples,
                                                        double bpm, 
                                                        bool useHostTiming,
-                                                       double ppqPosition)
+                                                       double ppqPosition,
+                                                       double beatsPerBar)
 {
-    const int patternIdx = juce::jlimit (0, (int) patterns.size() - 1, currentPatternIndex.load());
-    const auto& pattern = patterns[patternIdx];
-    const double patternLength = pattern.lengthInBeats;
+    CHORDER_TRACE_SCOPE ("renderPattern");
+    
+    const int numPatterns = getNumPatterns();
+    const int requestedPattern = getRequestedPattern (engine);
+    const bool quantiseSwitch = quantiseSwitchParam->get();
+    auto& activePatternIndex = engines.activePatternIndex[(size_t) engine];
+    auto& accumulatedBeats = engines.accumulatedBeats[(size_t) engine];
+    activePatternIndex = juce::jlimit (0, numPatterns - 1, activePatternIndex);
     
     // Calculate beats per sample
     const double beatsPerSecond = bpm / 60.0;
     const double beatsPerSample = beatsPerSecond / currentSampleRate;
     const double beatsInBlock = beatsPerSample * numSamples;
     
-    // Determine start beat position
-    double startBeat;
-    if (useHostTiming)
-    {
-        // Use host PPQ position when transport is playing
-        startBeat = std::fmod (ppqPosition, patternLength);
-    }
-    else
+    // The block's timeline: one span from its absolute start beat, or the
+    // onset follower's spans, which jump where the player re-phases it
+    const OnsetFollower::Span wholeBlock { 0, numSamples, useHostTiming ? ppqPosition : accumulatedBeats };
+    const bool followOnsets = lastRhythmSync == onsetSync;
+    const auto* spans = followOnsets ? onsetFollower.getSpans() : &wholeBlock;
+    const int numSpans = followOnsets ? onsetFollower.getNumSpans() : 1;
+    
+    // Shared by every segment of the block
+    int scriptBudget = PatternScript::instructionBudget;
+    bool scriptOverran = false;
+    
+    for (int s = 0; s < numSpans; ++s)
     {
-        // Use internal accumulator for standalone/stopped transport
-        startBeat = std::fmod (accumulatedBeats, patternLength);
+        const auto& span = spans[s];
+        
+        // Render the span in segments, splitting at the sample where a pending
+        // pattern switch takes effect so the new pattern starts exactly on the bar
+        int segmentStart = span.start;
+        
+        while (segmentStart < span.end)
+        {
+            int segmentEnd = span.end;
+            
+            if (requestedPattern != activePatternIndex)
+            {
+                if (! quantiseSwitch)
+                {
+                    activePatternIndex = requestedPattern;
+                }
+                else
+                {
+                    const double barLength = beatsPerBar > 0.0 ? beatsPerBar
+                                                               : getPattern (activePatternIndex).lengthInBeats;
+                    const double segmentBeat = span.beat + (segmentStart - span.start) * beatsPerSample;
+                    const double nextBar = std::ceil (segmentBeat / barLength - 1.0e-9) * barLength;
+                    const int switchSample = segmentStart
+                                           + static_cast<int> (std::ceil ((nextBar - segmentBeat) / beatsPerSample));
+                    
+                    if (switchSample <= segmentStart)
+                        activePatternIndex = requestedPattern;
+                    else if (switchSample < span.end)
+                        segmentEnd = switchSample;
+                }
+            }
+            
+            const auto& pattern = getPattern (activePatternIndex);
+            const double patternLength = pattern.lengthInBeats;
+            const double segmentStartBeat = span.beat + (segmentStart - span.start) * beatsPerSample;
+            
+            if (activePatternIndex == getScriptPatternIndex())
+            {
+                // Scripts see the bar count, so they run on the absolute timeline
+                const double barLength = beatsPerBar > 0.0 ? beatsPerBar : patternLength;
+                
+                if (! scriptOverran)
+                    scriptOverran = ! addScriptNotes (engine, midiMessages, segmentStartBeat, segmentStart, segmentEnd,
+                                                      bpm, barLength, scriptBudget);
+            }
+            else
+            {
+                double startBeat = std::fmod (segmentStartBeat, patternLength);
+                
+                if (startBeat < 0.0)
+                    startBeat += patternLength;     // Song start with a latency-shifted timeline
+                
+                const double endBeat = startBeat + (segmentEnd - segmentStart) * beatsPerSample;
+                
+                addPatternNotes (engine, midiMessages, pattern, startBeat, endBeat, segmentStart, segmentEnd, bpm);
+            }
+            
+            if (segmentEnd < span.end)
+                activePatternIndex = requestedPattern;
+            
+            segmentStart = segmentEnd;
+        }
     }
     
-    double endBeat = startBeat + beatsInBlock;
-    
-    // Add notes for this block
-    addPatternNotes (midiMessages, startBeat, endBeat, 0, numSamples, bpm);
+    if (scriptOverran)
+        scriptOverruns.fetch_add (1, std::memory_order_relaxed);
     
     // Always update accumulated beats (used for standalone/internal timing)
     accumulatedBeats += beatsInBlock;
-    // Keep it from growing too large
-    if (accumulatedBeats > patternLength * 1000.0)
-        accumulatedBeats = std::fmod (accumulatedBeats, patternLength);
+    // Keep it from growing too large (wrapping on whole bars keeps bar lines in place)
+    const double wrapLength = beatsPerBar > 0.0 ? beatsPerBar : getPattern (activePatternIndex).lengthInBeats;
+    if (accumulatedBeats > wrapLength * 1000.0)
+        accumulatedBeats = std::fmod (accumulatedBeats, wrapLength);
 }
 
-void AudioPluginAudioProcessor::addPatternNotes (juce::MidiBuffer& midiMessages,
+void AudioPluginAudioProcessor::addPatternNotes (int engine,
+                                                  juce::MidiBuffer& midiMessages,
+                                                  const RhythmPattern& pattern,
                                                   double startBeat,
                                                   double endBeat,
-                                                  int blockStartSample,
-                                                  int numSamples,
+                                                  int segmentStart,
+                                                  int segmentEnd,
                                                   double bpm)
 {
-    const int patternIdx = juce::jlimit (0, (int) patterns.size() - 1, currentPatternIndex.load());
-    const auto& pattern = patterns[patternIdx];
     const double patternLength = pattern.lengthInBeats;
+    const auto& chord = engines.chords[(size_t) engine];
+    const int outputChannel = getOutputChannel (lastInputMode, engine);
     
     const double beatsPerSecond = bpm / 60.0;
     const double samplesPerBeat = currentSampleRate / beatsPerSecond;
     
+    // Notes on the same beat with the same probability share one roll
+    double rolledBeat = -1.0;
+    float rolledProbability = 1.0f;
+    bool rollPassed = true;
+    
     for (const auto& note : pattern.notes)
     {
         double noteBeat = note.beatPosition;
         
-        // Check if note falls within this block (handle pattern wrap)
+        // Check if note falls within this segment (handle pattern wrap)
         bool shouldTrigger = false;
         double relativeBeat = 0.0;
         
         if (endBeat > patternLength)
         {
-            // Pattern wraps in this block
+            // Pattern wraps in this segment
             if (noteBeat >= startBeat || noteBeat < (endBeat - patternLength))
             {
                 shouldTrigger = true;
@@ -318,35 +1132,115 @@ void AudioPluginAudioProcessor::addPatternNotes (juce::MidiBuffer& midiMessages,
             }
         }
         
-        if (shouldTrigger && currentChord.isValid)
+        if (shouldTrigger && chord.isValid && note.probability < 1.0f)
         {
-            int midiNote = getChordNote (note.chordIndex);
+            if (note.beatPosition != rolledBeat || note.probability != rolledProbability)
+            {
+                rolledBeat = note.beatPosition;
+                rolledProbability = note.probability;
+                rollPassed = patternRandom.nextFloat() < note.probability;
+            }
             
-            if (midiNote >= 0 && midiNote <= 127)
+            shouldTrigger = rollPassed;
+        }
+        
+        if (shouldTrigger && chord.isValid)
+        {
+            int midiNote = note.chordIndex == -1 ? getBassNote (engine, noteBeat, patternLength)
+                                                 : getChordNote (engine, note.chordIndex);
+            
+            if (midiNote >= 0 && midiNote <= 127 && overloadGuard.tryStartNote (pendingNoteOffs.size()))
             {
-                int samplePos = blockStartSample + static_cast<int> (relativeBeat * samplesPerBeat);
-                samplePos = juce::jlimit (0, numSamples - 1, samplePos);
+                int samplePos = segmentStart + static_cast<int> (relativeBeat * samplesPerBeat);
+                samplePos = juce::jlimit (segmentStart, segmentEnd - 1, samplePos);
                 
                 // Note on
-                auto noteOn = juce::MidiMessage::noteOn (1, midiNote, note.velocity);
+                auto noteOn = juce::MidiMessage::noteOn (outputChannel, midiNote, note.velocity);
                 midiMessages.addEvent (noteOn, samplePos);
-                activeOutputNotes.insert (midiNote);
+                engines.activeOutputNotes[(size_t) engine].insert (midiNote);
                 
                 // Schedule note off
                 int noteOffSample = samplePos + static_cast<int> (note.duration * samplesPerBeat);
-                pendingNoteOffs.push_back ({ midiNote, 1, noteOffSample });
+                pendingNoteOffs.push_back ({ midiNote, outputChannel, noteOffSample, engine });
             }
         }
     }
 }
 
-int AudioPluginAudioProcessor::getChordNote (int chordIndex) const
+bool AudioPluginAudioProcessor::addScriptNotes (int engine,
+                                                 juce::MidiBuffer& midiMessages,
+                                                 double segmentStartBeat,
+                                                 int segmentStart,
+                                                 int segmentEnd,
+                                                 double bpm,
+                                                 double barLength,
+                                                 int& budget)
+{
+    const auto& chord = engines.chords[(size_t) engine];
+    
+    if (! chord.isValid)
+        return true;
+    
+    const auto& program = *scriptProgram;
+    const int outputChannel = getOutputChannel (lastInputMode, engine);
+    const double samplesPerBeat = currentSampleRate * 60.0 / bpm;
+    const double segmentEndBeat = segmentStartBeat + (segmentEnd - segmentStart) / samplesPerBeat;
+    const double stepLength = program.getStepLength();
+    
+    PatternScript::Context context;
+    context.setChord (chord);
+    context.random = &patternRandom;
+    
+    // Every grid step that starts inside the segment
+    for (auto k = (juce::int64) std::ceil (segmentStartBeat / stepLength); k * stepLength < segmentEndBeat; ++k)
+    {
+        const double stepBeat = (double) k * stepLength;
+        const int samplePos = juce::jlimit (segmentStart, segmentEnd - 1,
+                                            segmentStart + static_cast<int> ((stepBeat - segmentStartBeat) * samplesPerBeat));
+        context.setStep (program, k, barLength);
+        
+        const bool finished = PatternScript::run (program, context, budget, [&] (const PatternScript::PlayEvent& event)
+        {
+            if (event.velocity <= 0.0f)
+                return;
+            
+            const float velocity = juce::jmin (1.0f, event.velocity);
+            const int durationSamples = static_cast<int> (juce::jlimit (0.01f, 64.0f, event.lengthInSteps)
+                                                          * stepLength * samplesPerBeat);
+            
+            for (int tone = -1; tone < juce::jmin (8, (int) chord.intervals.size()); ++tone)
+            {
+                if ((event.tones & (tone < 0 ? PatternScript::bassTone : (1 << tone))) == 0)
+                    continue;
+                
+                const int midiNote = tone < 0 ? getBassNote (engine, context.values[PatternScript::beatVar], program.pattern.lengthInBeats)
+                                              : getChordNote (engine, tone);
+                
+                if (midiNote < 0 || midiNote > 127 || ! overloadGuard.tryStartNote (pendingNoteOffs.size()))
+                    continue;
+                
+                midiMessages.addEvent (juce::MidiMessage::noteOn (outputChannel, midiNote, velocity), samplePos);
+                engines.activeOutputNotes[(size_t) engine].insert (midiNote);
+                pendingNoteOffs.push_back ({ midiNote, outputChannel, samplePos + durationSamples, engine });
+            }
+        });
+        
+        if (! finished)
+            return false;
+    }
+    
+    return true;
+}
+
+int AudioPluginAudioProcessor::getChordNote (int engine, int chordIndex) const
 {
-    if (!currentChord.isValid)
+    const auto& chord = engines.chords[(size_t) engine];
+    
+    if (!chord.isValid)
         return -1;
         
-    int rootNote = currentChord.rootNote;
-    const auto& intervals = currentChord.intervals;
+    int rootNote = chord.rootNote;
+    const auto& intervals = chord.intervals;
     
     if (chordIndex == -1)
     {
@@ -363,15 +1257,35 @@ int AudioPluginAudioProcessor::getChordNote (int chordIndex) const
     return rootNote;
 }
 
-void AudioPluginAudioProcessor::stopAllActiveNotes (juce::MidiBuffer& midiMessages, int samplePosition)
+int AudioPluginAudioProcessor::getBassNote (int engine, double beatInCycle, double cycleLength) const
+{
+    const int bass = getChordNote (engine, -1);
+    const int chordKey = engines.chordKeys[(size_t) engine];
+    
+    if (bass < 0 || chordKey < 0 || bassModeParam->getIndex() != walkingBass)
+        return bass;
+    
+    const int beat = static_cast<int> (std::floor (beatInCycle + 1.0e-6));
+    const int beatsInCycle = static_cast<int> (std::ceil (cycleLength - 1.0e-6));
+    return bass + bassLines.getOffset (chordKey, beat, beatsInCycle);
+}
+
+void AudioPluginAudioProcessor::stopAllActiveNotes (juce::MidiBuffer& midiMessages, int engine, int samplePosition)
 {
-    for (int note : activeOutputNotes)
+    auto& active = engines.activeOutputNotes[(size_t) engine];
+    const int outputChannel = getOutputChannel (lastInputMode, engine);
+    
+    for (int note : active)
     {
-        auto noteOff = juce::MidiMessage::noteOff (1, note);
+        auto noteOff = juce::MidiMessage::noteOff (outputChannel, note);
         midiMessages.addEvent (noteOff, samplePosition);
     }
-    activeOutputNotes.clear();
-    pendingNoteOffs.clear();
+    active.clear();
+    
+    // Drop this engine's scheduled note-offs - they have just been sent
+    pendingNoteOffs.erase (std::remove_if (pendingNoteOffs.begin(), pendingNoteOffs.end(),
+                                           [engine] (const ScheduledNoteOff& n) { return n.engine == engine; }),
+                           pendingNoteOffs.end());
 }
 
 //==============================================================================
@@ -386,34 +1300,160 @@ juce::AudioProcessorEditor* AudioPluginAudioProcessor::createEditor()
 }
 
 //==============================================================================
-void AudioPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
+void AudioPluginAudioProcessor::startSessionCapture (const juce::File& file)
 {
-    juce::ValueTree state ("ChordPlayerState");
-    state.setProperty ("patternIndex", currentPatternIndex.load(), nullptr);
-    state.setProperty ("tempo", internalTempo.load(), nullptr);
-    state.setProperty ("enabled", patternEnabled.load(), nullptr);
+    juce::MemoryBlock state;
+    getStateInformation (state);
+    
+    juce::StringArray parameterIDs;
+    
+    for (auto* parameter : getParameters())
+    {
+        if (auto* hosted = dynamic_cast<juce::HostedAudioProcessorParameter*> (parameter))
+            parameterIDs.add (hosted->getParameterID());
+        else
+            parameterIDs.add (juce::String (parameter->getParameterIndex()));
+    }
     
-    std::unique_ptr<juce::XmlElement> xml (state.createXml());
-    copyXmlToBinary (*xml, destData);
+    sessionCapture.start (file, state, parameterIDs);
 }
 
-void AudioPluginAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
+void AudioPluginAudioProcessor::prepareReplayBlock (const SessionLogReader::Record& block)
 {
-    std::unique_ptr<juce::XmlElement> xml (getXmlFromBinary (data, sizeInBytes));
+    // Only the captured targets move the walking lines
+    bassLines.setLearning (false);
+    patternRandom.setSeed (block.randomSeed);
     
-    if (xml != nullptr)
+    // The generated pattern changes where the capture saw it change, not on
+    // a timer
+    if (block.has (SessionCapture::generatedChanged))
+        generatedPatterns->refresh();
+}
+
+void AudioPluginAudioProcessor::setReplayBassTargets (const WalkingBass::Targets& targets)
+{
+    bassLines.setTargets (targets);
+}
+
+//==============================================================================
+void AudioPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
+{
+    PluginStateSerialiser::write (captureState(), destData);
+}
+
+void AudioPluginAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
+{
+    PluginState state;
+    const auto result = PluginStateSerialiser::read (data, sizeInBytes, state);
+
+    if (result == PluginStateSerialiser::Result::ok)
     {
-        juce::ValueTree state = juce::ValueTree::fromXml (*xml);
-        
-        if (state.isValid())
+        applyState (state);
+        return;
+    }
+
+    // Sessions saved before the binary format stored an XML ValueTree
+    if (result == PluginStateSerialiser::Result::notBinaryFormat)
+    {
+        std::unique_ptr<juce::XmlElement> xml (getXmlFromBinary (data, sizeInBytes));
+
+        if (xml != nullptr)
         {
-            currentPatternIndex.store (state.getProperty ("patternIndex", 0));
-            internalTempo.store (state.getProperty ("tempo", 120.0f));
-            patternEnabled.store (state.getProperty ("enabled", true));
+            juce::ValueTree tree = juce::ValueTree::fromXml (*xml);
+
+            if (tree.isValid())
+            {
+                state.patternIndex = tree.getProperty ("patternIndex", 0);
+                state.tempo = tree.getProperty ("tempo", 120.0f);
+                state.enabled = tree.getProperty ("enabled", true);
+                applyState (state);
+            }
         }
     }
 }
 
+PluginState AudioPluginAudioProcessor::captureState() const
+{
+    PluginState state;
+    state.patternIndex = patternParam->getIndex();
+    state.tempo = tempoParam->get();
+    state.enabled = enabledParam->get();
+    state.quantiseSwitch = quantiseSwitchParam->get();
+    state.inputMode = inputModeParam->getIndex();
+    state.splitPoint = splitPointParam->get();
+    
+    for (size_t e = 0; e < state.enginePatterns.size(); ++e)
+        state.enginePatterns[e] = enginePatternParams[e]->getIndex();
+    
+    state.dinOutput = dinOutputParam->get();
+    state.dinJitterBudgetMs = dinJitterBudgetParam->get();
+    state.previewEnabled = previewEnabledParam->get();
+    state.previewSound = previewSoundParam->getIndex();
+    state.previewLevel = previewLevelParam->get();
+    state.strumCaptureMs = strumCaptureParam->get();
+    state.clockMode = clockModeParam->getIndex();
+    state.genSteps = genStepsParam->get();
+    state.genHits = genHitsParam->get();
+    state.genRotation = genRotationParam->get();
+    state.genProbability = genProbabilityParam->get();
+    state.genGhost = genGhostParam->get();
+    state.genAccent = genAccentParam->get();
+    state.chordBusMode = chordBusModeParam->getIndex();
+    state.chordBusChannel = chordBusChannelParam->get();
+    state.inputChannel = inputChannelParam->getIndex();
+    state.patternScript = patternScripts.getSource();
+    state.bassMode = bassModeParam->getIndex();
+    state.chordSource = chordSourceParam->getIndex();
+    state.audioWindow = audioWindowParam->getIndex();
+    state.audioHop = audioHopParam->getIndex();
+    state.rhythmSync = rhythmSyncParam->getIndex();
+    return state;
+}
+
+void AudioPluginAudioProcessor::applyState (const PluginState& state)
+{
+    // The blob has been fully parsed and validated at this point, so each
+    // parameter the audio thread reads holds a complete value. The state as
+    // a whole is not swapped atomically: a block running meanwhile can see
+    // some parameters already restored and others not yet.
+    *patternParam = juce::jlimit (0, getNumPatterns() - 1, state.patternIndex);
+    *tempoParam = juce::jlimit (40.0f, 240.0f, state.tempo);
+    *enabledParam = state.enabled;
+    *quantiseSwitchParam = state.quantiseSwitch;
+    *inputModeParam = juce::jlimit (0, (int) perChannelMode, state.inputMode);
+    *splitPointParam = juce::jlimit (0, 127, state.splitPoint);
+    
+    for (size_t e = 0; e < state.enginePatterns.size(); ++e)
+        *enginePatternParams[e] = juce::jlimit (0, getNumPatterns(), state.enginePatterns[e]);
+    
+    *dinOutputParam = state.dinOutput;
+    *dinJitterBudgetParam = juce::jlimit (0.0f, 10.0f, state.dinJitterBudgetMs);
+    *previewEnabledParam = state.previewEnabled;
+    *previewSoundParam = juce::jlimit (0, (int) PreviewSynth::fmSound, state.previewSound);
+    *previewLevelParam = juce::jlimit (0.0f, 1.0f, state.previewLevel);
+    *strumCaptureParam = juce::jlimit (0.0f, 100.0f, state.strumCaptureMs);
+    *clockModeParam = juce::jlimit (0, (int) clockFollow, state.clockMode);
+    *genStepsParam = juce::jlimit (2, 32, state.genSteps);
+    *genHitsParam = juce::jlimit (1, 32, state.genHits);
+    *genRotationParam = juce::jlimit (0, 31, state.genRotation);
+    *genProbabilityParam = juce::jlimit (0.0f, 1.0f, state.genProbability);
+    *genGhostParam = juce::jlimit (0.0f, 1.0f, state.genGhost);
+    *genAccentParam = juce::jlimit (0.0f, 1.0f, state.genAccent);
+    *chordBusModeParam = juce::jlimit (0, (int) busFollow, state.chordBusMode);
+    *chordBusChannelParam = juce::jlimit (1, ChordBus::numChannels, state.chordBusChannel);
+    *inputChannelParam = juce::jlimit (0, 16, state.inputChannel);
+    *bassModeParam = juce::jlimit (0, (int) walkingBass, state.bassMode);
+    *chordSourceParam = juce::jlimit (0, (int) audioSource, state.chordSource);
+    *audioWindowParam = juce::jlimit (0, AudioChordDetector::numWindowSizes - 1, state.audioWindow);
+    *audioHopParam = juce::jlimit (0, AudioChordDetector::numHopSizes - 1, state.audioHop);
+    *rhythmSyncParam = juce::jlimit (0, (int) onsetSync, state.rhythmSync);
+    
+    // A script that no longer compiles keeps its text for editing and leaves
+    // the current one playing
+    patternScripts.setSource (state.patternScript.isNotEmpty() ? juce::String (state.patternScript)
+                                                               : juce::String (PatternScript::getDefaultSource()));
+}
+
 //==============================================================================
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 {
@@ -4,18 +4,41 @@
 #include <juce_audio_utils/juce_audio_utils.h>
 #include "RhythmPattern.h"
 #include "ChordDetector.h"
+#include "KeyEstimator.h"
+#include "ChordEngineBank.h"
+#include "PluginState.h"
+#include "DinOutputScheduler.h"
+#include "PreviewSynth.h"
+#include "MidiClock.h"
+#include "TraceRecorder.h"
+#include "RealtimeSafety.h"
+#include "PatternGenerator.h"
+#include "ChordBus.h"
+#include "MidiRecorder.h"
+#include "PatternSearchIndex.h"
+#include "MidiInputDecoder.h"
+#include "PatternScript.h"
+#include "WalkingBass.h"
+#include "SessionCapture.h"
+#include "AudioChordDetector.h"
+#include "OverloadGuard.h"
+#include "OnsetFollower.h"
 #include <set>
 
 //==============================================================================
-class AudioPluginAudioProcessor final : public juce::AudioProcessor
+class AudioPluginAudioProcessor final : public juce::AudioProcessor,
+                                        private juce::Timer
 {
 public:
     //==============================================================================
     AudioPluginAudioProcessor();
     ~AudioPluginAudioProcessor() override;
     
-    // Keyboard state to visualize output notes in the UI
+    // Keyboard state to visualize output notes in the UI. The audio thread
+    // queues its output notes and the editor applies them, so only the
+    // message thread takes the keyboard state's lock.
     juce::MidiKeyboardState keyboardState;
+    void updateKeyboardState();
 
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
@@ -50,71 +73,341 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     //==========================================================================
-    // Rhythm pattern control
-    juce::StringArray getPatternNames() const { return RhythmPatternFactory::getPatternNames(); }
+    // Rhythm pattern control. The generated and scripted patterns follow the
+    // factory ones.
+    juce::StringArray getPatternNames() const
+    {
+        auto names = RhythmPatternFactory::getPatternNames();
+        names.add ("Euclidean");
+        names.add ("Script");
+        return names;
+    }
+    
+    int getGeneratedPatternIndex() const { return (int) patterns.size(); }
+    int getScriptPatternIndex() const    { return (int) patterns.size() + 1; }
+    
+    // Message thread: the pattern script. setSource returns the compile error,
+    // if any; the script playing only changes when one compiles.
+    PatternScriptSource& getPatternScript() { return patternScripts; }
+    
+    // Blocks in which a script ran out of instructions (for UI display, lock-free)
+    int getScriptOverruns() const        { return scriptOverruns.load (std::memory_order_relaxed); }
+    
+    // Message thread: name and tag index for the pattern browser, built the
+    // first time it is asked for
+    PatternSearchIndex& getPatternSearchIndex();
+    
+    // Message thread: a copy of a pattern for display. The generated one is
+    // compiled from the current generator settings.
+    RhythmPattern getPatternForDisplay (int index) const;
     
-    // Current selected pattern index (thread-safe)
-    std::atomic<int> currentPatternIndex { 0 };
+    //==========================================================================
+    // Host-automatable parameters (owned by the AudioProcessor, read lock-free
+    // on the audio thread)
+    
+    // Current selected pattern index
+    juce::AudioParameterChoice* patternParam { nullptr };
     
     // Tempo control (BPM) - used when host tempo not available
-    std::atomic<float> internalTempo { 120.0f };
+    juce::AudioParameterFloat* tempoParam { nullptr };
     
     // Enable/disable pattern playback
-    std::atomic<bool> patternEnabled { true };
+    juce::AudioParameterBool* enabledParam { nullptr };
+    
+    // Delay pattern switches until the next bar line
+    juce::AudioParameterBool* quantiseSwitchParam { nullptr };
+    
+    // How input notes are routed to chord engines
+    enum InputMode { omniMode = 0, splitMode, perChannelMode };
+    juce::AudioParameterChoice* inputModeParam { nullptr };
+    
+    // Split mode: notes below this go to the lower zone (engine 0)
+    juce::AudioParameterInt* splitPointParam { nullptr };
+    
+    // Per-engine pattern override (index 0 = follow the main pattern)
+    std::array<juce::AudioParameterChoice*, ChordEngineBank::maxEngines> enginePatternParams {};
+    
+    // Reschedule output for a 31.25 kbaud DIN link
+    juce::AudioParameterBool* dinOutputParam { nullptr };
+    juce::AudioParameterFloat* dinJitterBudgetParam { nullptr };
+    
+    // Built-in synth on the audio output for auditioning the pattern
+    juce::AudioParameterBool* previewEnabledParam { nullptr };
+    juce::AudioParameterChoice* previewSoundParam { nullptr };
+    juce::AudioParameterFloat* previewLevelParam { nullptr };
+    
+    // Strum capture window in ms. Input is delayed by this much (and reported
+    // as latency) so a rolled chord is detected whole; 0 = live
+    juce::AudioParameterFloat* strumCaptureParam { nullptr };
+    
+    // MIDI clock: send 24-PPQN clock, or follow an external one
+    enum ClockMode { clockOff = 0, clockSend, clockFollow };
+    juce::AudioParameterChoice* clockModeParam { nullptr };
+    
+    // Euclidean pattern generator: hits over steps with rotation, the chance
+    // of each further hit, ghost notes on rests and on-beat accent depth
+    juce::AudioParameterInt* genStepsParam { nullptr };
+    juce::AudioParameterInt* genHitsParam { nullptr };
+    juce::AudioParameterInt* genRotationParam { nullptr };
+    juce::AudioParameterFloat* genProbabilityParam { nullptr };
+    juce::AudioParameterFloat* genGhostParam { nullptr };
+    juce::AudioParameterFloat* genAccentParam { nullptr };
+    
+    // Chord bus between instances in this process: a leader publishes its
+    // chords, followers play them instead of detecting their own. Engine e
+    // uses bus channel (chordBusChannel + e).
+    enum ChordBusMode { busOff = 0, busLead, busFollow };
+    juce::AudioParameterChoice* chordBusModeParam { nullptr };
+    juce::AudioParameterInt* chordBusChannelParam { nullptr };
+    
+    // Input channel filter: 0 = all channels, otherwise only that channel
+    juce::AudioParameterChoice* inputChannelParam { nullptr };
+    
+    // Bass layer: the root an octave down, or a walking line
+    enum BassMode { rootBass = 0, walkingBass };
+    juce::AudioParameterChoice* bassModeParam { nullptr };
+    
+    // Where chords come from: MIDI notes, or the audio input (the optional
+    // "Chord Input" bus). Audio analysis uses a window of 1024-8192 samples
+    // every 128-1024 samples: larger windows resolve the bass better, smaller
+    // ones and shorter hops react faster.
+    enum ChordSource { midiSource = 0, audioSource };
+    juce::AudioParameterChoice* chordSourceParam { nullptr };
+    juce::AudioParameterChoice* audioWindowParam { nullptr };
+    juce::AudioParameterChoice* audioHopParam { nullptr };
+    
+    // What the pattern's timeline follows: the tempo (host transport, MIDI
+    // clock or the Tempo parameter), or the hits of a live player on the
+    // audio input, which start, re-phase and set the tempo of the pattern.
+    // In onset mode the Tempo parameter centres the tempo search.
+    enum RhythmSync { tempoSync = 0, onsetSync };
+    juce::AudioParameterChoice* rhythmSyncParam { nullptr };
     
     // Detected chord info (for UI display)
     juce::String getDetectedChordName() const 
     { 
-        juce::SpinLock::ScopedLockType lock (chordNameLock);
-        return detectedChordName; 
+        char name[sizeof (detectedChordName)];
+        
+        {
+            juce::SpinLock::ScopedLockType lock (chordNameLock);
+            std::memcpy (name, detectedChordName, sizeof (name));
+        }
+        
+        return juce::String (juce::CharPointer_UTF8 (name));
+    }
+    
+    // Estimated key (for UI display, lock-free)
+    KeyEstimate getDetectedKey() const { return keyEstimator.getEstimate(); }
+    
+    // DIN output stage stats (for UI display, lock-free)
+    float getDinWorstLatencyMs() const  { return dinScheduler.getWorstLatencyMs(); }
+    int getDinDroppedNotes() const      { return dinScheduler.getDroppedEventCount(); }
+    int getDinShedEvents() const        { return dinScheduler.getShedEventCount(); }
+    
+    // External clock lock state (for UI display, lock-free)
+    bool isClockLocked() const          { return clockFollower.isLocked(); }
+    float getClockTempo() const         { return clockFollower.getTempo(); }
+    float getClockJitterMs() const      { return clockFollower.getJitterMs(); }
+    
+    // Followed clock position at the start of the last block (audio thread)
+    double getClockBeat() const         { return clockFollower.getBeatAtBlockStart(); }
+    
+    // Audio chord detection (for UI display, lock-free)
+    double getAudioChordLatencyMs() const
+    {
+        return AudioChordDetector::getLatencySeconds (audioWindowParam->getIndex(), audioHopParam->getIndex(),
+                                                      currentSampleRate) * 1000.0;
     }
+    int getAudioSkippedFrames() const   { return audioChordDetector.getSkippedFrames(); }
+    
+    // Audio onset following (for UI display, lock-free)
+    float getOnsetTempo() const         { return onsetFollower.getTempo(); }
+    float getOnsetLatencyMs() const     { return onsetFollower.getLatencyMs(); }
+    float getOnsetWorstLatencyMs() const { return onsetFollower.getWorstLatencyMs(); }
+    int getOnsetSkippedFrames() const   { return onsetDetector.getSkippedFrames(); }
+    
+    // Events shed under a MIDI flood, per stage (for UI display, lock-free)
+    int getShedEvents (OverloadGuard::Stage stage) const   { return overloadGuard.getShedEvents (stage); }
+    int getTotalShedEvents() const                         { return overloadGuard.getTotalShedEvents(); }
+    
+    // True while leading but another instance already leads the channel
+    bool isChordBusChannelTaken() const { return chordBusChannelTaken.load (std::memory_order_relaxed); }
+    
+    // Records the generated output to a MIDI file (started and stopped by the UI)
+    MidiRecorder& getRecorder()         { return recorder; }
+    
+    // Captures every block's input, transport and parameter changes for
+    // Tools/SessionReplay (started and stopped by the UI)
+    SessionCapture& getSessionCapture() { return sessionCapture; }
+    void startSessionCapture (const juce::File& file);
+    
+    // Session replay: what a captured block depended on besides its input and
+    // parameters. Call before each replayed processBlock, on the same thread.
+    void prepareReplayBlock (const SessionLogReader::Record& block);
+    void setReplayBassTargets (const WalkingBass::Targets& targets);
     
 private:
     //==============================================================================
-    // Thread-safe chord name for UI display
+    // Thread-safe chord name for UI display, copied into fixed storage so
+    // publishing it never allocates
     mutable juce::SpinLock chordNameLock;
-    juce::String detectedChordName { "---" };
+    char detectedChordName[32] = "---";
     
-    void setDetectedChordName (const juce::String& name)
+    void setDetectedChordName (const char* name) noexcept
     {
         juce::SpinLock::ScopedLockType lock (chordNameLock);
-        detectedChordName = name;
+        juce::CharPointer_UTF8 (detectedChordName).writeWithDestByteLimit (juce::CharPointer_UTF8 (name), sizeof (detectedChordName));
     }
     
+    // Output notes waiting for the on-screen keyboard. If the editor isn't
+    // draining them the queue fills up and the keyboard is cleared when it
+    // next catches up, rather than showing notes whose note-offs were lost.
+    static constexpr int keyboardFifoSize = 1024;
+    juce::AbstractFifo keyboardFifo { keyboardFifoSize };
+    std::array<std::array<juce::uint8, 3>, keyboardFifoSize> keyboardEvents {};
+    std::atomic<bool> keyboardEventsLost { false };
+    
     // Rhythm patterns
     std::vector<RhythmPattern> patterns;
     
-    // Currently detected chord (used for playback)
-    DetectedChord currentChord;
+    // Generated pattern, compiled on the message thread. The audio thread
+    // picks up the current one at the start of each block.
+    std::unique_ptr<GeneratedPatternSource> generatedPatterns;
+    const RhythmPattern* generatedPattern { nullptr };
+    juce::Random patternRandom;         // Rolls note probabilities
+    
+    // Pattern script, compiled off the audio thread and picked up the same way
+    PatternScriptSource patternScripts;
+    const PatternScript::Program* scriptProgram { nullptr };
+    std::atomic<int> scriptOverruns { 0 };
+    
+    // Precomputed walking lines, re-targeted in the background as the
+    // session's chord changes are learned
+    WalkingBass bassLines;
+    
+    // Browser search index (message thread only)
+    PatternSearchIndex patternSearchIndex;
+    
+    // Per-engine chord following state (held notes, chord, pattern, cursor).
+    // Engines follow the active input mode: one in omni mode, two in split
+    // mode and one per MIDI channel in per-channel mode.
+    ChordEngineBank engines;
+    int lastInputMode { omniMode };
     
-    // Currently held input notes (for chord detection)
-    std::set<int> heldNotes;
+    // Input stage: the block's input is moved into a buffer sized in
+    // prepareToPlay within the overload guard's event budget, decoded from
+    // raw bytes and tracked per channel through the sustain and sostenuto
+    // pedals
+    juce::MidiBuffer inputMidi;
+    OverloadGuard overloadGuard;
+    MidiInputDecoder inputDecoder;
+    InputNoteTracker inputNotes;
+    int lastInputChannel { 0 };
+    
+    // Chords from the audio input, as notes for engine 0
+    AudioChordDetector audioChordDetector;
+    int lastChordSource { midiSource };
+    
+    // Hits on the audio input, and the pattern timeline they drive
+    OnsetDetector onsetDetector;
+    OnsetFollower onsetFollower;
+    int lastRhythmSync { tempoSync };
+    
+    // Rolling key estimate used to disambiguate and spell chords
+    KeyEstimator keyEstimator;
+    
+    // Optional DIN bandwidth model applied to the final output
+    DinOutputScheduler dinScheduler;
+    bool dinWasEnabled { false };
+    
+    // Preview voices, fed by the generated notes
+    PreviewSynth previewSynth;
+    bool previewWasEnabled { false };
+    
+    // Take recorder, fed with the output before clock and DIN scheduling
+    MidiRecorder recorder;
+    
+    // Session capture, fed with the raw input at the start of the block and
+    // the final output at the end
+    SessionCapture sessionCapture;
+    WalkingBass::Targets capturedBassTargets {};
+    
+    // Strum capture delay line (event positions relative to the block start)
+    juce::MidiBuffer captureDelayLine, captureScratch;
+    int captureSamples { 0 };
+    
+    // The capture window as latency for the host. processBlock only stores
+    // it; the timer reports it from the message thread, as setLatencySamples
+    // notifies the host
+    std::atomic<int> latencyToReport { 0 };
+    void timerCallback() override;
+    
+    // MIDI clock sync
+    MidiClockGenerator clockGenerator;
+    MidiClockFollower clockFollower;
+    int lastClockMode { clockOff };
+    double clockBeat { 0.0 };           // Free-running timeline when sending without a host transport
+    
+    // Chord bus state
+    juce::SharedResourcePointer<ChordBus> chordBus;
+    int lastBusMode { busOff };
+    int lastBusChannel { 0 };
+    juce::uint32 ownedBusChannels { 0 };
+    std::array<BusChord, ChordEngineBank::maxEngines> lastPublishedChords;
+    std::array<juce::uint32, ChordEngineBank::maxEngines> busSequenceSeen {};
+    std::atomic<bool> chordBusChannelTaken { false };
     
     // Timing state
     double currentSampleRate { 44100.0 };
     double lastPatternBeat { 0.0 };
-    double accumulatedBeats { 0.0 };
     
-    // Scheduled note-offs (sample position -> notes to turn off)
+    // Scheduled note-offs (sample position -> notes to turn off). Reserved
+    // in prepareToPlay; the overload guard keeps it within that.
     struct ScheduledNoteOff
     {
         int noteNumber;
         int channel;
         int samplePosition;
+        int engine;
     };
     std::vector<ScheduledNoteOff> pendingNoteOffs;
     
-    // Currently playing notes (to handle note-offs properly)
-    std::set<int> activeOutputNotes;
-    
     // Helper methods
-    void processRhythmPattern (juce::MidiBuffer& midiMessages, int numSamples, 
-                               double bpm, bool useHostTiming, double ppqPosition);
-    void addPatternNotes (juce::MidiBuffer& midiMessages, double startBeat, 
-                          double endBeat, int blockStartSample, int numSamples, double bpm);
-    int getChordNote (int chordIndex) const;
-    void stopAllActiveNotes (juce::MidiBuffer& midiMessages, int samplePosition);
-    void updateDetectedChord();
+    void processRhythmPattern (int engine, juce::MidiBuffer& midiMessages, int numSamples, 
+                               double bpm, bool useHostTiming, double ppqPosition,
+                               double beatsPerBar);
+    void addPatternNotes (int engine, juce::MidiBuffer& midiMessages, const RhythmPattern& pattern,
+                          double startBeat, double endBeat, int segmentStart,
+                          int segmentEnd, double bpm);
+    bool addScriptNotes (int engine, juce::MidiBuffer& midiMessages, double segmentStartBeat,
+                         int segmentStart, int segmentEnd, double bpm, double barLength, int& budget);
+    int getChordNote (int engine, int chordIndex) const;
+    int getBassNote (int engine, double beatInCycle, double cycleLength) const;
+    void updateChordKey (int engine);
+    void stopAllActiveNotes (juce::MidiBuffer& midiMessages, int engine, int samplePosition);
+    void updateDetectedChord (int engine);
+    void resetEngines();
+    int getCaptureSamples() const;
+    void delayInputForCapture (int numSamples, int inputMode);
+    void applyAudioChord (juce::MidiBuffer& midiMessages, std::array<int, ChordEngineBank::maxEngines>& changeSamples);
+    void releaseInputNote (int inputMode, int channel, int note, juce::MidiBuffer& midiMessages, int samplePosition,
+                           std::array<int, ChordEngineBank::maxEngines>& changeSamples);
+    void leaveChordBus();
+    void publishToChordBus (int numEngines, juce::int64 hostSample, const std::array<int, ChordEngineBank::maxEngines>& changeSamples);
+    void followChordBus (juce::MidiBuffer& midiMessages, int numEngines, juce::int64 hostSample, int numSamples);
+    
+    // Input routing
+    static int getNumEngines (int inputMode);
+    int getEngineForNote (int inputMode, int channel, int noteNumber) const;
+    static int getOutputChannel (int inputMode, int engine);
+    int getRequestedPattern (int engine) const;
+    int getNumPatterns() const { return (int) patterns.size() + 2; }
+    const RhythmPattern& getPattern (int index) const;
+    PatternGeneratorSettings getGeneratorSettings() const;
+    
+    // Session state
+    PluginState captureState() const;
+    void applyState (const PluginState& state);
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessor)
 };
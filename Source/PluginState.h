@@ -0,0 +1,323 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <array>
+
+//==============================================================================
+// Snapshot of everything the processor persists in a session
+struct PluginState
+{
+    int patternIndex { 0 };
+    float tempo { 120.0f };
+    bool enabled { true };
+    bool quantiseSwitch { false };
+    
+    // Multi-zone routing
+    int inputMode { 0 };
+    int splitPoint { 60 };
+    std::array<int, 16> enginePatterns {};     // Per-engine override, 0 = follow main pattern
+    
+    // Hardware output
+    bool dinOutput { false };
+    float dinJitterBudgetMs { 3.0f };
+    
+    // Built-in preview synth
+    bool previewEnabled { false };
+    int previewSound { 0 };
+    float previewLevel { 0.5f };
+    
+    // Strum capture window (0 = live, no added latency)
+    float strumCaptureMs { 0.0f };
+    
+    // MIDI clock sync (0 = off, 1 = send, 2 = follow)
+    int clockMode { 0 };
+    
+    // Euclidean pattern generator
+    int genSteps { 16 };
+    int genHits { 5 };
+    int genRotation { 0 };
+    float genProbability { 1.0f };
+    float genGhost { 0.0f };
+    float genAccent { 0.5f };
+    
+    // Cross-instance chord bus (0 = off, 1 = lead, 2 = follow)
+    int chordBusMode { 0 };
+    int chordBusChannel { 1 };
+    
+    // Input channel filter (0 = all channels)
+    int inputChannel { 0 };
+    
+    // Pattern script source (empty = the default script)
+    juce::String patternScript;
+    
+    // Bass layer (0 = root, 1 = walking line)
+    int bassMode { 0 };
+    
+    // Chord source (0 = MIDI, 1 = audio input) and the audio analysis
+    // window and hop, as choice indices
+    int chordSource { 0 };
+    int audioWindow { 2 };
+    int audioHop { 2 };
+    
+    // Rhythm sync (0 = tempo, 1 = audio onsets)
+    int rhythmSync { 0 };
+};
+
+//==============================================================================
+// Compact, versioned binary encoding of PluginState.
+//
+// Layout (little endian):
+//   u32 magic | u16 version | u16 minReaderVersion | u32 payloadSize | u32 crc32
+//   payload: repeated { u16 tag | u16 length | length bytes }
+//
+// Fields are tagged so older readers skip tags they don't know (forward
+// compatibility) and newer readers fall back to defaults for tags that are
+// missing (backward compatibility). A writer only bumps minReaderVersion when
+// an existing field changes meaning, which older readers must then reject.
+// v1 is the only version so far; a later one that changes a field converts
+// the older value in read(), keyed on the header's version.
+class PluginStateSerialiser
+{
+public:
+    static constexpr juce::uint32 magic = 0x53505043;    // "CPPS"
+    static constexpr juce::uint16 currentVersion = 1;
+    static constexpr juce::uint16 minReaderVersion = 1;
+    static constexpr int headerSize = 16;
+
+    enum FieldTag : juce::uint16
+    {
+        patternIndexTag = 1,
+        tempoTag        = 2,
+        enabledTag      = 3,
+        quantiseTag     = 4,
+        inputModeTag    = 5,
+        splitPointTag   = 6,
+        enginePatternsTag = 7,
+        dinOutputTag      = 8,
+        dinJitterTag      = 9,
+        previewEnabledTag = 10,
+        previewSoundTag   = 11,
+        previewLevelTag   = 12,
+        strumCaptureTag   = 13,
+        clockModeTag      = 14,
+        genStepsTag       = 15,
+        genHitsTag        = 16,
+        genRotationTag    = 17,
+        genProbabilityTag = 18,
+        genGhostTag       = 19,
+        genAccentTag      = 20,
+        chordBusModeTag   = 21,
+        chordBusChannelTag = 22,
+        inputChannelTag   = 23,
+        patternScriptTag  = 24,
+        bassModeTag       = 25,
+        chordSourceTag    = 26,
+        audioWindowTag    = 27,
+        audioHopTag       = 28,
+        rhythmSyncTag     = 29
+    };
+
+    enum class Result
+    {
+        ok,
+        notBinaryFormat,    // No magic - probably a legacy XML blob
+        unsupportedVersion, // Written by a newer build that we can't read safely
+        corrupt             // Truncated or checksum mismatch
+    };
+
+    //==========================================================================
+    static void write (const PluginState& state, juce::MemoryBlock& destData)
+    {
+        juce::MemoryOutputStream payload (256);
+
+        writeField (payload, patternIndexTag, [&] (auto& out) { out.writeInt (state.patternIndex); });
+        writeField (payload, tempoTag,        [&] (auto& out) { out.writeFloat (state.tempo); });
+        writeField (payload, enabledTag,      [&] (auto& out) { out.writeByte ((char) (state.enabled ? 1 : 0)); });
+        writeField (payload, quantiseTag,     [&] (auto& out) { out.writeByte ((char) (state.quantiseSwitch ? 1 : 0)); });
+        writeField (payload, inputModeTag,    [&] (auto& out) { out.writeByte ((char) state.inputMode); });
+        writeField (payload, splitPointTag,   [&] (auto& out) { out.writeByte ((char) state.splitPoint); });
+        writeField (payload, enginePatternsTag, [&] (auto& out)
+        {
+            for (auto p : state.enginePatterns)
+                out.writeShort ((short) p);
+        });
+        writeField (payload, dinOutputTag,    [&] (auto& out) { out.writeByte ((char) (state.dinOutput ? 1 : 0)); });
+        writeField (payload, dinJitterTag,    [&] (auto& out) { out.writeFloat (state.dinJitterBudgetMs); });
+        writeField (payload, previewEnabledTag, [&] (auto& out) { out.writeByte ((char) (state.previewEnabled ? 1 : 0)); });
+        writeField (payload, previewSoundTag, [&] (auto& out) { out.writeByte ((char) state.previewSound); });
+        writeField (payload, previewLevelTag, [&] (auto& out) { out.writeFloat (state.previewLevel); });
+        writeField (payload, strumCaptureTag, [&] (auto& out) { out.writeFloat (state.strumCaptureMs); });
+        writeField (payload, clockModeTag,    [&] (auto& out) { out.writeByte ((char) state.clockMode); });
+        writeField (payload, genStepsTag,     [&] (auto& out) { out.writeByte ((char) state.genSteps); });
+        writeField (payload, genHitsTag,      [&] (auto& out) { out.writeByte ((char) state.genHits); });
+        writeField (payload, genRotationTag,  [&] (auto& out) { out.writeByte ((char) state.genRotation); });
+        writeField (payload, genProbabilityTag, [&] (auto& out) { out.writeFloat (state.genProbability); });
+        writeField (payload, genGhostTag,     [&] (auto& out) { out.writeFloat (state.genGhost); });
+        writeField (payload, genAccentTag,    [&] (auto& out) { out.writeFloat (state.genAccent); });
+        writeField (payload, chordBusModeTag, [&] (auto& out) { out.writeByte ((char) state.chordBusMode); });
+        writeField (payload, chordBusChannelTag, [&] (auto& out) { out.writeByte ((char) state.chordBusChannel); });
+        writeField (payload, inputChannelTag, [&] (auto& out) { out.writeByte ((char) state.inputChannel); });
+        writeField (payload, patternScriptTag, [&] (auto& out)
+        {
+            // UTF-8 without a terminator; the field length bounds it
+            out.write (state.patternScript.toRawUTF8(), state.patternScript.getNumBytesAsUTF8());
+        });
+        writeField (payload, bassModeTag,     [&] (auto& out) { out.writeByte ((char) state.bassMode); });
+        writeField (payload, chordSourceTag,  [&] (auto& out) { out.writeByte ((char) state.chordSource); });
+        writeField (payload, audioWindowTag,  [&] (auto& out) { out.writeByte ((char) state.audioWindow); });
+        writeField (payload, audioHopTag,     [&] (auto& out) { out.writeByte ((char) state.audioHop); });
+        writeField (payload, rhythmSyncTag,   [&] (auto& out) { out.writeByte ((char) state.rhythmSync); });
+
+        const auto payloadSize = (juce::uint32) payload.getDataSize();
+
+        destData.setSize ((size_t) headerSize + payloadSize);
+        auto* bytes = static_cast<juce::uint8*> (destData.getData());
+
+        writeLE32 (bytes + 0,  magic);
+        writeLE16 (bytes + 4,  currentVersion);
+        writeLE16 (bytes + 6,  minReaderVersion);
+        writeLE32 (bytes + 8,  payloadSize);
+        writeLE32 (bytes + 12, crc32 (payload.getData(), payloadSize));
+
+        if (payloadSize > 0)
+            std::memcpy (bytes + headerSize, payload.getData(), payloadSize);
+    }
+
+    //==========================================================================
+    // Parses into a local copy first so a bad blob never half-applies
+    static Result read (const void* data, int sizeInBytes, PluginState& destState)
+    {
+        if (data == nullptr || sizeInBytes < headerSize)
+            return Result::notBinaryFormat;
+
+        auto* bytes = static_cast<const juce::uint8*> (data);
+
+        if (juce::ByteOrder::littleEndianInt (bytes) != magic)
+            return Result::notBinaryFormat;
+
+        const auto minReader   = juce::ByteOrder::littleEndianShort (bytes + 6);
+        const auto payloadSize = juce::ByteOrder::littleEndianInt (bytes + 8);
+        const auto checksum    = juce::ByteOrder::littleEndianInt (bytes + 12);
+
+        if (minReader > currentVersion)
+            return Result::unsupportedVersion;
+
+        if ((juce::uint64) payloadSize + headerSize > (juce::uint64) sizeInBytes)
+            return Result::corrupt;
+
+        const auto* payload = bytes + headerSize;
+
+        if (crc32 (payload, payloadSize) != checksum)
+            return Result::corrupt;
+
+        PluginState state;
+        juce::uint32 pos = 0;
+
+        while (pos + 4 <= payloadSize)
+        {
+            const auto tag    = juce::ByteOrder::littleEndianShort (payload + pos);
+            const auto length = juce::ByteOrder::littleEndianShort (payload + pos + 2);
+            pos += 4;
+
+            if (pos + length > payloadSize)
+                return Result::corrupt;
+
+            juce::MemoryInputStream field (payload + pos, length, false);
+
+            switch (tag)
+            {
+                case patternIndexTag: if (length >= 4) state.patternIndex = field.readInt();        break;
+                case tempoTag:        if (length >= 4) state.tempo        = field.readFloat();      break;
+                case enabledTag:      if (length >= 1) state.enabled      = field.readByte() != 0;  break;
+                case quantiseTag:     if (length >= 1) state.quantiseSwitch = field.readByte() != 0; break;
+                case inputModeTag:    if (length >= 1) state.inputMode  = (juce::uint8) field.readByte();  break;
+                case splitPointTag:   if (length >= 1) state.splitPoint = (juce::uint8) field.readByte();  break;
+                case enginePatternsTag:
+                    for (size_t i = 0; i < state.enginePatterns.size() && (i + 1) * 2 <= length; ++i)
+                        state.enginePatterns[i] = field.readShort();
+                    break;
+                case dinOutputTag:    if (length >= 1) state.dinOutput = field.readByte() != 0;     break;
+                case dinJitterTag:    if (length >= 4) state.dinJitterBudgetMs = field.readFloat(); break;
+                case previewEnabledTag: if (length >= 1) state.previewEnabled = field.readByte() != 0; break;
+                case previewSoundTag: if (length >= 1) state.previewSound = (juce::uint8) field.readByte(); break;
+                case previewLevelTag: if (length >= 4) state.previewLevel = field.readFloat();      break;
+                case strumCaptureTag: if (length >= 4) state.strumCaptureMs = field.readFloat();    break;
+                case clockModeTag:    if (length >= 1) state.clockMode = (juce::uint8) field.readByte();    break;
+                case genStepsTag:     if (length >= 1) state.genSteps = (juce::uint8) field.readByte();     break;
+                case genHitsTag:      if (length >= 1) state.genHits = (juce::uint8) field.readByte();      break;
+                case genRotationTag:  if (length >= 1) state.genRotation = (juce::uint8) field.readByte();  break;
+                case genProbabilityTag: if (length >= 4) state.genProbability = field.readFloat();  break;
+                case genGhostTag:     if (length >= 4) state.genGhost = field.readFloat();          break;
+                case genAccentTag:    if (length >= 4) state.genAccent = field.readFloat();         break;
+                case chordBusModeTag: if (length >= 1) state.chordBusMode = (juce::uint8) field.readByte();    break;
+                case chordBusChannelTag: if (length >= 1) state.chordBusChannel = (juce::uint8) field.readByte(); break;
+                case inputChannelTag: if (length >= 1) state.inputChannel = (juce::uint8) field.readByte();    break;
+                case patternScriptTag:
+                    state.patternScript = juce::String::fromUTF8 (reinterpret_cast<const char*> (payload + pos), (int) length);
+                    break;
+                case bassModeTag:     if (length >= 1) state.bassMode = (juce::uint8) field.readByte();     break;
+                case chordSourceTag:  if (length >= 1) state.chordSource = (juce::uint8) field.readByte();  break;
+                case audioWindowTag:  if (length >= 1) state.audioWindow = (juce::uint8) field.readByte();  break;
+                case audioHopTag:     if (length >= 1) state.audioHop = (juce::uint8) field.readByte();     break;
+                case rhythmSyncTag:   if (length >= 1) state.rhythmSync = (juce::uint8) field.readByte();   break;
+                default:              break; // Unknown tag from a newer writer - skip it
+            }
+
+            pos += length;
+        }
+
+        destState = state;
+        return Result::ok;
+    }
+
+    //==========================================================================
+    static juce::uint32 crc32 (const void* data, size_t numBytes)
+    {
+        static const auto table = []
+        {
+            std::array<juce::uint32, 256> t {};
+
+            for (juce::uint32 i = 0; i < 256; ++i)
+            {
+                auto c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+                t[i] = c;
+            }
+            return t;
+        }();
+
+        auto* p = static_cast<const juce::uint8*> (data);
+        juce::uint32 crc = 0xffffffffu;
+
+        for (size_t i = 0; i < numBytes; ++i)
+            crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+
+        return crc ^ 0xffffffffu;
+    }
+
+private:
+    //==========================================================================
+    template <typename Writer>
+    static void writeField (juce::MemoryOutputStream& out, FieldTag tag, Writer&& writeValue)
+    {
+        juce::MemoryOutputStream value (16);
+        writeValue (value);
+
+        out.writeShort ((short) tag);
+        out.writeShort ((short) value.getDataSize());
+        out.write (value.getData(), value.getDataSize());
+    }
+
+    static void writeLE16 (juce::uint8* dest, juce::uint16 v)
+    {
+        dest[0] = (juce::uint8) (v & 0xff);
+        dest[1] = (juce::uint8) (v >> 8);
+    }
+
+    static void writeLE32 (juce::uint8* dest, juce::uint32 v)
+    {
+        for (int i = 0; i < 4; ++i)
+            dest[i] = (juce::uint8) ((v >> (8 * i)) & 0xff);
+    }
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+#include <cmath>
+
+//==============================================================================
+// Small polyphonic synth for auditioning the generated pattern without a
+// second instrument.
+//
+// Voice state is kept as parallel arrays and each voice is rendered a chunk
+// at a time: the phase ramp and the sine approximation are branch-free loops
+// the compiler vectorises, and the envelope multiply and the mix go through
+// FloatVectorOperations. The sine is a polynomial rather than a table so it
+// needs no gathers; the FM sound uses a single 1:1 modulator with a
+// velocity-scaled index, which keeps it well below Nyquist for the keyboard
+// range the patterns produce.
+class PreviewSynth
+{
+public:
+    //==========================================================================
+    static constexpr int maxVoices = 64;
+    static constexpr int chunkSize = 64;
+
+    enum Sound { sineSound = 0, fmSound };
+
+    void prepare (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+
+        for (auto& env : envelopes)
+            env.setSampleRate (sampleRate);
+
+        currentSound = -1;
+        reset();
+    }
+
+    void reset()
+    {
+        for (int v = 0; v < maxVoices; ++v)
+        {
+            envelopes[(size_t) v].reset();
+            isActive[(size_t) v] = false;
+        }
+    }
+
+    //==========================================================================
+    // Audio thread: adds the voices triggered by midiMessages into buffer
+    void render (juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages,
+                 int sound, float gain)
+    {
+        if (sound != currentSound)
+            setSound (sound);
+
+        const int numSamples = buffer.getNumSamples();
+        int position = 0;
+
+        for (const auto metadata : midiMessages)
+        {
+            const int eventPosition = juce::jlimit (0, numSamples, metadata.samplePosition);
+
+            if (eventPosition > position)
+            {
+                renderRange (buffer, position, eventPosition - position, gain);
+                position = eventPosition;
+            }
+
+            handleMessage (metadata.getMessage());
+        }
+
+        if (position < numSamples)
+            renderRange (buffer, position, numSamples - position, gain);
+    }
+
+    int getNumActiveVoices() const
+    {
+        int count = 0;
+        for (auto active : isActive)
+            count += active ? 1 : 0;
+        return count;
+    }
+
+    //==========================================================================
+    void noteOn (int channel, int noteNumber, float velocity)
+    {
+        const int v = findVoiceFor (channel, noteNumber);
+
+        phases[(size_t) v] = 0.0f;
+        increments[(size_t) v] = (float) (juce::MidiMessage::getMidiNoteInHertz (noteNumber) / sampleRate);
+        velocities[(size_t) v] = velocity;
+        modIndices[(size_t) v] = currentSound == fmSound ? 0.25f + 0.35f * velocity : 0.0f;
+        noteNumbers[(size_t) v] = noteNumber;
+        channels[(size_t) v] = channel;
+        startOrder[(size_t) v] = ++voiceCounter;
+        isActive[(size_t) v] = true;
+        isReleased[(size_t) v] = false;
+
+        envelopes[(size_t) v].reset();
+        envelopes[(size_t) v].noteOn();
+    }
+
+    void noteOff (int channel, int noteNumber)
+    {
+        for (int v = 0; v < maxVoices; ++v)
+            if (isActive[(size_t) v] && noteNumbers[(size_t) v] == noteNumber && channels[(size_t) v] == channel)
+                releaseVoice (v);
+    }
+
+    void allNotesOff (int channel)
+    {
+        for (int v = 0; v < maxVoices; ++v)
+            if (isActive[(size_t) v] && (channel == 0 || channels[(size_t) v] == channel))
+                releaseVoice (v);
+    }
+
+private:
+    //==========================================================================
+    void releaseVoice (int v)
+    {
+        envelopes[(size_t) v].noteOff();
+        isReleased[(size_t) v] = true;
+    }
+
+    void setSound (int sound)
+    {
+        currentSound = sound;
+
+        // Organ-like sine, or a decaying electric-piano style FM tone
+        const auto params = sound == fmSound ? juce::ADSR::Parameters { 0.002f, 0.8f, 0.25f, 0.3f }
+                                             : juce::ADSR::Parameters { 0.005f, 0.1f, 0.8f, 0.15f };
+
+        for (auto& env : envelopes)
+            env.setParameters (params);
+    }
+
+    void handleMessage (const juce::MidiMessage& message)
+    {
+        if (message.isNoteOn())
+            noteOn (message.getChannel(), message.getNoteNumber(), message.getFloatVelocity());
+        else if (message.isNoteOff())
+            noteOff (message.getChannel(), message.getNoteNumber());
+        else if (message.isAllNotesOff())
+            allNotesOff (message.getChannel());
+        else if (message.isAllSoundOff())
+            reset();
+    }
+
+    // Retrigger the same note, else take a free voice, else steal the oldest
+    // (released voices first)
+    int findVoiceFor (int channel, int noteNumber) const
+    {
+        int freeVoice = -1, oldestReleased = -1, oldest = 0;
+
+        for (int v = 0; v < maxVoices; ++v)
+        {
+            if (! isActive[(size_t) v])
+            {
+                if (freeVoice < 0)
+                    freeVoice = v;
+                continue;
+            }
+
+            if (noteNumbers[(size_t) v] == noteNumber && channels[(size_t) v] == channel)
+                return v;
+
+            if (startOrder[(size_t) v] < startOrder[(size_t) oldest])
+                oldest = v;
+
+            if (isReleased[(size_t) v] && (oldestReleased < 0 || startOrder[(size_t) v] < startOrder[(size_t) oldestReleased]))
+                oldestReleased = v;
+        }
+
+        if (freeVoice >= 0)     return freeVoice;
+        if (oldestReleased >= 0) return oldestReleased;
+        return oldest;
+    }
+
+    //==========================================================================
+    // sin (2 pi x) for any x, parabolic approximation with one refinement
+    // step (max error ~0.1%)
+    static inline float fastSin (float x) noexcept
+    {
+        x -= std::floor (x + 0.5f);                 // [-0.5, 0.5]
+        const float y = 8.0f * x - 16.0f * x * std::abs (x);
+        return 0.225f * (y * std::abs (y) - y) + y;
+    }
+
+    void renderRange (juce::AudioBuffer<float>& buffer, int startSample, int numSamples, float gain)
+    {
+        while (numSamples > 0)
+        {
+            const int n = juce::jmin (numSamples, chunkSize);
+            juce::FloatVectorOperations::clear (mix.data(), n);
+
+            for (int v = 0; v < maxVoices; ++v)
+            {
+                if (! isActive[(size_t) v])
+                    continue;
+
+                renderVoice (v, n);
+                juce::FloatVectorOperations::addWithMultiply (mix.data(), oscillator.data(), envelope.data(), n);
+
+                if (! envelopes[(size_t) v].isActive())
+                    isActive[(size_t) v] = false;
+            }
+
+            for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                buffer.addFrom (ch, startSample, mix.data(), n, gain);
+
+            startSample += n;
+            numSamples -= n;
+        }
+    }
+
+    void renderVoice (int v, int n)
+    {
+        const float phase = phases[(size_t) v];
+        const float inc = increments[(size_t) v];
+        const float index = modIndices[(size_t) v];
+
+        if (index > 0.0f)
+        {
+            // 1:1 modulator, so it shares the carrier's phase
+            for (int i = 0; i < n; ++i)
+            {
+                const float p = phase + inc * (float) i;
+                oscillator[(size_t) i] = fastSin (p + index * fastSin (p));
+            }
+        }
+        else
+        {
+            for (int i = 0; i < n; ++i)
+                oscillator[(size_t) i] = fastSin (phase + inc * (float) i);
+        }
+
+        phases[(size_t) v] = wrap (phase + inc * (float) n);
+
+        auto& env = envelopes[(size_t) v];
+        for (int i = 0; i < n; ++i)
+            envelope[(size_t) i] = env.getNextSample();
+
+        juce::FloatVectorOperations::multiply (envelope.data(), velocities[(size_t) v] * 0.2f, n);
+    }
+
+    static float wrap (float x) noexcept    { return x - std::floor (x); }
+
+    //==========================================================================
+    double sampleRate { 44100.0 };
+    int currentSound { -1 };
+    juce::uint32 voiceCounter { 0 };
+
+    // Voice state, one slot per voice
+    std::array<float, maxVoices> phases {}, increments {}, modIndices {}, velocities {};
+    std::array<int, maxVoices> noteNumbers {}, channels {};
+    std::array<juce::uint32, maxVoices> startOrder {};
+    std::array<bool, maxVoices> isActive {}, isReleased {};
+    std::array<juce::ADSR, maxVoices> envelopes;
+
+    // Per-chunk scratch
+    std::array<float, chunkSize> oscillator {}, envelope {}, mix {};
+};
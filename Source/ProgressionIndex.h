@@ -0,0 +1,571 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <map>
+#include <vector>
+
+//==============================================================================
+// One chord in a progression: root pitch class plus the chord's pitch classes
+// relative to that root (bit n = n semitones above the root).
+struct ProgressionChord
+{
+    int rootPitchClass { 0 };
+    juce::uint16 intervalMask { 0 };
+
+    bool operator== (const ProgressionChord& other) const
+    {
+        return rootPitchClass == other.rootPitchClass && intervalMask == other.intervalMask;
+    }
+};
+
+//==============================================================================
+// Mapping between chord qualities and interval masks, plus the transposition
+// normalised n-gram keys the index is built on.
+//
+// A key packs up to four chords exactly (no hashing): the first chord
+// contributes only its 12-bit interval mask, each following chord adds its
+// root distance from the previous chord (4 bits) and its mask (12 bits). The
+// top bits hold the n-gram length and whether masks were reduced to triad
+// families, so "ii V I" in any key maps to the same key.
+struct ProgressionKeys
+{
+    static constexpr int minGram = 2;
+    static constexpr int maxGram = 4;
+
+    enum class Level { exact = 0, family = 1 };
+
+    //==========================================================================
+    static juce::uint16 maskFromIntervals (std::initializer_list<int> intervals)
+    {
+        juce::uint16 mask = 0;
+        for (auto i : intervals)
+            mask |= (juce::uint16) (1 << (i % 12));
+        return mask;
+    }
+
+    // Interval mask for a ChordDetector quality name (0 if unknown)
+    static juce::uint16 maskForQuality (const juce::String& quality)
+    {
+        if (quality == "Maj")    return maskFromIntervals ({ 0, 4, 7 });
+        if (quality == "m")      return maskFromIntervals ({ 0, 3, 7 });
+        if (quality == "7")      return maskFromIntervals ({ 0, 4, 7, 10 });
+        if (quality == "Maj7")   return maskFromIntervals ({ 0, 4, 7, 11 });
+        if (quality == "m7")     return maskFromIntervals ({ 0, 3, 7, 10 });
+        if (quality == "m7b5")   return maskFromIntervals ({ 0, 3, 6, 10 });
+        if (quality == "mMaj7")  return maskFromIntervals ({ 0, 3, 7, 11 });
+        if (quality == "6")      return maskFromIntervals ({ 0, 4, 7, 9 });
+        if (quality == "m6")     return maskFromIntervals ({ 0, 3, 7, 9 });
+        if (quality == "sus4")   return maskFromIntervals ({ 0, 5, 7 });
+        if (quality == "sus2")   return maskFromIntervals ({ 0, 2, 7 });
+        if (quality == "dim")    return maskFromIntervals ({ 0, 3, 6 });
+        if (quality == "aug")    return maskFromIntervals ({ 0, 4, 8 });
+        if (quality == "5")      return maskFromIntervals ({ 0, 7 });
+        return 0;
+    }
+
+    // Reduces a chord to its triad family (Cmaj7 -> C, Dm7 -> Dm, Bm7b5 -> Bdim)
+    static juce::uint16 familyMask (juce::uint16 mask)
+    {
+        const bool m3 = (mask & (1 << 3)) != 0;
+        const bool M3 = (mask & (1 << 4)) != 0;
+        const bool b5 = (mask & (1 << 6)) != 0;
+        const bool p5 = (mask & (1 << 7)) != 0;
+        const bool s5 = (mask & (1 << 8)) != 0;
+
+        if (M3 && s5 && ! p5)   return maskFromIntervals ({ 0, 4, 8 });
+        if (M3)                 return maskFromIntervals ({ 0, 4, 7 });
+        if (m3 && b5 && ! p5)   return maskFromIntervals ({ 0, 3, 6 });
+        if (m3)                 return maskFromIntervals ({ 0, 3, 7 });
+        return mask;    // sus / power chords stay as they are
+    }
+
+    //==========================================================================
+    static juce::uint64 makeKey (const ProgressionChord* chords, int n, Level level)
+    {
+        jassert (n >= minGram && n <= maxGram);
+
+        juce::uint64 key = ((juce::uint64) level << 62) | ((juce::uint64) (n - minGram) << 60);
+        int shift = 60;
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (i > 0)
+            {
+                const auto step = (juce::uint64) ((chords[i].rootPitchClass - chords[i - 1].rootPitchClass + 12) % 12);
+                shift -= 4;
+                key |= step << shift;
+            }
+
+            shift -= 12;
+            key |= (juce::uint64) (chords[i].intervalMask & 0x0fff) << shift;
+        }
+
+        return key;
+    }
+
+    // Converts a chord sequence to the level's alphabet and drops repeats
+    static std::vector<ProgressionChord> normalise (const std::vector<ProgressionChord>& chords, Level level)
+    {
+        std::vector<ProgressionChord> result;
+        result.reserve (chords.size());
+
+        for (auto c : chords)
+        {
+            if (level == Level::family)
+                c.intervalMask = familyMask (c.intervalMask);
+
+            if (result.empty() || ! (result.back() == c))
+                result.push_back (c);
+        }
+        return result;
+    }
+};
+
+//==============================================================================
+// On-disk segment layout (little endian, memory mapped for queries):
+//
+//   Header   magic "CPIX" | u32 version | u32 numDocs | u32 numKeys
+//            u64 keyTableOffset | u64 postingsOffset | u64 docTableOffset
+//   Keys     numKeys x { u64 key | u32 firstPosting | u32 numPostings }, sorted by key
+//   Postings u32 document ids (ascending within each key)
+//   Docs     numDocs x u64 path offset, then the UTF-8 path blob
+//
+// An index is a directory of segments; appending writes a new segment, so
+// existing segments never need rewriting.
+class ProgressionIndexSegmentWriter
+{
+public:
+    static constexpr juce::uint32 magic = 0x58495043;   // "CPIX"
+    static constexpr juce::uint32 version = 1;
+    static constexpr int headerSize = 40;
+    static constexpr int keyEntrySize = 16;
+
+    //==========================================================================
+    void addDocument (const juce::String& path, const std::vector<ProgressionChord>& chords)
+    {
+        const auto docId = (juce::uint32) paths.size();
+        paths.add (path);
+
+        for (auto level : { ProgressionKeys::Level::exact, ProgressionKeys::Level::family })
+        {
+            const auto sequence = ProgressionKeys::normalise (chords, level);
+
+            for (int n = ProgressionKeys::minGram; n <= ProgressionKeys::maxGram; ++n)
+            {
+                for (int i = 0; i + n <= (int) sequence.size(); ++i)
+                {
+                    auto& list = postings[ProgressionKeys::makeKey (sequence.data() + i, n, level)];
+
+                    if (list.empty() || list.back() != docId)
+                        list.push_back (docId);
+                }
+            }
+        }
+    }
+
+    int getNumDocuments() const { return paths.size(); }
+
+    //==========================================================================
+    bool writeTo (const juce::File& file) const
+    {
+        juce::MemoryOutputStream keys, postingData, docOffsets, docBlob;
+        juce::uint32 postingIndex = 0;
+
+        for (const auto& [key, docs] : postings)
+        {
+            keys.writeInt64 ((juce::int64) key);
+            keys.writeInt ((int) postingIndex);
+            keys.writeInt ((int) docs.size());
+
+            for (auto d : docs)
+                postingData.writeInt ((int) d);
+
+            postingIndex += (juce::uint32) docs.size();
+        }
+
+        for (const auto& p : paths)
+        {
+            docOffsets.writeInt64 ((juce::int64) docBlob.getDataSize());
+            const auto utf8 = p.toUTF8();
+            docBlob.write (utf8.getAddress(), utf8.sizeInBytes());   // includes terminator
+        }
+
+        const auto keyTableOffset = (juce::uint64) headerSize;
+        const auto postingsOffset = keyTableOffset + keys.getDataSize();
+        const auto docTableOffset = postingsOffset + postingData.getDataSize();
+
+        juce::TemporaryFile temp (file);
+
+        {
+            juce::FileOutputStream out (temp.getFile());
+
+            if (! out.openedOk())
+                return false;
+
+            out.writeInt ((int) magic);
+            out.writeInt ((int) version);
+            out.writeInt (paths.size());
+            out.writeInt ((int) postings.size());
+            out.writeInt64 ((juce::int64) keyTableOffset);
+            out.writeInt64 ((juce::int64) postingsOffset);
+            out.writeInt64 ((juce::int64) docTableOffset);
+            out << keys.getMemoryBlock() << postingData.getMemoryBlock()
+                << docOffsets.getMemoryBlock() << docBlob.getMemoryBlock();
+            out.flush();
+
+            if (out.getStatus().failed())
+                return false;
+        }
+
+        return temp.overwriteTargetFileWithTemporary();
+    }
+
+private:
+    juce::StringArray paths;
+    std::map<juce::uint64, std::vector<juce::uint32>> postings;
+};
+
+//==============================================================================
+// Read-only view of one memory-mapped segment
+class ProgressionIndexSegment
+{
+public:
+    explicit ProgressionIndexSegment (const juce::File& file)
+        : mapped (file, juce::MemoryMappedFile::readOnly)
+    {
+        const auto* base = static_cast<const juce::uint8*> (mapped.getData());
+        const auto size = mapped.getSize();
+
+        if (base == nullptr || size < (size_t) ProgressionIndexSegmentWriter::headerSize
+             || juce::ByteOrder::littleEndianInt (base) != ProgressionIndexSegmentWriter::magic
+             || juce::ByteOrder::littleEndianInt (base + 4) != ProgressionIndexSegmentWriter::version)
+            return;
+
+        numDocs = juce::ByteOrder::littleEndianInt (base + 8);
+        numKeys = juce::ByteOrder::littleEndianInt (base + 12);
+        const auto keyTableOffset = juce::ByteOrder::littleEndianInt64 (base + 16);
+        const auto postingsOffset = juce::ByteOrder::littleEndianInt64 (base + 24);
+        const auto docTableOffset = juce::ByteOrder::littleEndianInt64 (base + 32);
+
+        if (keyTableOffset + (juce::uint64) numKeys * ProgressionIndexSegmentWriter::keyEntrySize > postingsOffset
+             || docTableOffset + (juce::uint64) numDocs * 8 > size)
+            return;
+
+        keyTable = base + keyTableOffset;
+        postingTable = base + postingsOffset;
+        docTable = base + docTableOffset;
+        docBlob = docTable + (size_t) numDocs * 8;
+        blobSize = size - (size_t) (docBlob - base);
+        valid = true;
+    }
+
+    bool isValid() const            { return valid; }
+    juce::uint32 getNumDocuments() const { return numDocs; }
+
+    //==========================================================================
+    // Binary search of the key table; returns the posting list for a key
+    struct Postings
+    {
+        const juce::uint8* data { nullptr };
+        juce::uint32 size { 0 };
+
+        juce::uint32 operator[] (juce::uint32 i) const { return juce::ByteOrder::littleEndianInt (data + (size_t) i * 4); }
+    };
+
+    Postings find (juce::uint64 key) const
+    {
+        if (! valid)
+            return {};
+
+        juce::uint32 lo = 0, hi = numKeys;
+
+        while (lo < hi)
+        {
+            const auto mid = lo + (hi - lo) / 2;
+            const auto* entry = keyTable + (size_t) mid * ProgressionIndexSegmentWriter::keyEntrySize;
+            const auto midKey = juce::ByteOrder::littleEndianInt64 (entry);
+
+            if (midKey < key)
+                lo = mid + 1;
+            else if (midKey > key)
+                hi = mid;
+            else
+                return { postingTable + (size_t) juce::ByteOrder::littleEndianInt (entry + 8) * 4,
+                         juce::ByteOrder::littleEndianInt (entry + 12) };
+        }
+
+        return {};
+    }
+
+    juce::String getDocumentPath (juce::uint32 docId) const
+    {
+        if (! valid || docId >= numDocs)
+            return {};
+
+        const auto offset = (size_t) juce::ByteOrder::littleEndianInt64 (docTable + (size_t) docId * 8);
+
+        if (offset >= blobSize)
+            return {};
+
+        return juce::String::fromUTF8 (reinterpret_cast<const char*> (docBlob + offset));
+    }
+
+private:
+    juce::MemoryMappedFile mapped;
+    bool valid { false };
+    juce::uint32 numDocs { 0 }, numKeys { 0 };
+    const juce::uint8* keyTable { nullptr };
+    const juce::uint8* postingTable { nullptr };
+    const juce::uint8* docTable { nullptr };
+    const juce::uint8* docBlob { nullptr };
+    size_t blobSize { 0 };
+};
+
+//==============================================================================
+// A directory of segments queried as one index
+class ProgressionIndex
+{
+public:
+    static constexpr const char* segmentPattern = "*.cpx";
+
+    explicit ProgressionIndex (const juce::File& directory)
+    {
+        auto files = directory.findChildFiles (juce::File::findFiles, false, segmentPattern);
+        files.sort();
+
+        for (const auto& f : files)
+        {
+            auto segment = std::make_unique<ProgressionIndexSegment> (f);
+
+            if (segment->isValid())
+                segments.push_back (std::move (segment));
+        }
+    }
+
+    // Numbered after the highest existing segment, so a deleted segment
+    // never makes a new one replace a live one
+    static juce::File getNextSegmentFile (const juce::File& directory)
+    {
+        int highest = 0;
+
+        for (const auto& f : directory.findChildFiles (juce::File::findFiles, false, segmentPattern))
+        {
+            const auto name = f.getFileNameWithoutExtension();
+
+            if (name.startsWith ("segment-"))
+                highest = juce::jmax (highest, name.substring (8).getIntValue());
+        }
+
+        auto file = getSegmentFile (directory, highest + 1);
+
+        for (int number = highest + 2; file.exists(); ++number)
+            file = getSegmentFile (directory, number);
+
+        return file;
+    }
+
+    size_t getNumSegments() const { return segments.size(); }
+
+    //==========================================================================
+    // Documents containing the progression (in any key). Progressions longer
+    // than the largest n-gram intersect overlapping n-grams, so the result is
+    // a superset that can be confirmed against the source files if needed.
+    juce::StringArray query (const std::vector<ProgressionChord>& progression, ProgressionKeys::Level level) const
+    {
+        juce::StringArray results;
+        const auto sequence = ProgressionKeys::normalise (progression, level);
+
+        if ((int) sequence.size() < ProgressionKeys::minGram)
+            return results;
+
+        const int n = juce::jmin (ProgressionKeys::maxGram, (int) sequence.size());
+        std::vector<juce::uint64> keys;
+
+        for (int i = 0; i + n <= (int) sequence.size(); ++i)
+            keys.push_back (ProgressionKeys::makeKey (sequence.data() + i, n, level));
+
+        std::vector<juce::uint32> docs, next;
+
+        for (const auto& segment : segments)
+        {
+            docs.clear();
+
+            for (size_t k = 0; k < keys.size(); ++k)
+            {
+                const auto list = segment->find (keys[k]);
+
+                if (k == 0)
+                {
+                    for (juce::uint32 i = 0; i < list.size; ++i)
+                        docs.push_back (list[i]);
+                }
+                else
+                {
+                    // Sorted-list intersection
+                    next.clear();
+                    juce::uint32 i = 0;
+                    size_t j = 0;
+
+                    while (i < list.size && j < docs.size())
+                    {
+                        const auto a = list[i], b = docs[j];
+                        if (a < b)       ++i;
+                        else if (b < a)  ++j;
+                        else             { next.push_back (a); ++i; ++j; }
+                    }
+                    docs.swap (next);
+                }
+
+                if (docs.empty())
+                    break;
+            }
+
+            for (auto d : docs)
+                results.add (segment->getDocumentPath (d));
+        }
+
+        return results;
+    }
+
+private:
+    static juce::File getSegmentFile (const juce::File& directory, int number)
+    {
+        return directory.getChildFile ("segment-" + juce::String (number).paddedLeft ('0', 6) + ".cpx");
+    }
+
+    std::vector<std::unique_ptr<ProgressionIndexSegment>> segments;
+};
+
+//==============================================================================
+// Parses progressions written as chord symbols ("Dm7 G7 Cmaj7") or roman
+// numerals relative to an arbitrary key ("ii7 V7 Imaj7", "ii V I").
+struct ProgressionParser
+{
+    static bool parse (const juce::String& text, std::vector<ProgressionChord>& result, juce::String& error)
+    {
+        result.clear();
+        const auto enDash = juce::String (juce::CharPointer_UTF8 ("\xe2\x80\x93"));
+        auto tokens = juce::StringArray::fromTokens (text.replace (enDash, " ").replaceCharacters (",-|", "   "), " ", {});
+        tokens.removeEmptyStrings();
+
+        for (const auto& token : tokens)
+        {
+            ProgressionChord chord;
+
+            if (! parseRoman (token, chord) && ! parseSymbol (token, chord))
+            {
+                error = "Cannot parse chord '" + token + "'";
+                return false;
+            }
+            result.push_back (chord);
+        }
+
+        if ((int) result.size() < ProgressionKeys::minGram)
+        {
+            error = "A progression needs at least " + juce::String (ProgressionKeys::minGram) + " chords";
+            return false;
+        }
+        return true;
+    }
+
+    // True when every chord is a plain triad, so a family-level search is intended
+    static bool isTriadOnly (const std::vector<ProgressionChord>& chords)
+    {
+        for (const auto& c : chords)
+            if (ProgressionKeys::familyMask (c.intervalMask) != c.intervalMask)
+                return false;
+        return true;
+    }
+
+private:
+    //==========================================================================
+    static bool parseSymbol (const juce::String& token, ProgressionChord& chord)
+    {
+        static const juce::String letters ("C D EF G A B");
+        const int letterIndex = letters.indexOfChar (juce::CharacterFunctions::toUpperCase (token[0]));
+
+        if (token.isEmpty() || letterIndex < 0 || letters[letterIndex] == ' ')
+            return false;
+
+        int root = letterIndex;
+        int pos = 1;
+
+        for (; pos < token.length(); ++pos)
+        {
+            if (token[pos] == '#')       ++root;
+            else if (token[pos] == 'b')  --root;
+            else                         break;
+        }
+
+        const auto mask = maskForSuffix (token.substring (pos));
+        if (mask == 0)
+            return false;
+
+        chord.rootPitchClass = (root % 12 + 12) % 12;
+        chord.intervalMask = mask;
+        return true;
+    }
+
+    static juce::uint16 maskForSuffix (const juce::String& suffix)
+    {
+        if (suffix.isEmpty() || suffix == "maj" || suffix == "M")           return ProgressionKeys::maskForQuality ("Maj");
+        if (suffix == "m" || suffix == "min")                               return ProgressionKeys::maskForQuality ("m");
+        if (suffix == "maj7" || suffix == "M7" || suffix == "Maj7")         return ProgressionKeys::maskForQuality ("Maj7");
+        const juce::String halfDiminished (juce::CharPointer_UTF8 ("\xc3\xb8"));
+        const juce::String diminished (juce::CharPointer_UTF8 ("\xc2\xb0"));
+        
+        if (suffix == "m7b5" || suffix == "min7b5" || suffix == halfDiminished)  return ProgressionKeys::maskForQuality ("m7b5");
+        if (suffix == "dim" || suffix == "o" || suffix == diminished)            return ProgressionKeys::maskForQuality ("dim");
+        if (suffix == "aug" || suffix == "+")                               return ProgressionKeys::maskForQuality ("aug");
+        if (suffix == "mMaj7" || suffix == "mM7")                           return ProgressionKeys::maskForQuality ("mMaj7");
+        if (suffix == "min7")                                               return ProgressionKeys::maskForQuality ("m7");
+        return ProgressionKeys::maskForQuality (suffix);
+    }
+
+    //==========================================================================
+    static bool parseRoman (const juce::String& token, ProgressionChord& chord)
+    {
+        static const char* numerals[] = { "VII", "III", "IV", "VI", "II", "V", "I" };
+        static const int degrees[]    = { 11,    4,     5,    9,    2,    7,   0 };
+
+        int pos = 0;
+        int accidental = 0;
+
+        if (token.startsWithChar ('b'))       { accidental = -1; ++pos; }
+        else if (token.startsWithChar ('#'))  { accidental = 1;  ++pos; }
+
+        const auto rest = token.substring (pos);
+
+        for (int i = 0; i < 7; ++i)
+        {
+            const juce::String numeral (numerals[i]);
+
+            if (! rest.startsWithIgnoreCase (numeral))
+                continue;
+
+            const auto written = rest.substring (0, numeral.length());
+            const bool isUpper = written == numeral;
+            const bool isLower = written == numeral.toLowerCase();
+
+            if (! isUpper && ! isLower)
+                return false;
+
+            auto suffix = rest.substring (numeral.length());
+            juce::uint16 mask = 0;
+
+            if (suffix.isEmpty())               mask = ProgressionKeys::maskForQuality (isUpper ? "Maj" : "m");
+            else if (suffix == "7")             mask = ProgressionKeys::maskForQuality (isUpper ? "7" : "m7");
+            else if (suffix == "6")             mask = ProgressionKeys::maskForQuality (isUpper ? "6" : "m6");
+            else                                mask = maskForSuffix (suffix);
+
+            if (mask == 0)
+                return false;
+
+            chord.rootPitchClass = (degrees[i] + accidental + 12) % 12;
+            chord.intervalMask = mask;
+            return true;
+        }
+
+        return false;
+    }
+};
@@ -0,0 +1,297 @@
+#include "RealtimeSafety.h"
+
+#if CHORDER_REALTIME_CHECKS
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <execinfo.h>
+ #include <pthread.h>
+ #include <unistd.h>
+#endif
+
+#if JUCE_MAC
+ #include <malloc/malloc.h>
+#endif
+
+#if JUCE_WINDOWS
+ #include <malloc.h>
+#endif
+
+//==============================================================================
+namespace RealtimeSafety
+{
+    namespace
+    {
+        thread_local int realtimeDepth = 0;
+        thread_local int suspendDepth = 0;
+
+        std::atomic<int> numViolations { 0 };
+        std::atomic<bool> abortOnViolation { false };
+
+        // Stacks already reported. Lossy by design: a racing duplicate just
+        // gets printed twice.
+        constexpr int maxReportedStacks = 512;
+        std::atomic<juce::uint64> reportedStacks[maxReportedStacks] {};
+
+        bool isChecking() noexcept
+        {
+            return realtimeDepth > 0 && suspendDepth == 0;
+        }
+
+        bool markReported (juce::uint64 hash) noexcept
+        {
+            for (int i = 0; i < maxReportedStacks; ++i)
+            {
+                auto& slot = reportedStacks[(hash + (juce::uint64) i) % maxReportedStacks];
+                auto current = slot.load (std::memory_order_relaxed);
+
+                if (current == hash)
+                    return false;
+
+                if (current == 0 && slot.compare_exchange_strong (current, hash))
+                    return true;
+            }
+            return true;
+        }
+
+        void writeStderr (const char* text) noexcept
+        {
+            std::fputs (text, stderr);
+        }
+    }
+
+    //==========================================================================
+    void enterRealtimeScope() noexcept   { ++realtimeDepth; }
+    void exitRealtimeScope() noexcept    { --realtimeDepth; }
+    void suspendChecks() noexcept        { ++suspendDepth; }
+    void resumeChecks() noexcept         { --suspendDepth; }
+
+    int getNumViolations() noexcept                     { return numViolations.load(); }
+    void setAbortOnViolation (bool shouldAbort) noexcept { abortOnViolation = shouldAbort; }
+
+    void reportViolation (const char* what) noexcept
+    {
+        if (! isChecking())
+            return;
+
+        // Whatever the report itself does must not be reported again
+        ++suspendDepth;
+        ++numViolations;
+
+       #if JUCE_LINUX || JUCE_MAC
+        void* frames[48];
+        const int numFrames = backtrace (frames, 48);
+
+        juce::uint64 hash = 1469598103934665603ull;
+        for (int i = 0; i < numFrames; ++i)
+            hash = (hash ^ (juce::uint64) (juce::pointer_sized_uint) frames[i]) * 1099511628211ull;
+
+        if (markReported (hash | 1))
+        {
+            std::fprintf (stderr, "\n*** Real-time violation: %s on the audio thread\n", what);
+            backtrace_symbols_fd (frames + 1, numFrames - 1, STDERR_FILENO);   // Writes without allocating
+        }
+       #else
+        std::fprintf (stderr, "*** Real-time violation: %s on the audio thread\n", what);
+       #endif
+
+        if (abortOnViolation)
+        {
+            writeStderr ("*** Aborting (abort on violation is set)\n");
+            std::abort();
+        }
+
+        --suspendDepth;
+    }
+}
+
+//==============================================================================
+// operator new / delete
+namespace
+{
+    void* checkedAllocate (std::size_t size, const char* what)
+    {
+        RealtimeSafety::reportViolation (what);
+
+        // The malloc interceptor would report the same allocation again
+        RealtimeSafety::ScopedChecksSuspended suspended;
+        return std::malloc (size == 0 ? 1 : size);
+    }
+
+    void checkedFree (void* p, const char* what) noexcept
+    {
+        if (p == nullptr)
+            return;
+
+        RealtimeSafety::reportViolation (what);
+        RealtimeSafety::ScopedChecksSuspended suspended;
+        std::free (p);
+    }
+
+    // Over-aligned types (alignas above the default new alignment)
+    void* checkedAlignedAllocate (std::size_t size, std::align_val_t alignment, const char* what)
+    {
+        RealtimeSafety::reportViolation (what);
+        RealtimeSafety::ScopedChecksSuspended suspended;
+
+        const auto align = juce::jmax ((std::size_t) alignment, sizeof (void*));
+
+       #if JUCE_WINDOWS
+        return _aligned_malloc (size == 0 ? 1 : size, align);
+       #else
+        void* p = nullptr;
+        return posix_memalign (&p, align, size == 0 ? 1 : size) == 0 ? p : nullptr;
+       #endif
+    }
+
+    void checkedAlignedFree (void* p, const char* what) noexcept
+    {
+        if (p == nullptr)
+            return;
+
+        RealtimeSafety::reportViolation (what);
+        RealtimeSafety::ScopedChecksSuspended suspended;
+
+       #if JUCE_WINDOWS
+        _aligned_free (p);
+       #else
+        std::free (p);
+       #endif
+    }
+}
+
+void* operator new (std::size_t size)
+{
+    if (auto* p = checkedAllocate (size, "operator new"))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size)
+{
+    if (auto* p = checkedAllocate (size, "operator new[]"))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept     { return checkedAllocate (size, "operator new"); }
+void* operator new[] (std::size_t size, const std::nothrow_t&) noexcept   { return checkedAllocate (size, "operator new[]"); }
+
+void operator delete (void* p) noexcept                                   { checkedFree (p, "operator delete"); }
+void operator delete[] (void* p) noexcept                                 { checkedFree (p, "operator delete[]"); }
+void operator delete (void* p, std::size_t) noexcept                      { checkedFree (p, "operator delete"); }
+void operator delete[] (void* p, std::size_t) noexcept                    { checkedFree (p, "operator delete[]"); }
+void operator delete (void* p, const std::nothrow_t&) noexcept            { checkedFree (p, "operator delete"); }
+void operator delete[] (void* p, const std::nothrow_t&) noexcept          { checkedFree (p, "operator delete[]"); }
+
+void* operator new (std::size_t size, std::align_val_t alignment)
+{
+    if (auto* p = checkedAlignedAllocate (size, alignment, "operator new"))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size, std::align_val_t alignment)
+{
+    if (auto* p = checkedAlignedAllocate (size, alignment, "operator new[]"))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new (std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return checkedAlignedAllocate (size, alignment, "operator new");
+}
+
+void* operator new[] (std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return checkedAlignedAllocate (size, alignment, "operator new[]");
+}
+
+void operator delete (void* p, std::align_val_t) noexcept                                   { checkedAlignedFree (p, "operator delete"); }
+void operator delete[] (void* p, std::align_val_t) noexcept                                 { checkedAlignedFree (p, "operator delete[]"); }
+void operator delete (void* p, std::size_t, std::align_val_t) noexcept                      { checkedAlignedFree (p, "operator delete"); }
+void operator delete[] (void* p, std::size_t, std::align_val_t) noexcept                    { checkedAlignedFree (p, "operator delete[]"); }
+void operator delete (void* p, std::align_val_t, const std::nothrow_t&) noexcept            { checkedAlignedFree (p, "operator delete"); }
+void operator delete[] (void* p, std::align_val_t, const std::nothrow_t&) noexcept          { checkedAlignedFree (p, "operator delete[]"); }
+
+//==============================================================================
+#if JUCE_LINUX
+
+// Linked with -Wl,--wrap=<symbol> so every call from our objects and the JUCE
+// modules lands here first
+extern "C"
+{
+    void* __real_malloc (size_t);
+    void* __real_calloc (size_t, size_t);
+    void* __real_realloc (void*, size_t);
+    void __real_free (void*);
+    int __real_pthread_mutex_lock (pthread_mutex_t*);
+
+    void* __wrap_malloc (size_t size)
+    {
+        RealtimeSafety::reportViolation ("malloc");
+        return __real_malloc (size);
+    }
+
+    void* __wrap_calloc (size_t count, size_t size)
+    {
+        RealtimeSafety::reportViolation ("calloc");
+        return __real_calloc (count, size);
+    }
+
+    void* __wrap_realloc (void* p, size_t size)
+    {
+        RealtimeSafety::reportViolation ("realloc");
+        return __real_realloc (p, size);
+    }
+
+    void __wrap_free (void* p)
+    {
+        if (p != nullptr)
+            RealtimeSafety::reportViolation ("free");
+
+        __real_free (p);
+    }
+
+    int __wrap_pthread_mutex_lock (pthread_mutex_t* mutex)
+    {
+        RealtimeSafety::reportViolation ("pthread_mutex_lock");
+        return __real_pthread_mutex_lock (mutex);
+    }
+}
+
+#elif JUCE_MAC
+
+// libmalloc calls this (Instruments uses it) for every allocation and free
+typedef void (MallocLogger) (uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3,
+                             uintptr_t result, uint32_t numFramesToSkip);
+extern "C" MallocLogger* malloc_logger;
+
+namespace
+{
+    void logMalloc (uint32_t type, uintptr_t, uintptr_t, uintptr_t, uintptr_t, uint32_t)
+    {
+        constexpr uint32_t deallocateFlag = 4;
+        RealtimeSafety::reportViolation ((type & deallocateFlag) != 0 ? "free" : "malloc");
+    }
+
+    struct MallocLoggerInstaller
+    {
+        MallocLoggerInstaller() { malloc_logger = logMalloc; }
+    };
+
+    MallocLoggerInstaller mallocLoggerInstaller;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+//==============================================================================
+// Real-time safety checks for the audio thread.
+//
+// With CHORDER_REALTIME_CHECKS=1 (the CHORDER_REALTIME_CHECKS CMake option)
+// every heap allocation, deallocation and mutex acquisition made while a
+// thread is inside CHORDER_REALTIME_SCOPE() is reported on stderr with a
+// stack trace, once per distinct call stack. What gets intercepted depends on
+// the platform (see RealtimeSafety.cpp):
+//
+//   operator new / delete      everywhere
+//   malloc / calloc / realloc / free, pthread_mutex_lock
+//                              Linux (linker --wrap)
+//   malloc family              macOS (malloc_logger hook)
+//
+// Without the option the macros expand to nothing.
+//==============================================================================
+
+#ifndef CHORDER_REALTIME_CHECKS
+ #define CHORDER_REALTIME_CHECKS 0
+#endif
+
+#if CHORDER_REALTIME_CHECKS
+
+namespace RealtimeSafety
+{
+    void enterRealtimeScope() noexcept;
+    void exitRealtimeScope() noexcept;
+
+    // Deliberate non-real-time work inside a real-time scope
+    void suspendChecks() noexcept;
+    void resumeChecks() noexcept;
+
+    // Called by the interceptors; reports if the calling thread is being checked
+    void reportViolation (const char* what) noexcept;
+
+    int getNumViolations() noexcept;
+    void setAbortOnViolation (bool shouldAbort) noexcept;
+
+    //==========================================================================
+    struct ScopedRealtime
+    {
+        ScopedRealtime() noexcept   { enterRealtimeScope(); }
+        ~ScopedRealtime() noexcept  { exitRealtimeScope(); }
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedRealtime)
+    };
+
+    struct ScopedChecksSuspended
+    {
+        ScopedChecksSuspended() noexcept    { suspendChecks(); }
+        ~ScopedChecksSuspended() noexcept   { resumeChecks(); }
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedChecksSuspended)
+    };
+}
+
+ #define CHORDER_REALTIME_SCOPE() RealtimeSafety::ScopedRealtime JUCE_JOIN_MACRO (realtimeScope_, __LINE__)
+
+#else
+
+ #define CHORDER_REALTIME_SCOPE()
+
+#endif
@@ -11,6 +11,7 @@ struct PatternNote
     int chordIndex;         // Which chord note to play: 0=root, 1=3rd, 2=5th, 3=7th, -1=bass (octave down)
     float velocity;         // Note velocity (0.0 to 1.0)
     double duration;        // Duration in beats
+    float probability { 1.0f }; // Chance the note sounds each cycle; notes sharing a beat roll together
 };
 
 //==============================================================================
@@ -20,6 +21,7 @@ struct RhythmPattern
     juce::String name;
     double lengthInBeats;           // Pattern length (typically 4 or 8 beats)
     std::vector<PatternNote> notes; // All notes in the pattern
+    juce::StringArray tags;         // Style and feel, for filtering in the browser
 };
 
 //==============================================================================
@@ -66,6 +68,7 @@ private:
     {
         RhythmPattern pattern;
         pattern.name = "Samba";
+        pattern.tags = { "Latin", "Syncopated", "Up-tempo" };
         pattern.lengthInBeats = 4.0;
         pattern.notes = {
             // Bass hits
@@ -95,6 +98,7 @@ private:
     {
         RhythmPattern pattern;
         pattern.name = "Bossa Nova";
+        pattern.tags = { "Latin", "Syncopated" };
         pattern.lengthInBeats = 4.0;
         pattern.notes = {
             // Classic bossa bass pattern
@@ -120,6 +124,7 @@ private:
     {
         RhythmPattern pattern;
         pattern.name = "Rumba";
+        pattern.tags = { "Latin" };
         pattern.lengthInBeats = 4.0;
         pattern.notes = {
             // Strong bass pattern
@@ -147,6 +152,7 @@ private:
     {
         RhythmPattern pattern;
         pattern.name = "Cha-Cha";
+        pattern.tags = { "Latin", "Dance" };
         pattern.lengthInBeats = 4.0;
         pattern.notes = {
             // Bass on 1 and 3
@@ -176,6 +182,7 @@ private:
     {
         RhythmPattern pattern;
         pattern.name = "Reggae";
+        pattern.tags = { "Offbeat" };
         pattern.lengthInBeats = 4.0;
         pattern.notes = {
             // One drop bass
@@ -203,6 +210,7 @@ private:
     {
         RhythmPattern pattern;
         pattern.name = "Waltz";
+        pattern.tags = { "3/4" };
         pattern.lengthInBeats = 3.0;
         pattern.notes = {
             // Strong bass on 1
@@ -224,6 +232,7 @@ private:
     {
         RhythmPattern pattern;
         pattern.name = "March";
+        pattern.tags = { "Straight" };
         pattern.lengthInBeats = 4.0;
         pattern.notes = {
             // Strong bass on 1 and 3
@@ -252,6 +261,7 @@ private:
     {
         RhythmPattern pattern;
         pattern.name = "Ballad";
+        pattern.tags = { "Slow" };
         pattern.lengthInBeats = 4.0;
         pattern.notes = {
             // Gentle bass
@@ -274,6 +284,7 @@ private:
     {
         RhythmPattern pattern;
         pattern.name = "Disco";
+        pattern.tags = { "Dance", "Offbeat", "Up-tempo" };
         pattern.lengthInBeats = 4.0;
         pattern.notes = {
             // Four-on-the-floor bass
@@ -304,6 +315,7 @@ private:
     {
         RhythmPattern pattern;
         pattern.name = "Rock";
+        pattern.tags = { "Straight" };
         pattern.lengthInBeats = 4.0;
         pattern.notes = {
             // Driving bass
@@ -0,0 +1,714 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "WalkingBass.h"
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+//==============================================================================
+// Session capture: everything processBlock was given, for replaying a
+// performance exactly.
+//
+// Per block the audio thread serialises the input MIDI, the host position,
+// the block size, the parameters that changed since the previous block, the
+// pattern random seed, (when it moved) the walking bass targets and, while
+// the output depends on it, the audio input into a preallocated scratch
+// buffer. At the end of the block a hash of the output
+// is appended and the whole chunk goes into a byte ring in one write; if the
+// ring is full the block is counted as dropped and the next chunk starts with
+// a gap record and a full parameter snapshot. A background thread drains the
+// ring every 50 ms to the log file, whose header holds the plugin state and
+// parameter IDs at the moment the capture started.
+//
+// Tools/SessionReplay reads the log with SessionLogReader and drives a fresh
+// processor through the same blocks, comparing each block's output hash.
+class SessionCapture final : private juce::Thread
+{
+public:
+    static constexpr int ringSize = 1 << 22;
+    static constexpr int maxChunkSize = 1 << 18;     // 8 channels of 8192 samples
+    static constexpr juce::uint32 formatVersion = 1;
+
+    enum RecordType : juce::uint8
+    {
+        prepareRecord = 1,      // Sample rate and maximum block size
+        blockRecord,            // One processBlock call
+        bassTargetsRecord,      // Walking bass targets learned since the last one
+        gapRecord,              // Blocks dropped because the ring was full
+        audioInputRecord        // The block's input channels, when they drive the output
+    };
+
+    // Block record flags
+    enum
+    {
+        hasPosition         = 1 << 0,
+        hasBpm              = 1 << 1,
+        hasPpq              = 1 << 2,
+        isPlaying           = 1 << 3,
+        hasTimeSignature    = 1 << 4,
+        hasTimeInSamples    = 1 << 5,
+        generatedChanged    = 1 << 6    // The generated pattern was re-published before this block
+    };
+
+    SessionCapture() : juce::Thread ("Session capture"), ring ((size_t) ringSize), scratch ((size_t) maxChunkSize) {}
+
+    ~SessionCapture() override
+    {
+        stop();
+        stopThread (4000);
+    }
+
+    //==========================================================================
+    // Message thread. The header records the state to replay from and the
+    // parameter order the block records index into.
+    void start (const juce::File& file, const juce::MemoryBlock& state, const juce::StringArray& parameterIDs)
+    {
+        const auto newGeneration = ++lastGeneration;
+
+        {
+            const juce::ScopedLock sl (commandLock);
+            stopPending = true;
+            pendingFile = file;
+            pendingState = state;
+            pendingParameterIDs = parameterIDs;
+            pendingGeneration = newGeneration;
+        }
+
+        writeFailed = false;
+        blocksWritten = 0;
+        droppedBlocks = 0;
+        generation.store (newGeneration, std::memory_order_release);
+
+        if (! isThreadRunning())
+            startThread (juce::Thread::Priority::low);
+
+        notify();
+    }
+
+    void stop()
+    {
+        generation.store (0, std::memory_order_release);
+
+        {
+            const juce::ScopedLock sl (commandLock);
+            stopPending = true;
+            pendingFile = juce::File();
+        }
+
+        notify();
+    }
+
+    // Before the audio thread runs: the number of parameters blocks record
+    void setNumParameters (int numParameters)
+    {
+        lastParameterValues.resize ((size_t) numParameters);
+    }
+
+    bool isCapturing() const                { return generation.load (std::memory_order_relaxed) != 0; }
+    bool hasWriteFailed() const             { return writeFailed.load(); }
+    juce::int64 getBlocksWritten() const    { return blocksWritten.load(); }
+    int getDroppedBlocks() const            { return droppedBlocks.load(); }
+
+    juce::File getCurrentFile() const
+    {
+        const juce::ScopedLock sl (commandLock);
+        return currentFile;
+    }
+
+    static juce::File getDefaultLogFile()
+    {
+        return juce::File::getSpecialLocation (juce::File::userDocumentsDirectory)
+                 .getChildFile ("Chord Pattern Player Sessions")
+                 .getChildFile ("session-" + juce::Time::getCurrentTime().formatted ("%Y%m%d-%H%M%S") + ".cpsl");
+    }
+
+    //==========================================================================
+    // Audio thread, at the start of processBlock with its untouched input.
+    // audioInput is the block's input channels if the output depends on them
+    // (audio chord detection or onset rhythm sync), or null. Does nothing unless a capture is
+    // running.
+    void beginBlock (const juce::MidiBuffer& input, const juce::AudioBuffer<float>* audioInput,
+                     int numInputChannels, int numSamples,
+                     const juce::Optional<juce::AudioPlayHead::PositionInfo>& position,
+                     const juce::Array<juce::AudioProcessorParameter*>& parameters,
+                     juce::int64 randomSeed, bool generatedPatternChanged,
+                     const WalkingBass::Targets& bassTargets,
+                     double sampleRate, int maxBlockSize) noexcept
+    {
+        chunkOpen = false;
+        const auto currentGeneration = generation.load (std::memory_order_acquire);
+
+        if (currentGeneration == 0)
+            return;
+
+        if (currentGeneration != audioGeneration)
+        {
+            // New capture: everything is written in full once
+            audioGeneration = currentGeneration;
+            needsSnapshot = true;
+            pendingGap = 0;
+        }
+
+        const bool snapshot = std::exchange (needsSnapshot, false);
+        overflowed = false;
+        scratchSize = 0;
+        put (audioGeneration);
+        put ((juce::uint32) 0);     // Chunk size, patched in endBlock
+
+        if (pendingGap > 0)
+        {
+            const auto start = beginRecord (gapRecord);
+            put (pendingGap);
+            endRecord (start);
+        }
+
+        if (snapshot || sampleRate != lastSampleRate || maxBlockSize != lastMaxBlockSize)
+        {
+            const auto start = beginRecord (prepareRecord);
+            put (sampleRate);
+            put ((juce::int32) maxBlockSize);
+            endRecord (start);
+            lastSampleRate = sampleRate;
+            lastMaxBlockSize = maxBlockSize;
+        }
+
+        if (snapshot || bassTargets != lastBassTargets)
+        {
+            const auto start = beginRecord (bassTargetsRecord);
+            putBytes (bassTargets.data(), bassTargets.size());
+            endRecord (start);
+            lastBassTargets = bassTargets;
+        }
+
+        if (audioInput != nullptr && numInputChannels > 0)
+        {
+            const auto start = beginRecord (audioInputRecord);
+            const int numChannels = juce::jmin (numInputChannels, audioInput->getNumChannels());
+            put ((juce::uint8) numChannels);
+            put ((juce::int32) numSamples);
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                const auto* samples = audioInput->getReadPointer (c);
+
+                for (int i = 0; i < numSamples; ++i)
+                    put (samples[i]);
+            }
+
+            endRecord (start);
+        }
+
+        const auto start = beginRecord (blockRecord);
+        auto flags = (juce::uint8) (generatedPatternChanged || snapshot ? generatedChanged : 0);
+        double bpm = 0.0, ppq = 0.0;
+        juce::int16 numerator = 0, denominator = 0;
+        juce::int64 timeInSamples = 0;
+
+        if (position.hasValue())
+        {
+            flags |= hasPosition;
+
+            if (auto value = position->getBpm())            { flags |= hasBpm; bpm = *value; }
+            if (auto value = position->getPpqPosition())    { flags |= hasPpq; ppq = *value; }
+            if (auto value = position->getTimeInSamples())  { flags |= hasTimeInSamples; timeInSamples = *value; }
+
+            if (auto value = position->getTimeSignature())
+            {
+                flags |= hasTimeSignature;
+                numerator = (juce::int16) value->numerator;
+                denominator = (juce::int16) value->denominator;
+            }
+
+            if (position->getIsPlaying())
+                flags |= isPlaying;
+        }
+
+        put ((juce::int32) numSamples);
+        put (flags);
+        put (bpm);
+        put (ppq);
+        put (numerator);
+        put (denominator);
+        put (timeInSamples);
+        put (randomSeed);
+
+        // Parameters that moved since the last block (all of them after a
+        // gap: NaN never equals a value)
+        if (snapshot)
+            std::fill (lastParameterValues.begin(), lastParameterValues.end(), std::numeric_limits<float>::quiet_NaN());
+
+        const auto countPosition = scratchSize;
+        put ((juce::uint16) 0);
+        juce::uint16 numChanges = 0;
+
+        for (int i = 0; i < juce::jmin (parameters.size(), (int) lastParameterValues.size()); ++i)
+        {
+            const auto value = parameters.getUnchecked (i)->getValue();
+
+            if (value != lastParameterValues[(size_t) i])
+            {
+                put ((juce::uint16) i);
+                put (value);
+                lastParameterValues[(size_t) i] = value;
+                ++numChanges;
+            }
+        }
+
+        patch (countPosition, numChanges);
+
+        const auto midiCountPosition = scratchSize;
+        put ((juce::uint32) 0);
+        juce::uint32 numEvents = 0;
+
+        for (const auto metadata : input)
+        {
+            put ((juce::int32) metadata.samplePosition);
+            put ((juce::uint16) metadata.numBytes);
+            putBytes (metadata.data, (size_t) metadata.numBytes);
+            ++numEvents;
+        }
+
+        patch (midiCountPosition, numEvents);
+        blockRecordStart = start;
+        chunkOpen = true;
+    }
+
+    // Audio thread, at the end of processBlock with its final output
+    void endBlock (const juce::MidiBuffer& output) noexcept
+    {
+        if (! std::exchange (chunkOpen, false))
+            return;
+
+        put (hashOutput (output));
+        endRecord (blockRecordStart);
+        patch ((int) sizeof (juce::uint32), (juce::uint32) scratchSize);
+
+        if (overflowed || fifo.getFreeSpace() < scratchSize)
+        {
+            // Nothing partial goes in: drop the chunk and resynchronise
+            // with a snapshot once there is room
+            ++pendingGap;
+            needsSnapshot = true;
+            droppedBlocks.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+
+        pendingGap = 0;
+        const auto scope = fifo.write (scratchSize);
+        std::memcpy (ring.data() + scope.startIndex1, scratch.data(), (size_t) scope.blockSize1);
+        std::memcpy (ring.data() + scope.startIndex2, scratch.data() + scope.blockSize1, (size_t) scope.blockSize2);
+    }
+
+    // FNV-1a over the output events, so a replay can confirm each block
+    static juce::uint64 hashOutput (const juce::MidiBuffer& output) noexcept
+    {
+        juce::uint64 hash = 14695981039346656037ull;
+
+        auto add = [&hash] (juce::uint8 byte)
+        {
+            hash = (hash ^ byte) * 1099511628211ull;
+        };
+
+        for (const auto metadata : output)
+        {
+            for (int shift = 0; shift < 32; shift += 8)
+                add ((juce::uint8) (metadata.samplePosition >> shift));
+
+            for (int i = 0; i < metadata.numBytes; ++i)
+                add (metadata.data[i]);
+        }
+
+        return hash;
+    }
+
+private:
+    //==========================================================================
+    // Scratch writing. A chunk that outgrows the scratch buffer is dropped.
+    void putBytes (const void* data, size_t size) noexcept
+    {
+        if (overflowed || (size_t) scratchSize + size > scratch.size())
+        {
+            overflowed = true;
+            return;
+        }
+
+        std::memcpy (scratch.data() + scratchSize, data, size);
+        scratchSize += (int) size;
+    }
+
+    template <typename Value>
+    void put (Value value) noexcept
+    {
+        if constexpr (sizeof (Value) > 1)
+            value = juce::ByteOrder::swapIfBigEndian (value);
+
+        putBytes (&value, sizeof (Value));
+    }
+
+    template <typename Value>
+    void patch (int position, Value value) noexcept
+    {
+        if (! overflowed)
+        {
+            value = juce::ByteOrder::swapIfBigEndian (value);
+            std::memcpy (scratch.data() + position, &value, sizeof (Value));
+        }
+    }
+
+    int beginRecord (RecordType type) noexcept
+    {
+        put ((juce::uint8) type);
+        const auto start = scratchSize;
+        put ((juce::uint32) 0);
+        return start;
+    }
+
+    void endRecord (int sizePosition) noexcept
+    {
+        patch (sizePosition, (juce::uint32) (scratchSize - sizePosition - (int) sizeof (juce::uint32)));
+    }
+
+    //==========================================================================
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait (50);
+            service();
+        }
+
+        drain();
+        closeFile();
+    }
+
+    void service()
+    {
+        bool shouldStop;
+        juce::File fileToOpen;
+        juce::MemoryBlock state;
+        juce::StringArray parameterIDs;
+        juce::uint32 newGeneration;
+
+        {
+            const juce::ScopedLock sl (commandLock);
+            shouldStop = std::exchange (stopPending, false);
+            fileToOpen = std::exchange (pendingFile, juce::File());
+            state = std::exchange (pendingState, {});
+            parameterIDs = std::exchange (pendingParameterIDs, {});
+            newGeneration = pendingGeneration;
+        }
+
+        if (shouldStop)
+        {
+            drain();
+            closeFile();
+        }
+
+        if (fileToOpen != juce::File())
+            openFile (fileToOpen, state, parameterIDs, newGeneration);
+
+        drain();
+    }
+
+    // Writes the current capture's chunks. Chunks from an older capture are
+    // dropped; a newer capture's chunks wait until its file opens.
+    void drain()
+    {
+        while (fifo.getNumReady() >= (int) (2 * sizeof (juce::uint32)))
+        {
+            juce::uint32 header[2];
+            peek (header, sizeof (header));
+
+            const auto chunkGeneration = juce::ByteOrder::swapIfBigEndian (header[0]);
+            const auto chunkSize = (int) juce::ByteOrder::swapIfBigEndian (header[1]);
+
+            if (chunkGeneration > fileGeneration)
+                break;
+
+            chunk.resize ((size_t) chunkSize);
+            peek (chunk.data(), chunk.size());
+            fifo.finishedRead (chunkSize);
+
+            if (chunkGeneration == fileGeneration && output != nullptr)
+            {
+                output->write (chunk.data() + sizeof (header), chunk.size() - sizeof (header));
+                blocksWritten.fetch_add (1, std::memory_order_relaxed);
+            }
+        }
+
+        if (output != nullptr)
+            output->flush();
+    }
+
+    void peek (void* dest, size_t size) const
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead ((int) size, start1, size1, start2, size2);
+
+        std::memcpy (dest, ring.data() + start1, (size_t) size1);
+        std::memcpy (static_cast<char*> (dest) + size1, ring.data() + start2, (size_t) size2);
+    }
+
+    //==========================================================================
+    void openFile (const juce::File& file, const juce::MemoryBlock& state,
+                   const juce::StringArray& parameterIDs, juce::uint32 captureGeneration)
+    {
+        file.getParentDirectory().createDirectory();
+        file.deleteFile();
+
+        auto stream = std::make_unique<juce::FileOutputStream> (file);
+        fileGeneration = captureGeneration;
+
+        if (! stream->openedOk())
+        {
+            writeFailed = true;     // Its chunks are discarded
+            return;
+        }
+
+        output = std::move (stream);
+
+        {
+            const juce::ScopedLock sl (commandLock);
+            currentFile = file;
+        }
+
+        output->write ("CPSL", 4);
+        output->writeInt ((int) formatVersion);
+        output->writeInt (parameterIDs.size());
+
+        for (const auto& id : parameterIDs)
+            output->writeString (id);
+
+        output->writeInt ((int) state.getSize());
+        output->write (state.getData(), state.getSize());
+    }
+
+    void closeFile()
+    {
+        if (output != nullptr)
+            output->flush();
+
+        output.reset();
+        fileGeneration = 0;
+    }
+
+    //==========================================================================
+    // Audio thread -> writer
+    juce::AbstractFifo fifo { ringSize };
+    std::vector<juce::uint8> ring;
+
+    // Audio thread only
+    std::vector<juce::uint8> scratch;
+    int scratchSize { 0 };
+    bool overflowed { false }, chunkOpen { false }, needsSnapshot { true };
+    int blockRecordStart { 0 };
+    juce::uint32 audioGeneration { 0 };
+    juce::uint32 pendingGap { 0 };
+    double lastSampleRate { 0.0 };
+    int lastMaxBlockSize { 0 };
+    WalkingBass::Targets lastBassTargets {};
+    std::vector<float> lastParameterValues;
+
+    // Message thread -> writer
+    juce::CriticalSection commandLock;
+    bool stopPending { false };
+    juce::File pendingFile, currentFile;
+    juce::MemoryBlock pendingState;
+    juce::StringArray pendingParameterIDs;
+    juce::uint32 pendingGeneration { 0 };
+    juce::uint32 lastGeneration { 0 };      // Message thread only
+    std::atomic<juce::uint32> generation { 0 };
+
+    // Writer thread only
+    std::unique_ptr<juce::FileOutputStream> output;
+    juce::uint32 fileGeneration { 0 };
+    std::vector<juce::uint8> chunk;
+
+    // Stats, any thread
+    std::atomic<bool> writeFailed { false };
+    std::atomic<juce::int64> blocksWritten { 0 };
+    std::atomic<int> droppedBlocks { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (SessionCapture)
+};
+
+//==============================================================================
+// Reads a session log back, one record at a time.
+class SessionLogReader
+{
+public:
+    struct Record
+    {
+        SessionCapture::RecordType type {};
+
+        // prepareRecord
+        double sampleRate { 0.0 };
+        int maxBlockSize { 0 };
+
+        // blockRecord
+        int numSamples { 0 };
+        juce::uint8 flags { 0 };
+        double bpm { 0.0 }, ppq { 0.0 };
+        int numerator { 0 }, denominator { 0 };
+        juce::int64 timeInSamples { 0 };
+        juce::int64 randomSeed { 0 };
+        std::vector<std::pair<int, float>> parameterChanges;
+        juce::MidiBuffer midi;
+        juce::uint64 outputHash { 0 };
+
+        // bassTargetsRecord
+        WalkingBass::Targets bassTargets {};
+
+        // gapRecord
+        juce::uint32 droppedBlocks { 0 };
+
+        // audioInputRecord
+        juce::AudioBuffer<float> audio;
+
+        bool has (int flag) const noexcept   { return (flags & flag) != 0; }
+    };
+
+    explicit SessionLogReader (juce::InputStream& source) : input (source) {}
+
+    // Reads the header. False (with getError() set) if this isn't a log.
+    bool readHeader()
+    {
+        char magic[4] {};
+
+        if (input.read (magic, 4) != 4 || std::memcmp (magic, "CPSL", 4) != 0)
+            return fail ("Not a session log");
+
+        if ((juce::uint32) input.readInt() != SessionCapture::formatVersion)
+            return fail ("Unsupported session log version");
+
+        const int numParameters = input.readInt();
+
+        if (numParameters < 0 || numParameters > 65536)
+            return fail ("Corrupt session log header");
+
+        for (int i = 0; i < numParameters; ++i)
+            parameterIDs.add (input.readString());
+
+        const int stateSize = input.readInt();
+
+        if (stateSize < 0 || stateSize > input.getNumBytesRemaining())
+            return fail ("Corrupt session log header");
+
+        state.setSize ((size_t) stateSize);
+        input.read (state.getData(), stateSize);
+        return true;
+    }
+
+    // Reads the next record. False at the end of the log or on a truncated
+    // record (the last one, if the capture was cut off).
+    bool readNext (Record& record)
+    {
+        if (input.getNumBytesRemaining() < 5)
+            return false;
+
+        record.type = (SessionCapture::RecordType) input.readByte();
+        const auto size = (juce::int64) (juce::uint32) input.readInt();
+
+        if (size > input.getNumBytesRemaining())
+            return fail ("Truncated record at the end of the log");
+
+        payload.setSize ((size_t) size);
+        input.read (payload.getData(), (int) size);
+        juce::MemoryInputStream in (payload, false);
+
+        // Records are often kept, so don't carry a previous record's audio along
+        if (record.type != SessionCapture::audioInputRecord)
+            record.audio.setSize (0, 0);
+
+        switch (record.type)
+        {
+            case SessionCapture::prepareRecord:
+                record.sampleRate = in.readDouble();
+                record.maxBlockSize = in.readInt();
+                break;
+
+            case SessionCapture::bassTargetsRecord:
+                in.read (record.bassTargets.data(), (int) record.bassTargets.size());
+                break;
+
+            case SessionCapture::gapRecord:
+                record.droppedBlocks = (juce::uint32) in.readInt();
+                break;
+
+            case SessionCapture::audioInputRecord:
+            {
+                const int numChannels = (juce::uint8) in.readByte();
+                const int numSamples = in.readInt();
+
+                if (numSamples < 0 || (juce::int64) numChannels * numSamples * 4 > in.getNumBytesRemaining())
+                    return fail ("Corrupt audio input record");
+
+                record.audio.setSize (numChannels, numSamples);
+
+                for (int c = 0; c < numChannels; ++c)
+                    for (int i = 0; i < numSamples; ++i)
+                        record.audio.setSample (c, i, in.readFloat());
+
+                break;
+            }
+
+            case SessionCapture::blockRecord:
+            {
+                record.numSamples = in.readInt();
+                record.flags = (juce::uint8) in.readByte();
+                record.bpm = in.readDouble();
+                record.ppq = in.readDouble();
+                record.numerator = in.readShort();
+                record.denominator = in.readShort();
+                record.timeInSamples = in.readInt64();
+                record.randomSeed = in.readInt64();
+
+                record.parameterChanges.clear();
+
+                for (int n = (juce::uint16) in.readShort(); n > 0; --n)
+                {
+                    const int index = (juce::uint16) in.readShort();
+                    record.parameterChanges.emplace_back (index, in.readFloat());
+                }
+
+                record.midi.clear();
+
+                for (auto n = (juce::uint32) in.readInt(); n > 0; --n)
+                {
+                    const int samplePosition = in.readInt();
+                    const int numBytes = (juce::uint16) in.readShort();
+                    eventBytes.setSize ((size_t) numBytes);
+                    in.read (eventBytes.getData(), numBytes);
+                    record.midi.addEvent (eventBytes.getData(), numBytes, samplePosition);
+                }
+
+                record.outputHash = (juce::uint64) in.readInt64();
+                break;
+            }
+
+            default:
+                break;      // Unknown record from a newer writer: skipped
+        }
+
+        return true;
+    }
+
+    const juce::StringArray& getParameterIDs() const    { return parameterIDs; }
+    const juce::MemoryBlock& getState() const           { return state; }
+    const juce::String& getError() const                { return error; }
+
+private:
+    bool fail (const juce::String& message)
+    {
+        error = message;
+        return false;
+    }
+
+    juce::InputStream& input;
+    juce::StringArray parameterIDs;
+    juce::MemoryBlock state, payload, eventBytes;
+    juce::String error;
+};
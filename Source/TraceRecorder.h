@@ -0,0 +1,252 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <array>
+#include <atomic>
+#include <vector>
+
+//==============================================================================
+// Scope tracing for profiling glitches after the fact.
+//
+//   CHORDER_TRACE_SCOPE ("detectChords");
+//
+// records the scope's begin time and duration into a ring buffer owned by the
+// calling thread. Buffers are allocated up front and each one has a single
+// writer, so recording is two clock reads and a store - no locks, no
+// allocation. A thread gives its buffer back when it exits, so hosts that
+// recreate their audio threads don't use them up; threads that find none
+// free aren't traced, and are counted in the dump. TraceRecorder::
+// requestDump() has a background thread write the last events of every
+// buffer as Chrome trace JSON (chrome://tracing or ui.perfetto.dev).
+//
+// Everything compiles away unless CHORDER_ENABLE_TRACING is 1 (Debug builds,
+// or the CHORDER_TRACING CMake option).
+//==============================================================================
+
+#ifndef CHORDER_ENABLE_TRACING
+ #define CHORDER_ENABLE_TRACING 0
+#endif
+
+#if CHORDER_ENABLE_TRACING
+
+class TraceRecorder final : private juce::Thread
+{
+public:
+    static constexpr int maxThreads = 16;
+    static constexpr int eventsPerThread = 1 << 15;
+
+    struct Event
+    {
+        const char* name;           // String literal, never copied
+        juce::int64 beginTicks;
+        juce::int64 endTicks;
+    };
+
+    //==========================================================================
+    static TraceRecorder& getInstance()
+    {
+        static TraceRecorder instance;
+        return instance;
+    }
+
+    ~TraceRecorder() override
+    {
+        stopThread (2000);
+    }
+
+    // Any thread
+    void record (const char* name, juce::int64 beginTicks, juce::int64 endTicks) noexcept
+    {
+        if (auto* buffer = getThreadBuffer())
+        {
+            const auto index = buffer->writeIndex.load (std::memory_order_relaxed);
+            buffer->events[(size_t) (index & (eventsPerThread - 1))] = { name, beginTicks, endTicks };
+            buffer->writeIndex.store (index + 1, std::memory_order_release);
+        }
+    }
+
+    // Message thread: writes the buffered events to a JSON file in the background
+    void requestDump (const juce::File& destination)
+    {
+        {
+            const juce::ScopedLock sl (dumpLock);
+            pendingDumpFile = destination;
+        }
+
+        if (! isThreadRunning())
+            startThread (juce::Thread::Priority::low);
+
+        notify();
+    }
+
+    static juce::File getDefaultDumpFile()
+    {
+        return juce::File::getSpecialLocation (juce::File::userDocumentsDirectory)
+                 .getChildFile ("Chord Pattern Player Traces")
+                 .getChildFile ("trace-" + juce::Time::getCurrentTime().formatted ("%Y%m%d-%H%M%S") + ".json");
+    }
+
+private:
+    //==========================================================================
+    struct ThreadBuffer
+    {
+        std::array<Event, eventsPerThread> events;
+        std::atomic<juce::uint64> writeIndex { 0 };
+        std::atomic<bool> claimed { false };
+    };
+
+    // A thread's hold on its buffer, released when the thread exits. A buffer
+    // taken over by a new thread keeps the old one's events until they are
+    // overwritten.
+    struct ThreadSlot
+    {
+        static constexpr int unclaimed = -1, noneFree = -2;
+        int index { unclaimed };
+
+        ~ThreadSlot()
+        {
+            if (index >= 0)
+                getInstance().buffers[(size_t) index]->claimed.store (false, std::memory_order_release);
+        }
+    };
+
+    TraceRecorder() : juce::Thread ("Trace dump")
+    {
+        for (auto& b : buffers)
+            b = std::make_unique<ThreadBuffer>();
+    }
+
+    // A thread claims a buffer the first time it records
+    ThreadBuffer* getThreadBuffer() noexcept
+    {
+        thread_local ThreadSlot slot;
+
+        if (slot.index == ThreadSlot::unclaimed)
+            slot.index = claimBuffer();
+
+        return slot.index >= 0 ? buffers[(size_t) slot.index].get() : nullptr;
+    }
+
+    int claimBuffer() noexcept
+    {
+        for (int i = 0; i < maxThreads; ++i)
+        {
+            bool expected = false;
+
+            if (buffers[(size_t) i]->claimed.compare_exchange_strong (expected, true, std::memory_order_acquire))
+                return i;
+        }
+
+        // Out of buffers: this thread isn't traced
+        untracedThreads.fetch_add (1, std::memory_order_relaxed);
+        return ThreadSlot::noneFree;
+    }
+
+    //==========================================================================
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait (-1);
+
+            juce::File destination;
+            {
+                const juce::ScopedLock sl (dumpLock);
+                std::swap (destination, pendingDumpFile);
+            }
+
+            if (destination != juce::File())
+                writeJson (destination);
+        }
+    }
+
+    void writeJson (const juce::File& destination)
+    {
+        destination.getParentDirectory().createDirectory();
+        juce::FileOutputStream out (destination);
+
+        if (! out.openedOk())
+            return;
+
+        out.setPosition (0);
+        out.truncate();
+
+        const double microsPerTick = 1.0e6 / (double) juce::Time::getHighResolutionTicksPerSecond();
+        std::vector<Event> snapshot;
+        bool first = true;
+
+        out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"untracedThreads\":" << untracedThreads.load()
+            << "},\"traceEvents\":[";
+
+        for (int t = 0; t < maxThreads; ++t)
+        {
+            auto& buffer = *buffers[(size_t) t];
+
+            // Copy, then drop anything the writer may have overwritten meanwhile
+            const auto end = buffer.writeIndex.load (std::memory_order_acquire);
+
+            if (end == 0)
+                continue;
+
+            const auto begin = end > (juce::uint64) eventsPerThread ? end - eventsPerThread : 0;
+            snapshot.clear();
+
+            for (auto i = begin; i < end; ++i)
+                snapshot.push_back (buffer.events[(size_t) (i & (eventsPerThread - 1))]);
+
+            const auto after = buffer.writeIndex.load (std::memory_order_acquire);
+            const auto firstValid = after > (juce::uint64) eventsPerThread ? after - eventsPerThread : 0;
+            const auto skip = (size_t) juce::jmin<juce::uint64> (snapshot.size(), firstValid > begin ? firstValid - begin : 0);
+
+            out << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+                << ",\"args\":{\"name\":\"Thread " << t << "\"}}";
+            first = false;
+
+            for (size_t i = skip; i < snapshot.size(); ++i)
+            {
+                const auto& e = snapshot[i];
+                out << ",{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t
+                    << ",\"ts\":" << juce::String ((double) e.beginTicks * microsPerTick, 3)
+                    << ",\"dur\":" << juce::String ((double) (e.endTicks - e.beginTicks) * microsPerTick, 3) << "}";
+            }
+        }
+
+        out << "]}\n";
+    }
+
+    //==========================================================================
+    std::array<std::unique_ptr<ThreadBuffer>, maxThreads> buffers;
+    std::atomic<int> untracedThreads { 0 };
+
+    juce::CriticalSection dumpLock;
+    juce::File pendingDumpFile;
+
+    JUCE_DECLARE_NON_COPYABLE (TraceRecorder)
+};
+
+//==============================================================================
+class TraceScope
+{
+public:
+    explicit TraceScope (const char* scopeName) noexcept
+        : name (scopeName), beginTicks (juce::Time::getHighResolutionTicks()) {}
+
+    ~TraceScope()
+    {
+        TraceRecorder::getInstance().record (name, beginTicks, juce::Time::getHighResolutionTicks());
+    }
+
+private:
+    const char* name;
+    juce::int64 beginTicks;
+
+    JUCE_DECLARE_NON_COPYABLE (TraceScope)
+};
+
+ #define CHORDER_TRACE_SCOPE(name) TraceScope JUCE_JOIN_MACRO (traceScope_, __LINE__) (name)
+
+#else
+
+ #define CHORDER_TRACE_SCOPE(name)
+
+#endif
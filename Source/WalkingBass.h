@@ -0,0 +1,218 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <array>
+#include <atomic>
+#include <cstring>
+
+//==============================================================================
+// Walking bass lines for the bass layer (chordIndex -1).
+//
+// Every line is worked out up front: a chord scale for each quality
+// ChordDetector names, and from it one line per (quality, target) - root,
+// third, fifth, sixth, octave and back down, ending on a half-step approach
+// into the target root. Playing a bass note is then two table reads: the
+// target for the current chord, and the line's tone for the beat.
+//
+// The target is where the line expects to go next. A worker thread learns it
+// from the session: the audio thread posts each chord change to a FIFO, the
+// worker counts which root followed which chord and re-points that chord's
+// target at the most frequent one, so the next time the chord comes round
+// its last beat already leads into the likely next chord. A chord with no
+// history walks back to its own root.
+class WalkingBass final : private juce::Thread
+{
+public:
+    static constexpr int numQualities = 16;
+    static constexpr int numChordKeys = numQualities * 12;     // Quality x root pitch class
+    static constexpr int lineLength = 8;                        // Seven walking tones, then the approach
+    static constexpr int noChord = -1;
+
+    using Targets = std::array<juce::int8, numChordKeys>;
+
+    WalkingBass() : juce::Thread ("Walking Bass")
+    {
+        buildLines();
+
+        for (auto& target : targets)
+            target.store (0, std::memory_order_relaxed);
+
+        startThread (juce::Thread::Priority::low);
+    }
+
+    ~WalkingBass() override
+    {
+        stopThread (1000);
+    }
+
+    //==========================================================================
+    // Index of a DetectedChord quality, 0 for a single note or anything unknown
+    static int getQualityIndex (const char* quality) noexcept
+    {
+        for (int q = 1; q < numQualities; ++q)
+            if (std::strcmp (quality, qualities[(size_t) q].name) == 0)
+                return q;
+
+        return 0;
+    }
+
+    static int getChordKey (int quality, int rootNote) noexcept
+    {
+        return quality * 12 + ((rootNote % 12) + 12) % 12;
+    }
+
+    //==========================================================================
+    // Audio thread: a chord change, for the worker to learn from. Dropped if
+    // the worker has fallen behind.
+    void chordChanged (int fromKey, int toKey) noexcept
+    {
+        if (fromKey == noChord || toKey == noChord || fromKey == toKey
+             || ! learning.load (std::memory_order_relaxed))
+            return;
+
+        const auto scope = changes.write (1);
+
+        if (scope.blockSize1 > 0)
+            changeBuffer[(size_t) scope.startIndex1] = { (juce::uint8) fromKey, (juce::uint8) toKey };
+    }
+
+    // Audio thread: semitones above the plain bass note (root - 12) for the
+    // given beat of a cycle. The last beat of a cycle is the approach tone.
+    int getOffset (int chordKey, int beat, int beatsInCycle) const noexcept
+    {
+        const auto quality = (size_t) (chordKey / 12);
+        const auto target = (size_t) targets[(size_t) chordKey].load (std::memory_order_relaxed);
+        const auto& line = lines[quality][target];
+
+        if (beatsInCycle > 1 && beat >= beatsInCycle - 1)
+            return line[lineLength - 1];
+
+        return line[(size_t) juce::jlimit (0, lineLength - 2, beat)];
+    }
+
+    //==========================================================================
+    // Snapshot and restore of the learned targets, for session capture and
+    // replay. A replay turns learning off so only the captured targets apply.
+    void getTargets (Targets& dest) const noexcept
+    {
+        for (size_t i = 0; i < dest.size(); ++i)
+            dest[i] = targets[i].load (std::memory_order_relaxed);
+    }
+
+    void setTargets (const Targets& source) noexcept
+    {
+        for (size_t i = 0; i < source.size(); ++i)
+            targets[i].store ((juce::int8) juce::jlimit (0, 11, (int) source[i]), std::memory_order_relaxed);
+    }
+
+    void setLearning (bool shouldLearn) noexcept
+    {
+        learning.store (shouldLearn, std::memory_order_relaxed);
+    }
+
+private:
+    //==========================================================================
+    struct Quality
+    {
+        const char* name;
+        std::array<juce::int8, 7> scale;    // Chord scale, ascending from the root
+        int third, fifth;                   // Scale degrees the line leans on
+    };
+
+    static constexpr std::array<Quality, numQualities> qualities {{
+        { "",      { 0, 2, 4, 5, 7, 9, 10 }, 2, 4 },   // Single note or unknown: mixolydian
+        { "Maj",   { 0, 2, 4, 5, 7, 9, 11 }, 2, 4 },   // Ionian
+        { "m",     { 0, 2, 3, 5, 7, 9, 10 }, 2, 4 },   // Dorian
+        { "7",     { 0, 2, 4, 5, 7, 9, 10 }, 2, 4 },   // Mixolydian
+        { "Maj7",  { 0, 2, 4, 5, 7, 9, 11 }, 2, 4 },
+        { "m7",    { 0, 2, 3, 5, 7, 9, 10 }, 2, 4 },
+        { "m7b5",  { 0, 1, 3, 5, 6, 8, 10 }, 2, 4 },   // Locrian
+        { "mMaj7", { 0, 2, 3, 5, 7, 9, 11 }, 2, 4 },   // Melodic minor
+        { "6",     { 0, 2, 4, 5, 7, 9, 11 }, 2, 4 },
+        { "m6",    { 0, 2, 3, 5, 7, 9, 10 }, 2, 4 },
+        { "sus4",  { 0, 2, 5, 5, 7, 9, 10 }, 2, 4 },   // Mixolydian with the fourth for the third
+        { "sus2",  { 0, 2, 2, 5, 7, 9, 10 }, 2, 4 },
+        { "dim",   { 0, 2, 3, 5, 6, 8, 9 },  2, 4 },   // Whole-half diminished
+        { "aug",   { 0, 2, 4, 6, 8, 9, 11 }, 2, 4 },   // Lydian augmented
+        { "5",     { 0, 2, 4, 5, 7, 9, 10 }, 4, 4 },   // No third: stay on the fifth
+        { "chord", { 0, 2, 4, 5, 7, 9, 10 }, 4, 4 }
+    }};
+
+    using Line = std::array<juce::int8, lineLength>;
+
+    void buildLines()
+    {
+        for (size_t q = 0; q < (size_t) numQualities; ++q)
+        {
+            const auto& quality = qualities[q];
+            const auto& s = quality.scale;
+            const auto third = s[(size_t) quality.third];
+            const auto fifth = s[(size_t) quality.fifth];
+            const auto sixth = s[(size_t) quality.fifth + 1];
+
+            for (size_t target = 0; target < 12; ++target)
+            {
+                // Target in the octave nearest the root, approached by a half
+                // step from the side the line is on
+                const int nearest = target <= 6 ? (int) target : (int) target - 12;
+                const int approach = nearest >= 0 ? nearest - 1 : nearest + 1;
+
+                lines[q][target] = { 0, third, fifth, sixth, 12, sixth, fifth, (juce::int8) approach };
+            }
+        }
+    }
+
+    //==========================================================================
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait (50);
+
+            const auto scope = changes.read (changes.getNumReady());
+
+            for (int i = 0; i < scope.blockSize1; ++i)
+                learn (changeBuffer[(size_t) (scope.startIndex1 + i)]);
+
+            for (int i = 0; i < scope.blockSize2; ++i)
+                learn (changeBuffer[(size_t) (scope.startIndex2 + i)]);
+        }
+    }
+
+    struct Change
+    {
+        juce::uint8 from, to;
+    };
+
+    void learn (Change change)
+    {
+        auto& counts = transitionCounts[change.from];
+        const int interval = ((change.to % 12) - (change.from % 12) + 12) % 12;
+
+        // Halving keeps the counts bounded and lets newer habits win
+        if (++counts[(size_t) interval] == 255)
+            for (auto& count : counts)
+                count = (juce::uint8) (count / 2);
+
+        int best = targets[change.from].load (std::memory_order_relaxed);
+
+        for (int i = 0; i < 12; ++i)
+            if (counts[(size_t) i] > counts[(size_t) best])
+                best = i;
+
+        targets[change.from].store ((juce::int8) best, std::memory_order_relaxed);
+    }
+
+    //==========================================================================
+    std::array<std::array<Line, 12>, numQualities> lines {};               // Read-only after construction
+    std::array<std::atomic<juce::int8>, numChordKeys> targets;             // Written by the worker
+
+    static constexpr int fifoSize = 256;
+    juce::AbstractFifo changes { fifoSize };
+    std::array<Change, fifoSize> changeBuffer {};
+
+    std::array<std::array<juce::uint8, 12>, numChordKeys> transitionCounts {}; // Worker only
+    std::atomic<bool> learning { true };
+
+    JUCE_DECLARE_NON_COPYABLE (WalkingBass)
+};
@@ -0,0 +1,267 @@
+#include <juce_core/juce_core.h>
+#include "../../Source/ChordAnalysis.h"
+#include <fstream>
+#include <iostream>
+
+//==============================================================================
+// Batch chord labelling for MIDI corpora.
+//
+//   ChordAnalyzer [options] <file-or-directory>...
+//
+//     --format csv|jsonl    Output format (default csv)
+//     --output <file>       Write to a file instead of stdout
+//     --threads <n>         Worker threads (default: all cores)
+//     --per-track           Analyse each track on its own instead of merging
+//     --min-notes <n>       Notes that must sound together to form a chord (default 3)
+//     --include-drums       Don't skip channel 10
+//
+// Each file (or track with --per-track) is a job on a thread pool. Files are
+// memory mapped and streamed event by event, so memory per job depends on
+// the number of tracks, not the length of the file.
+//==============================================================================
+
+namespace
+{
+    struct AnalyzerSettings
+    {
+        bool jsonLines { false };
+        bool perTrack { false };
+        int numThreads { juce::SystemStats::getNumCpus() };
+        ChordFileAnalysis::Options options;
+        juce::File outputFile;
+    };
+
+    //==========================================================================
+    // Serialises segments from all workers onto one output stream
+    class SegmentWriter
+    {
+    public:
+        SegmentWriter (std::ostream& destination, bool writeJsonLines)
+            : out (destination), jsonLines (writeJsonLines)
+        {
+            if (! jsonLines)
+                out << "file,track,start,end,duration,root,quality\n";
+        }
+
+        void write (const juce::String& path, const std::vector<ChordSegment>& segments)
+        {
+            juce::String text;
+            text.preallocateBytes (segments.size() * 64);
+
+            for (const auto& s : segments)
+            {
+                if (jsonLines)
+                {
+                    text << "{\"file\":" << juce::JSON::toString (path)
+                         << ",\"track\":" << s.track
+                         << ",\"start\":" << juce::String (s.startSeconds, 4)
+                         << ",\"end\":" << juce::String (s.endSeconds, 4)
+                         << ",\"duration\":" << juce::String (s.getDuration(), 4)
+                         << ",\"root\":" << juce::JSON::toString (s.root)
+                         << ",\"quality\":" << juce::JSON::toString (s.quality) << "}\n";
+                }
+                else
+                {
+                    text << path.quoted() << ',' << s.track << ','
+                         << juce::String (s.startSeconds, 4) << ','
+                         << juce::String (s.endSeconds, 4) << ','
+                         << juce::String (s.getDuration(), 4) << ','
+                         << s.root << ',' << s.quality << '\n';
+                }
+            }
+
+            const juce::ScopedLock sl (lock);
+            out << text.toStdString();
+        }
+
+    private:
+        juce::CriticalSection lock;
+        std::ostream& out;
+        const bool jsonLines;
+    };
+
+    //==========================================================================
+    struct Totals
+    {
+        std::atomic<juce::int64> numNotes { 0 };
+        std::atomic<juce::int64> numSegments { 0 };
+        std::atomic<int> numFiles { 0 };
+        std::atomic<int> numFailed { 0 };
+    };
+
+    // Segments are flushed in batches so a long file never holds its whole
+    // label list in memory
+    constexpr size_t flushThreshold = 4096;
+
+    bool analyseFile (const juce::File& file, int track, const AnalyzerSettings& settings,
+                      SegmentWriter& writer, Totals& totals)
+    {
+        juce::MemoryMappedFile mapped (file, juce::MemoryMappedFile::readOnly);
+
+        if (mapped.getData() == nullptr)
+            return false;
+
+        const auto path = file.getFullPathName();
+        std::vector<ChordSegment> pending;
+        ChordFileAnalysis::Stats stats;
+
+        const bool ok = ChordFileAnalysis::analyse (mapped.getData(), mapped.getSize(), track, settings.options,
+                                                    [&] (const ChordSegment& segment)
+                                                    {
+                                                        pending.push_back (segment);
+
+                                                        if (pending.size() >= flushThreshold)
+                                                        {
+                                                            writer.write (path, pending);
+                                                            pending.clear();
+                                                        }
+                                                    },
+                                                    stats);
+
+        writer.write (path, pending);
+        totals.numNotes += stats.numNotes;
+        totals.numSegments += stats.numSegments;
+        return ok;
+    }
+
+    int countTracks (const juce::File& file)
+    {
+        juce::MemoryMappedFile mapped (file, juce::MemoryMappedFile::readOnly);
+        MidiFileStreamReader reader;
+
+        if (mapped.getData() == nullptr || ! reader.open (mapped.getData(), mapped.getSize()))
+            return -1;
+
+        return reader.getNumTracks();
+    }
+
+    //==========================================================================
+    void collectInputs (const juce::String& arg, juce::Array<juce::File>& files)
+    {
+        const auto f = juce::File::getCurrentWorkingDirectory().getChildFile (arg);
+
+        if (f.isDirectory())
+        {
+            for (const auto& entry : juce::RangedDirectoryIterator (f, true, "*.mid;*.midi;*.MID;*.MIDI",
+                                                                    juce::File::findFiles))
+                files.add (entry.getFile());
+        }
+        else if (f.existsAsFile())
+        {
+            files.add (f);
+        }
+        else
+        {
+            std::cerr << "Skipping missing input: " << arg << std::endl;
+        }
+    }
+
+    void printUsage()
+    {
+        std::cerr << "Usage: ChordAnalyzer [--format csv|jsonl] [--output file] [--threads n]\n"
+                     "                     [--per-track] [--min-notes n] [--include-drums]\n"
+                     "                     <file-or-directory>...\n";
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    AnalyzerSettings settings;
+    juce::Array<juce::File> inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--format" && hasValue)
+        {
+            const juce::String format (argv[++i]);
+
+            if (format != "csv" && format != "jsonl")
+            {
+                printUsage();
+                return 1;
+            }
+
+            settings.jsonLines = format == "jsonl";
+        }
+        else if (arg == "--output" && hasValue)     settings.outputFile = juce::File::getCurrentWorkingDirectory().getChildFile (argv[++i]);
+        else if (arg == "--threads" && hasValue)    settings.numThreads = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--min-notes" && hasValue)  settings.options.minimumNotes = juce::String (argv[++i]).getIntValue();
+        else if (arg == "--per-track")              settings.perTrack = true;
+        else if (arg == "--include-drums")          settings.options.includeDrums = true;
+        else if (arg.startsWith ("--"))             { printUsage(); return 1; }
+        else                                        collectInputs (arg, inputs);
+    }
+
+    if (inputs.isEmpty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::unique_ptr<std::ofstream> fileStream;
+
+    if (settings.outputFile != juce::File())
+    {
+        fileStream = std::make_unique<std::ofstream> (settings.outputFile.getFullPathName().toStdString());
+
+        if (! fileStream->is_open())
+        {
+            std::cerr << "Cannot write " << settings.outputFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+
+    SegmentWriter writer (fileStream != nullptr ? *fileStream : std::cout, settings.jsonLines);
+    Totals totals;
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    {
+        juce::ThreadPool pool (settings.numThreads);
+
+        for (const auto& file : inputs)
+        {
+            pool.addJob ([file, &settings, &writer, &totals, &pool]
+            {
+                ++totals.numFiles;
+
+                if (! settings.perTrack)
+                {
+                    if (! analyseFile (file, -1, settings, writer, totals))
+                        ++totals.numFailed;
+                    return;
+                }
+
+                const int numTracks = countTracks (file);
+
+                if (numTracks < 0)
+                {
+                    ++totals.numFailed;
+                    return;
+                }
+
+                // Fan the tracks out as separate jobs
+                for (int t = 0; t < numTracks; ++t)
+                    pool.addJob ([file, t, &settings, &writer, &totals] { analyseFile (file, t, settings, writer, totals); });
+            });
+        }
+
+        while (pool.getNumJobs() > 0)
+            juce::Thread::sleep (20);
+    }
+
+    const auto elapsedSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+    const auto numNotes = totals.numNotes.load();
+
+    std::cerr << "Files: " << totals.numFiles.load() << " (" << totals.numFailed.load() << " failed)"
+              << ", notes: " << numNotes
+              << ", segments: " << totals.numSegments.load()
+              << ", time: " << elapsedSeconds << " s"
+              << ", throughput: " << (elapsedSeconds > 0.0 ? (double) numNotes / elapsedSeconds : 0.0) << " notes/s"
+              << std::endl;
+
+    return totals.numFailed.load() > 0 ? 2 : 0;
+}
@@ -0,0 +1,274 @@
+#include <juce_core/juce_core.h>
+#include "../../Source/ChordAnalysis.h"
+#include "../../Source/ProgressionIndex.h"
+#include <iostream>
+
+//==============================================================================
+// Chord-progression search over a MIDI corpus.
+//
+//   ChordIndex build  <index-dir> <file-or-directory>...   Replace the index
+//   ChordIndex append <index-dir> <file-or-directory>...   Add a new segment
+//   ChordIndex query  <index-dir> [--exact|--family] "<progression>"
+//   ChordIndex bench  <index-dir> [--iterations n] "<progression>"...
+//
+// Progressions are chord symbols ("Dm7 G7 Cmaj7") or roman numerals
+// ("ii-V-I"). Matches are transposition invariant. Triad-only queries search
+// chord families (so "ii V I" also finds Dm7 G7 Cmaj7) unless --exact is given.
+//==============================================================================
+
+namespace
+{
+    //==========================================================================
+    // Chord sequence of one file, built from the analyser's merged-track segments
+    std::vector<ProgressionChord> extractProgression (const juce::File& file, juce::int64& numNotes)
+    {
+        std::vector<ProgressionChord> chords;
+        juce::MemoryMappedFile mapped (file, juce::MemoryMappedFile::readOnly);
+
+        if (mapped.getData() == nullptr)
+            return chords;
+
+        ChordFileAnalysis::Stats stats;
+
+        ChordFileAnalysis::analyse (mapped.getData(), mapped.getSize(), -1, {},
+                                    [&] (const ChordSegment& segment)
+                                    {
+                                        auto mask = ProgressionKeys::maskForQuality (segment.quality);
+
+                                        // Unnamed chords: use the sounding pitch classes, rotated to the root
+                                        if (mask == 0)
+                                        {
+                                            const auto pcs = (juce::uint32) segment.pitchClassMask;
+                                            const int r = segment.rootPitchClass;
+                                            mask = (juce::uint16) (((pcs >> r) | (pcs << (12 - r))) & 0x0fff);
+                                        }
+
+                                        chords.push_back ({ segment.rootPitchClass, mask });
+                                    },
+                                    stats);
+
+        numNotes += stats.numNotes;
+        return chords;
+    }
+
+    void collectInputs (const juce::String& arg, juce::Array<juce::File>& files)
+    {
+        const auto f = juce::File::getCurrentWorkingDirectory().getChildFile (arg);
+
+        if (f.isDirectory())
+        {
+            for (const auto& entry : juce::RangedDirectoryIterator (f, true, "*.mid;*.midi;*.MID;*.MIDI",
+                                                                    juce::File::findFiles))
+                files.add (entry.getFile());
+        }
+        else if (f.existsAsFile())
+        {
+            files.add (f);
+        }
+    }
+
+    //==========================================================================
+    int appendSegment (const juce::File& indexDir, const juce::StringArray& inputArgs)
+    {
+        juce::Array<juce::File> inputs;
+        for (const auto& a : inputArgs)
+            collectInputs (a, inputs);
+
+        if (inputs.isEmpty())
+        {
+            std::cerr << "No MIDI files found" << std::endl;
+            return 1;
+        }
+
+        ProgressionIndexSegmentWriter writer;
+        juce::CriticalSection writerLock;
+        std::atomic<juce::int64> numNotes { 0 };
+        const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+        {
+            juce::ThreadPool pool (juce::SystemStats::getNumCpus());
+
+            for (const auto& file : inputs)
+            {
+                pool.addJob ([file, &writer, &writerLock, &numNotes]
+                {
+                    juce::int64 notes = 0;
+                    const auto chords = extractProgression (file, notes);
+                    numNotes += notes;
+
+                    const juce::ScopedLock sl (writerLock);
+                    writer.addDocument (file.getFullPathName(), chords);
+                });
+            }
+
+            while (pool.getNumJobs() > 0)
+                juce::Thread::sleep (20);
+        }
+
+        indexDir.createDirectory();
+        const auto segmentFile = ProgressionIndex::getNextSegmentFile (indexDir);
+
+        if (! writer.writeTo (segmentFile))
+        {
+            std::cerr << "Cannot write " << segmentFile.getFullPathName() << std::endl;
+            return 1;
+        }
+
+        const auto elapsedSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+        std::cerr << "Indexed " << writer.getNumDocuments() << " files (" << numNotes.load() << " notes) into "
+                  << segmentFile.getFileName() << " in " << elapsedSeconds << " s" << std::endl;
+        return 0;
+    }
+
+    //==========================================================================
+    bool parseProgression (const juce::String& text, std::vector<ProgressionChord>& chords)
+    {
+        juce::String error;
+
+        if (! ProgressionParser::parse (text, chords, error))
+        {
+            std::cerr << error << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    ProgressionKeys::Level chooseLevel (const std::vector<ProgressionChord>& chords, int forcedLevel)
+    {
+        if (forcedLevel >= 0)
+            return (ProgressionKeys::Level) forcedLevel;
+
+        return ProgressionParser::isTriadOnly (chords) ? ProgressionKeys::Level::family
+                                                       : ProgressionKeys::Level::exact;
+    }
+
+    int runQuery (const ProgressionIndex& index, const juce::StringArray& args)
+    {
+        int forcedLevel = -1;
+        juce::String text;
+
+        for (const auto& a : args)
+        {
+            if (a == "--exact")         forcedLevel = (int) ProgressionKeys::Level::exact;
+            else if (a == "--family")   forcedLevel = (int) ProgressionKeys::Level::family;
+            else                        text << a << " ";
+        }
+
+        std::vector<ProgressionChord> chords;
+        if (! parseProgression (text, chords))
+            return 1;
+
+        const auto startTime = juce::Time::getHighResolutionTicks();
+        const auto results = index.query (chords, chooseLevel (chords, forcedLevel));
+        const auto elapsedMs = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTime) * 1000.0;
+
+        for (const auto& path : results)
+            std::cout << path << "\n";
+
+        std::cerr << results.size() << " matches in " << elapsedMs << " ms" << std::endl;
+        return 0;
+    }
+
+    //==========================================================================
+    int runBenchmark (const ProgressionIndex& index, const juce::StringArray& args)
+    {
+        int iterations = 1000;
+        juce::StringArray queries;
+
+        for (int i = 0; i < args.size(); ++i)
+        {
+            if (args[i] == "--iterations" && i + 1 < args.size())
+                iterations = juce::jmax (1, args[++i].getIntValue());
+            else
+                queries.add (args[i]);
+        }
+
+        for (const auto& text : queries)
+        {
+            std::vector<ProgressionChord> chords;
+            if (! parseProgression (text, chords))
+                return 1;
+
+            const auto level = chooseLevel (chords, -1);
+            std::vector<double> latenciesUs;
+            latenciesUs.reserve ((size_t) iterations);
+            int numResults = 0;
+
+            for (int i = 0; i < iterations; ++i)
+            {
+                const auto start = juce::Time::getHighResolutionTicks();
+                numResults = index.query (chords, level).size();
+                latenciesUs.push_back (juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start) * 1.0e6);
+            }
+
+            std::sort (latenciesUs.begin(), latenciesUs.end());
+            double total = 0.0;
+            for (auto l : latenciesUs)
+                total += l;
+
+            std::cout << text << ": " << numResults << " matches"
+                      << ", mean " << total / iterations << " us"
+                      << ", p50 " << latenciesUs[(size_t) iterations / 2] << " us"
+                      << ", p99 " << latenciesUs[(size_t) (iterations * 99 / 100)] << " us"
+                      << std::endl;
+        }
+        return 0;
+    }
+
+    void printUsage()
+    {
+        std::cerr << "Usage: ChordIndex build  <index-dir> <file-or-directory>...\n"
+                     "       ChordIndex append <index-dir> <file-or-directory>...\n"
+                     "       ChordIndex query  <index-dir> [--exact|--family] \"<progression>\"\n"
+                     "       ChordIndex bench  <index-dir> [--iterations n] \"<progression>\"...\n";
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        printUsage();
+        return 1;
+    }
+
+    const juce::String command (argv[1]);
+    const auto indexDir = juce::File::getCurrentWorkingDirectory().getChildFile (argv[2]);
+
+    juce::StringArray args;
+    for (int i = 3; i < argc; ++i)
+        args.add (juce::String (juce::CharPointer_UTF8 (argv[i])));
+
+    if (command == "build")
+    {
+        // Remove only our own segments, never anything else in the directory
+        for (const auto& f : indexDir.findChildFiles (juce::File::findFiles, false, ProgressionIndex::segmentPattern))
+            f.deleteFile();
+
+        return appendSegment (indexDir, args);
+    }
+
+    if (command == "append")
+        return appendSegment (indexDir, args);
+
+    if (command == "query" || command == "bench")
+    {
+        const auto openStart = juce::Time::getMillisecondCounterHiRes();
+        ProgressionIndex index (indexDir);
+
+        if (index.getNumSegments() == 0)
+        {
+            std::cerr << "No index segments in " << indexDir.getFullPathName() << std::endl;
+            return 1;
+        }
+
+        std::cerr << "Opened " << index.getNumSegments() << " segments in "
+                  << juce::Time::getMillisecondCounterHiRes() - openStart << " ms" << std::endl;
+
+        return command == "query" ? runQuery (index, args) : runBenchmark (index, args);
+    }
+
+    printUsage();
+    return 1;
+}
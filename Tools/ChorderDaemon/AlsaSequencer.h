@@ -0,0 +1,147 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <alsa/asoundlib.h>
+#include <poll.h>
+#include <vector>
+
+//==============================================================================
+// An ALSA sequencer client with one input and one output port.
+//
+// Works with hardware, with other applications and with virtual ports
+// (snd-virmidi, or a2jmidid for JACK MIDI), and can be patched with aconnect.
+// Reading and writing happen on different threads: the input thread owns
+// the decoder and readIncoming(); the engine thread owns the encoder and
+// send(), which writes straight to the kernel without queueing.
+class AlsaSequencer
+{
+public:
+    ~AlsaSequencer()
+    {
+        if (encoder != nullptr)  snd_midi_event_free (encoder);
+        if (decoder != nullptr)  snd_midi_event_free (decoder);
+        if (seq != nullptr)      snd_seq_close (seq);
+    }
+
+    bool open (const juce::String& clientName, juce::String& error)
+    {
+        if (const int err = snd_seq_open (&seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK); err < 0)
+        {
+            error = "Can't open the ALSA sequencer: " + juce::String (snd_strerror (err));
+            seq = nullptr;
+            return false;
+        }
+
+        snd_seq_set_client_name (seq, clientName.toRawUTF8());
+
+        inputPort = snd_seq_create_simple_port (seq, "in",
+                                                SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+                                                SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+        outputPort = snd_seq_create_simple_port (seq, "out",
+                                                 SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+                                                 SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+
+        if (inputPort < 0 || outputPort < 0
+             || snd_midi_event_new (maxEventBytes, &decoder) < 0
+             || snd_midi_event_new (maxEventBytes, &encoder) < 0)
+        {
+            error = "Can't create the ALSA sequencer ports";
+            return false;
+        }
+
+        // Decoded messages always carry their status byte
+        snd_midi_event_no_status (decoder, 1);
+
+        pollDescriptors.resize ((size_t) snd_seq_poll_descriptors_count (seq, POLLIN));
+        snd_seq_poll_descriptors (seq, pollDescriptors.data(), (unsigned int) pollDescriptors.size(), POLLIN);
+        return true;
+    }
+
+    int getClientId() const     { return snd_seq_client_id (seq); }
+
+    // Address is "client:port", or a client name
+    bool connectInputFrom (const juce::String& address, juce::String& error)
+    {
+        return connect (address, true, error);
+    }
+
+    bool connectOutputTo (const juce::String& address, juce::String& error)
+    {
+        return connect (address, false, error);
+    }
+
+    //==========================================================================
+    // Input thread: waits up to timeoutMs for input, then passes each decoded
+    // message (up to 3 bytes; sysex is skipped) to the callback
+    template <typename Callback>
+    void readIncoming (int timeoutMs, Callback&& callback)
+    {
+        if (poll (pollDescriptors.data(), (nfds_t) pollDescriptors.size(), timeoutMs) <= 0)
+            return;
+
+        snd_seq_event_t* event = nullptr;
+
+        while (snd_seq_event_input (seq, &event) >= 0 && event != nullptr)
+        {
+            juce::uint8 bytes[maxEventBytes];
+            const long numBytes = snd_midi_event_decode (decoder, bytes, maxEventBytes, event);
+
+            if (numBytes > 0 && numBytes <= 3)
+                callback (bytes, (int) numBytes);
+        }
+    }
+
+    //==========================================================================
+    // Engine thread: sends every message in the buffer now, in order
+    void send (const juce::MidiBuffer& messages)
+    {
+        for (const auto metadata : messages)
+        {
+            snd_seq_event_t event;
+            snd_seq_ev_clear (&event);
+            snd_midi_event_reset_encode (encoder);
+
+            if (snd_midi_event_encode (encoder, metadata.data, metadata.numBytes, &event) <= 0
+                 || event.type == SND_SEQ_EVENT_NONE)
+                continue;
+
+            snd_seq_ev_set_source (&event, outputPort);
+            snd_seq_ev_set_subs (&event);
+            snd_seq_ev_set_direct (&event);
+            snd_seq_event_output_direct (seq, &event);
+        }
+    }
+
+private:
+    static constexpr int maxEventBytes = 16;
+
+    bool connect (const juce::String& address, bool isInput, juce::String& error)
+    {
+        snd_seq_addr_t other;
+
+        if (snd_seq_parse_address (seq, &other, address.toRawUTF8()) < 0)
+        {
+            error = "No ALSA sequencer port '" + address + "'";
+            return false;
+        }
+
+        const int err = isInput ? snd_seq_connect_from (seq, inputPort, other.client, other.port)
+                                : snd_seq_connect_to (seq, outputPort, other.client, other.port);
+
+        if (err < 0)
+        {
+            error = "Can't connect " + address + ": " + juce::String (snd_strerror (err));
+            return false;
+        }
+
+        return true;
+    }
+
+    snd_seq_t* seq { nullptr };
+    int inputPort { -1 }, outputPort { -1 };
+    snd_midi_event_t* decoder { nullptr };
+    snd_midi_event_t* encoder { nullptr };
+    std::vector<pollfd> pollDescriptors;
+
+    JUCE_DECLARE_NON_COPYABLE (AlsaSequencer)
+};
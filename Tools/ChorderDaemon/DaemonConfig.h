@@ -0,0 +1,159 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <map>
+
+//==============================================================================
+// Daemon settings, read from an INI-style file:
+//
+//   # Engine
+//   client_name = Chorder
+//   connect_input = Keystation:0
+//   sample_rate = 48000
+//   block_size = 64
+//   realtime_priority = 70
+//
+//   [parameters]
+//   pattern = Bossa Nova
+//
+//   [program 1]
+//   pattern = Samba
+//
+// Keys before the first section configure the daemon. [parameters] holds
+// processor parameter values (by parameter ID) applied at startup, and each
+// [program N] a set applied when program change N (1-128) arrives.
+struct DaemonConfig
+{
+    juce::String clientName { "Chorder" };
+    juce::StringArray connectInputs, connectOutputs;    // ALSA addresses, e.g. "20:0" or "Keystation"
+
+    double sampleRate { 48000.0 };                      // Timeline rate; there is no audio device
+    int blockSize { 64 };
+
+    int realtimePriority { 70 };                        // SCHED_FIFO priority, 0 = normal scheduling
+    int cpu { -1 };                                     // Pin the engine thread to this CPU, -1 = don't
+    bool lockMemory { true };                           // mlockall() before starting
+
+    int programChannel { 0 };                           // Channel for program changes, 0 = any
+    double statsIntervalSeconds { 10.0 };               // 0 = no timing log
+
+    juce::StringPairArray parameters { false };
+    std::map<int, juce::StringPairArray> programs;
+
+    //==========================================================================
+    static bool load (const juce::File& file, DaemonConfig& config, juce::String& error)
+    {
+        if (! file.existsAsFile())
+        {
+            error = "Can't read " + file.getFullPathName();
+            return false;
+        }
+
+        return parse (file.loadFileAsString(), config, error);
+    }
+
+    static bool parse (const juce::String& text, DaemonConfig& config, juce::String& error)
+    {
+        enum class Section { daemon, parameters, program };
+        auto section = Section::daemon;
+        int program = 0;
+        int lineNumber = 0;
+
+        for (auto line : juce::StringArray::fromLines (text))
+        {
+            ++lineNumber;
+            line = line.upToFirstOccurrenceOf ("#", false, false).trim();
+
+            if (line.isEmpty())
+                continue;
+
+            const auto where = "line " + juce::String (lineNumber) + ": ";
+
+            if (line.startsWithChar ('[') && line.endsWithChar (']'))
+            {
+                const auto name = line.substring (1, line.length() - 1).trim();
+
+                if (name.equalsIgnoreCase ("parameters"))
+                {
+                    section = Section::parameters;
+                }
+                else if (name.startsWithIgnoreCase ("program ")
+                          && name.fromFirstOccurrenceOf (" ", false, false).trim().containsOnly ("0123456789"))
+                {
+                    program = name.fromFirstOccurrenceOf (" ", false, false).getIntValue();
+
+                    if (program < 1 || program > 128)
+                    {
+                        error = where + "program numbers run from 1 to 128";
+                        return false;
+                    }
+
+                    section = Section::program;
+                    config.programs[program] = juce::StringPairArray (false);
+                }
+                else
+                {
+                    error = where + "unknown section [" + name + "]";
+                    return false;
+                }
+
+                continue;
+            }
+
+            if (! line.containsChar ('='))
+            {
+                error = where + "expected key = value";
+                return false;
+            }
+
+            const auto key = line.upToFirstOccurrenceOf ("=", false, false).trim();
+            const auto value = line.fromFirstOccurrenceOf ("=", false, false).trim().unquoted();
+
+            switch (section)
+            {
+                case Section::parameters:   config.parameters.set (key, value); break;
+                case Section::program:      config.programs[program].set (key, value); break;
+
+                case Section::daemon:
+                    if (! setDaemonKey (config, key, value))
+                    {
+                        error = where + "unknown setting '" + key + "'";
+                        return false;
+                    }
+                    break;
+            }
+        }
+
+        if (config.sampleRate < 8000.0 || config.blockSize < 8 || config.blockSize > 4096)
+        {
+            error = "sample_rate must be at least 8000 and block_size 8 to 4096";
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    static bool parseBool (const juce::String& value)
+    {
+        return value.equalsIgnoreCase ("yes") || value.equalsIgnoreCase ("true")
+            || value.equalsIgnoreCase ("on") || value == "1";
+    }
+
+    static bool setDaemonKey (DaemonConfig& config, const juce::String& key, const juce::String& value)
+    {
+        if      (key == "client_name")          config.clientName = value;
+        else if (key == "connect_input")        config.connectInputs.add (value);
+        else if (key == "connect_output")       config.connectOutputs.add (value);
+        else if (key == "sample_rate")          config.sampleRate = value.getDoubleValue();
+        else if (key == "block_size")           config.blockSize = value.getIntValue();
+        else if (key == "realtime_priority")    config.realtimePriority = juce::jlimit (0, 99, value.getIntValue());
+        else if (key == "cpu")                  config.cpu = value.getIntValue();
+        else if (key == "lock_memory")          config.lockMemory = parseBool (value);
+        else if (key == "program_channel")      config.programChannel = juce::jlimit (0, 16, value.getIntValue());
+        else if (key == "stats_interval")       config.statsIntervalSeconds = juce::jmax (0.0, value.getDoubleValue());
+        else                                    return false;
+
+        return true;
+    }
+};
@@ -0,0 +1,497 @@
+#include <juce_audio_utils/juce_audio_utils.h>
+#include "../../Source/PluginProcessor.h"
+#include "AlsaSequencer.h"
+#include "DaemonConfig.h"
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+
+//==============================================================================
+// Headless chord pattern daemon for Linux.
+//
+//   ChorderDaemon [--config file] [--check]
+//
+// Hosts the processor without an editor or audio device. MIDI comes and goes
+// through ALSA sequencer ports; the engine runs one block per period on a
+// SCHED_FIFO thread (optionally pinned to a CPU, with memory locked), against
+// a virtual sample clock. Input is timestamped on arrival and placed at the
+// matching sample in the next block, so timing within a block is kept at the
+// cost of one block of latency.
+//
+// Try it without hardware:
+//
+//   ChorderDaemon --config chorder-daemon.conf &
+//   aconnect <keyboard or vkbd port> Chorder:0
+//   aseqdump -p Chorder:1
+//
+// --check parses the config and resolves every parameter, then exits.
+//==============================================================================
+
+namespace
+{
+    std::atomic<bool> quitRequested { false };
+
+    void handleSignal (int)
+    {
+        quitRequested = true;
+    }
+
+    juce::int64 nowNs()
+    {
+        timespec ts;
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (juce::int64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    timespec toTimespec (juce::int64 ns)
+    {
+        return { (time_t) (ns / 1000000000), (long) (ns % 1000000000) };
+    }
+
+    //==========================================================================
+    // Parameter values resolved once, so applying a preset is just stores
+    using Preset = std::vector<std::pair<juce::RangedAudioParameter*, float>>;
+    using ProgramPresets = std::array<Preset, 128>;
+
+    juce::RangedAudioParameter* findParameter (juce::AudioProcessor& processor, const juce::String& id)
+    {
+        for (auto* p : processor.getParameters())
+            if (auto* ranged = dynamic_cast<juce::RangedAudioParameter*> (p))
+                if (ranged->getParameterID() == id)
+                    return ranged;
+
+        return nullptr;
+    }
+
+    bool resolvePreset (juce::AudioProcessor& processor, const juce::StringPairArray& values,
+                        Preset& preset, juce::String& error)
+    {
+        for (const auto& id : values.getAllKeys())
+        {
+            auto* param = findParameter (processor, id);
+            const auto text = values[id];
+
+            if (param == nullptr)
+            {
+                error = "Unknown parameter '" + id + "'";
+                return false;
+            }
+
+            float value = 0.0f;
+
+            if (auto* choice = dynamic_cast<juce::AudioParameterChoice*> (param);
+                choice != nullptr && choice->choices.contains (text, true))
+                value = (float) choice->choices.indexOf (text, true);
+            else if (dynamic_cast<juce::AudioParameterBool*> (param) != nullptr && ! text.containsOnly ("0123456789"))
+                value = text.equalsIgnoreCase ("on") || text.equalsIgnoreCase ("yes") || text.equalsIgnoreCase ("true") ? 1.0f : 0.0f;
+            else if (text.isNotEmpty() && text.containsOnly ("0123456789.-+"))
+                value = text.getFloatValue();
+            else
+            {
+                error = "Bad value '" + text + "' for " + id;
+                return false;
+            }
+
+            const auto& range = param->getNormalisableRange();
+            preset.emplace_back (param, param->convertTo0to1 (juce::jlimit (range.start, range.end, value)));
+        }
+
+        return true;
+    }
+
+    // Before the engine starts, or on the engine thread between blocks, so a
+    // block never renders with half a preset applied. There is no host to
+    // notify.
+    void applyPreset (const Preset& preset)
+    {
+        for (const auto& [param, value] : preset)
+            param->setValue (value);
+    }
+
+    //==========================================================================
+    // Engine timing, written by the engine thread and collected by the logger
+    struct TimingStats
+    {
+        std::atomic<juce::int64> blocks { 0 };
+        std::atomic<juce::int64> overruns { 0 };            // Blocks that finished after their deadline
+        std::atomic<juce::int64> totalProcessNs { 0 };
+        std::atomic<juce::int64> maxProcessNs { 0 };
+        std::atomic<juce::int64> maxWakeLatencyNs { 0 };
+        std::atomic<juce::int64> inputOverflows { 0 };
+
+        static void updateMax (std::atomic<juce::int64>& max, juce::int64 value)
+        {
+            if (value > max.load (std::memory_order_relaxed))
+                max.store (value, std::memory_order_relaxed);
+        }
+    };
+
+    //==========================================================================
+    class Daemon final : private juce::Timer
+    {
+    public:
+        Daemon (const DaemonConfig& c, AudioPluginAudioProcessor& p, AlsaSequencer& s, const ProgramPresets& presets)
+            : config (c), processor (p), sequencer (s), programs (presets)
+        {
+        }
+
+        ~Daemon() override
+        {
+            stop();
+        }
+
+        void start()
+        {
+            startEngineThread();
+            inputThread = std::thread ([this] { runInput(); });
+            startTimer (100);
+        }
+
+        void stop()
+        {
+            stopTimer();
+            shouldStop = true;
+
+            if (inputThread.joinable())
+                inputThread.join();
+
+            if (engineThreadRunning)
+            {
+                pthread_join (engineThread, nullptr);
+                engineThreadRunning = false;
+            }
+        }
+
+    private:
+        //======================================================================
+        struct InputEvent
+        {
+            juce::int64 timeNs;
+            juce::uint8 bytes[3];
+            int numBytes;
+        };
+
+        static constexpr int inputFifoSize = 4096;
+
+        // The preset a program change selects, or nullptr if it isn't one
+        // the daemon handles
+        const Preset* getProgramPreset (const juce::uint8* bytes, int numBytes) const
+        {
+            const int channel = (bytes[0] & 0x0f) + 1;
+
+            if ((bytes[0] & 0xf0) != 0xc0 || numBytes < 2
+                 || (config.programChannel != 0 && config.programChannel != channel))
+                return nullptr;
+
+            return &programs[(size_t) (bytes[1] & 0x7f)];
+        }
+
+        //======================================================================
+        // Input thread: timestamps incoming MIDI for the engine. Program
+        // changes are queued with it and applied by the engine.
+        void runInput()
+        {
+            while (! shouldStop)
+            {
+                sequencer.readIncoming (50, [this] (const juce::uint8* bytes, int numBytes)
+                {
+                    const auto time = nowNs();
+
+                    if (const auto* preset = getProgramPreset (bytes, numBytes))
+                    {
+                        if (preset->empty())
+                            return;
+
+                        std::cout << "Program " << (bytes[1] & 0x7f) + 1 << std::endl;
+                    }
+
+                    const auto scope = inputFifo.write (1);
+
+                    if (scope.blockSize1 + scope.blockSize2 == 0)
+                    {
+                        stats.inputOverflows.fetch_add (1, std::memory_order_relaxed);
+                        return;
+                    }
+
+                    scope.forEach ([&] (int index)
+                    {
+                        auto& event = inputEvents[(size_t) index];
+                        event.timeNs = time;
+                        event.numBytes = numBytes;
+                        std::copy (bytes, bytes + numBytes, event.bytes);
+                    });
+                });
+            }
+        }
+
+        //======================================================================
+        void startEngineThread()
+        {
+            pthread_attr_t attributes;
+            pthread_attr_init (&attributes);
+
+            if (config.realtimePriority > 0)
+            {
+                sched_param param {};
+                param.sched_priority = config.realtimePriority;
+                pthread_attr_setinheritsched (&attributes, PTHREAD_EXPLICIT_SCHED);
+                pthread_attr_setschedpolicy (&attributes, SCHED_FIFO);
+                pthread_attr_setschedparam (&attributes, &param);
+            }
+
+            auto entry = [] (void* daemon) -> void* { static_cast<Daemon*> (daemon)->runEngine(); return nullptr; };
+            int err = pthread_create (&engineThread, &attributes, entry, this);
+
+            if (err == EPERM)
+            {
+                std::cerr << "No permission for SCHED_FIFO (check rtprio in limits.conf); "
+                             "running the engine at normal priority" << std::endl;
+                err = pthread_create (&engineThread, nullptr, entry, this);
+            }
+
+            pthread_attr_destroy (&attributes);
+            engineThreadRunning = err == 0;
+
+            if (err != 0)
+            {
+                std::cerr << "Can't start the engine thread: " << std::strerror (err) << std::endl;
+                quitRequested = true;
+            }
+        }
+
+        // Engine thread: one block per period, on an absolute schedule
+        void runEngine()
+        {
+            if (config.cpu >= 0)
+            {
+                cpu_set_t cpus;
+                CPU_ZERO (&cpus);
+                CPU_SET (config.cpu, &cpus);
+
+                if (pthread_setaffinity_np (pthread_self(), sizeof (cpus), &cpus) != 0)
+                    std::cerr << "Can't pin the engine thread to CPU " << config.cpu << std::endl;
+            }
+
+            // Fault the stack in now rather than on the first deep call
+            {
+                volatile char stackPrefault[128 * 1024];
+                for (size_t i = 0; i < sizeof (stackPrefault); i += 4096)
+                    stackPrefault[i] = 0;
+            }
+
+            const int blockSize = config.blockSize;
+            const auto periodNs = (juce::int64) std::llround (blockSize * 1.0e9 / config.sampleRate);
+            const double samplesPerNs = config.sampleRate * 1.0e-9;
+
+            juce::AudioBuffer<float> buffer (2, blockSize);
+            juce::MidiBuffer midi;
+            midi.ensureSize (16 * 1024);
+
+            auto deadline = nowNs() + periodNs;
+
+            while (! shouldStop)
+            {
+                const auto wakeTime = toTimespec (deadline);
+                clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeTime, nullptr);
+
+                const auto woke = nowNs();
+                const auto blockStart = deadline - periodNs;
+                TimingStats::updateMax (stats.maxWakeLatencyNs, woke - deadline);
+
+                // Input that arrived during the last period. Program changes
+                // take effect from the start of this block.
+                midi.clear();
+                const auto scope = inputFifo.read (inputFifo.getNumReady());
+
+                scope.forEach ([&] (int index)
+                {
+                    const auto& event = inputEvents[(size_t) index];
+
+                    if (const auto* preset = getProgramPreset (event.bytes, event.numBytes))
+                    {
+                        applyPreset (*preset);
+                        return;
+                    }
+
+                    const int position = juce::jlimit (0, blockSize - 1,
+                                                       (int) ((double) (event.timeNs - blockStart) * samplesPerNs));
+                    midi.addEvent (event.bytes, event.numBytes, position);
+                });
+
+                buffer.clear();
+                processor.processBlock (buffer, midi);
+                sequencer.send (midi);
+
+                const auto finished = nowNs();
+                const auto processNs = finished - woke;
+                stats.blocks.fetch_add (1, std::memory_order_relaxed);
+                stats.totalProcessNs.fetch_add (processNs, std::memory_order_relaxed);
+                TimingStats::updateMax (stats.maxProcessNs, processNs);
+
+                deadline += periodNs;
+
+                // Missed a whole period: count it and restart the schedule
+                // rather than running a burst of catch-up blocks
+                if (finished > deadline)
+                {
+                    stats.overruns.fetch_add (1, std::memory_order_relaxed);
+                    deadline = finished + periodNs;
+                }
+            }
+        }
+
+        //======================================================================
+        // Message thread
+        void timerCallback() override
+        {
+            if (quitRequested)
+            {
+                juce::MessageManager::getInstance()->stopDispatchLoop();
+                return;
+            }
+
+            const auto now = juce::Time::getMillisecondCounterHiRes();
+
+            if (config.statsIntervalSeconds > 0.0 && now - lastStatsTime >= config.statsIntervalSeconds * 1000.0)
+            {
+                lastStatsTime = now;
+                logStats();
+            }
+        }
+
+        void logStats()
+        {
+            const auto blocks = stats.blocks.exchange (0);
+            const auto totalNs = stats.totalProcessNs.exchange (0);
+            const auto periodUs = config.blockSize * 1.0e6 / config.sampleRate;
+
+            std::cout << juce::Time::getCurrentTime().toISO8601 (true)
+                      << " blocks " << blocks
+                      << ", process avg " << juce::String (blocks > 0 ? totalNs / 1000.0 / (double) blocks : 0.0, 1)
+                      << " us, max " << juce::String (stats.maxProcessNs.exchange (0) / 1000.0, 1)
+                      << " us (period " << juce::String (periodUs, 1)
+                      << " us), wake latency max " << juce::String (stats.maxWakeLatencyNs.exchange (0) / 1000.0, 1)
+                      << " us, overruns " << stats.overruns.exchange (0)
+                      << ", input overflows " << stats.inputOverflows.exchange (0) << std::endl;
+        }
+
+        //======================================================================
+        const DaemonConfig& config;
+        AudioPluginAudioProcessor& processor;
+        AlsaSequencer& sequencer;
+
+        const ProgramPresets& programs;
+
+        juce::AbstractFifo inputFifo { inputFifoSize };
+        std::array<InputEvent, inputFifoSize> inputEvents {};
+
+        std::atomic<bool> shouldStop { false };
+        std::thread inputThread;
+        pthread_t engineThread {};
+        bool engineThreadRunning { false };
+
+        TimingStats stats;
+        double lastStatsTime { 0.0 };
+    };
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::File configFile;
+    bool checkOnly = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+
+        if (arg == "--config" && i + 1 < argc)  configFile = juce::File::getCurrentWorkingDirectory().getChildFile (argv[++i]);
+        else if (arg == "--check")              checkOnly = true;
+        else
+        {
+            std::cerr << "Usage: ChorderDaemon [--config file] [--check]\n";
+            return 2;
+        }
+    }
+
+    DaemonConfig config;
+    juce::String error;
+
+    if (configFile != juce::File() && ! DaemonConfig::load (configFile, config, error))
+    {
+        std::cerr << configFile.getFileName() << ": " << error << std::endl;
+        return 1;
+    }
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;   // Message loop only; no windows are created
+
+    AudioPluginAudioProcessor processor;
+    Preset startupValues;
+    ProgramPresets programs;
+
+    if (! resolvePreset (processor, config.parameters, startupValues, error))
+    {
+        std::cerr << "[parameters] " << error << std::endl;
+        return 1;
+    }
+
+    for (const auto& [program, values] : config.programs)
+    {
+        if (! resolvePreset (processor, values, programs[(size_t) program - 1], error))
+        {
+            std::cerr << "[program " << program << "] " << error << std::endl;
+            return 1;
+        }
+    }
+
+    if (checkOnly)
+    {
+        std::cout << "Config OK" << std::endl;
+        return 0;
+    }
+
+    AlsaSequencer sequencer;
+
+    if (! sequencer.open (config.clientName, error))
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    for (const auto& address : config.connectInputs)
+        if (! sequencer.connectInputFrom (address, error))
+            std::cerr << error << std::endl;
+
+    for (const auto& address : config.connectOutputs)
+        if (! sequencer.connectOutputTo (address, error))
+            std::cerr << error << std::endl;
+
+    applyPreset (startupValues);
+    processor.setRateAndBufferSizeDetails (config.sampleRate, config.blockSize);
+    processor.prepareToPlay (config.sampleRate, config.blockSize);
+
+    if (config.lockMemory && mlockall (MCL_CURRENT | MCL_FUTURE) != 0)
+        std::cerr << "mlockall failed (check memlock in limits.conf); memory may page out" << std::endl;
+
+    std::signal (SIGINT, handleSignal);
+    std::signal (SIGTERM, handleSignal);
+
+    std::cout << "Chord Pattern Player daemon on ALSA client " << sequencer.getClientId()
+              << " (" << config.clientName << "), " << config.blockSize << " samples at "
+              << config.sampleRate << " Hz" << std::endl;
+
+    {
+        Daemon daemon (config, processor, sequencer, programs);
+        daemon.start();
+        juce::MessageManager::getInstance()->runDispatchLoop();
+    }
+
+    processor.releaseResources();
+    std::cout << "Stopped" << std::endl;
+    return 0;
+}
@@ -0,0 +1,317 @@
+#include <juce_audio_utils/juce_audio_utils.h>
+#include "../../Source/PluginProcessor.h"
+#include <algorithm>
+#include <iostream>
+
+//==============================================================================
+// MIDI flood stress run for the overload guard.
+//
+//   FloodStress [--blocks n] [--block-size n] [--events n] [--limit-ms x] [--seed n]
+//
+// Holds a chord on every channel in per-channel mode, so all 16 engines play,
+// and times processBlock in three phases:
+//
+//   baseline  ordinary playing, a few events a block
+//   flood     --events messages a block: note-ons, duplicates, note-offs,
+//             pedals, mode messages, pitch bend, pressure and clock, all
+//             channels at once
+//   release   every key and pedal let go, then two seconds of silence
+//
+// The whole run is done three times, on a fresh processor each time: once
+// with plain output; once through the DIN output stage, whose wire falls far
+// behind a flood and has to queue and shed events across blocks; and once
+// following an external MIDI clock at 120 bpm that keeps ticking through
+// all three phases.
+//
+// The output is followed note by note throughout. A pass fails if the worst
+// flood block takes longer than --limit-ms (by default the block's own
+// duration at 48 kHz) or if any note is still sounding at the end, which
+// would mean a note-off was lost. The clock pass also fails if the followed
+// beat position is more than half a tick off after the flood, which would
+// mean clock ticks were lost. The run exits with 1 if any pass fails.
+//==============================================================================
+
+namespace
+{
+    struct PhaseTimes
+    {
+        std::vector<double> blockMs;
+
+        void report (const char* name)
+        {
+            std::sort (blockMs.begin(), blockMs.end());
+
+            const auto percentile = [this] (double p)
+            {
+                return blockMs.empty() ? 0.0 : blockMs[(size_t) juce::jlimit (0, (int) blockMs.size() - 1, (int) (p * (double) blockMs.size()))];
+            };
+
+            std::cout << "  " << name << ": " << blockMs.size() << " blocks, processBlock ms p50 " << percentile (0.5)
+                      << ", p99 " << percentile (0.99) << ", max " << (blockMs.empty() ? 0.0 : blockMs.back()) << "\n";
+        }
+
+        double getMax() const   { return blockMs.empty() ? 0.0 : *std::max_element (blockMs.begin(), blockMs.end()); }
+    };
+
+    // Which output notes are sounding, per channel
+    struct OutputNotes
+    {
+        std::array<std::array<bool, 128>, 16> sounding {};
+
+        void follow (const juce::MidiBuffer& output)
+        {
+            for (const auto metadata : output)
+            {
+                const auto* data = metadata.data;
+
+                if (metadata.numBytes != 3 || data[0] >= 0xf0)
+                    continue;
+
+                auto& channel = sounding[(size_t) (data[0] & 0x0f)];
+
+                if ((data[0] & 0xf0) == 0x90 && data[2] > 0)
+                    channel[(size_t) data[1]] = true;
+                else if ((data[0] & 0xf0) == 0x80 || (data[0] & 0xf0) == 0x90)
+                    channel[(size_t) data[1]] = false;
+                else if ((data[0] & 0xf0) == 0xb0 && data[1] >= 120)
+                    channel.fill (false);
+            }
+        }
+
+        int count() const
+        {
+            int n = 0;
+
+            for (const auto& channel : sounding)
+                n += (int) std::count (channel.begin(), channel.end(), true);
+
+            return n;
+        }
+    };
+
+    struct Options
+    {
+        int numBlocks { 20000 };
+        int blockSize { 64 };
+        int eventsPerBlock { 4000 };
+        double limitMs { -1.0 };
+        juce::int64 seed { 1 };
+    };
+
+    // One full baseline, flood and release run on a fresh processor. True if
+    // it passed.
+    bool runPass (const Options& options, bool dinOutput, bool clockFollow)
+    {
+        constexpr double sampleRate = 48000.0;
+        const int numBlocks = options.numBlocks;
+        const int blockSize = options.blockSize;
+        const int eventsPerBlock = options.eventsPerBlock;
+        const double limitMs = options.limitMs > 0.0 ? options.limitMs : blockSize * 1000.0 / sampleRate;
+        const juce::int64 seed = options.seed;
+
+        AudioPluginAudioProcessor processor;
+        processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+        processor.prepareToPlay (sampleRate, blockSize);
+        *processor.inputModeParam = AudioPluginAudioProcessor::perChannelMode;
+        *processor.tempoParam = 240.0f;
+        *processor.dinOutputParam = dinOutput;
+        *processor.clockModeParam = clockFollow ? AudioPluginAudioProcessor::clockFollow
+                                                : AudioPluginAudioProcessor::clockOff;
+
+        // Host-side buffers are sized up front, as a real host's would be
+        juce::AudioBuffer<float> buffer (2, blockSize);
+        juce::MidiBuffer midi;
+        midi.ensureSize ((size_t) juce::jmax (64 * 1024, eventsPerBlock * 16));
+
+        juce::Random rng (seed);
+        OutputNotes output;
+        std::array<std::array<bool, 128>, 16> held {};
+
+        // External clock for the clock pass: start, then a tick every 1000
+        // samples (120 bpm at 48 kHz) from the first sample on
+        constexpr double samplesPerTick = sampleRate * 60.0 / (120.0 * MidiClockFollower::ticksPerBeat);
+        juce::int64 blockStart = 0;
+        double nextTick = 0.0;
+
+        const auto runBlock = [&] (PhaseTimes& times)
+        {
+            if (clockFollow)
+            {
+                if (blockStart == 0)
+                    midi.addEvent (juce::MidiMessage::midiStart(), 0);
+
+                for (; nextTick < (double) (blockStart + blockSize); nextTick += samplesPerTick)
+                    midi.addEvent (juce::MidiMessage::midiClock(), (int) (nextTick - (double) blockStart));
+            }
+
+            buffer.clear();
+            const auto start = juce::Time::getHighResolutionTicks();
+            processor.processBlock (buffer, midi);
+            times.blockMs.push_back (juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start) * 1000.0);
+            output.follow (midi);
+            midi.clear();
+            blockStart += blockSize;
+        };
+
+        const auto addNoteOn = [&] (int channel, int note, int position)
+        {
+            midi.addEvent (juce::MidiMessage::noteOn (channel + 1, note, (juce::uint8) (40 + rng.nextInt (88))), position);
+            held[(size_t) channel][(size_t) note] = true;
+        };
+
+        // Baseline: a triad on every channel, changing now and then
+        PhaseTimes baseline;
+
+        for (int block = 0; block < numBlocks / 4; ++block)
+        {
+            if (block % 200 == 0)
+            {
+                for (int channel = 0; channel < 16; ++channel)
+                {
+                    for (int note = 0; note < 128; ++note)
+                        if (std::exchange (held[(size_t) channel][(size_t) note], false))
+                            midi.addEvent (juce::MidiMessage::noteOff (channel + 1, note), 0);
+
+                    const int root = 48 + rng.nextInt (12);
+
+                    for (int interval : { 0, 4, 7 })
+                        addNoteOn (channel, root + interval, 1);
+                }
+            }
+
+            runBlock (baseline);
+        }
+
+        // Flood: everything at once, on every channel
+        PhaseTimes flood;
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            for (int i = 0; i < eventsPerBlock; ++i)
+            {
+                const int channel = rng.nextInt (16);
+                const int note = 24 + rng.nextInt (84);
+                const int position = rng.nextInt (blockSize);
+                const int kind = rng.nextInt (100);
+
+                if (kind < 35)
+                    addNoteOn (channel, note, position);
+                else if (kind < 50)
+                    addNoteOn (channel, 48 + rng.nextInt (12), position);     // Mostly duplicates
+                else if (kind < 60)
+                {
+                    midi.addEvent (juce::MidiMessage::noteOff (channel + 1, note), position);
+                    held[(size_t) channel][(size_t) note] = false;
+                }
+                else if (kind < 70)
+                    midi.addEvent (juce::MidiMessage::controllerEvent (channel + 1, rng.nextBool() ? 64 : 66, rng.nextBool() ? 127 : 0), position);
+                else if (kind < 72)
+                    midi.addEvent (juce::MidiMessage::controllerEvent (channel + 1, 121, 0), position);
+                else if (kind < 85)
+                    midi.addEvent (juce::MidiMessage::pitchWheel (channel + 1, rng.nextInt (16384)), position);
+                else if (kind < 95)
+                    midi.addEvent (juce::MidiMessage::controllerEvent (channel + 1, 1, rng.nextInt (128)), position);
+                else
+                    midi.addEvent (juce::MidiMessage::channelPressureChange (channel + 1, rng.nextInt (128)), position);
+            }
+
+            if (! clockFollow)
+                midi.addEvent (juce::MidiMessage::midiClock(), rng.nextInt (blockSize));
+
+            runBlock (flood);
+        }
+
+        // Where the clock follower put the last flood block's start
+        const double clockErrorTicks = std::abs (processor.getClockBeat() * MidiClockFollower::ticksPerBeat
+                                                  - (double) (blockStart - blockSize) / samplesPerTick);
+        const bool clockLocked = processor.isClockLocked();
+
+        // Release: every key and pedal let go, then let the patterns run out
+        PhaseTimes release;
+
+        for (int channel = 0; channel < 16; ++channel)
+        {
+            for (int note = 0; note < 128; ++note)
+                if (std::exchange (held[(size_t) channel][(size_t) note], false))
+                    midi.addEvent (juce::MidiMessage::noteOff (channel + 1, note), 0);
+
+            midi.addEvent (juce::MidiMessage::controllerEvent (channel + 1, 64, 0), 0);
+            midi.addEvent (juce::MidiMessage::controllerEvent (channel + 1, 66, 0), 0);
+        }
+
+        // A backed-up DIN wire takes a few seconds to drain at 31.25 kbaud
+        const double releaseSeconds = dinOutput ? 8.0 : 2.0;
+
+        for (int block = 0; block < (int) (releaseSeconds * sampleRate) / blockSize; ++block)
+            runBlock (release);
+
+        processor.releaseResources();
+
+        std::cout << "DIN output " << (dinOutput ? "on" : "off") << ", clock follow " << (clockFollow ? "on" : "off")
+                  << ": block size " << blockSize << " at 48 kHz (" << limitMs << " ms limit), "
+                  << eventsPerBlock << " events a flood block\n";
+        baseline.report ("baseline");
+        flood.report ("flood");
+        release.report ("release");
+
+        std::cout << "  Shed: " << processor.getShedEvents (OverloadGuard::inputStage) << " input, "
+                  << processor.getShedEvents (OverloadGuard::outputStage) << " output, "
+                  << processor.getShedEvents (OverloadGuard::scheduleStage) << " scheduled";
+
+        if (dinOutput)
+            std::cout << ", " << processor.getDinDroppedNotes() << " over the DIN jitter budget, "
+                      << processor.getDinShedEvents() << " DIN backlog";
+
+        std::cout << "\n";
+
+        if (clockFollow)
+            std::cout << "  Clock: " << clockErrorTicks << " ticks off after the flood, "
+                      << (clockLocked ? "locked" : "not locked") << "\n";
+
+        const int stuck = output.count();
+        const bool withinLimit = flood.getMax() <= limitMs;
+        const bool inPhase = ! clockFollow || (clockLocked && clockErrorTicks <= 0.5);
+
+        if (stuck > 0)
+            std::cout << "FAIL: " << stuck << " notes still sounding after the release\n";
+
+        if (! withinLimit)
+            std::cout << "FAIL: worst flood block took " << flood.getMax() << " ms\n";
+
+        if (! inPhase)
+            std::cout << "FAIL: the followed clock lost its phase during the flood\n";
+
+        return stuck == 0 && withinLimit && inPhase;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--blocks" && hasValue)          options.numBlocks = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--block-size" && hasValue) options.blockSize = juce::jlimit (16, 4096, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--events" && hasValue)     options.eventsPerBlock = juce::jmax (0, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--limit-ms" && hasValue)   options.limitMs = juce::String (argv[++i]).getDoubleValue();
+        else if (arg == "--seed" && hasValue)       options.seed = juce::String (argv[++i]).getLargeIntValue();
+        else
+        {
+            std::cerr << "Usage: FloodStress [--blocks n] [--block-size n] [--events n] [--limit-ms x] [--seed n]\n";
+            return 2;
+        }
+    }
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    const bool plainPassed = runPass (options, false, false);
+    const bool dinPassed = runPass (options, true, false);
+    const bool clockPassed = runPass (options, false, true);
+
+    return plainPassed && dinPassed && clockPassed ? 0 : 1;
+}
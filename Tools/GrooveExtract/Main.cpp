@@ -0,0 +1,258 @@
+#include <juce_core/juce_core.h>
+#include "../../Source/GrooveExtraction.h"
+#include "../../Source/PatternScript.h"
+#include <iostream>
+#include <map>
+
+//==============================================================================
+// Turns MIDI comping loops into patterns.
+//
+//   GrooveExtract [options] <file-or-directory>...
+//
+//     --output <dir>        Where to write (default ./Grooves)
+//     --grid <n>            Steps per beat to quantise to (default 0: the coarsest that fits)
+//     --cluster <beats>     Onsets this close form one hit (default 0.06)
+//     --bass-below <note>   A hit's lowest note below this plays the bass (default 52)
+//     --threads <n>         Worker threads (default: all cores)
+//     --include-drums       Don't skip channel 10
+//
+// Each loop is a job on a thread pool. For <name>.mid it writes <name>.txt,
+// a pattern script that plays the quantised pattern (paste it into the
+// Script pattern's editor), headed by the chord the roles were read
+// against and the swing. grooves.jsonl gets one line per loop with the
+// pattern notes as [beat, chord index, velocity, duration] and the groove
+// template, in file name order.
+//==============================================================================
+
+namespace
+{
+    struct ExtractSettings
+    {
+        GrooveExtraction::Options options;
+        juce::File outputDirectory { juce::File::getCurrentWorkingDirectory().getChildFile ("Grooves") };
+        int numThreads { juce::SystemStats::getNumCpus() };
+    };
+
+    struct Totals
+    {
+        std::atomic<int> numFiles { 0 };
+        std::atomic<int> numFailed { 0 };
+        std::atomic<juce::int64> numNotes { 0 };
+        std::atomic<juce::int64> numHits { 0 };
+    };
+
+    //==========================================================================
+    // Collects the index lines from all workers, to be written in order
+    class GrooveIndex
+    {
+    public:
+        void add (const juce::String& path, const juce::String& line)
+        {
+            const juce::ScopedLock sl (lock);
+            lines[path] = line;
+        }
+
+        bool writeTo (const juce::File& file) const
+        {
+            juce::String text;
+
+            for (const auto& [path, line] : lines)
+                text << line << "\n";
+
+            return file.replaceWithText (text);
+        }
+
+    private:
+        juce::CriticalSection lock;
+        std::map<juce::String, juce::String> lines;
+    };
+
+    juce::var toJson (const juce::File& file, const ExtractedLoop& loop)
+    {
+        juce::Array<juce::var> notes, offsets, velocities;
+
+        for (const auto& note : loop.pattern.notes)
+            notes.add (juce::Array<juce::var> { note.beatPosition, note.chordIndex, note.velocity, note.duration });
+
+        for (auto offset : loop.groove.offsets)
+            offsets.add (juce::roundToInt (offset * 1000.0f) / 1000.0);
+
+        for (auto velocity : loop.groove.velocities)
+            velocities.add (juce::roundToInt (velocity * 100.0f) / 100.0);
+
+        auto* groove = new juce::DynamicObject();
+        groove->setProperty ("stepsPerBeat", loop.groove.stepsPerBeat);
+        groove->setProperty ("swing", juce::roundToInt (loop.groove.swing * 10.0f) / 10.0);
+        groove->setProperty ("offsets", offsets);
+        groove->setProperty ("velocities", velocities);
+
+        auto* json = new juce::DynamicObject();
+        json->setProperty ("file", file.getFullPathName());
+        json->setProperty ("name", loop.pattern.name);
+        json->setProperty ("chord", loop.chordName);
+        json->setProperty ("lengthInBeats", loop.pattern.lengthInBeats);
+        json->setProperty ("notes", notes);
+        json->setProperty ("groove", groove);
+        return json;
+    }
+
+    // Returns an error message, or an empty string on success
+    juce::String extractFile (const juce::File& file, const juce::String& name, const ExtractSettings& settings,
+                              GrooveIndex& index, Totals& totals)
+    {
+        juce::MemoryMappedFile mapped (file, juce::MemoryMappedFile::readOnly);
+
+        if (mapped.getData() == nullptr)
+            return "Can't read the file";
+
+        ExtractedLoop loop;
+        loop.pattern.name = name;
+
+        const auto error = GrooveExtraction::extract (mapped.getData(), mapped.getSize(), settings.options, loop);
+
+        if (error.isNotEmpty())
+            return error;
+
+        // Only a script that compiles is worth pasting in. It is written on
+        // the loop's own grid, which extraction keeps within a script cycle.
+        static_assert (GrooveExtraction::maxSteps <= PatternScript::maxStepsPerCycle);
+        auto source = PatternScript::fromPattern (loop.pattern, loop.groove.stepsPerBeat);
+
+        if (source.isEmpty())
+            return "The pattern isn't on a grid the script language covers";
+
+        source = "# " + name + ": " + loop.chordName + ", swing " + juce::String (loop.groove.swing, 1) + "%\n" + source;
+
+        const auto compiled = PatternScript::compile (source);
+
+        if (compiled.program == nullptr)
+            return "Script: " + compiled.error;
+
+        if (! settings.outputDirectory.getChildFile (name + ".txt").replaceWithText (source))
+            return "Can't write " + name + ".txt";
+
+        // Only loops that made it into a script are listed
+        totals.numNotes += loop.numNotes;
+        totals.numHits += loop.numHits;
+        index.add (file.getFullPathName(), juce::JSON::toString (toJson (file, loop), true));
+        return {};
+    }
+
+    //==========================================================================
+    void collectInputs (const juce::String& arg, juce::Array<juce::File>& files)
+    {
+        const auto f = juce::File::getCurrentWorkingDirectory().getChildFile (arg);
+
+        if (f.isDirectory())
+        {
+            for (const auto& entry : juce::RangedDirectoryIterator (f, true, "*.mid;*.midi;*.MID;*.MIDI",
+                                                                    juce::File::findFiles))
+                files.add (entry.getFile());
+        }
+        else if (f.existsAsFile())
+        {
+            files.add (f);
+        }
+        else
+        {
+            std::cerr << "Skipping missing input: " << arg << std::endl;
+        }
+    }
+
+    void printUsage()
+    {
+        std::cerr << "Usage: GrooveExtract [--output dir] [--grid n] [--cluster beats] [--bass-below note]\n"
+                     "                     [--threads n] [--include-drums] <file-or-directory>...\n";
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ExtractSettings settings;
+    juce::Array<juce::File> inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--output" && hasValue)          settings.outputDirectory = juce::File::getCurrentWorkingDirectory().getChildFile (argv[++i]);
+        else if (arg == "--grid" && hasValue)       settings.options.stepsPerBeat = juce::jlimit (0, 16, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--cluster" && hasValue)    settings.options.clusterBeats = juce::jlimit (0.0, 0.5, juce::String (argv[++i]).getDoubleValue());
+        else if (arg == "--bass-below" && hasValue) settings.options.bassBelow = juce::jlimit (0, 128, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--threads" && hasValue)    settings.numThreads = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--include-drums")          settings.options.includeDrums = true;
+        else if (arg.startsWith ("--"))             { printUsage(); return 1; }
+        else                                        collectInputs (arg, inputs);
+    }
+
+    if (inputs.isEmpty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (! settings.outputDirectory.createDirectory())
+    {
+        std::cerr << "Cannot create " << settings.outputDirectory.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    // Loops from different folders may share a name; later ones get a number
+    juce::StringArray names;
+    std::map<juce::String, int> nameCounts;
+
+    for (const auto& file : inputs)
+    {
+        const auto stem = file.getFileNameWithoutExtension();
+        const int count = ++nameCounts[stem.toLowerCase()];
+        names.add (count > 1 ? stem + "-" + juce::String (count) : stem);
+    }
+
+    GrooveIndex index;
+    Totals totals;
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    {
+        juce::ThreadPool pool (settings.numThreads);
+        juce::CriticalSection errorLock;
+
+        for (int i = 0; i < inputs.size(); ++i)
+        {
+            pool.addJob ([file = inputs[i], name = names[i], &settings, &index, &totals, &errorLock]
+            {
+                ++totals.numFiles;
+                const auto error = extractFile (file, name, settings, index, totals);
+
+                if (error.isNotEmpty())
+                {
+                    ++totals.numFailed;
+                    const juce::ScopedLock sl (errorLock);
+                    std::cerr << file.getFullPathName() << ": " << error << std::endl;
+                }
+            });
+        }
+
+        while (pool.getNumJobs() > 0)
+            juce::Thread::sleep (20);
+    }
+
+    const auto indexFile = settings.outputDirectory.getChildFile ("grooves.jsonl");
+
+    if (! index.writeTo (indexFile))
+    {
+        std::cerr << "Cannot write " << indexFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    const auto elapsedSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+
+    std::cerr << "Loops: " << totals.numFiles.load() << " (" << totals.numFailed.load() << " failed)"
+              << ", notes: " << totals.numNotes.load()
+              << ", hits: " << totals.numHits.load()
+              << ", time: " << elapsedSeconds << " s"
+              << std::endl;
+
+    return totals.numFailed.load() > 0 ? 2 : 0;
+}
@@ -0,0 +1,167 @@
+#include <juce_core/juce_core.h>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "../../Source/MidiInputDecoder.h"
+#include <iostream>
+
+//==============================================================================
+// Input decoding benchmark: the raw-byte decoder against the previous
+// MidiMessage-per-event path.
+//
+//   InputBench [--stream mpe|aftertouch|notes] [--events n] [--blocks n]
+//
+// Builds one block of the chosen stream (n events) and runs both input paths
+// over it repeatedly, tracking held notes the way processBlock does. mpe is
+// fifteen member channels each holding a note under continuous pitch bend,
+// channel pressure and CC74; aftertouch is poly pressure on ten held notes;
+// notes is a plain stream of note-ons and note-offs.
+//==============================================================================
+
+namespace
+{
+    juce::MidiBuffer createStream (const juce::String& stream, int numEvents, int blockSize)
+    {
+        juce::MidiBuffer buffer;
+        juce::Random random (1);
+
+        for (int i = 0; i < numEvents; ++i)
+        {
+            const int position = i * blockSize / numEvents;
+
+            if (stream == "mpe")
+            {
+                const int channel = 2 + i % 15;
+                const int note = 48 + channel;
+
+                switch ((i / 15) % 4)
+                {
+                    case 0:  buffer.addEvent (juce::MidiMessage::noteOn (channel, note, 0.8f), position); break;
+                    case 1:  buffer.addEvent (juce::MidiMessage::pitchWheel (channel, random.nextInt (16384)), position); break;
+                    case 2:  buffer.addEvent (juce::MidiMessage::channelPressureChange (channel, random.nextInt (128)), position); break;
+                    default: buffer.addEvent (juce::MidiMessage::controllerEvent (channel, 74, random.nextInt (128)), position); break;
+                }
+            }
+            else if (stream == "aftertouch")
+            {
+                const int note = 60 + i % 10;
+
+                if (i < 10)
+                    buffer.addEvent (juce::MidiMessage::noteOn (1, note, 0.8f), position);
+                else
+                    buffer.addEvent (juce::MidiMessage::aftertouchChange (1, note, random.nextInt (128)), position);
+            }
+            else
+            {
+                const int note = 36 + random.nextInt (48);
+
+                if (random.nextBool())
+                    buffer.addEvent (juce::MidiMessage::noteOn (1, note, 0.8f), position);
+                else
+                    buffer.addEvent (juce::MidiMessage::noteOff (1, note), position);
+            }
+        }
+
+        return buffer;
+    }
+
+    // The input loop as it was: a MidiMessage per event, notes only
+    void runMessagePath (const juce::MidiBuffer& buffer, NoteMask& held)
+    {
+        for (const auto metadata : buffer)
+        {
+            const auto message = metadata.getMessage();
+
+            if (message.isNoteOn())
+                held.insert (message.getNoteNumber());
+            else if (message.isNoteOff())
+                held.erase (message.getNoteNumber());
+        }
+    }
+
+    void runDecoderPath (const MidiInputDecoder& decoder, InputNoteTracker& tracker,
+                         const juce::MidiBuffer& buffer, NoteMask& held)
+    {
+        decoder.decode (buffer, [&] (const InputEvent& event, int)
+        {
+            switch (event.type)
+            {
+                case InputEvent::noteOn:
+                    tracker.noteOn (event.channel, event.data1);
+                    held.insert (event.data1);
+                    break;
+
+                case InputEvent::noteOff:
+                    if (tracker.noteOff (event.channel, event.data1) && tracker.getChannelsSounding (event.data1) == 0)
+                        held.erase (event.data1);
+                    break;
+
+                default:
+                    break;
+            }
+        });
+    }
+
+    template <typename Function>
+    double timeMs (juce::int64 numBlocks, Function&& function)
+    {
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        for (juce::int64 b = 0; b < numBlocks; ++b)
+            function();
+
+        return juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start) * 1000.0;
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    juce::String stream ("mpe");
+    int numEvents = 512;
+    juce::int64 numBlocks = 20000;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--stream" && hasValue)        stream = argv[++i];
+        else if (arg == "--events" && hasValue)   numEvents = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--blocks" && hasValue)   numBlocks = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else
+        {
+            std::cerr << "Usage: InputBench [--stream mpe|aftertouch|notes] [--events n] [--blocks n]\n";
+            return 1;
+        }
+    }
+
+    if (stream != "mpe" && stream != "aftertouch" && stream != "notes")
+    {
+        std::cerr << "Unknown stream '" << stream << "'\n";
+        return 1;
+    }
+
+    const auto buffer = createStream (stream, numEvents, 512);
+
+    NoteMask messageHeld, decoderHeld;
+    MidiInputDecoder decoder;
+    InputNoteTracker tracker;
+
+    const auto messageMs = timeMs (numBlocks, [&] { runMessagePath (buffer, messageHeld); });
+    const auto decoderMs = timeMs (numBlocks, [&] { runDecoderPath (decoder, tracker, buffer, decoderHeld); });
+
+    // Without pedals both paths must agree on the held notes
+    if (messageHeld != decoderHeld)
+    {
+        std::cerr << "Held notes differ between the two paths\n";
+        return 1;
+    }
+
+    const auto totalEvents = (double) numEvents * (double) numBlocks;
+
+    std::cout << "Stream: " << stream << ", " << numEvents << " events per block, " << numBlocks << " blocks\n"
+              << "MidiMessage path: " << totalEvents / messageMs << " events/ms\n"
+              << "Raw decoder:      " << totalEvents / decoderMs << " events/ms\n"
+              << "Speed-up: " << messageMs / decoderMs << "x"
+              << std::endl;
+
+    return 0;
+}
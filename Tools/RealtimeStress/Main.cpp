@@ -0,0 +1,168 @@
+#include <juce_audio_utils/juce_audio_utils.h>
+#include "../../Source/PluginProcessor.h"
+#include <iostream>
+
+//==============================================================================
+// processBlock stress run for the real-time safety checker build.
+//
+//   RealtimeStress [--blocks n] [--seed n] [--abort]
+//
+// Drives the processor with random block sizes, random notes on all 16
+// channels, clock messages and a host transport that starts, stops and
+// jumps, while periodically switching input mode, patterns and the optional
+// output stages. processBlock runs inside CHORDER_REALTIME_SCOPE, so every
+// allocation, free or mutex lock it makes is reported. Exits with 1 if any
+// violation was seen, so it can gate CI.
+//==============================================================================
+
+namespace
+{
+    class StressPlayHead final : public juce::AudioPlayHead
+    {
+    public:
+        juce::Optional<PositionInfo> getPosition() const override
+        {
+            if (! hasTransport)
+                return {};
+
+            PositionInfo info;
+            info.setBpm (bpm);
+            info.setTimeSignature (TimeSignature { 4, 4 });
+            info.setIsPlaying (isPlaying);
+            info.setPpqPosition (ppq);
+            return info;
+        }
+
+        bool hasTransport { false };
+        bool isPlaying { false };
+        double bpm { 120.0 };
+        double ppq { 0.0 };
+    };
+
+    template <typename Param>
+    void setRandomChoice (Param* param, juce::Random& rng)
+    {
+        *param = rng.nextInt (param->choices.size());
+    }
+
+    // Changes settings the way a user or host automation would, between blocks
+    void shuffleSettings (AudioPluginAudioProcessor& p, StressPlayHead& playHead, juce::Random& rng)
+    {
+        setRandomChoice (p.patternParam, rng);
+        setRandomChoice (p.inputModeParam, rng);
+        setRandomChoice (p.clockModeParam, rng);
+        setRandomChoice (p.previewSoundParam, rng);
+
+        for (auto* param : p.enginePatternParams)
+            setRandomChoice (param, rng);
+
+        *p.quantiseSwitchParam = rng.nextBool();
+        *p.previewEnabledParam = rng.nextBool();
+        *p.dinOutputParam = rng.nextBool();
+        *p.splitPointParam = 36 + rng.nextInt (48);
+        *p.tempoParam = 60.0f + rng.nextFloat() * 160.0f;
+        *p.strumCaptureParam = rng.nextBool() ? 0.0f : rng.nextFloat() * 60.0f;
+
+        playHead.hasTransport = rng.nextBool();
+        playHead.isPlaying = rng.nextBool();
+        playHead.bpm = 70.0 + rng.nextDouble() * 100.0;
+
+        if (rng.nextInt (4) == 0)
+            playHead.ppq = rng.nextDouble() * 64.0;     // Seek / loop jump
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    int numBlocks = 50000;
+    juce::int64 seed = 1;
+    bool abortOnViolation = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--blocks" && hasValue)      numBlocks = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--seed" && hasValue)   seed = juce::String (argv[++i]).getLargeIntValue();
+        else if (arg == "--abort")              abortOnViolation = true;
+        else
+        {
+            std::cerr << "Usage: RealtimeStress [--blocks n] [--seed n] [--abort]\n";
+            return 2;
+        }
+    }
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    RealtimeSafety::setAbortOnViolation (abortOnViolation);
+
+    constexpr double sampleRate = 48000.0;
+    constexpr int maxBlockSize = 1024;
+
+    AudioPluginAudioProcessor processor;
+    StressPlayHead playHead;
+    processor.setPlayHead (&playHead);
+    processor.setRateAndBufferSizeDetails (sampleRate, maxBlockSize);
+    processor.prepareToPlay (sampleRate, maxBlockSize);
+
+    // Host-side buffers are sized up front, as a real host's would be
+    juce::AudioBuffer<float> buffer (2, maxBlockSize);
+    juce::MidiBuffer midi;
+    midi.ensureSize (64 * 1024);
+
+    juce::Random rng (seed);
+    std::array<std::array<bool, 128>, 16> held {};
+    juce::int64 samplesProcessed = 0;
+
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        if (block % 500 == 0)
+            shuffleSettings (processor, playHead, rng);
+
+        const int numSamples = 16 + rng.nextInt (maxBlockSize - 15);
+        buffer.setSize (2, numSamples, false, false, true);
+        buffer.clear();
+        midi.clear();
+
+        // Chords come and go on random channels
+        const int numEvents = rng.nextInt (6);
+
+        for (int i = 0; i < numEvents; ++i)
+        {
+            const int channel = 1 + rng.nextInt (16);
+            const int note = 36 + rng.nextInt (48);
+            auto& isHeld = held[(size_t) channel - 1][(size_t) note];
+            const int position = rng.nextInt (numSamples);
+
+            if (isHeld)
+                midi.addEvent (juce::MidiMessage::noteOff (channel, note), position);
+            else
+                midi.addEvent (juce::MidiMessage::noteOn (channel, note, (juce::uint8) (40 + rng.nextInt (88))), position);
+
+            isHeld = ! isHeld;
+        }
+
+        // External clock for follow mode
+        if (rng.nextInt (3) == 0)
+            midi.addEvent (juce::MidiMessage::midiClock(), rng.nextInt (numSamples));
+
+        if (rng.nextInt (2000) == 0)
+            midi.addEvent (rng.nextBool() ? juce::MidiMessage::midiStart() : juce::MidiMessage::midiStop(), 0);
+
+        processor.processBlock (buffer, midi);
+
+        if (playHead.isPlaying)
+            playHead.ppq += numSamples * playHead.bpm / (60.0 * sampleRate);
+
+        samplesProcessed += numSamples;
+    }
+
+    processor.releaseResources();
+
+    const int violations = RealtimeSafety::getNumViolations();
+    std::cerr << "Processed " << numBlocks << " blocks (" << samplesProcessed / sampleRate << " s of audio), "
+              << violations << " real-time violations" << std::endl;
+
+    return violations > 0 ? 1 : 0;
+}
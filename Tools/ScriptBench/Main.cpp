@@ -0,0 +1,267 @@
+#include <juce_core/juce_core.h>
+#include "../../Source/RhythmPattern.h"
+#include "../../Source/PatternScript.h"
+#include <algorithm>
+#include <iostream>
+#include <tuple>
+
+//==============================================================================
+// Pattern script benchmark: scripted patterns against the static ones.
+//
+//   ScriptBench [--blocks n] [--block n] [--tempo bpm] [--rate hz]
+//
+// Each factory pattern is translated into an equivalent script (one
+// "if step == ..." line per group of notes), and both are rendered over the
+// same run of blocks with the per-block loops the processor uses. One cycle
+// of each script must play exactly the pattern's notes; the report is the
+// cost per block of each and the instructions the script ran per block
+// against its budget. The default script, which branches on the bar count,
+// is timed as well.
+//==============================================================================
+
+namespace
+{
+    // Keeps the rendered notes observable so neither loop is optimised away
+    struct NoteSink
+    {
+        juce::int64 count { 0 };
+        juce::int64 checksum { 0 };
+
+        void add (int chordIndex, float velocity, juce::int64 sample)
+        {
+            ++count;
+            checksum += (chordIndex + 2) * 131 + juce::roundToInt (velocity * 100.0f) + sample * 7;
+        }
+    };
+
+    using NoteKey = std::tuple<int, int, int>;     // Step, chord index, velocity in percent
+
+    // True if one cycle of the script plays exactly the pattern's notes
+    bool playsSameNotes (const PatternScript::Program& program, const RhythmPattern& pattern,
+                         PatternScript::Context& context, int numTones)
+    {
+        const double stepLength = program.getStepLength();
+        std::vector<NoteKey> expected, played;
+
+        for (const auto& note : pattern.notes)
+            expected.emplace_back (juce::roundToInt (note.beatPosition / stepLength), note.chordIndex,
+                                   juce::roundToInt (note.velocity * 100.0f));
+
+        for (int k = 0; k < program.stepsPerCycle; ++k)
+        {
+            int budget = PatternScript::instructionBudget;
+            context.setStep (program, k, pattern.lengthInBeats);
+
+            PatternScript::run (program, context, budget, [&] (const PatternScript::PlayEvent& event)
+            {
+                for (int tone = -1; tone < numTones; ++tone)
+                    if ((event.tones & (tone < 0 ? PatternScript::bassTone : (1 << tone))) != 0)
+                        played.emplace_back (k, tone, juce::roundToInt (event.velocity * 100.0f));
+            });
+        }
+
+        std::sort (expected.begin(), expected.end());
+        std::sort (played.begin(), played.end());
+        return expected == played;
+    }
+
+    // The static loop from addPatternNotes, without the MIDI output
+    void renderStatic (const RhythmPattern& pattern, double startBeat, double endBeat,
+                       juce::int64 blockSample, double samplesPerBeat, NoteSink& sink)
+    {
+        const double patternLength = pattern.lengthInBeats;
+
+        for (const auto& note : pattern.notes)
+        {
+            const double noteBeat = note.beatPosition;
+            double relativeBeat = -1.0;
+
+            if (endBeat > patternLength)
+            {
+                if (noteBeat >= startBeat)
+                    relativeBeat = noteBeat - startBeat;
+                else if (noteBeat < endBeat - patternLength)
+                    relativeBeat = (patternLength - startBeat) + noteBeat;
+            }
+            else if (noteBeat >= startBeat && noteBeat < endBeat)
+            {
+                relativeBeat = noteBeat - startBeat;
+            }
+
+            if (relativeBeat >= 0.0)
+                sink.add (note.chordIndex, note.velocity, blockSample + juce::roundToInt (relativeBeat * samplesPerBeat));
+        }
+    }
+
+    // The step loop from addScriptNotes. Returns the instructions used.
+    int renderScript (const PatternScript::Program& program, PatternScript::Context& context, int numTones,
+                      double blockStartBeat, double endBeat, juce::int64 blockSample, double samplesPerBeat,
+                      NoteSink& sink, bool& overran)
+    {
+        const double stepLength = program.getStepLength();
+        int budget = PatternScript::instructionBudget;
+
+        for (auto k = (juce::int64) std::ceil (blockStartBeat / stepLength); k * stepLength < endBeat; ++k)
+        {
+            const auto sample = blockSample + juce::roundToInt (((double) k * stepLength - blockStartBeat) * samplesPerBeat);
+            context.setStep (program, k, program.pattern.lengthInBeats);
+
+            const bool finished = PatternScript::run (program, context, budget, [&] (const PatternScript::PlayEvent& event)
+            {
+                if (event.velocity <= 0.0f)
+                    return;
+
+                for (int tone = -1; tone < numTones; ++tone)
+                    if ((event.tones & (tone < 0 ? PatternScript::bassTone : (1 << tone))) != 0)
+                        sink.add (tone, event.velocity, sample);
+            });
+
+            if (! finished)
+            {
+                overran = true;
+                break;
+            }
+        }
+
+        return PatternScript::instructionBudget - budget;
+    }
+
+    template <typename Function>
+    double timeMs (Function&& function)
+    {
+        const auto start = juce::Time::getHighResolutionTicks();
+        function();
+        return juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start) * 1000.0;
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    juce::int64 numBlocks = 200000;
+    int blockSize = 512;
+    double tempo = 120.0;
+    double sampleRate = 48000.0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--blocks" && hasValue)        numBlocks = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--block" && hasValue)    blockSize = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--tempo" && hasValue)    tempo = juce::jlimit (20.0, 400.0, juce::String (argv[++i]).getDoubleValue());
+        else if (arg == "--rate" && hasValue)     sampleRate = juce::jmax (8000.0, juce::String (argv[++i]).getDoubleValue());
+        else
+        {
+            std::cerr << "Usage: ScriptBench [--blocks n] [--block n] [--tempo bpm] [--rate hz]\n";
+            return 1;
+        }
+    }
+
+    const double samplesPerBeat = sampleRate * 60.0 / tempo;
+    const double beatsPerBlock = blockSize / samplesPerBeat;
+
+    // A C major seventh: four tones for the scripts to pick from
+    DetectedChord chord;
+    chord.rootNote = 60;
+    chord.intervals = { 0, 4, 7, 11 };
+    chord.isValid = true;
+
+    juce::Random random (1);
+    PatternScript::Context context;
+    context.setChord (chord);
+    context.random = &random;
+
+    std::cout << "Blocks: " << numBlocks << " x " << blockSize << " samples at " << tempo << " BPM\n\n"
+              << juce::String ("Pattern").paddedRight (' ', 14) << juce::String ("static ns").paddedLeft (' ', 11)
+              << juce::String ("script ns").paddedLeft (' ', 11) << juce::String ("ratio").paddedLeft (' ', 8)
+              << juce::String ("instr/block").paddedLeft (' ', 13) << "\n";
+
+    bool allMatched = true;
+    juce::int64 checksum = 0;
+
+    auto report = [&] (const juce::String& name, double staticMs, double scriptMs, juce::int64 instructions, bool overran)
+    {
+        const auto perBlock = [&] (double ms) { return ms * 1.0e6 / (double) numBlocks; };
+
+        std::cout << name.paddedRight (' ', 14)
+                  << (staticMs > 0.0 ? juce::String (perBlock (staticMs), 1) : juce::String ("-")).paddedLeft (' ', 11)
+                  << juce::String (perBlock (scriptMs), 1).paddedLeft (' ', 11)
+                  << (staticMs > 0.0 ? juce::String (scriptMs / staticMs, 2) + "x" : juce::String ("-")).paddedLeft (' ', 8)
+                  << juce::String ((double) instructions / (double) numBlocks, 1).paddedLeft (' ', 13)
+                  << (overran ? "  over budget" : "") << "\n";
+    };
+
+    for (const auto& pattern : RhythmPatternFactory::createAllPatterns())
+    {
+        const auto source = PatternScript::fromPattern (pattern);
+
+        if (source.isEmpty())
+        {
+            std::cout << pattern.name.paddedRight (' ', 14) << "  (not on a grid the script language covers)\n";
+            continue;
+        }
+
+        auto compiled = PatternScript::compile (source);
+
+        if (compiled.program == nullptr)
+        {
+            std::cerr << pattern.name << ": " << compiled.error << "\n";
+            return 1;
+        }
+
+        if (! playsSameNotes (*compiled.program, pattern, context, (int) chord.intervals.size()))
+        {
+            std::cerr << pattern.name << ": the script doesn't play the pattern's notes\n";
+            allMatched = false;
+        }
+
+        NoteSink staticNotes, scriptNotes;
+        juce::int64 instructions = 0;
+        bool overran = false;
+
+        const auto staticMs = timeMs ([&]
+        {
+            for (juce::int64 b = 0; b < numBlocks; ++b)
+            {
+                const double startBeat = std::fmod ((double) b * beatsPerBlock, pattern.lengthInBeats);
+                renderStatic (pattern, startBeat, startBeat + beatsPerBlock, b * blockSize, samplesPerBeat, staticNotes);
+            }
+        });
+
+        const auto scriptMs = timeMs ([&]
+        {
+            for (juce::int64 b = 0; b < numBlocks; ++b)
+            {
+                const double startBeat = (double) b * beatsPerBlock;
+                instructions += renderScript (*compiled.program, context, (int) chord.intervals.size(), startBeat,
+                                              startBeat + beatsPerBlock, b * blockSize, samplesPerBeat, scriptNotes, overran);
+            }
+        });
+
+        report (pattern.name, staticMs, scriptMs, instructions, overran);
+        checksum += staticNotes.checksum + scriptNotes.checksum;
+    }
+
+    // A script with real branching, which has no static equivalent
+    auto compiled = PatternScript::compile (PatternScript::getDefaultSource());
+    NoteSink notes;
+    juce::int64 instructions = 0;
+    bool overran = false;
+
+    const auto scriptMs = timeMs ([&]
+    {
+        for (juce::int64 b = 0; b < numBlocks; ++b)
+        {
+            const double startBeat = (double) b * beatsPerBlock;
+            instructions += renderScript (*compiled.program, context, (int) chord.intervals.size(), startBeat,
+                                          startBeat + beatsPerBlock, b * blockSize, samplesPerBeat, notes, overran);
+        }
+    });
+
+    report ("Default script", 0.0, scriptMs, instructions, overran);
+    std::cout << "\nBudget: " << PatternScript::instructionBudget << " instructions per block"
+              << " (checksum " << (checksum + notes.checksum) << ")" << std::endl;
+
+    return allMatched ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#include <juce_core/juce_core.h>
+#include "../../Source/PatternSearchIndex.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+
+//==============================================================================
+// Type-ahead benchmark for the pattern browser's search index.
+//
+//   SearchBench [--names n] [--seed n]
+//
+// Builds the index over n synthetic pattern names (default 50000) made of
+// style, feel and descriptor words plus a number, each with two to four
+// tags, then types a set of queries one character at a time - with and
+// without a tag filter, and with backspacing - timing every keystroke the
+// way the browser's search box issues them. Every result list is checked
+// against a plain scan of all the names; the run fails (exit 1) on any
+// mismatch.
+//==============================================================================
+
+namespace
+{
+    const char* const styles[]      = { "Bossa", "Samba", "Funk", "Ballad", "Reggae", "Gospel", "Country", "Rock",
+                                        "Disco", "Waltz", "Tango", "Afro", "Soul", "Blues", "Latin", "Pop" };
+    const char* const feels[]       = { "Straight", "Swing", "Shuffle", "Half-time", "Double-time", "Laid-back",
+                                        "Pushed", "Broken" };
+    const char* const descriptors[] = { "Comp", "Stabs", "Arpeggio", "Pulse", "Strum", "Offbeat", "Anticipation",
+                                        "Syncopated", "Sparse", "Busy", "Ghosted", "Accented" };
+    const char* const tagWords[]    = { "Latin", "Jazz", "Pop", "Rock", "Funk", "Ballad", "Dance", "World",
+                                        "Straight", "Swing", "Triplet", "Sparse", "Busy", "Arpeggio", "Strum",
+                                        "Stabs", "Odd meter", "Half-time", "Generated", "Factory", "User",
+                                        "Imported", "Slow", "Fast" };
+
+    template <typename Array>
+    const char* pick (juce::Random& rng, const Array& words)
+    {
+        return words[rng.nextInt ((int) std::size (words))];
+    }
+
+    std::vector<int> scan (const PatternSearchIndex& index, const juce::String& query, juce::uint64 requiredTags)
+    {
+        const auto text = query.trim().toLowerCase();
+        std::vector<int> found;
+
+        for (int i = 0; i < index.getNumPatterns(); ++i)
+            if ((index.getTagMask (i) & requiredTags) == requiredTags && index.getName (i).toLowerCase().contains (text))
+                found.push_back (i);
+
+        return found;
+    }
+
+    struct KeystrokeTimes
+    {
+        std::vector<double> ms;
+
+        void report (const char* name)
+        {
+            std::sort (ms.begin(), ms.end());
+
+            const auto percentile = [this] (double p)
+            {
+                return ms.empty() ? 0.0 : ms[(size_t) juce::jlimit (0, (int) ms.size() - 1, (int) (p * (double) ms.size()))];
+            };
+
+            std::cout << "  " << name << ": " << ms.size() << " keystrokes, ms p50 " << percentile (0.5)
+                      << ", p99 " << percentile (0.99) << ", max " << (ms.empty() ? 0.0 : ms.back()) << "\n";
+        }
+    };
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    int numNames = 50000;
+    juce::int64 seed = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--names" && hasValue)       numNames = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--seed" && hasValue)   seed = juce::String (argv[++i]).getLargeIntValue();
+        else
+        {
+            std::cerr << "Usage: SearchBench [--names n] [--seed n]\n";
+            return 2;
+        }
+    }
+
+    juce::Random rng (seed);
+    juce::StringArray names;
+    std::vector<juce::StringArray> tags ((size_t) numNames);
+
+    for (int i = 0; i < numNames; ++i)
+    {
+        names.add (juce::String (pick (rng, styles)) + " " + pick (rng, feels) + " " + pick (rng, descriptors)
+                     + " " + juce::String (i + 1));
+
+        for (int t = 2 + rng.nextInt (3); --t >= 0;)
+            tags[(size_t) i].addIfNotAlreadyThere (pick (rng, tagWords));
+    }
+
+    PatternSearchIndex index;
+    const auto buildStart = juce::Time::getHighResolutionTicks();
+
+    for (int i = 0; i < numNames; ++i)
+        index.add (names[i], tags[(size_t) i]);
+
+    const auto buildMs = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - buildStart) * 1000.0;
+
+    // Whole queries typed a character at a time; "<" is a backspace
+    const char* const queries[] = { "bossa swing", "funk", "arpeggio 12", "ed c", "ghost", "latin<<<<<samba",
+                                    "syncopated 4", "zz", "half-time stabs", "rock s<<pulse" };
+
+    const juce::uint64 tagFilter = (juce::uint64) 1 << juce::jmax (0, index.getTagNames().indexOf ("Latin"));
+
+    KeystrokeTimes plain, filtered;
+    int mismatches = 0;
+
+    for (auto* times : { &plain, &filtered })
+    {
+        const auto requiredTags = times == &filtered ? tagFilter : (juce::uint64) 0;
+
+        for (auto* typed : queries)
+        {
+            juce::String query;
+
+            for (auto* c = typed; *c != 0; ++c)
+            {
+                query = *c == '<' ? query.dropLastCharacters (1) : query + juce::String::charToString ((juce::juce_wchar) *c);
+
+                const auto start = juce::Time::getHighResolutionTicks();
+                const auto& results = index.search (query, requiredTags);
+                times->ms.push_back (juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start) * 1000.0);
+
+                if (results != scan (index, query, requiredTags))
+                {
+                    if (mismatches++ == 0)
+                        std::cout << "FAIL: results differ from a full scan for \"" << query << "\"\n";
+                }
+            }
+        }
+    }
+
+    std::cout << numNames << " names, " << index.getTagNames().size() << " tags, index built in " << buildMs << " ms\n";
+    plain.report ("no filter");
+    filtered.report ("tag filter");
+
+    if (mismatches > 0)
+        std::cout << "FAIL: " << mismatches << " searches differ from a full scan\n";
+
+    return mismatches == 0 ? 0 : 1;
+}
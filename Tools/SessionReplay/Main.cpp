@@ -0,0 +1,313 @@
+#include <juce_audio_utils/juce_audio_utils.h>
+#include "../../Source/PluginProcessor.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+//==============================================================================
+// Replays a captured session through a fresh processor.
+//
+//   SessionReplay <log.cpsl> [--realtime] [--repeat n]
+//
+// The log (written by the CAPTURE button) holds the plugin state when the
+// capture started and, per block, the input MIDI, host position, block size,
+// changed parameters, pattern random seed, walking bass targets and, while
+// audio chord detection or onset rhythm sync was on, the audio input. A log with audio replays
+// with the chord input bus enabled at the captured channel count. Every
+// block is fed to processBlock exactly as captured and its output hashed
+// against the captured one, so a replay either reproduces the performance
+// block for block or says where it stops doing so. The log is read into
+// memory first, so timings cover the engine only.
+//
+// By default blocks run back to back, for profiling; --realtime paces them
+// at the captured sample rate. --repeat runs the whole log n times, each on
+// a new processor.
+//
+// Not reproduced: chord bus input from other instances (a follower replays
+// against an empty bus), script edits made while capturing, and the audio
+// heard before the capture started - audio analysis already running then
+// has history the replay lacks, so its first window can differ.
+//==============================================================================
+
+namespace
+{
+    class ReplayPlayHead final : public juce::AudioPlayHead
+    {
+    public:
+        juce::Optional<PositionInfo> getPosition() const override
+        {
+            if (block == nullptr || ! block->has (SessionCapture::hasPosition))
+                return {};
+
+            PositionInfo info;
+            info.setIsPlaying (block->has (SessionCapture::isPlaying));
+
+            if (block->has (SessionCapture::hasBpm))
+                info.setBpm (block->bpm);
+
+            if (block->has (SessionCapture::hasPpq))
+                info.setPpqPosition (block->ppq);
+
+            if (block->has (SessionCapture::hasTimeInSamples))
+                info.setTimeInSamples (block->timeInSamples);
+
+            if (block->has (SessionCapture::hasTimeSignature))
+                info.setTimeSignature (TimeSignature { block->numerator, block->denominator });
+
+            return info;
+        }
+
+        const SessionLogReader::Record* block { nullptr };
+    };
+
+    struct PassResult
+    {
+        juce::int64 blocks { 0 }, samples { 0 };
+        juce::int64 mismatches { 0 }, firstMismatch { -1 };
+        juce::int64 gaps { 0 };
+        double sampleRate { 0.0 };
+        std::vector<double> blockMs;
+    };
+
+    PassResult replay (const std::vector<SessionLogReader::Record>& records, const juce::MemoryBlock& state,
+                       const juce::StringArray& parameterIDs, bool realtime)
+    {
+        AudioPluginAudioProcessor processor;
+        ReplayPlayHead playHead;
+        processor.setPlayHead (&playHead);
+        processor.setStateInformation (state.getData(), (int) state.getSize());
+
+        // Block records index parameters in the capturing build's order
+        std::vector<juce::AudioProcessorParameter*> parameters;
+
+        for (const auto& id : parameterIDs)
+        {
+            juce::AudioProcessorParameter* match = nullptr;
+
+            for (auto* parameter : processor.getParameters())
+                if (auto* hosted = dynamic_cast<juce::HostedAudioProcessorParameter*> (parameter))
+                    if (hosted->getParameterID() == id)
+                        match = parameter;
+
+            if (match == nullptr)
+                std::cerr << "Warning: parameter '" << id << "' is not in this build, its changes are ignored\n";
+
+            parameters.push_back (match);
+        }
+
+        // Audio input in the log needs the chord input bus, which is off by default
+        int numAudioChannels = 0;
+
+        for (const auto& record : records)
+            if (record.type == SessionCapture::audioInputRecord)
+                numAudioChannels = juce::jmax (numAudioChannels, record.audio.getNumChannels());
+
+        if (numAudioChannels > 0)
+        {
+            auto layout = processor.getBusesLayout();
+            layout.getChannelSet (true, 0) = juce::AudioChannelSet::canonicalChannelSet (numAudioChannels);
+
+            if (! processor.setBusesLayout (layout))
+                std::cerr << "Warning: can't enable " << numAudioChannels << " input channels, audio input is not replayed\n";
+        }
+
+        const int numBufferChannels = juce::jmax (2, processor.getTotalNumInputChannels());
+
+        PassResult result;
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+        const SessionLogReader::Record* audioInput = nullptr;
+        bool prepared = false;
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+
+        for (const auto& record : records)
+        {
+            switch (record.type)
+            {
+                case SessionCapture::prepareRecord:
+                    if (prepared)
+                        processor.releaseResources();
+
+                    processor.setRateAndBufferSizeDetails (record.sampleRate, record.maxBlockSize);
+                    processor.prepareToPlay (record.sampleRate, record.maxBlockSize);
+                    buffer.setSize (numBufferChannels, record.maxBlockSize);
+                    midi.ensureSize (64 * 1024);
+                    result.sampleRate = record.sampleRate;
+                    prepared = true;
+                    break;
+
+                case SessionCapture::bassTargetsRecord:
+                    processor.setReplayBassTargets (record.bassTargets);
+                    break;
+
+                case SessionCapture::gapRecord:
+                    ++result.gaps;
+                    break;
+
+                case SessionCapture::audioInputRecord:
+                    audioInput = &record;
+                    break;
+
+                case SessionCapture::blockRecord:
+                {
+                    if (! prepared)
+                        break;
+
+                    for (const auto& [index, value] : record.parameterChanges)
+                        if (juce::isPositiveAndBelow (index, (int) parameters.size()) && parameters[(size_t) index] != nullptr)
+                            parameters[(size_t) index]->setValue (value);
+
+                    processor.prepareReplayBlock (record);
+                    playHead.block = &record;
+
+                    buffer.setSize (numBufferChannels, record.numSamples, false, false, true);
+                    buffer.clear();
+
+                    if (audioInput != nullptr && audioInput->audio.getNumSamples() == record.numSamples)
+                        for (int c = 0; c < juce::jmin (audioInput->audio.getNumChannels(), processor.getTotalNumInputChannels()); ++c)
+                            buffer.copyFrom (c, 0, audioInput->audio, c, 0, record.numSamples);
+
+                    audioInput = nullptr;
+                    midi.clear();
+                    midi.addEvents (record.midi, 0, -1, 0);
+
+                    if (realtime)
+                    {
+                        // Hold each block back until its captured start time
+                        const auto due = (double) result.samples / result.sampleRate;
+
+                        while (juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks) < due)
+                            std::this_thread::sleep_for (std::chrono::microseconds (200));
+                    }
+
+                    const auto blockStart = juce::Time::getHighResolutionTicks();
+                    processor.processBlock (buffer, midi);
+                    result.blockMs.push_back (juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - blockStart) * 1000.0);
+
+                    if (SessionCapture::hashOutput (midi) != record.outputHash)
+                    {
+                        if (result.firstMismatch < 0)
+                            result.firstMismatch = result.blocks;
+
+                        ++result.mismatches;
+                    }
+
+                    ++result.blocks;
+                    result.samples += record.numSamples;
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+
+        if (prepared)
+            processor.releaseResources();
+
+        return result;
+    }
+
+    void report (int pass, PassResult& result)
+    {
+        auto& times = result.blockMs;
+        std::sort (times.begin(), times.end());
+
+        const auto percentile = [&times] (double p)
+        {
+            return times.empty() ? 0.0 : times[(size_t) juce::jlimit (0, (int) times.size() - 1, (int) (p * (double) times.size()))];
+        };
+
+        double total = 0.0;
+
+        for (auto t : times)
+            total += t;
+
+        const auto audioSeconds = result.sampleRate > 0.0 ? (double) result.samples / result.sampleRate : 0.0;
+
+        std::cout << "Pass " << pass << ": " << result.blocks << " blocks, " << audioSeconds << " s of audio\n"
+                  << "  processBlock ms: mean " << (times.empty() ? 0.0 : total / (double) times.size())
+                  << ", p50 " << percentile (0.5) << ", p99 " << percentile (0.99)
+                  << ", max " << (times.empty() ? 0.0 : times.back()) << "\n"
+                  << "  Speed: " << (total > 0.0 ? audioSeconds * 1000.0 / total : 0.0) << "x real time\n";
+
+        if (result.mismatches == 0)
+            std::cout << "  Output matches the capture in every block\n";
+        else
+            std::cout << "  Output differs from the capture in " << result.mismatches << " blocks, first at block "
+                      << result.firstMismatch << "\n";
+
+        if (result.gaps > 0)
+            std::cout << "  " << result.gaps << " gaps in the log (blocks dropped while capturing); "
+                      << "output after a gap can differ\n";
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::File logFile;
+    bool realtime = false;
+    int repeat = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--realtime")                    realtime = true;
+        else if (arg == "--repeat" && hasValue)     repeat = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (! arg.startsWith ("--") && logFile == juce::File())
+            logFile = juce::File::getCurrentWorkingDirectory().getChildFile (arg);
+        else
+        {
+            std::cerr << "Usage: SessionReplay <log.cpsl> [--realtime] [--repeat n]\n";
+            return 2;
+        }
+    }
+
+    if (logFile == juce::File())
+    {
+        std::cerr << "Usage: SessionReplay <log.cpsl> [--realtime] [--repeat n]\n";
+        return 2;
+    }
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::FileInputStream stream (logFile);
+
+    if (! stream.openedOk())
+    {
+        std::cerr << "Can't open " << logFile.getFullPathName() << "\n";
+        return 2;
+    }
+
+    juce::BufferedInputStream input (stream, 1 << 16);
+    SessionLogReader reader (input);
+
+    if (! reader.readHeader())
+    {
+        std::cerr << logFile.getFileName() << ": " << reader.getError() << "\n";
+        return 2;
+    }
+
+    std::vector<SessionLogReader::Record> records;
+    SessionLogReader::Record record;
+
+    while (reader.readNext (record))
+        records.push_back (record);
+
+    if (reader.getError().isNotEmpty())
+        std::cerr << "Warning: " << reader.getError() << "\n";
+
+    bool allMatched = true;
+
+    for (int pass = 1; pass <= repeat; ++pass)
+    {
+        auto result = replay (records, reader.getState(), reader.getParameterIDs(), realtime);
+        report (pass, result);
+        allMatched = allMatched && result.mismatches == 0;
+    }
+
+    return allMatched ? 0 : 1;
+}
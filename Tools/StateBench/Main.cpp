@@ -0,0 +1,167 @@
+#include <juce_audio_utils/juce_audio_utils.h>
+#include "../../Source/PluginProcessor.h"
+#include <iostream>
+
+//==============================================================================
+// Save/restore benchmark for the binary session state.
+//
+//   StateBench [--iterations n] [--seed n]
+//
+// Builds a state with every field away from its default (random values in
+// each parameter's range, the default script text) and times, per round trip:
+//
+//   write   PluginStateSerialiser::write of the state
+//   read    PluginStateSerialiser::read of that blob
+//   save    the processor's getStateInformation
+//   restore the processor's setStateInformation, parse and apply
+//
+// Two checks run alongside, and the run fails (exit 1) if either breaks:
+// re-serialising a parsed blob gives the same bytes, and a blob restored
+// into the processor and saved again comes back byte for byte.
+//==============================================================================
+
+namespace
+{
+    PluginState makeState (juce::Random& rng, int numPatterns)
+    {
+        PluginState state;
+        state.patternIndex = rng.nextInt (numPatterns);
+        state.tempo = 40.0f + 200.0f * rng.nextFloat();
+        state.enabled = rng.nextBool();
+        state.quantiseSwitch = rng.nextBool();
+        state.inputMode = rng.nextInt ((int) AudioPluginAudioProcessor::perChannelMode + 1);
+        state.splitPoint = rng.nextInt (128);
+
+        for (auto& p : state.enginePatterns)
+            p = rng.nextInt (numPatterns + 1);
+
+        state.dinOutput = rng.nextBool();
+        state.dinJitterBudgetMs = 10.0f * rng.nextFloat();
+        state.previewEnabled = rng.nextBool();
+        state.previewSound = rng.nextInt ((int) PreviewSynth::fmSound + 1);
+        state.previewLevel = rng.nextFloat();
+        state.strumCaptureMs = 100.0f * rng.nextFloat();
+        state.clockMode = rng.nextInt ((int) AudioPluginAudioProcessor::clockFollow + 1);
+        state.genSteps = 2 + rng.nextInt (31);
+        state.genHits = 1 + rng.nextInt (32);
+        state.genRotation = rng.nextInt (32);
+        state.genProbability = rng.nextFloat();
+        state.genGhost = rng.nextFloat();
+        state.genAccent = rng.nextFloat();
+        state.chordBusMode = rng.nextInt ((int) AudioPluginAudioProcessor::busFollow + 1);
+        state.chordBusChannel = 1 + rng.nextInt (ChordBus::numChannels);
+        state.inputChannel = rng.nextInt (17);
+        state.patternScript = PatternScript::getDefaultSource();
+        state.bassMode = rng.nextInt ((int) AudioPluginAudioProcessor::walkingBass + 1);
+        state.chordSource = rng.nextInt ((int) AudioPluginAudioProcessor::audioSource + 1);
+        state.audioWindow = rng.nextInt (AudioChordDetector::numWindowSizes);
+        state.audioHop = rng.nextInt (AudioChordDetector::numHopSizes);
+        state.rhythmSync = rng.nextInt ((int) AudioPluginAudioProcessor::onsetSync + 1);
+        return state;
+    }
+
+    struct Timer
+    {
+        double totalMs { 0.0 };
+
+        template <typename Fn>
+        void run (Fn&& fn)
+        {
+            const auto start = juce::Time::getHighResolutionTicks();
+            fn();
+            totalMs += juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start) * 1000.0;
+        }
+
+        void report (const char* name, int iterations) const
+        {
+            std::cout << "  " << name << ": " << 1000.0 * totalMs / iterations << " us\n";
+        }
+    };
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    int iterations = 2000;
+    juce::int64 seed = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--iterations" && hasValue)  iterations = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--seed" && hasValue)   seed = juce::String (argv[++i]).getLargeIntValue();
+        else
+        {
+            std::cerr << "Usage: StateBench [--iterations n] [--seed n]\n";
+            return 2;
+        }
+    }
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    AudioPluginAudioProcessor processor;
+    processor.setRateAndBufferSizeDetails (48000.0, 512);
+    processor.prepareToPlay (48000.0, 512);
+
+    juce::Random rng (seed);
+    Timer writeTime, readTime, saveTime, restoreTime;
+    int serialiserMismatches = 0, processorMismatches = 0, readFailures = 0;
+    size_t blobBytes = 0;
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        const auto state = makeState (rng, processor.patternParam->choices.size());
+
+        juce::MemoryBlock written, rewritten;
+        writeTime.run ([&] { PluginStateSerialiser::write (state, written); });
+        blobBytes = written.getSize();
+
+        PluginState parsed;
+        auto result = PluginStateSerialiser::Result::ok;
+        readTime.run ([&] { result = PluginStateSerialiser::read (written.getData(), (int) written.getSize(), parsed); });
+
+        if (result != PluginStateSerialiser::Result::ok)
+        {
+            ++readFailures;
+            continue;
+        }
+
+        PluginStateSerialiser::write (parsed, rewritten);
+
+        if (rewritten != written)
+            ++serialiserMismatches;
+
+        // The first restore settles each value onto its parameter's range, so
+        // the comparison is between two saves of the same restored session
+        juce::MemoryBlock saved, resaved;
+        restoreTime.run ([&] { processor.setStateInformation (written.getData(), (int) written.getSize()); });
+        saveTime.run ([&] { processor.getStateInformation (saved); });
+
+        processor.setStateInformation (saved.getData(), (int) saved.getSize());
+        processor.getStateInformation (resaved);
+
+        if (resaved != saved)
+            ++processorMismatches;
+    }
+
+    processor.releaseResources();
+
+    std::cout << iterations << " round trips, " << blobBytes << " byte blob (default script included)\n";
+    writeTime.report ("write", iterations);
+    readTime.report ("read", iterations);
+    saveTime.report ("save", iterations);
+    restoreTime.report ("restore", iterations);
+
+    if (readFailures > 0)
+        std::cout << "FAIL: " << readFailures << " blobs did not parse\n";
+
+    if (serialiserMismatches > 0)
+        std::cout << "FAIL: " << serialiserMismatches << " blobs re-serialised to different bytes\n";
+
+    if (processorMismatches > 0)
+        std::cout << "FAIL: " << processorMismatches << " sessions changed across a restore and save\n";
+
+    return readFailures + serialiserMismatches + processorMismatches == 0 ? 0 : 1;
+}
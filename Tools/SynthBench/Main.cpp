@@ -0,0 +1,77 @@
+#include <juce_core/juce_core.h>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "../../Source/PreviewSynth.h"
+#include <iostream>
+
+//==============================================================================
+// Render benchmark for the built-in preview synth.
+//
+//   SynthBench [--voices n] [--seconds s] [--block n] [--rate hz] [--sound sine|fm]
+//
+// Holds n voices for s seconds of audio and reports how many voices are
+// rendered per millisecond of CPU time, i.e. how many could run in real time
+// on one core, and what share of a core the requested voice count needs.
+//==============================================================================
+
+int main (int argc, char* argv[])
+{
+    int numVoices = PreviewSynth::maxVoices;
+    double seconds = 10.0;
+    int blockSize = 512;
+    double sampleRate = 48000.0;
+    int sound = PreviewSynth::fmSound;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--voices" && hasValue)        numVoices = juce::jlimit (1, PreviewSynth::maxVoices, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--seconds" && hasValue)  seconds = juce::jmax (0.1, juce::String (argv[++i]).getDoubleValue());
+        else if (arg == "--block" && hasValue)    blockSize = juce::jmax (1, juce::String (argv[++i]).getIntValue());
+        else if (arg == "--rate" && hasValue)     sampleRate = juce::jmax (8000.0, juce::String (argv[++i]).getDoubleValue());
+        else if (arg == "--sound" && hasValue)    sound = juce::String (argv[++i]) == "sine" ? PreviewSynth::sineSound : PreviewSynth::fmSound;
+        else
+        {
+            std::cerr << "Usage: SynthBench [--voices n] [--seconds s] [--block n] [--rate hz] [--sound sine|fm]\n";
+            return 1;
+        }
+    }
+
+    PreviewSynth synth;
+    synth.prepare (sampleRate);
+
+    juce::AudioBuffer<float> buffer (2, blockSize);
+    juce::MidiBuffer midi;
+
+    // Spread the voices over the keyboard so every one of them is audible
+    for (int v = 0; v < numVoices; ++v)
+        midi.addEvent (juce::MidiMessage::noteOn (1 + v / 32, 36 + (v % 32) * 2, 0.8f), 0);
+
+    buffer.clear();
+    synth.render (buffer, midi, sound, 0.5f);
+    midi.clear();
+
+    const auto numBlocks = (juce::int64) (seconds * sampleRate / blockSize);
+    const auto start = juce::Time::getHighResolutionTicks();
+
+    for (juce::int64 b = 0; b < numBlocks; ++b)
+    {
+        buffer.clear();
+        synth.render (buffer, midi, sound, 0.5f);
+    }
+
+    const auto cpuMs = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start) * 1000.0;
+    const auto audioMs = (double) numBlocks * blockSize / sampleRate * 1000.0;
+    const auto voiceMsPerMs = numVoices * audioMs / cpuMs;
+
+    std::cout << "Voices: " << synth.getNumActiveVoices() << " (" << (sound == PreviewSynth::fmSound ? "fm" : "sine") << ")"
+              << ", audio: " << audioMs / 1000.0 << " s"
+              << ", cpu: " << cpuMs << " ms\n"
+              << "Voices rendered per ms: " << voiceMsPerMs
+              << " (real-time voices per core)\n"
+              << "Core usage for " << numVoices << " voices: " << 100.0 * numVoices / voiceMsPerMs << " %"
+              << std::endl;
+
+    return 0;
+}